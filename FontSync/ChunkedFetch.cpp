@@ -0,0 +1,163 @@
+#include "ChunkedFetch.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+namespace
+{
+    /// reads and checks chunks of one file against their digests
+    class ChunkChecker
+    {
+        const FontChunks& chunks;
+        HashAlgorithm algorithm;
+        std::ifstream in;
+
+    public:
+
+        std::vector<char> buffer;
+
+        ChunkChecker(const std::string& file, const FontChunks& chunks, HashAlgorithm algorithm) :
+            chunks(chunks), algorithm(algorithm), in(file, std::ios::binary), buffer(static_cast<std::size_t>(chunks.chunkSize))
+        {
+
+        }
+
+        std::size_t length(uint64_t chunk) const
+        {
+            return static_cast<std::size_t>((std::min)(this->chunks.chunkSize, this->chunks.size - chunk * this->chunks.chunkSize));
+        }
+
+        bool matches(uint64_t chunk, const char* data) const
+        {
+            auto hasher = Hasher::create(this->algorithm);
+            hasher->update(reinterpret_cast<const unsigned char*>(data), this->length(chunk));
+            return sameDigest(hasher->digest(), this->chunks.digests[static_cast<std::size_t>(chunk)]);
+        }
+
+        /// reads the provided chunk into the buffer, if the file holds all of it and it matches
+        bool read(uint64_t chunk)
+        {
+            if (!this->in.is_open())
+            {
+                return false;
+            }
+            this->in.clear();
+            this->in.seekg(static_cast<std::streamoff>(chunk * this->chunks.chunkSize));
+            return this->in.read(this->buffer.data(), this->length(chunk)) && this->matches(chunk, this->buffer.data());
+        }
+    };
+}
+
+ChunkedFetchResult fetchChunked(const std::string& stagingFile, const std::string& localFile, HashAlgorithm algorithm,
+    const FontChunks& chunks, const RangeFetcher& fetchRange)
+{
+    uint64_t count = chunks.chunkSize == 0 ? 0 : (chunks.size + chunks.chunkSize - 1) / chunks.chunkSize;
+    if (chunks.chunkSize == 0 || count != chunks.digests.size())
+    {
+        throw std::runtime_error("the chunk list does not describe the font");
+    }
+    if (chunks.chunkSize > maxChunkSize)
+    {
+        throw std::runtime_error("chunks of " + std::to_string(chunks.chunkSize) + " bytes exceed the limit of " + std::to_string(maxChunkSize));
+    }
+    ChunkedFetchResult result = { true, std::string(), 0, 0, 0 };
+    auto whole = Hasher::create(algorithm);
+
+    /// keep what an interrupted download got right
+    {
+        ChunkChecker staged(stagingFile, chunks, algorithm);
+        while (result.resumed < count && staged.read(result.resumed))
+        {
+            whole->update(reinterpret_cast<const unsigned char*>(staged.buffer.data()), staged.length(result.resumed));
+            ++result.resumed;
+        }
+    }
+    boost::system::error_code error;
+    if (boost::filesystem::exists(stagingFile, error))
+    {
+        boost::filesystem::resize_file(stagingFile, (std::min)(result.resumed * chunks.chunkSize, chunks.size), error);
+        if (error)
+        {
+            throw std::runtime_error("unable to truncate " + stagingFile + ": " + error.message());
+        }
+    }
+    std::ofstream out(stagingFile, std::ios::binary | std::ios::app);
+    if (!out)
+    {
+        throw std::runtime_error("unable to write " + stagingFile);
+    }
+
+    ChunkChecker local(localFile, chunks, algorithm);
+    std::vector<char> pending;
+    pending.reserve(static_cast<std::size_t>(chunks.chunkSize));
+    /// whether the buffer already holds the current chunk, read and matched while finding where the last range ends
+    bool buffered = false;
+    for (uint64_t chunk = result.resumed; chunk < count; )
+    {
+        if (buffered || local.read(chunk))
+        {
+            buffered = false;
+            out.write(local.buffer.data(), local.length(chunk));
+            whole->update(reinterpret_cast<const unsigned char*>(local.buffer.data()), local.length(chunk));
+            ++result.reused;
+            ++chunk;
+            continue;
+        }
+        /// one range for every chunk up to the next one that can be copied
+        uint64_t end = chunk + 1;
+        while (end < count && !local.read(end))
+        {
+            ++end;
+        }
+        uint64_t offset = chunk * chunks.chunkSize;
+        uint64_t length = (std::min)(end * chunks.chunkSize, chunks.size) - offset;
+        uint64_t next = chunk;
+        bool ranged = fetchRange(offset, length, [&](const unsigned char* data, std::size_t size)
+        {
+            while (size > 0)
+            {
+                if (next >= end)
+                {
+                    throw std::runtime_error("the server sent more than the range asked for");
+                }
+                std::size_t take = (std::min)(size, local.length(next) - pending.size());
+                pending.insert(pending.end(), data, data + take);
+                data += take;
+                size -= take;
+                if (pending.size() == local.length(next))
+                {
+                    if (!local.matches(next, pending.data()))
+                    {
+                        throw std::runtime_error("chunk " + std::to_string(next) + " does not match its digest");
+                    }
+                    out.write(pending.data(), pending.size());
+                    whole->update(reinterpret_cast<const unsigned char*>(pending.data()), pending.size());
+                    pending.clear();
+                    ++result.fetched;
+                    ++next;
+                }
+            }
+        });
+        if (!ranged)
+        {
+            result.complete = false;
+            return result;
+        }
+        if (next != end)
+        {
+            throw std::runtime_error("the server sent less than the range asked for");
+        }
+        chunk = end;
+        buffered = end < count;
+    }
+    if (!out.flush())
+    {
+        throw std::runtime_error("unable to write " + stagingFile);
+    }
+    result.digest = whole->digest();
+    return result;
+}
@@ -0,0 +1,114 @@
+#ifndef CHUNKED_FETCH_HPP_INCLUDED
+#define CHUNKED_FETCH_HPP_INCLUDED
+
+/// some microsoft compilers still benefit from the use of #pragma once
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "Hashing.hpp"
+
+/**
+ * Receives the bytes of a range as they arrive.
+ *
+ */
+typedef std::function<void(const unsigned char*, std::size_t)> RangeSink;
+
+/**
+ * Downloads a range of a remote file, passing its bytes to the provided
+ * sink in order.
+ *
+ * @return false if the server ignored the range, in which case nothing was
+ *         passed to the sink
+ *
+ * @throws std::runtime_error if the range cannot be downloaded
+ *
+ */
+typedef std::function<bool(uint64_t offset, uint64_t length, const RangeSink& sink)> RangeFetcher;
+
+/**
+ * The largest chunk an index may list.  A chunk is held in memory while it
+ * is checked, by every fetch worker at once, so an index listing larger
+ * chunks has its chunk list ignored and the font is downloaded whole.
+ *
+ */
+const uint64_t maxChunkSize = 4 * 1024 * 1024;
+
+/**
+ * The per-chunk digests an index lists for a large font.
+ *
+ */
+struct FontChunks
+{
+    /// the size of the font, in bytes
+    uint64_t size;
+
+    /// the size of every chunk but the last, in bytes
+    uint64_t chunkSize;
+
+    /// the digest of each chunk, in order, with the font's hash algorithm
+    std::vector<std::string> digests;
+};
+
+/**
+ * How a chunked fetch assembled a font.
+ *
+ */
+struct ChunkedFetchResult
+{
+    /// false if the server ignored range requests, and nothing was fetched
+    bool complete;
+
+    /// the digest of the whole staged font, if complete
+    std::string digest;
+
+    /// chunks kept from an interrupted download
+    uint64_t resumed;
+
+    /// chunks copied from the installed revision
+    uint64_t reused;
+
+    /// chunks fetched from the server
+    uint64_t fetched;
+};
+
+/**
+ * Assembles a font in its staging file a chunk at a time, fetching only
+ * the chunks that cannot be found locally.
+ *
+ * The staging file is kept up to the first chunk that does not match its
+ * digest, so a download that was interrupted resumes from its last good
+ * chunk.  Every chunk after that is copied from the installed revision if
+ * it still matches there, and otherwise fetched, together with the
+ * mismatching chunks that follow it, in a single range.  Every chunk is
+ * verified before it is written, so a failure leaves only good chunks
+ * behind to resume from; the digest of the whole font is calculated along
+ * the way.
+ *
+ * @param stagingFile the file to assemble the font in
+ *
+ * @param localFile the installed revision of the font, which need not exist
+ *
+ * @param algorithm the algorithm the digests were produced with
+ *
+ * @param chunks the chunk digests of the font
+ *
+ * @param fetchRange downloads ranges of the font
+ *
+ * @return how the font was assembled
+ *
+ * @throws std::runtime_error if the chunk list does not describe the font
+ *         or its chunks exceed maxChunkSize, a fetched chunk does not match
+ *         its digest, or a range or file cannot be read or written
+ *
+ */
+ChunkedFetchResult fetchChunked(const std::string& stagingFile, const std::string& localFile, HashAlgorithm algorithm,
+    const FontChunks& chunks, const RangeFetcher& fetchRange);
+
+#endif
@@ -1,10 +1,27 @@
 #include "Config.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iterator>
 #include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
-#include <boost/any.hpp>
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/numeric/conversion/cast.hpp>
 #include <boost/property_tree/ini_parser.hpp>
 #include <boost/property_tree/json_parser.hpp>
 #include <boost/property_tree/ptree.hpp>
@@ -13,7 +30,10 @@
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
 
+#include "FileReader.hpp"
 #include "Logging.hpp"
+#include "MirrorSet.hpp"
+#include "TokenBucket.hpp"
 
 /// quick and dirty lookup table to convert strings to logging constants
 std::map<std::string, boost::log::trivial::severity_level> severityMappings = 
@@ -30,7 +50,18 @@ std::map<std::string, boost::log::trivial::severity_level> severityMappings =
 
 struct Config::ConfigImpl
 {
-    std::map<std::string, std::pair<boost::any, boost::any>> properties;
+    /// only ever accessed through std::atomic_load / std::atomic_store
+    std::shared_ptr<const Config::Settings> settings;
+
+    std::string configFile;
+
+    std::thread watcher;
+
+    std::mutex mutex;
+
+    std::condition_variable wakeup;
+
+    bool stopping = false;
 
     bool onConfigError(const std::exception& e, int options = MB_CANCELTRYCONTINUE | MB_ICONERROR | MB_DEFBUTTON3)
     {
@@ -51,111 +82,330 @@ struct Config::ConfigImpl
         }
     }
 
-    void populate(boost::property_tree::ptree& tree) {/* no-op -- terminate meta-recursion */ }
+    static void parse(const std::string& text, std::string& value)
+    {
+        value = text;
+    }
+
+    static void parse(const std::string& text, unsigned& value)
+    {
+        if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos)
+        {
+            throw std::invalid_argument("expected a non-negative integer");
+        }
+        try
+        {
+            value = boost::numeric_cast<unsigned>(std::stoull(text));
+        }
+        catch (const std::exception&)
+        {
+            throw std::invalid_argument("integer is out of range");
+        }
+    }
+
+    static void parse(const std::string& text, uint16_t& value)
+    {
+        unsigned wide;
+        parse(text, wide);
+        if (wide > 0xFFFF)
+        {
+            throw std::invalid_argument("expected a port number no greater than 65535");
+        }
+        value = static_cast<uint16_t>(wide);
+    }
+
+    static void parse(const std::string& text, bool& value)
+    {
+        auto lowered = boost::algorithm::to_lower_copy(text);
+        if (lowered == "true" || lowered == "1" || lowered == "yes" || lowered == "on")
+        {
+            value = true;
+        }
+        else if (lowered == "false" || lowered == "0" || lowered == "no" || lowered == "off")
+        {
+            value = false;
+        }
+        else
+        {
+            throw std::invalid_argument("expected true or false");
+        }
+    }
+
+    static void parse(const std::string& text, boost::log::trivial::severity_level& value)
+    {
+        auto iter = severityMappings.find(boost::algorithm::to_lower_copy(text));
+        if (iter == severityMappings.end())
+        {
+            throw std::invalid_argument("expected one of fatal, error, warning, info, debug or trace");
+        }
+        value = iter->second;
+    }
+
+    /// parses a single option, leaving its default untouched if it is absent or invalid
+    template<typename T>
+    static void populate(const boost::property_tree::ptree& tree, const char* key, T& value, std::vector<std::string>& errors)
+    {
+        auto text = tree.get_optional<std::string>(key);
+        if (!text)
+        {
+            return;
+        }
+        try
+        {
+            T parsed;
+            parse(boost::algorithm::trim_copy(*text), parsed);
+            value = parsed;
+        }
+        catch (const std::invalid_argument& error)
+        {
+            errors.push_back(std::string(key) + " = \"" + *text + "\" (" + error.what() + ")");
+        }
+    }
+
+    /// checks a parsed option against the module that consumes it, restoring its default if it is invalid
+    template<typename T, typename Check>
+    static void validate(const char* key, T& value, const T& fallback, std::vector<std::string>& errors, Check check)
+    {
+        try
+        {
+            check(value);
+        }
+        catch (const std::invalid_argument& error)
+        {
+            errors.push_back(std::string(key) + " = \"" + value + "\" (" + error.what() + ")");
+            value = fallback;
+        }
+    }
+
+    /// validates the options whose values are only known to the modules that consume them
+    static void validate(Config::Settings& settings, std::vector<std::string>& errors)
+    {
+        const Config::Settings defaults;
+        validate("io_backend", settings.io_backend, defaults.io_backend, errors, [](const std::string& value)
+        {
+            if (!boost::algorithm::iequals(value, "auto"))
+            {
+                parseIOBackend(value);
+            }
+        });
+        validate("bandwidth_schedule", settings.bandwidth_schedule, defaults.bandwidth_schedule, errors, [](const std::string& value)
+        {
+            BandwidthSchedule schedule(value);
+        });
+        validate("mirrors", settings.mirrors, defaults.mirrors, errors, [&settings](const std::string& value)
+        {
+            MirrorSet::parse(settings.host, settings.port, value);
+        });
+    }
+
+    /// validates every option in the schema, collecting all errors before reporting them
+    static Config::Settings populate(const boost::property_tree::ptree& tree, std::vector<std::string>& errors)
+    {
+        Config::Settings settings;
+#define FONTSYNC_POPULATE_SETTING(type, key, value) populate(tree, #key, settings.key, errors);
+        FONTSYNC_CONFIG_SCHEMA(FONTSYNC_POPULATE_SETTING)
+#undef FONTSYNC_POPULATE_SETTING
+        validate(settings, errors);
+        static const std::set<std::string> known = {
+#define FONTSYNC_SETTING_KEY(type, key, value) #key,
+            FONTSYNC_CONFIG_SCHEMA(FONTSYNC_SETTING_KEY)
+#undef FONTSYNC_SETTING_KEY
+        };
+        for (const auto& option : tree)
+        {
+            if (known.find(option.first) == known.end())
+            {
+                FONTSYNC_LOG_TRIVIAL(warning) << "Ignoring unknown configuration option: " << option.first;
+            }
+        }
+        return settings;
+    }
 
-    template<typename Key, typename Value, typename... Remaining>
-    void populate(boost::property_tree::ptree& tree, Key&& key, Value&& value, Remaining&&... args)
+    /// HACK!  due to variations between boost::property_tree::*_parser::read_*...
+    ///        the various parsers can't be loaded into a string indexed map...
+    static void read(const std::string& configFile, boost::property_tree::ptree& tree)
     {
-        this->properties.insert(std::make_pair(key, std::make_pair(tree.get(key, value), value)));
-        populate(tree, args...);
+        auto extension = boost::filesystem::path(configFile).extension();
+        if (extension == ".ini")
+        {
+            boost::property_tree::ini_parser::read_ini(configFile, tree);
+        }
+        else if (extension == ".json")
+        {
+            boost::property_tree::json_parser::read_json(configFile, tree);
+        }
+        else if (extension == ".xml")
+        {
+            boost::property_tree::xml_parser::read_xml(configFile, tree);
+        }
+        else
+        {
+            throw std::invalid_argument(extension.string() + (" configuration files are not supported"));
+        }
     }
 
-    ConfigImpl(const std::map<std::string, std::pair<boost::any, boost::any>> properties) : properties(properties)
+    /// identifies a revision of the configuration file; modification times only have a resolution
+    /// of a second, so an edit that keeps the size within the same second is told apart by the
+    /// contents, which are small enough to read on every poll
+    struct Revision
     {
+        std::time_t modified;
+        boost::uintmax_t size;
+        std::size_t contents;
+
+        bool operator!=(const Revision& other) const
+        {
+            return this->modified != other.modified || this->size != other.size || this->contents != other.contents;
+        }
+    };
 
+    Revision revision() const
+    {
+        Revision rv = { 0, 0, 0 };
+        boost::system::error_code modifiedError, sizeError;
+        auto modified = boost::filesystem::last_write_time(this->configFile, modifiedError);
+        auto size = boost::filesystem::file_size(this->configFile, sizeError);
+        if (modifiedError || sizeError)
+        {
+            return rv;
+        }
+        std::ifstream in(this->configFile, std::ios::binary);
+        std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        rv.modified = modified;
+        rv.size = size;
+        rv.contents = std::hash<std::string>()(contents);
+        return rv;
     }
 
-    ConfigImpl(const std::string& configFile)
+    /// re-parses the configuration file, publishing it only if it is entirely valid
+    void reload(const Config::ReloadListener& listener)
     {
         boost::property_tree::ptree tree;
+        try
+        {
+            read(this->configFile, tree);
+        }
+        catch (const std::exception& error)
+        {
+            FONTSYNC_LOG_TRIVIAL(error) << "Unable to reload " << this->configFile << ", keeping the current configuration (" << error.what() << ")";
+            return;
+        }
+        std::vector<std::string> errors;
+        auto next = std::make_shared<const Config::Settings>(populate(tree, errors));
+        if (!errors.empty())
+        {
+            for (const auto& error : errors)
+            {
+                FONTSYNC_LOG_TRIVIAL(error) << "Invalid configuration option " << error;
+            }
+            FONTSYNC_LOG_TRIVIAL(error) << "Unable to reload " << this->configFile << ", keeping the current configuration";
+            return;
+        }
+        auto previous = std::atomic_load(&this->settings);
+        std::atomic_store(&this->settings, next);
+        FONTSYNC_LOG_TRIVIAL(info) << "Reloaded configuration from " << this->configFile;
+        if (listener)
+        {
+            listener(*previous, *next);
+        }
+    }
+
+    void watch(const Config::ReloadListener& listener)
+    {
+        auto interval = std::chrono::milliseconds(std::atomic_load(&this->settings)->config_reload_interval);
+        if (this->configFile.empty() || interval.count() == 0 || this->watcher.joinable())
+        {
+            return;
+        }
+        /// taken before returning, so an edit made as soon as watching starts is not mistaken for the original
+        auto seen = this->revision();
+        this->watcher = std::thread([this, interval, listener, seen]() mutable
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            while (!this->wakeup.wait_for(lock, interval, [this]() { return this->stopping; }))
+            {
+                /// reloading and the listener run unlocked, so neither holds up the destructor
+                lock.unlock();
+                auto current = this->revision();
+                if (current != seen)
+                {
+                    seen = current;
+                    this->reload(listener);
+                }
+                lock.lock();
+            }
+        });
+    }
+
+    ConfigImpl(const std::shared_ptr<const Config::Settings>& settings) : settings(settings)
+    {
+
+    }
+
+    ConfigImpl(const std::string& configFile) : configFile(configFile)
+    {
         bool tryAgain;
         do
         {
+            boost::property_tree::ptree tree;
             try
             {
                 tryAgain = false;
-                auto extension = boost::filesystem::path(configFile).extension();
-                /// HACK!  due to variations between boost::property_tree::*_parser::read_*...
-                ///        the various parsers can't be loaded into a string indexed map...
-                if (extension == ".ini")
-                {
-                    boost::property_tree::ini_parser::read_ini(configFile, tree);
-                }
-                else if (extension == ".json")
-                {
-                    boost::property_tree::json_parser::read_json(configFile, tree);
-                }
-                else if (extension == ".xml")
-                {
-                    boost::property_tree::xml_parser::read_xml(configFile, tree);
-                }
-                else
-                {
-                    tryAgain = this->onConfigError(std::runtime_error(extension.string() + (" configuration files are not supported")), MB_OKCANCEL | MB_ICONERROR | MB_DEFBUTTON1 | MB_SYSTEMMODAL);
-                }
+                read(configFile, tree);
+            }
+            catch (const std::invalid_argument& error)
+            {
+                tryAgain = this->onConfigError(error, MB_OKCANCEL | MB_ICONERROR | MB_DEFBUTTON1 | MB_SYSTEMMODAL);
             }
             catch (const boost::property_tree::ptree_error& error)
             {
                 tryAgain = this->onConfigError(error);
             }
+            if (tryAgain)
+            {
+                continue;
+            }
+
+            /// Soldier on, even if configuration fails...
+            /// invalid options just keep their defaults
+            std::vector<std::string> errors;
+            this->settings = std::make_shared<const Config::Settings>(populate(tree, errors));
+            if (!errors.empty())
+            {
+                std::stringstream ss;
+                ss << "invalid configuration option(s):";
+                for (const auto& error : errors)
+                {
+                    ss << "\n" << error;
+                }
+                tryAgain = this->onConfigError(std::runtime_error(ss.str()));
+            }
         } while (tryAgain);
+    }
 
-        /// Soldier on, even if configuration fails...
-        /// we'll just try out the defaults
-        this->populate(tree,
-            "host", "localhost",
-            "port", 80,
-            "sync_interval", 60000,
-            "resource", "update.php",
-            "local_font_dir", "C:\\windows\\fonts",
-            "failed_sync_delay", 60000,
-            "failed_download_delay", 5000,
-            "failed_download_retries", 3,
-            "console_logging_enabled", true,
-            "console_logging_format", "[%TimeStamp%]: %Message%",
-            "file_logging_enabled", true,
-            "file_name_format", "FontSync_%3N.log",
-            "max_individual_file_size", 1 * 1024 * 1024,
-            "max_cumulative_file_size", 20 * 1024 * 1024,
-            "file_logging_format", "[%TimeStamp%]: %Message%",
-            "logging_severity_filter", "info"
-        );
-
-        /// Special case for boost::log::trivial::severity_level
-        try
+    ~ConfigImpl()
+    {
         {
-            auto iter = severityMappings.find(boost::any_cast<std::string>(this->properties["logging_severity_filter"].first));
-            this->properties["logging_severity_filter"].first = iter != severityMappings.end() ? iter->second : boost::log::trivial::info;
-            this->properties["logging_severity_filter"].second = iter != severityMappings.end() ? iter->second : boost::log::trivial::info;
+            std::lock_guard<std::mutex> lock(this->mutex);
+            this->stopping = true;
         }
-        catch (const boost::bad_any_cast&)
+        this->wakeup.notify_all();
+        if (this->watcher.joinable())
         {
-            this->properties["logging_severity_filter"].first = boost::log::trivial::info;
-            this->properties["logging_severity_filter"].second = boost::log::trivial::info;
+            this->watcher.join();
         }
     }
 };
 
-#define EXPLICIT_INSTANTIATE(X) \
-template<> \
-X Config::get(const std::string& option) const { \
-    try \
-    { \
-        return boost::any_cast<X>(this->impl->properties.at(option).first); \
-    } \
-    catch(...) \
-    { \
-        std::cout << "Mucked Up Config" << std::endl; \
-        return boost::any_cast<X>(this->impl->properties.at(option).second); \
-    } \
+std::shared_ptr<const Config::Settings> Config::settings() const
+{
+    return std::atomic_load(&this->impl->settings);
 }
 
-EXPLICIT_INSTANTIATE(boost::log::trivial::severity_level)
-EXPLICIT_INSTANTIATE(std::string)
-EXPLICIT_INSTANTIATE(unsigned)
-EXPLICIT_INSTANTIATE(signed)
-EXPLICIT_INSTANTIATE(bool)
-EXPLICIT_INSTANTIATE(const char*)
+void Config::watch(const ReloadListener& listener)
+{
+    this->impl->watch(listener);
+}
 
 Config::Config(const std::string& configFile) : 
 impl(new ConfigImpl(configFile))
@@ -163,16 +413,16 @@ impl(new ConfigImpl(configFile))
 
 }
 
-Config::Config(const Config& other) : impl(new ConfigImpl(other.impl->properties))
+Config::Config(const Config& other) : impl(new ConfigImpl(other.settings()))
 {
 
 }
 
-Config& Config::operator=(Config& other)
+Config& Config::operator=(const Config& other)
 {
 	if (this != &other)
 	{
-        this->impl->properties = other.impl->properties;
+        std::atomic_store(&this->impl->settings, other.settings());
 	}
 	return *this;
 }
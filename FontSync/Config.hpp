@@ -6,9 +6,69 @@
 # pragma once
 #endif
 
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
 
+#include <boost/log/trivial.hpp>
+
+/**
+ * The configuration schema.
+ *
+ * Every option is declared exactly once as X(type, key, default).  The key
+ * is both the name looked up in the configuration file and the name of the
+ * generated field in Config::Settings.
+ *
+ */
+#define FONTSYNC_CONFIG_SCHEMA(X) \
+    X(std::string, host,                     "localhost") \
+    X(uint16_t,    port,                     80) \
+    X(unsigned,    sync_interval,            60000) \
+    X(std::string, resource,                 "update.php") \
+    X(std::string, mirrors,                  "") \
+    X(unsigned,    mirror_probe_interval,    300000) \
+    X(unsigned,    dns_cache_ttl,            300) \
+    X(unsigned,    index_connect_timeout,    10000) \
+    X(unsigned,    index_header_timeout,     15000) \
+    X(unsigned,    index_body_timeout,       15000) \
+    X(unsigned,    index_total_timeout,      120000) \
+    X(unsigned,    index_max_size,           16384) \
+    X(unsigned,    index_page_size,          1000) \
+    X(unsigned,    sync_memory_budget,       131072) \
+    X(std::string, local_font_dir,           "C:\\windows\\fonts") \
+    X(bool,        watch_font_dir,           true) \
+    X(unsigned,    failed_sync_delay,        60000) \
+    X(unsigned,    failed_download_delay,    5000) \
+    X(unsigned,    failed_download_retries,  3) \
+    X(unsigned,    sync_fetch_workers,       4) \
+    X(unsigned,    sync_verify_workers,      1) \
+    X(unsigned,    sync_queue_depth,         8) \
+    X(bool,        console_logging_enabled,  true) \
+    X(std::string, console_logging_format,   "[%TimeStamp%]: %Message%") \
+    X(bool,        file_logging_enabled,     true) \
+    X(std::string, file_name_format,         "FontSync_%3N.log") \
+    X(unsigned,    max_individual_file_size, 1 * 1024 * 1024) \
+    X(unsigned,    max_cumulative_file_size, 20 * 1024 * 1024) \
+    X(std::string, file_logging_format,      "[%TimeStamp%]: %Message%") \
+    X(unsigned,    logging_queue_size,       8192) \
+    X(unsigned,    logging_batch_size,       256) \
+    X(unsigned,    logging_flush_interval,   1000) \
+    X(boost::log::trivial::severity_level, logging_flush_severity, boost::log::trivial::warning) \
+    X(unsigned,    config_reload_interval,   5000) \
+    X(std::string, io_backend,               "auto") \
+    X(std::string, include_categories,       "") \
+    X(std::string, exclude_categories,       "") \
+    X(std::string, include_types,            "") \
+    X(std::string, exclude_types,            "") \
+    X(std::string, include_names,            "") \
+    X(std::string, exclude_names,            "") \
+    X(unsigned,    bandwidth_limit,          0) \
+    X(unsigned,    bandwidth_burst,          256) \
+    X(std::string, bandwidth_schedule,       "") \
+    X(bool,        compressed_downloads,     true) \
+    X(boost::log::trivial::severity_level, logging_severity_filter, boost::log::trivial::info)
+
 /**
  * Application configuration.
  *
@@ -31,23 +91,62 @@ class Config {
 public:
     
     /**
-     * Retrieves the provided configuration option.
+     * The parsed configuration options, one field per schema entry.
+     *
+     * Every field holds either the validated value from the configuration
+     * file or its schema default, so reading an option is a plain load.
+     *
+     */
+    struct Settings
+    {
+#define FONTSYNC_DECLARE_SETTING(type, key, value) type key = value;
+        FONTSYNC_CONFIG_SCHEMA(FONTSYNC_DECLARE_SETTING)
+#undef FONTSYNC_DECLARE_SETTING
+    };
+
+    /**
+     * Invoked on the watcher thread after a new snapshot has been published.
+     *
+     * @param previous the snapshot that was replaced
+     *
+     * @param current the snapshot that is now in effect
+     *
+     */
+    typedef std::function<void(const Settings& previous, const Settings& current)> ReloadListener;
+
+    /**
+     * Retrieves the current configuration snapshot.
+     *
+     * Snapshots are immutable; a reload publishes a new one atomically, so a
+     * caller that holds on to a snapshot sees a consistent set of options.
      * 
-     * @param option the configuration option to retrieve
+     * @return the current configuration snapshot
      *
-     * @tparam T the anticipated type of the option data
+     */
+    std::shared_ptr<const Settings> settings() const;
+
+    /**
+     * Starts watching the configuration file for changes.
      *
-     * @return the requested configuration option
+     * The file is polled every config_reload_interval milliseconds.  When it
+     * changes it is re-parsed and, only if every option is valid, published
+     * as the new snapshot.  An invalid file is logged and the current
+     * snapshot is kept.  Does nothing if there is no configuration file or
+     * config_reload_interval is 0.
+     *
+     * @param listener invoked after each successful reload
      *
      */
-    template<typename T>
-    T get(const std::string& option) const;
+    void watch(const ReloadListener& listener = ReloadListener());
     
     /**
      * Constructs a configuration object based on the provided INI file
      * 
      * @param configFile the INI configuration file
      * 
+     * Options whose values cannot be parsed as their schema type are
+     * reported as configuration errors here, never on access.
+     * 
      * @throws std::runtime_error if any configuration error occurs
      */
     Config(const std::string& configFile = "");
@@ -62,12 +161,10 @@ public:
 	 * Copy Assignment
 	 *
 	 */
-	Config& operator=(Config& other);
+	Config& operator=(const Config& other);
 
     /**
-     * Default destructor (does nothing)
-     * 
-     * Only explicitly declared because mingw is wonky.
+     * Destructor, stops watching the configuration file.
      * 
      */
     ~Config();
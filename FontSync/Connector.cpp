@@ -0,0 +1,258 @@
+#include "Connector.hpp"
+
+#include <memory>
+
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/system/system_error.hpp>
+
+#include "Logging.hpp"
+
+std::vector<boost::asio::ip::tcp::endpoint> systemLookup(const std::string& host, uint16_t port)
+{
+    using namespace boost::asio::ip;
+    boost::asio::io_service service;
+    tcp::resolver resolver(service);
+    tcp::resolver::iterator iterator = resolver.resolve(tcp::resolver::query(host, std::to_string(port)));
+    std::vector<tcp::endpoint> endpoints;
+    for (tcp::resolver::iterator end; iterator != end; ++iterator)
+    {
+        endpoints.push_back(iterator->endpoint());
+    }
+    return endpoints;
+}
+
+ResolverCache::ResolverCache(std::chrono::seconds ttl, const Lookup& lookup, const Clock& clock) :
+    lookup(lookup), clock(clock), ttl(ttl)
+{
+
+}
+
+std::vector<boost::asio::ip::tcp::endpoint> ResolverCache::resolve(const std::string& host, uint16_t port, bool* cached)
+{
+    auto key = std::make_pair(host, port);
+    std::chrono::seconds ttl;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        auto entry = this->entries.find(key);
+        if (entry != this->entries.end())
+        {
+            if (this->clock() < entry->second.expires)
+            {
+                if (cached != nullptr)
+                {
+                    *cached = true;
+                }
+                return entry->second.endpoints;
+            }
+            this->entries.erase(entry);
+        }
+        ttl = this->ttl;
+    }
+    /// resolve without holding the lock, so a slow lookup never holds up cached ones
+    auto endpoints = this->lookup(host, port);
+    if (endpoints.empty())
+    {
+        throw boost::system::system_error(boost::asio::error::host_not_found);
+    }
+    if (ttl.count() > 0)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        Entry entry = { endpoints, this->clock() + ttl };
+        this->entries[key] = entry;
+    }
+    if (cached != nullptr)
+    {
+        *cached = false;
+    }
+    return endpoints;
+}
+
+void ResolverCache::invalidate(const std::string& host, uint16_t port)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->entries.erase(std::make_pair(host, port));
+}
+
+void ResolverCache::setTtl(std::chrono::seconds ttl)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->ttl = ttl;
+    if (ttl.count() == 0)
+    {
+        this->entries.clear();
+    }
+}
+
+ResolverCache& sharedResolverCache()
+{
+    static ResolverCache cache(std::chrono::seconds(300));
+    return cache;
+}
+
+namespace
+{
+    /// alternates address families, starting with the family of the first endpoint (RFC 8305, section 4)
+    std::vector<boost::asio::ip::tcp::endpoint> interleave(const std::vector<boost::asio::ip::tcp::endpoint>& endpoints)
+    {
+        std::vector<boost::asio::ip::tcp::endpoint> preferred, other;
+        for (const auto& endpoint : endpoints)
+        {
+            (endpoint.address().is_v6() == endpoints.front().address().is_v6() ? preferred : other).push_back(endpoint);
+        }
+        std::vector<boost::asio::ip::tcp::endpoint> rv;
+        for (size_t i = 0; i < preferred.size() || i < other.size(); ++i)
+        {
+            if (i < preferred.size())
+            {
+                rv.push_back(preferred[i]);
+            }
+            if (i < other.size())
+            {
+                rv.push_back(other[i]);
+            }
+        }
+        return rv;
+    }
+}
+
+boost::asio::ip::tcp::endpoint raceConnect(boost::asio::io_service& service,
+                                           boost::asio::ip::tcp::socket& socket,
+                                           const std::vector<boost::asio::ip::tcp::endpoint>& endpoints,
+                                           std::chrono::milliseconds attemptDelay,
+                                           std::chrono::milliseconds timeout)
+{
+    using boost::asio::ip::tcp;
+    if (endpoints.empty())
+    {
+        throw boost::system::system_error(boost::asio::error::host_not_found);
+    }
+    auto ordered = interleave(endpoints);
+    std::vector<std::unique_ptr<tcp::socket>> attempts;
+    size_t started = 0;
+    size_t pending = 0;
+    int winner = -1;
+    bool timedOut = false;
+    boost::system::error_code lastError = boost::asio::error::host_not_found;
+    boost::asio::deadline_timer stagger(service);
+    boost::asio::deadline_timer deadline(service, boost::posix_time::milliseconds(timeout.count()));
+
+    auto abandonOthers = [&]()
+    {
+        boost::system::error_code ignored;
+        stagger.cancel(ignored);
+        deadline.cancel(ignored);
+        for (size_t i = 0; i < attempts.size(); ++i)
+        {
+            if (static_cast<int>(i) != winner)
+            {
+                attempts[i]->close(ignored);
+            }
+        }
+    };
+
+    std::function<void()> startNext = [&]()
+    {
+        if (winner >= 0 || timedOut || started >= ordered.size())
+        {
+            return;
+        }
+        size_t index = started++;
+        attempts.push_back(std::unique_ptr<tcp::socket>(new tcp::socket(service)));
+        ++pending;
+        attempts[index]->async_connect(ordered[index], [&, index](const boost::system::error_code& error)
+        {
+            --pending;
+            if (winner >= 0 || timedOut)
+            {
+                return;
+            }
+            if (!error)
+            {
+                winner = static_cast<int>(index);
+                abandonOthers();
+                return;
+            }
+            FONTSYNC_LOG_TRIVIAL(trace) << "Connecting to " << ordered[index] << " failed: " << error.message();
+            lastError = error;
+            /// a failed attempt hands over to the next one straight away
+            startNext();
+            if (pending == 0 && started >= ordered.size())
+            {
+                abandonOthers();
+            }
+        });
+        boost::system::error_code ignored;
+        stagger.expires_from_now(boost::posix_time::milliseconds(attemptDelay.count()), ignored);
+        stagger.async_wait([&](const boost::system::error_code& error)
+        {
+            if (!error)
+            {
+                startNext();
+            }
+        });
+    };
+
+    deadline.async_wait([&](const boost::system::error_code& error)
+    {
+        if (!error && winner < 0)
+        {
+            timedOut = true;
+            abandonOthers();
+        }
+    });
+    startNext();
+    service.reset();
+    service.run();
+    service.reset();
+
+    if (winner < 0)
+    {
+        throw boost::system::system_error(timedOut ? boost::asio::error::timed_out : lastError);
+    }
+    socket = std::move(*attempts[winner]);
+    return ordered[winner];
+}
+
+boost::asio::ip::tcp::endpoint connectTo(boost::asio::io_service& service,
+                                         boost::asio::ip::tcp::socket& socket,
+                                         const std::string& host,
+                                         uint16_t port,
+                                         std::chrono::milliseconds timeout)
+{
+    auto start = std::chrono::steady_clock::now();
+    bool cached = false;
+    auto endpoints = sharedResolverCache().resolve(host, port, &cached);
+    auto resolved = std::chrono::steady_clock::now();
+    boost::asio::ip::tcp::endpoint connected;
+    try
+    {
+        connected = raceConnect(service, socket, endpoints, std::chrono::milliseconds(250), timeout);
+    }
+    catch (const boost::system::system_error& e)
+    {
+        /// the cached addresses may have moved; look them up again, within what is left of the timeout
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(start + timeout - std::chrono::steady_clock::now());
+        if (!cached || remaining.count() <= 0)
+        {
+            throw;
+        }
+        FONTSYNC_LOG_TRIVIAL(debug) << "No cached address of " << host << " accepted a connection (" << e.what() << "), resolving again...";
+        sharedResolverCache().invalidate(host, port);
+        endpoints = sharedResolverCache().resolve(host, port, &cached);
+        resolved = std::chrono::steady_clock::now();
+        remaining = std::chrono::duration_cast<std::chrono::milliseconds>(start + timeout - resolved);
+        if (remaining.count() <= 0)
+        {
+            throw;
+        }
+        connected = raceConnect(service, socket, endpoints, std::chrono::milliseconds(250), remaining);
+    }
+    auto milliseconds = [](std::chrono::steady_clock::duration duration)
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+    };
+    FONTSYNC_LOG_TRIVIAL(debug) << "Connected to " << host << ":" << port << " (" << connected << ") in " << milliseconds(std::chrono::steady_clock::now() - start) <<
+        "ms; resolving took " << milliseconds(resolved - start) << "ms" << (cached ? " (cached)" : "") << ", connecting " << milliseconds(std::chrono::steady_clock::now() - resolved) << "ms";
+    return connected;
+}
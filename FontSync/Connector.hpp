@@ -0,0 +1,195 @@
+#ifndef CONNECTOR_HPP_INCLUDED
+#define CONNECTOR_HPP_INCLUDED
+
+/// some microsoft compilers still benefit from the use of #pragma once
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+/**
+ * Resolves a host and port with the system resolver.
+ *
+ * @param host the host name or address to resolve
+ *
+ * @param port the port to connect to
+ *
+ * @return every endpoint the host resolves to, in the system's order of preference
+ *
+ * @throws boost::system::system_error if the host cannot be resolved
+ *
+ */
+std::vector<boost::asio::ip::tcp::endpoint> systemLookup(const std::string& host, uint16_t port);
+
+/**
+ * A thread safe cache of resolved endpoints.
+ *
+ * The system resolver does not report the time to live of the records it
+ * returns, so entries are kept for at most the configured time to live and
+ * can be invalidated early, e.g. once none of their endpoints accept
+ * connections any more.
+ *
+ */
+class ResolverCache
+{
+public:
+
+    /**
+     * Resolves a host and port; injectable so that caching can be tested
+     * without a resolver.
+     *
+     */
+    typedef std::function<std::vector<boost::asio::ip::tcp::endpoint>(const std::string&, uint16_t)> Lookup;
+
+    /**
+     * The source of time; injectable so that expiry can be tested without
+     * waiting on a real clock.
+     *
+     */
+    typedef std::function<std::chrono::steady_clock::time_point()> Clock;
+
+private:
+
+    struct Entry
+    {
+        std::vector<boost::asio::ip::tcp::endpoint> endpoints;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    Lookup lookup;
+
+    Clock clock;
+
+    std::chrono::seconds ttl;
+
+    std::map<std::pair<std::string, uint16_t>, Entry> entries;
+
+    std::mutex mutex;
+
+public:
+
+    /**
+     * Constructs an empty ResolverCache.
+     *
+     * @param ttl how long a resolution is kept; 0 disables caching
+     *
+     * @param lookup resolves the hosts that are not cached
+     *
+     * @param clock the source of time
+     *
+     */
+    explicit ResolverCache(std::chrono::seconds ttl, const Lookup& lookup = systemLookup, const Clock& clock = std::chrono::steady_clock::now);
+
+    /**
+     * Resolves a host and port, from the cache if possible.
+     *
+     * @param host the host name or address to resolve
+     *
+     * @param port the port to connect to
+     *
+     * @param cached if provided, receives whether the endpoints came from the cache
+     *
+     * @return every endpoint the host resolves to
+     *
+     * @throws boost::system::system_error if the host cannot be resolved
+     *
+     */
+    std::vector<boost::asio::ip::tcp::endpoint> resolve(const std::string& host, uint16_t port, bool* cached = nullptr);
+
+    /**
+     * Forgets the resolution of a host and port.
+     *
+     * @param host the host name or address
+     *
+     * @param port the port
+     *
+     */
+    void invalidate(const std::string& host, uint16_t port);
+
+    /**
+     * Changes how long resolutions are kept, from the next resolution on.
+     *
+     * @param ttl how long a resolution is kept; 0 disables caching
+     *
+     */
+    void setTtl(std::chrono::seconds ttl);
+};
+
+/**
+ * Retrieves the resolver cache shared by every connection in this process.
+ *
+ * @return the shared resolver cache
+ *
+ */
+ResolverCache& sharedResolverCache();
+
+/**
+ * Connects to the first of several endpoints to accept a connection, racing
+ * staggered attempts in the manner of RFC 8305 ("happy eyeballs").
+ *
+ * The endpoints are interleaved by address family, starting with the family
+ * of the first one.  An attempt is started every attemptDelay, or as soon as
+ * the previous one fails; the first to connect wins and the rest are
+ * abandoned.  An unreachable address therefore costs attemptDelay, rather
+ * than a full TCP timeout.
+ *
+ * @param service the io_service the socket belongs to; it is run until the race is over
+ *
+ * @param socket receives the connection
+ *
+ * @param endpoints the endpoints to race
+ *
+ * @param attemptDelay the time between starting attempts
+ *
+ * @param timeout the most time the whole race may take
+ *
+ * @return the endpoint that accepted the connection
+ *
+ * @throws boost::system::system_error if no endpoint accepts a connection in time
+ *
+ */
+boost::asio::ip::tcp::endpoint raceConnect(boost::asio::io_service& service,
+                                           boost::asio::ip::tcp::socket& socket,
+                                           const std::vector<boost::asio::ip::tcp::endpoint>& endpoints,
+                                           std::chrono::milliseconds attemptDelay = std::chrono::milliseconds(250),
+                                           std::chrono::milliseconds timeout = std::chrono::milliseconds(10000));
+
+/**
+ * Connects to a host and port, resolving it through the shared resolver
+ * cache and racing its endpoints.  If every cached endpoint fails, the host
+ * is resolved afresh and raced once more.
+ *
+ * @param service the io_service the socket belongs to
+ *
+ * @param socket receives the connection
+ *
+ * @param host the host name or address to connect to
+ *
+ * @param port the port to connect to
+ *
+ * @param timeout the most time connecting may take in all, including a
+ *        second race against freshly resolved addresses
+ *
+ * @return the endpoint that accepted the connection
+ *
+ * @throws boost::system::system_error if the host cannot be resolved or reached
+ *
+ */
+boost::asio::ip::tcp::endpoint connectTo(boost::asio::io_service& service,
+                                         boost::asio::ip::tcp::socket& socket,
+                                         const std::string& host,
+                                         uint16_t port,
+                                         std::chrono::milliseconds timeout = std::chrono::milliseconds(10000));
+
+#endif
@@ -0,0 +1,267 @@
+#include "Delta.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+namespace
+{
+    /// identifies (and versions) the delta format
+    const char magic[8] = { 'F', 'S', 'D', 'E', 'L', 'T', 'A', '1' };
+
+    /// instructions; every number that follows is a little endian uint64
+    enum Instruction : unsigned char
+    {
+        /// the end of the delta
+        End = 0,
+
+        /// offset, length: copies a range of the base file
+        Copy = 1,
+
+        /// length, bytes: adds literal bytes
+        Add = 2
+    };
+
+    std::vector<unsigned char> readWhole(const std::string& file)
+    {
+        std::ifstream in(file, std::ios::binary);
+        if (!in)
+        {
+            throw std::runtime_error("unable to read " + file);
+        }
+        return std::vector<unsigned char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    void writeNumber(std::ostream& out, uint64_t value)
+    {
+        char bytes[8];
+        for (int i = 0; i < 8; ++i)
+        {
+            bytes[i] = static_cast<char>(value >> (8 * i));
+        }
+        out.write(bytes, sizeof(bytes));
+    }
+
+    uint64_t readNumber(std::istream& in)
+    {
+        unsigned char bytes[8];
+        if (!in.read(reinterpret_cast<char*>(bytes), sizeof(bytes)))
+        {
+            throw std::runtime_error("malformed delta: truncated");
+        }
+        uint64_t rv = 0;
+        for (int i = 7; i >= 0; --i)
+        {
+            rv = (rv << 8) | bytes[i];
+        }
+        return rv;
+    }
+
+    /// the rsync rolling checksum of a window: a plain sum and a position weighted sum, 16 bits each
+    struct RollingChecksum
+    {
+        uint32_t a;
+        uint32_t b;
+        std::size_t window;
+
+        RollingChecksum(const unsigned char* data, std::size_t window) : a(0), b(0), window(window)
+        {
+            for (std::size_t i = 0; i < window; ++i)
+            {
+                this->a += data[i];
+                this->b += static_cast<uint32_t>(window - i) * data[i];
+            }
+        }
+
+        void roll(unsigned char out, unsigned char in)
+        {
+            this->a += in - out;
+            this->b += this->a - static_cast<uint32_t>(this->window) * out;
+        }
+
+        uint32_t value() const
+        {
+            return (this->a & 0xFFFF) | (this->b << 16);
+        }
+    };
+
+    /// writes the literal bytes between two copies as a single instruction
+    void writeAdd(std::ostream& out, const std::vector<unsigned char>& target, std::size_t start, std::size_t end)
+    {
+        if (end > start)
+        {
+            out.put(static_cast<char>(Add));
+            writeNumber(out, end - start);
+            out.write(reinterpret_cast<const char*>(target.data() + start), end - start);
+        }
+    }
+}
+
+uint64_t createDelta(const std::string& base, const std::string& target, const std::string& delta, std::size_t blockSize)
+{
+    auto from = readWhole(base);
+    auto to = readWhole(target);
+    std::ofstream out(delta, std::ios::binary | std::ios::trunc);
+    out.write(magic, sizeof(magic));
+    writeNumber(out, to.size());
+
+    /// the first block of the base file with each checksum; later duplicates add nothing
+    std::unordered_map<uint32_t, std::size_t> blocks;
+    for (std::size_t offset = 0; offset + blockSize <= from.size(); offset += blockSize)
+    {
+        blocks.insert(std::make_pair(RollingChecksum(from.data() + offset, blockSize).value(), offset));
+    }
+
+    std::size_t literal = 0;
+    std::size_t position = 0;
+    if (!blocks.empty() && to.size() >= blockSize)
+    {
+        RollingChecksum checksum(to.data(), blockSize);
+        while (true)
+        {
+            auto block = blocks.find(checksum.value());
+            if (block != blocks.end() && std::memcmp(from.data() + block->second, to.data() + position, blockSize) == 0)
+            {
+                /// grow the match both ways, taking bytes back from the pending literal
+                std::size_t source = block->second;
+                std::size_t length = blockSize;
+                while (source > 0 && position > literal && from[source - 1] == to[position - 1])
+                {
+                    --source;
+                    --position;
+                    ++length;
+                }
+                while (source + length < from.size() && position + length < to.size() && from[source + length] == to[position + length])
+                {
+                    ++length;
+                }
+                writeAdd(out, to, literal, position);
+                out.put(static_cast<char>(Copy));
+                writeNumber(out, source);
+                writeNumber(out, length);
+                position += length;
+                literal = position;
+                if (position + blockSize > to.size())
+                {
+                    break;
+                }
+                checksum = RollingChecksum(to.data() + position, blockSize);
+                continue;
+            }
+            if (position + blockSize >= to.size())
+            {
+                break;
+            }
+            checksum.roll(to[position], to[position + blockSize]);
+            ++position;
+        }
+    }
+    writeAdd(out, to, literal, to.size());
+    out.put(static_cast<char>(End));
+    if (!out.flush())
+    {
+        throw std::runtime_error("unable to write delta " + delta);
+    }
+    return static_cast<uint64_t>(out.tellp());
+}
+
+std::string applyDelta(const std::string& base, const std::string& delta, const std::string& output, HashAlgorithm algorithm)
+{
+    auto fail = [&output](const std::string& reason) -> std::runtime_error
+    {
+        boost::system::error_code ignored;
+        boost::filesystem::remove(output, ignored);
+        return std::runtime_error(reason);
+    };
+    std::ifstream from(base, std::ios::binary);
+    if (!from)
+    {
+        throw std::runtime_error("unable to read " + base);
+    }
+    from.seekg(0, std::ios::end);
+    uint64_t baseSize = static_cast<uint64_t>(from.tellg());
+    std::ifstream in(delta, std::ios::binary);
+    char header[sizeof(magic)];
+    if (!in.read(header, sizeof(header)) || std::memcmp(header, magic, sizeof(magic)) != 0)
+    {
+        throw std::runtime_error("malformed delta: " + delta + " is not a delta");
+    }
+
+    auto hasher = Hasher::create(algorithm);
+    std::ofstream out(output, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        throw fail("unable to write " + output);
+    }
+    const std::size_t bufferSize = 64 * 1024;
+    std::unique_ptr<char[]> buffer(new char[bufferSize]);
+    try
+    {
+        uint64_t targetSize = readNumber(in);
+        uint64_t written = 0;
+        /// copies a range of either file to the output, never past the size the delta announced
+        auto transfer = [&](std::istream& source, uint64_t length, const std::string& truncated)
+        {
+            if (length > targetSize - written)
+            {
+                throw std::runtime_error("malformed delta: longer than its target");
+            }
+            written += length;
+            while (length > 0)
+            {
+                std::size_t chunk = static_cast<std::size_t>((std::min)(length, static_cast<uint64_t>(bufferSize)));
+                if (!source.read(buffer.get(), chunk))
+                {
+                    throw std::runtime_error(truncated);
+                }
+                hasher->update(reinterpret_cast<const unsigned char*>(buffer.get()), chunk);
+                out.write(buffer.get(), chunk);
+                length -= chunk;
+            }
+        };
+        for (int instruction = in.get(); instruction != End; instruction = in.get())
+        {
+            if (instruction == Copy)
+            {
+                uint64_t offset = readNumber(in);
+                uint64_t length = readNumber(in);
+                if (offset > baseSize || length > baseSize - offset)
+                {
+                    throw std::runtime_error("malformed delta: copies past the end of the base file");
+                }
+                from.clear();
+                from.seekg(static_cast<std::streamoff>(offset));
+                transfer(from, length, "unable to read " + base);
+            }
+            else if (instruction == Add)
+            {
+                transfer(in, readNumber(in), "malformed delta: truncated");
+            }
+            else
+            {
+                throw std::runtime_error("malformed delta: unknown instruction");
+            }
+        }
+        if (written != targetSize)
+        {
+            throw std::runtime_error("malformed delta: shorter than its target");
+        }
+        if (!out.flush())
+        {
+            throw std::runtime_error("unable to write " + output);
+        }
+    }
+    catch (const std::runtime_error& e)
+    {
+        out.close();
+        throw fail(e.what());
+    }
+    return hasher->digest();
+}
@@ -0,0 +1,62 @@
+#ifndef DELTA_HPP_INCLUDED
+#define DELTA_HPP_INCLUDED
+
+/// some microsoft compilers still benefit from the use of #pragma once
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Hashing.hpp"
+
+/**
+ * Writes a delta that turns one revision of a file into another.
+ *
+ * The delta is a list of instructions that either copy a range of the base
+ * file or add literal bytes, found by matching blocks of the base file
+ * against every offset of the target with a rolling checksum, so unchanged
+ * ranges are copied wherever they moved to.  Both files are read into
+ * memory; this is meant for whoever publishes the index, not for clients.
+ *
+ * @param base the revision clients already have
+ *
+ * @param target the revision the delta should produce
+ *
+ * @param delta the file to write the delta to
+ *
+ * @param blockSize the size of the blocks matched; smaller blocks find more
+ *        matches, at the cost of a larger index of the base file
+ *
+ * @return the size of the delta, in bytes
+ *
+ * @throws std::runtime_error if either file cannot be read, or the delta
+ *         cannot be written
+ *
+ */
+uint64_t createDelta(const std::string& base, const std::string& target, const std::string& delta, std::size_t blockSize = 64);
+
+/**
+ * Applies a delta written by createDelta, hashing the output as it is
+ * written so it never has to be read back.
+ *
+ * @param base the revision the delta was created from
+ *
+ * @param delta the delta to apply
+ *
+ * @param output the file to write the patched revision to; removed if the
+ *        delta cannot be applied
+ *
+ * @param algorithm the algorithm to hash the output with
+ *
+ * @return the digest of the output, as upper case hex
+ *
+ * @throws std::runtime_error if a file cannot be read or written, or the
+ *         delta is malformed or does not fit the base
+ *
+ */
+std::string applyDelta(const std::string& base, const std::string& delta, const std::string& output, HashAlgorithm algorithm);
+
+#endif
@@ -0,0 +1,316 @@
+#include "DirectoryWatcher.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#elif defined(__linux__)
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "Logging.hpp"
+
+struct DirectoryWatcher::DirectoryWatcherImpl
+{
+    std::string directory;
+
+    /// the names of the files changed since the dirty set was last taken
+    std::set<std::string> dirty;
+
+    /// whether changes may have been missed since the dirty set was last taken
+    bool rescan;
+
+    mutable std::mutex mutex;
+
+    std::atomic_bool running;
+
+    std::atomic_bool stopping;
+
+    std::thread thread;
+
+    void changed(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (!this->rescan)
+        {
+            this->dirty.insert(name);
+        }
+    }
+
+    /// once changes have been missed, the names collected so far are of no use
+    void overflowed()
+    {
+        FONTSYNC_LOG_TRIVIAL(debug) << "Changes to " << this->directory << " overflowed, its fonts will be rescanned...";
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->rescan = true;
+        this->dirty.clear();
+    }
+
+    void failed(const std::string& reason)
+    {
+        if (!this->stopping)
+        {
+            FONTSYNC_LOG_TRIVIAL(warning) << "Stopped watching " << this->directory << " for changes, its fonts will be rescanned every synchronization: " << reason;
+        }
+        this->running = false;
+        this->overflowed();
+    }
+
+    bool takeChanges(std::set<std::string>& changed)
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        changed.clear();
+        changed.swap(this->dirty);
+        bool complete = !this->rescan;
+        /// a stopped watch never catches up again
+        this->rescan = !this->running;
+        return complete;
+    }
+
+#if defined(_WIN32)
+    HANDLE handle;
+
+    /// signalled to interrupt the outstanding read when stopping
+    HANDLE wake;
+
+    static std::string errorString(DWORD error)
+    {
+        char* message = nullptr;
+        FormatMessageA(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS,
+            nullptr, error, 0, reinterpret_cast<char*>(&message), 0, nullptr);
+        std::string rv = message != nullptr ? message : "error " + std::to_string(error);
+        LocalFree(message);
+        return rv;
+    }
+
+    /// file names are reported as UTF-16, but fonts are handled with ANSI paths throughout
+    static std::string narrow(const WCHAR* name, int length)
+    {
+        int size = WideCharToMultiByte(CP_ACP, 0, name, length, nullptr, 0, nullptr, nullptr);
+        std::string rv(size, '\0');
+        WideCharToMultiByte(CP_ACP, 0, name, length, &rv[0], size, nullptr, nullptr);
+        return rv;
+    }
+
+    void start()
+    {
+        this->handle = CreateFileA(this->directory.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+        if (this->handle == INVALID_HANDLE_VALUE)
+        {
+            throw std::runtime_error("unable to watch " + this->directory + ": " + errorString(GetLastError()));
+        }
+        this->wake = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+        if (this->wake == nullptr)
+        {
+            CloseHandle(this->handle);
+            throw std::runtime_error("unable to watch " + this->directory + ": " + errorString(GetLastError()));
+        }
+    }
+
+    void watch()
+    {
+        OVERLAPPED overlapped = {};
+        overlapped.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+        /// DWORD aligned, as ReadDirectoryChangesW requires; it also sizes the buffer the system queues changes in
+        std::vector<DWORD> buffer(16 * 1024);
+        const DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_ATTRIBUTES | FILE_NOTIFY_CHANGE_CREATION;
+        while (!this->stopping)
+        {
+            ResetEvent(overlapped.hEvent);
+            if (!ReadDirectoryChangesW(this->handle, buffer.data(), static_cast<DWORD>(buffer.size() * sizeof(DWORD)), FALSE, filter, nullptr, &overlapped, nullptr))
+            {
+                this->failed(errorString(GetLastError()));
+                break;
+            }
+            HANDLE handles[] = { overlapped.hEvent, this->wake };
+            DWORD bytes = 0;
+            if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) != WAIT_OBJECT_0)
+            {
+                CancelIo(this->handle);
+                GetOverlappedResult(this->handle, &overlapped, &bytes, TRUE);
+                break;
+            }
+            if (!GetOverlappedResult(this->handle, &overlapped, &bytes, FALSE))
+            {
+                DWORD error = GetLastError();
+                if (error == ERROR_NOTIFY_ENUM_DIR)
+                {
+                    this->overflowed();
+                    continue;
+                }
+                this->failed(errorString(error));
+                break;
+            }
+            /// nothing returned means the system's own buffer overflowed
+            if (bytes == 0)
+            {
+                this->overflowed();
+                continue;
+            }
+            auto info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(buffer.data());
+            for (;;)
+            {
+                this->changed(narrow(info->FileName, static_cast<int>(info->FileNameLength / sizeof(WCHAR))));
+                if (info->NextEntryOffset == 0)
+                {
+                    break;
+                }
+                info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(reinterpret_cast<const char*>(info) + info->NextEntryOffset);
+            }
+        }
+        CloseHandle(overlapped.hEvent);
+    }
+
+    void interrupt()
+    {
+        SetEvent(this->wake);
+    }
+
+    void close()
+    {
+        CloseHandle(this->wake);
+        CloseHandle(this->handle);
+    }
+#elif defined(__linux__)
+    int descriptor;
+
+    void start()
+    {
+        this->descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (this->descriptor < 0)
+        {
+            throw std::runtime_error("unable to watch " + this->directory + ": " + std::strerror(errno));
+        }
+        const uint32_t events = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO |
+            IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+        if (inotify_add_watch(this->descriptor, this->directory.c_str(), events) < 0)
+        {
+            int error = errno;
+            ::close(this->descriptor);
+            throw std::runtime_error("unable to watch " + this->directory + ": " + std::strerror(error));
+        }
+    }
+
+    void watch()
+    {
+        std::vector<char> buffer(64 * 1024);
+        while (!this->stopping)
+        {
+            /// wakes up regularly to notice it is being stopped
+            pollfd ready = { this->descriptor, POLLIN, 0 };
+            int polled = poll(&ready, 1, 100);
+            if (polled < 0 && errno != EINTR)
+            {
+                this->failed(std::strerror(errno));
+                break;
+            }
+            if (polled <= 0)
+            {
+                continue;
+            }
+            ssize_t bytes = read(this->descriptor, buffer.data(), buffer.size());
+            if (bytes < 0)
+            {
+                if (errno == EAGAIN || errno == EINTR)
+                {
+                    continue;
+                }
+                this->failed(std::strerror(errno));
+                break;
+            }
+            for (ssize_t offset = 0; offset < bytes; )
+            {
+                inotify_event event;
+                std::memcpy(&event, buffer.data() + offset, sizeof(event));
+                if (event.mask & IN_Q_OVERFLOW)
+                {
+                    this->overflowed();
+                }
+                else if (event.mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+                {
+                    this->failed("the directory was removed");
+                    return;
+                }
+                else if (event.len > 0)
+                {
+                    this->changed(std::string(buffer.data() + offset + sizeof(event)));
+                }
+                offset += sizeof(event) + event.len;
+            }
+        }
+    }
+
+    void interrupt()
+    {
+
+    }
+
+    void close()
+    {
+        ::close(this->descriptor);
+    }
+#else
+    void start()
+    {
+        throw std::runtime_error("watching directories is not supported on this platform");
+    }
+
+    void watch()
+    {
+
+    }
+
+    void interrupt()
+    {
+
+    }
+
+    void close()
+    {
+
+    }
+#endif
+
+    DirectoryWatcherImpl(const std::string& directory) : directory(directory), rescan(true), running(true), stopping(false)
+    {
+        this->start();
+        this->thread = std::thread([this]() { this->watch(); });
+    }
+
+    ~DirectoryWatcherImpl()
+    {
+        this->stopping = true;
+        this->interrupt();
+        this->thread.join();
+        this->close();
+    }
+};
+
+DirectoryWatcher::DirectoryWatcher(const std::string& directory) : impl(new DirectoryWatcherImpl(directory))
+{
+
+}
+
+bool DirectoryWatcher::takeChanges(std::set<std::string>& changed)
+{
+    return this->impl->takeChanges(changed);
+}
+
+bool DirectoryWatcher::watching() const
+{
+    return this->impl->running;
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+
+}
@@ -0,0 +1,75 @@
+#ifndef DIRECTORY_WATCHER_HPP_INCLUDED
+#define DIRECTORY_WATCHER_HPP_INCLUDED
+
+/// some microsoft compilers still benefit from the use of #pragma once
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif
+
+#include <memory>
+#include <set>
+#include <string>
+
+/**
+ * Watches a directory for changes to the files directly inside it.
+ *
+ * Changes are collected on a background thread, using ReadDirectoryChangesW
+ * on Windows and inotify on Linux, into a set of dirty file names that is
+ * drained by whoever acts on them.  Whenever changes may have been missed,
+ * because the notifications overflowed or the watch failed, the watcher
+ * reports that everything must be rescanned instead; it does the same
+ * before its first notification, since nothing is known about the files
+ * that were changed before it started.
+ *
+ */
+class DirectoryWatcher
+{
+    /// Private Implementation
+    struct DirectoryWatcherImpl;
+
+    /// Private Implementation
+    std::unique_ptr<DirectoryWatcherImpl> impl;
+
+public:
+
+    /**
+     * Starts watching the provided directory.
+     *
+     * @param directory the directory to watch
+     *
+     * @throws std::runtime_error if the directory cannot be watched, or
+     *         watching is not supported on this platform
+     *
+     */
+    explicit DirectoryWatcher(const std::string& directory);
+
+    /**
+     * Takes the names of the files changed since the last call, leaving the
+     * set of dirty files empty.
+     *
+     * @param changed receives the names (not paths) of the changed files
+     *
+     * @return true if changed holds every change, false if changes were
+     *         missed and every file must be rescanned
+     *
+     */
+    bool takeChanges(std::set<std::string>& changed);
+
+    /**
+     * Retrieves whether the watch is still running; a watch whose directory
+     * is removed or whose handle fails stops, and reports every call to
+     * takeChanges as a rescan from then on.
+     *
+     * @return true while changes are being collected
+     *
+     */
+    bool watching() const;
+
+    /**
+     * Destructor, stops watching.
+     *
+     */
+    ~DirectoryWatcher();
+};
+
+#endif
@@ -0,0 +1,559 @@
+#include "FileReader.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+
+#include <boost/algorithm/string/predicate.hpp>
+
+#if defined(_WIN32)
+# ifndef WIN32_LEAN_AND_MEAN
+#  define WIN32_LEAN_AND_MEAN
+# endif
+# include <Windows.h>
+#else
+# include <cerrno>
+# include <cstdlib>
+
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+namespace
+{
+    std::atomic<int> defaultBackend { static_cast<int>(IOBackend::Buffered) };
+
+    /// large enough to amortize the per-read cost, small enough that a batch
+    /// of files being hashed side by side stays within a few megabytes
+    const std::size_t chunkSize = 256 * 1024;
+
+    /// the number of reads the overlapped backend keeps in flight
+    const std::size_t readsInFlight = 4;
+
+    /// the size of each view of a mapped file; a multiple of every allocation granularity
+    const uint64_t viewSize = 64 * 1024 * 1024;
+
+#if defined(_WIN32)
+    /// a page aligned buffer, as unbuffered and overlapped reads prefer
+    struct AlignedBuffer
+    {
+        unsigned char* data;
+
+        explicit AlignedBuffer(std::size_t size) : data(static_cast<unsigned char*>(VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE)))
+        {
+            if (this->data == NULL)
+            {
+                throw std::runtime_error("unable to allocate a read buffer");
+            }
+        }
+
+        ~AlignedBuffer()
+        {
+            VirtualFree(this->data, 0, MEM_RELEASE);
+        }
+
+    private:
+
+        AlignedBuffer(const AlignedBuffer&);
+        AlignedBuffer& operator=(const AlignedBuffer&);
+    };
+
+    /// an open file handle
+    struct File
+    {
+        HANDLE handle;
+
+        File(const std::string& file, DWORD flags) :
+            handle(CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags, NULL))
+        {
+            if (this->handle == INVALID_HANDLE_VALUE)
+            {
+                throw std::runtime_error("unable to open " + file);
+            }
+        }
+
+        uint64_t size() const
+        {
+            LARGE_INTEGER size;
+            return GetFileSizeEx(this->handle, &size) ? static_cast<uint64_t>(size.QuadPart) : 0;
+        }
+
+        ~File()
+        {
+            CloseHandle(this->handle);
+        }
+
+    private:
+
+        File(const File&);
+        File& operator=(const File&);
+    };
+
+    class BufferedReader : public FileReader
+    {
+        std::string name;
+        File file;
+        AlignedBuffer buffer;
+
+    public:
+
+        explicit BufferedReader(const std::string& file) : name(file), file(file, FILE_FLAG_SEQUENTIAL_SCAN), buffer(chunkSize)
+        {
+
+        }
+
+        bool next(const unsigned char*& data, std::size_t& size)
+        {
+            DWORD read = 0;
+            if (!ReadFile(this->file.handle, this->buffer.data, static_cast<DWORD>(chunkSize), &read, NULL))
+            {
+                throw std::runtime_error("error reading " + this->name);
+            }
+            data = this->buffer.data;
+            size = read;
+            return read > 0;
+        }
+    };
+
+    class MappedReader : public FileReader
+    {
+        File file;
+        HANDLE mapping;
+        uint64_t size;
+        uint64_t offset;
+        void* view;
+
+        void unmap()
+        {
+            if (this->view != NULL)
+            {
+                UnmapViewOfFile(this->view);
+                this->view = NULL;
+            }
+        }
+
+    public:
+
+        explicit MappedReader(const std::string& file) : file(file, FILE_FLAG_SEQUENTIAL_SCAN), mapping(NULL), size(this->file.size()), offset(0), view(NULL)
+        {
+            /// empty files cannot be mapped, and have nothing to read anyway
+            if (this->size > 0)
+            {
+                this->mapping = CreateFileMappingA(this->file.handle, NULL, PAGE_READONLY, 0, 0, NULL);
+                if (this->mapping == NULL)
+                {
+                    throw std::runtime_error("unable to map " + file);
+                }
+            }
+        }
+
+        bool next(const unsigned char*& data, std::size_t& size)
+        {
+            this->unmap();
+            if (this->offset >= this->size)
+            {
+                return false;
+            }
+            auto length = static_cast<std::size_t>((std::min)(viewSize, this->size - this->offset));
+            this->view = MapViewOfFile(this->mapping, FILE_MAP_READ, static_cast<DWORD>(this->offset >> 32), static_cast<DWORD>(this->offset), length);
+            if (this->view == NULL)
+            {
+                throw std::runtime_error("error mapping a view of a file");
+            }
+            data = static_cast<const unsigned char*>(this->view);
+            size = length;
+            this->offset += length;
+            return true;
+        }
+
+        ~MappedReader()
+        {
+            this->unmap();
+            if (this->mapping != NULL)
+            {
+                CloseHandle(this->mapping);
+            }
+        }
+    };
+
+    class OverlappedReader : public FileReader
+    {
+        struct Slot
+        {
+            OVERLAPPED overlapped;
+            bool pending;
+        };
+
+        std::string name;
+        File file;
+        AlignedBuffer buffer;
+        Slot slots[readsInFlight];
+        uint64_t nextOffset;
+        std::size_t current;
+        bool started;
+
+        unsigned char* slotData(std::size_t slot)
+        {
+            return this->buffer.data + slot * chunkSize;
+        }
+
+        void issue(std::size_t slot)
+        {
+            Slot& s = this->slots[slot];
+            ResetEvent(s.overlapped.hEvent);
+            s.overlapped.Offset = static_cast<DWORD>(this->nextOffset);
+            s.overlapped.OffsetHigh = static_cast<DWORD>(this->nextOffset >> 32);
+            this->nextOffset += chunkSize;
+            s.pending = true;
+            if (!ReadFile(this->file.handle, this->slotData(slot), static_cast<DWORD>(chunkSize), NULL, &s.overlapped))
+            {
+                DWORD error = GetLastError();
+                if (error == ERROR_HANDLE_EOF)
+                {
+                    s.pending = false;
+                }
+                else if (error != ERROR_IO_PENDING)
+                {
+                    s.pending = false;
+                    throw std::runtime_error("error reading " + this->name);
+                }
+            }
+        }
+
+    public:
+
+        explicit OverlappedReader(const std::string& file) :
+            name(file),
+            file(file, FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN),
+            buffer(chunkSize * readsInFlight),
+            nextOffset(0),
+            current(0),
+            started(false)
+        {
+            for (auto& slot : this->slots)
+            {
+                ZeroMemory(&slot.overlapped, sizeof(slot.overlapped));
+                slot.pending = false;
+                slot.overlapped.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+                if (slot.overlapped.hEvent == NULL)
+                {
+                    throw std::runtime_error("unable to create an I/O event");
+                }
+            }
+        }
+
+        bool next(const unsigned char*& data, std::size_t& size)
+        {
+            if (!this->started)
+            {
+                for (std::size_t slot = 0; slot < readsInFlight; ++slot)
+                {
+                    this->issue(slot);
+                }
+                this->started = true;
+            }
+            else
+            {
+                /// the previous chunk has been consumed; reuse its slot for the next read
+                this->issue(this->current);
+                this->current = (this->current + 1) % readsInFlight;
+            }
+            Slot& slot = this->slots[this->current];
+            if (!slot.pending)
+            {
+                return false;
+            }
+            DWORD read = 0;
+            slot.pending = false;
+            if (!GetOverlappedResult(this->file.handle, &slot.overlapped, &read, TRUE) && GetLastError() != ERROR_HANDLE_EOF)
+            {
+                throw std::runtime_error("error reading " + this->name);
+            }
+            data = this->slotData(this->current);
+            size = read;
+            return read > 0;
+        }
+
+        ~OverlappedReader()
+        {
+            CancelIo(this->file.handle);
+            for (auto& slot : this->slots)
+            {
+                if (slot.pending)
+                {
+                    DWORD read;
+                    GetOverlappedResult(this->file.handle, &slot.overlapped, &read, TRUE);
+                }
+                CloseHandle(slot.overlapped.hEvent);
+            }
+        }
+    };
+#else
+    struct AlignedBuffer
+    {
+        unsigned char* data;
+
+        explicit AlignedBuffer(std::size_t size) : data(NULL)
+        {
+            void* memory = NULL;
+            if (posix_memalign(&memory, 4096, size) != 0)
+            {
+                throw std::runtime_error("unable to allocate a read buffer");
+            }
+            this->data = static_cast<unsigned char*>(memory);
+        }
+
+        ~AlignedBuffer()
+        {
+            free(this->data);
+        }
+
+    private:
+
+        AlignedBuffer(const AlignedBuffer&);
+        AlignedBuffer& operator=(const AlignedBuffer&);
+    };
+
+    struct File
+    {
+        int descriptor;
+
+        File(const std::string& file) : descriptor(::open(file.c_str(), O_RDONLY))
+        {
+            if (this->descriptor < 0)
+            {
+                throw std::runtime_error("unable to open " + file);
+            }
+            posix_fadvise(this->descriptor, 0, 0, POSIX_FADV_SEQUENTIAL);
+        }
+
+        uint64_t size() const
+        {
+            struct stat status;
+            return fstat(this->descriptor, &status) == 0 ? static_cast<uint64_t>(status.st_size) : 0;
+        }
+
+        ~File()
+        {
+            ::close(this->descriptor);
+        }
+
+    private:
+
+        File(const File&);
+        File& operator=(const File&);
+    };
+
+    /// with readAhead set, the chunks after the current one are requested before they are needed
+    class BufferedReader : public FileReader
+    {
+        std::string name;
+        File file;
+        AlignedBuffer buffer;
+        uint64_t offset;
+        bool readAhead;
+
+    public:
+
+        BufferedReader(const std::string& file, bool readAhead = false) : name(file), file(file), buffer(chunkSize), offset(0), readAhead(readAhead)
+        {
+
+        }
+
+        bool next(const unsigned char*& data, std::size_t& size)
+        {
+            if (this->readAhead)
+            {
+                posix_fadvise(this->file.descriptor, static_cast<off_t>(this->offset + chunkSize), static_cast<off_t>(chunkSize * readsInFlight), POSIX_FADV_WILLNEED);
+            }
+            ssize_t read;
+            do
+            {
+                read = ::read(this->file.descriptor, this->buffer.data, chunkSize);
+            } while (read < 0 && errno == EINTR);
+            if (read < 0)
+            {
+                throw std::runtime_error("error reading " + this->name);
+            }
+            data = this->buffer.data;
+            size = static_cast<std::size_t>(read);
+            this->offset += size;
+            return read > 0;
+        }
+    };
+
+    class MappedReader : public FileReader
+    {
+        File file;
+        uint64_t size;
+        uint64_t offset;
+        void* view;
+        std::size_t length;
+
+        void unmap()
+        {
+            if (this->view != NULL)
+            {
+                munmap(this->view, this->length);
+                this->view = NULL;
+            }
+        }
+
+    public:
+
+        explicit MappedReader(const std::string& file) : file(file), size(this->file.size()), offset(0), view(NULL), length(0)
+        {
+
+        }
+
+        bool next(const unsigned char*& data, std::size_t& size)
+        {
+            this->unmap();
+            if (this->offset >= this->size)
+            {
+                return false;
+            }
+            this->length = static_cast<std::size_t>((std::min)(viewSize, this->size - this->offset));
+            void* view = mmap(NULL, this->length, PROT_READ, MAP_PRIVATE, this->file.descriptor, static_cast<off_t>(this->offset));
+            if (view == MAP_FAILED)
+            {
+                throw std::runtime_error("error mapping a view of a file");
+            }
+            this->view = view;
+            madvise(this->view, this->length, MADV_SEQUENTIAL);
+            data = static_cast<const unsigned char*>(this->view);
+            size = this->length;
+            this->offset += this->length;
+            return true;
+        }
+
+        ~MappedReader()
+        {
+            this->unmap();
+        }
+    };
+
+    class OverlappedReader : public BufferedReader
+    {
+    public:
+
+        explicit OverlappedReader(const std::string& file) : BufferedReader(file, true)
+        {
+
+        }
+    };
+#endif
+
+    /// reads the whole file, returning the number of bytes read
+    uint64_t drain(const std::string& file, IOBackend backend)
+    {
+        auto reader = FileReader::open(file, backend);
+        const unsigned char* data;
+        std::size_t size;
+        uint64_t total = 0;
+        while (reader->next(data, size))
+        {
+            total += size;
+        }
+        return total;
+    }
+}
+
+IOBackend parseIOBackend(const std::string& name)
+{
+    if (boost::algorithm::iequals(name, "buffered"))
+    {
+        return IOBackend::Buffered;
+    }
+    if (boost::algorithm::iequals(name, "mapped"))
+    {
+        return IOBackend::Mapped;
+    }
+    if (boost::algorithm::iequals(name, "overlapped"))
+    {
+        return IOBackend::Overlapped;
+    }
+    throw std::invalid_argument("unknown I/O backend: " + name);
+}
+
+const char* toString(IOBackend backend)
+{
+    switch (backend)
+    {
+    case IOBackend::Mapped:
+        return "mapped";
+    case IOBackend::Overlapped:
+        return "overlapped";
+    case IOBackend::Buffered:
+    default:
+        return "buffered";
+    }
+}
+
+IOBackend defaultIOBackend()
+{
+    return static_cast<IOBackend>(defaultBackend.load());
+}
+
+void setDefaultIOBackend(IOBackend backend)
+{
+    defaultBackend = static_cast<int>(backend);
+}
+
+IOBackend selectIOBackend(const std::vector<std::string>& sample)
+{
+    const IOBackend backends[] = { IOBackend::Buffered, IOBackend::Mapped, IOBackend::Overlapped };
+    const std::size_t count = sizeof(backends) / sizeof(backends[0]);
+    uint64_t bytes[count] = {};
+    double seconds[count] = {};
+    for (std::size_t i = 0; i < sample.size(); ++i)
+    {
+        std::size_t backend = i % count;
+        try
+        {
+            auto start = std::chrono::steady_clock::now();
+            bytes[backend] += drain(sample[i], backends[backend]);
+            seconds[backend] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        catch (const std::runtime_error&)
+        {
+            /// unreadable files say nothing about the storage
+        }
+    }
+    std::size_t best = 0;
+    for (std::size_t backend = 0; backend < count; ++backend)
+    {
+        if (bytes[backend] == 0 || seconds[backend] <= 0)
+        {
+            return IOBackend::Buffered;
+        }
+        if (bytes[backend] / seconds[backend] > bytes[best] / seconds[best])
+        {
+            best = backend;
+        }
+    }
+    return backends[best];
+}
+
+std::unique_ptr<FileReader> FileReader::open(const std::string& file, IOBackend backend)
+{
+    switch (backend)
+    {
+    case IOBackend::Mapped:
+        return std::unique_ptr<FileReader>(new MappedReader(file));
+    case IOBackend::Overlapped:
+        return std::unique_ptr<FileReader>(new OverlappedReader(file));
+    case IOBackend::Buffered:
+    default:
+        return std::unique_ptr<FileReader>(new BufferedReader(file));
+    }
+}
+
+FileReader::~FileReader()
+{
+
+}
@@ -0,0 +1,129 @@
+#ifndef FILE_READER_HPP_INCLUDED
+#define FILE_READER_HPP_INCLUDED
+
+/// some microsoft compilers still benefit from the use of #pragma once
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * The ways a file can be read for hashing.
+ *
+ */
+enum class IOBackend
+{
+    /// large, aligned, sequential reads, one at a time
+    Buffered,
+
+    /// the whole file mapped into memory, with sequential read-ahead hinted
+    Mapped,
+
+    /// several large reads kept in flight at once (overlapped I/O on windows)
+    Overlapped
+};
+
+/**
+ * Looks up an I/O backend by its configuration name ("buffered", "mapped"
+ * or "overlapped").
+ *
+ * @param name the configuration name of the backend
+ *
+ * @return the named backend
+ *
+ * @throws std::invalid_argument if no such backend exists
+ *
+ */
+IOBackend parseIOBackend(const std::string& name);
+
+/**
+ * Retrieves the configuration name of the provided backend.
+ *
+ * @param backend the backend to name
+ *
+ * @return the configuration name of the provided backend
+ *
+ */
+const char* toString(IOBackend backend);
+
+/**
+ * Retrieves the backend files are read with unless another one is requested.
+ *
+ * @return the default backend
+ *
+ */
+IOBackend defaultIOBackend();
+
+/**
+ * Changes the backend files are read with unless another one is requested.
+ *
+ * @param backend the new default backend
+ *
+ */
+void setDefaultIOBackend(IOBackend backend);
+
+/**
+ * Measures each backend on the provided files and picks the fastest.
+ *
+ * Every backend reads a different share of the files, so a backend never
+ * benefits from another one having warmed the cache.  The result is only as
+ * representative as the sample; it should be taken from the storage that is
+ * going to be hashed, before anything else reads or is reading it.
+ *
+ * @param sample the files to measure with
+ *
+ * @return the backend with the highest throughput, or the buffered backend
+ *         if the sample is too small to tell
+ *
+ */
+IOBackend selectIOBackend(const std::vector<std::string>& sample);
+
+/**
+ * Reads a file from start to end in chunks.
+ *
+ */
+class FileReader
+{
+public:
+
+    /**
+     * Opens the provided file.
+     *
+     * @param file the file to read
+     *
+     * @param backend the backend to read the file with
+     *
+     * @return a reader positioned at the start of the provided file
+     *
+     * @throws std::runtime_error if the file cannot be opened
+     *
+     */
+    static std::unique_ptr<FileReader> open(const std::string& file, IOBackend backend = defaultIOBackend());
+
+    /**
+     * Retrieves the next chunk of the file.  The chunk stays valid until the
+     * next call.
+     *
+     * @param data receives the start of the chunk
+     *
+     * @param size receives the size of the chunk
+     *
+     * @return true if a chunk was retrieved, false at the end of the file
+     *
+     * @throws std::runtime_error if the file cannot be read
+     *
+     */
+    virtual bool next(const unsigned char*& data, std::size_t& size) = 0;
+
+    /**
+     * Virtual Destructor
+     *
+     */
+    virtual ~FileReader();
+};
+
+#endif
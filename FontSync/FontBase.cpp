@@ -1,58 +1,62 @@
 #include "FontBase.hpp"
 
-struct FontBase::FontBaseImpl
-{
-	std::string name;
-	std::string category;
-	std::string type;
-
-	FontBaseImpl(const std::string& name,
-		         const std::string& category,
-		         const std::string& type) :
-		name(name),
-		category(category),
-		type(type)
-	{
+#include <utility>
 
-	}
-};
+#include "StringPool.hpp"
 
 FontBase::FontBase(const std::string& name,
 	               const std::string& category,
     	           const std::string& type) : 
-	impl(new FontBaseImpl(name, category, type))
+	name(name),
+	category(&StringPool::intern(category)),
+	type(&StringPool::intern(type))
 {
 
 }
 
-FontBase::FontBase(const FontBase& other) : impl(new FontBaseImpl(other.impl->name,
-											                      other.impl->category,
-																  other.impl->type))
+FontBase::FontBase(const FontBase& other) : name(other.name),
+											category(other.category),
+											type(other.type)
 {
 
 }
 
 FontBase& FontBase::operator=(const FontBase& other)
 {
-	this->impl->name = other.impl->name;
-	this->impl->category = other.impl->category;
-	this->impl->type = other.impl->type;
+	this->name = other.name;
+	this->category = other.category;
+	this->type = other.type;
+	return *this;
+}
+
+FontBase::FontBase(FontBase&& other) BOOST_NOEXCEPT : name(std::move(other.name)),
+									   category(other.category),
+									   type(other.type)
+{
+
+}
+
+FontBase& FontBase::operator=(FontBase&& other) BOOST_NOEXCEPT
+{
+	this->name = std::move(other.name);
+	this->category = other.category;
+	this->type = other.type;
 	return *this;
 }
 
 const std::string& FontBase::getName() const
 {
-	return this->impl->name;
+	return this->name;
 }
 
 const std::string& FontBase::getCategory() const
 {
-	return this->impl->category;
+	return *this->category;
 }
 
 const std::string& FontBase::getType() const
 {
-	return this->impl->type;
+	return *this->type;
 }
 
 FontBase::~FontBase()
@@ -6,20 +6,30 @@
 # pragma once
 #endif
 
-#include <memory>
 #include <string>
 
+#include <boost/config.hpp>
+
+#include "Hashing.hpp"
+
 /**
  * Parent class to both local and remote fonts.
  *
+ * Fonts are small value types: the fields are held inline rather than behind
+ * a private implementation, and the category and type are interned since
+ * they are shared by many fonts.
+ *
  */
 class FontBase
 {
-	/// Private Implementation
-	struct FontBaseImpl;
+	/// the name of this font
+	std::string name;
 
-	/// Private Implementation
-	std::unique_ptr<FontBaseImpl> impl;
+	/// the (interned) category of this font
+	const std::string* category;
+
+	/// the (interned) type of this font
+	const std::string* type;
     
 protected:
 	
@@ -51,6 +61,18 @@ public:
 	 */
 	FontBase& operator=(const FontBase&);
 
+	/**
+	 * Move Constructor
+	 *
+	 */
+	FontBase(FontBase&&) BOOST_NOEXCEPT;
+
+	/**
+	 * Move Assignment
+	 *
+	 */
+	FontBase& operator=(FontBase&&) BOOST_NOEXCEPT;
+
 	/**
 	* Retrieves the name of this font
 	*
@@ -76,12 +98,20 @@ public:
 	const std::string& getType() const;
 
 	/**
-	 * Retrieves the MD5 hash of this font
+	 * Retrieves the content hash of this font
+	 * 
+	 * @return the content hash of this font, as hex
+	 *
+	 */
+	virtual const std::string& getHash() const = 0;
+
+	/**
+	 * Retrieves the algorithm that produced the content hash of this font
 	 * 
-	 * @return the MD5 hash of this font
+	 * @return the algorithm that produced the content hash of this font
 	 *
 	 */
-	virtual const std::string& getMD5() const = 0;
+	virtual HashAlgorithm getHashAlgorithm() const = 0;
 
 	/**
 	 * Virtual Destructor
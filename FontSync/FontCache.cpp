@@ -1,162 +1,791 @@
 #include "FontCache.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <set>
 #include <sstream>
+#include <thread>
+#include <unordered_map>
 
 #include <Windows.h>
 #include <wingdi.h>
 
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
 
+#include "Delta.hpp"
+#include "DirectoryWatcher.hpp"
 #include "Logging.hpp"
+#include "Pipeline.hpp"
+#include "Sfnt.hpp"
+#include "SortedKeys.hpp"
+#include "StartupManifest.hpp"
 #include "Utilities.hpp"
 
 struct FontCache::FontCacheImpl
 {
     std::string fontDirectory;
-    std::vector<LocalFont> cache;
+    /// a font this cache registered with GDI, and how many references to it this cache holds
+    struct Registration
+    {
+        LocalFont font;
+        unsigned references;
+    };
+    /// everything this cache registered with GDI, keyed by local file; shutdown
+    /// unregisters from here, so it never has to read the disk
+    std::map<std::string, Registration> ledger;
     unsigned int failedDownloadRetryDelay;
     unsigned int failedDownloadRetryAttempts;
+    unsigned int fetchWorkers;
+    unsigned int verifyWorkers;
+    unsigned int queueDepth;
+    uint64_t memoryBudget;
+    HashCache hashCache;
+    /// reports changes to the font directory, so unchanged fonts are trusted without being looked at
+    std::unique_ptr<DirectoryWatcher> watcher;
+    /// whether every font must be looked at again, because changes to them may have been missed
+    bool rescan;
+    /// the keys of the fonts the running synchronization installed or removed; the watcher reports
+    /// those writes too, but their digests were recorded as they were made
+    std::set<std::string> written;
+    /// the names of fonts changed by others since the last synchronization drained the watcher
+    std::set<std::string> localChanges;
+    FontFilter filter;
+    std::shared_ptr<MirrorSet> mirrors;
+    std::thread verifier;
+    std::atomic_bool stopping;
+    /// abandons a synchronization's waits when the service is stopping
+    std::function<bool()> cancelled;
+
+    /// persists recorded digests; failing to do so only costs a re-hash later
+    void persistHashes()
+    {
+        try
+        {
+            this->hashCache.flush();
+        }
+        catch (const std::runtime_error& e)
+        {
+            FONTSYNC_LOG_TRIVIAL(warning) << e.what();
+        }
+    }
+
+    /// registers the provided font with GDI, recording the reference in the ledger
+    bool registerFont(const LocalFont& font)
+    {
+        if (AddFontResourceA(font.getLocalFile().c_str()) == 0)
+        {
+            return false;
+        }
+        auto entry = this->ledger.find(font.getLocalFile());
+        if (entry == this->ledger.end())
+        {
+            Registration registration = { font, 1 };
+            this->ledger.insert(std::make_pair(font.getLocalFile(), registration));
+        }
+        else
+        {
+            ++entry->second.references;
+        }
+        return true;
+    }
+
+    /// releases every reference the ledger holds to the provided file
+    void unregisterFont(const std::string& localFile)
+    {
+        auto entry = this->ledger.find(localFile);
+        if (entry == this->ledger.end())
+        {
+            return;
+        }
+        for (unsigned i = 0; i < entry->second.references; ++i)
+        {
+            if (RemoveFontResourceA(localFile.c_str()) == 0)
+            {
+                FONTSYNC_LOG_TRIVIAL(warning) << "Failed to unload managed font: " << localFile << "[" << errorString(GetLastError()) << "]...";
+                break;
+            }
+        }
+        this->ledger.erase(entry);
+    }
+
+    std::string localFileFor(const RemoteFont& font) const
+    {
+        return this->fontDirectory + '\\' + font.getRemoteFile().substr(font.getRemoteFile().find_last_of("/\\") + 1);
+    }
+
+    /// the key a font is tracked by between synchronizations: its file name, so fonts are always
+    /// looked for in the current font directory, case-folded like the file system folds it
+    static std::string keyFor(const std::string& file)
+    {
+        return boost::algorithm::to_lower_copy(file.substr(file.find_last_of("/\\") + 1));
+    }
+
+    /// unloads and deletes an installed font that is no longer listed or subscribed to
+    void removeOrphan(const std::string& localFile)
+    {
+        try
+        {
+            if (boost::filesystem::exists(localFile))
+            {
+                FONTSYNC_LOG_TRIVIAL(trace) << 
+                    "Removing orphaned font: " << localFile << "...";
+                int refs = 0;
+                while (RemoveFontResource(localFile.c_str()))
+                {
+                    refs++;
+                }
+                FONTSYNC_LOG_TRIVIAL(trace) << "Removed " << 
+                    refs << " references to " << localFile << "...";
+                this->ledger.erase(localFile);
+                boost::filesystem::remove(localFile);
+                this->hashCache.forget(localFile);
+                this->written.insert(keyFor(localFile));
+                FONTSYNC_LOG_TRIVIAL(trace) << "Deleted local font " << 
+                    localFile << " from the filesystem...";
+            }
+        }
+        catch (const boost::filesystem::filesystem_error& e)
+        {
+            FONTSYNC_LOG_TRIVIAL(warning) << "Failed to remove orphaned font: " << 
+                localFile << "[" << e.what() << "]...";
+        }
+    }
+
+    /// the sorted keys of the fonts managed before the first synchronization
+    /// that tracked them are built from the committed index, once
+    void ensureManagedKeys(const std::string& keysFile)
+    {
+        if (boost::filesystem::exists(keysFile) || !boost::filesystem::exists(getLocalCacheIndexPath()))
+        {
+            return;
+        }
+        FONTSYNC_LOG_TRIVIAL(info) << "Sorting the fonts listed by the local index...";
+        KeySorter previous(keysFile + ".run", this->memoryBudget / 4);
+        for (const auto& file : getManagedFiles(this->fontDirectory))
+        {
+            previous.add(keyFor(file));
+        }
+        previous.finish(keysFile);
+    }
 
-    void deleteOrphans(const std::vector<RemoteFont>& remoteFonts)
+    /// fonts that were managed before, but are not listed (or subscribed to) any more, are orphans;
+    /// both sides are sorted, so they are found in a single merge without holding either in memory
+    void deleteOrphans(const std::string& previousKeys, const std::string& currentKeys)
     {
         FONTSYNC_LOG_TRIVIAL(trace) << "Deleting orphaned fonts...";
-        if (boost::filesystem::exists(getLocalCacheIndexPath()))
+        forEachMissing(previousKeys, currentKeys, [this](const std::string& key)
+        {
+            this->removeOrphan(this->fontDirectory + '\\' + key);
+        });
+    }
+
+    /// whether a reported change is to a file synchronization itself stages fonts or deltas in
+    static bool stagingFile(const std::string& name)
+    {
+        return boost::algorithm::iends_with(name, ".part") || boost::algorithm::iends_with(name, ".delta");
+    }
+
+    /// moves what the watcher reported into the local changes, leaving out staging files and the
+    /// fonts the running synchronization wrote itself; returns false if changes were missed
+    bool drainWatcher()
+    {
+        std::set<std::string> changed;
+        if (!this->watcher || !this->watcher->takeChanges(changed))
+        {
+            return false;
+        }
+        for (const auto& name : changed)
+        {
+            if (!stagingFile(name) && this->written.count(keyFor(name)) == 0)
+            {
+                this->localChanges.insert(name);
+            }
+        }
+        return true;
+    }
+
+    /// trusts the recorded digests of fonts the watcher has not seen change; until a synchronization has
+    /// looked at every font since changes were last missed, none are trusted
+    void takeLocalChanges()
+    {
+        this->written.clear();
+        if (!this->drainWatcher())
+        {
+            this->rescan = true;
+        }
+        if (this->rescan)
+        {
+            FONTSYNC_LOG_TRIVIAL(debug) << "Checking every managed font for local changes...";
+            this->hashCache.setTrusting(false);
+            this->localChanges.clear();
+            return;
+        }
+        FONTSYNC_LOG_TRIVIAL(debug) << this->localChanges.size() << " file(s) changed locally since the last synchronization...";
+        this->hashCache.setTrusting(true);
+        for (const auto& name : this->localChanges)
+        {
+            this->hashCache.suspect(this->fontDirectory + '\\' + name);
+        }
+        this->localChanges.clear();
+    }
+
+    void setWatching(bool watching)
+    {
+        if (!watching)
+        {
+            this->watcher.reset();
+            return;
+        }
+        if (this->watcher && this->watcher->watching())
         {
-            auto installedFonts = 
-                getManagedFonts(this->fontDirectory);
-            for (const auto& font : installedFonts)
+            return;
+        }
+        try
+        {
+            this->watcher.reset(new DirectoryWatcher(this->fontDirectory));
+        }
+        catch (const std::runtime_error& e)
+        {
+            this->watcher.reset();
+            FONTSYNC_LOG_TRIVIAL(warning) << "Managed fonts will be checked for local changes every synchronization: " << e.what();
+        }
+    }
+
+    /// a font on its way through the synchronization pipeline
+    struct SyncItem
+    {
+        const RemoteFont* font = nullptr;
+        std::string localFile;
+        std::string stagingFile;
+        /// the digest of the revision installed now, if any
+        std::string localDigest;
+        std::string digest;
+        bool existed = false;
+        bool installed = false;
+        int refs = 0;
+    };
+
+    /// plan: works out what is out of date, in the order it should be downloaded
+    std::vector<SyncItem> plan(const std::vector<RemoteFont>& remoteFonts)
+    {
+        /// the last entry for a local file is the one that ends up installed
+        std::unordered_map<std::string, const RemoteFont*> latest;
+        for (const auto& font : remoteFonts)
+        {
+            latest[this->localFileFor(font)] = &font;
+        }
+
+        /// hash every font whose recorded digest is stale in one batch; missing fonts come back
+        /// without a digest, so trusted digests are handed out without touching the disk at all
+        std::vector<std::pair<std::string, HashAlgorithm>> existingFiles;
+        for (const auto& font : remoteFonts)
+        {
+            std::string localFile = this->localFileFor(font);
+            if (latest[localFile] == &font)
+            {
+                existingFiles.push_back(std::make_pair(localFile, font.getHashAlgorithm()));
+            }
+        }
+        auto existingDigests = this->hashCache.digests(existingFiles);
+        this->persistHashes();
+        std::unordered_map<std::string, std::string> localDigests;
+        for (size_t i = 0; i < existingFiles.size(); ++i)
+        {
+            localDigests[existingFiles[i].first] = std::move(existingDigests[i]);
+        }
+
+        std::vector<SyncItem> pending;
+        for (const auto& font : remoteFonts)
+        {
+            SyncItem item;
+            item.font = &font;
+            item.localFile = this->localFileFor(font);
+            if (latest[item.localFile] != &font)
+            {
+                continue;
+            }
+            auto digest = localDigests.find(item.localFile);
+            if (digest != localDigests.end() && sameDigest(digest->second, font.getHash()))
+            {
+                FONTSYNC_LOG_TRIVIAL(trace) << item.localFile << " was already up to date...";
+                continue;
+            }
+            if (digest != localDigests.end())
+            {
+                item.localDigest = digest->second;
+            }
+            item.stagingFile = item.localFile + ".part";
+            pending.push_back(std::move(item));
+        }
+        std::stable_sort(pending.begin(), pending.end(), [](const SyncItem& first, const SyncItem& second)
+        {
+            return downloadsBefore(*first.font, *second.font);
+        });
+        return pending;
+    }
+
+    /// patches the revision installed now into the staging file, with a delta the index offers from it;
+    /// any failure, including a result the index does not expect, leaves the font to be downloaded whole
+    bool patchFont(SyncItem& item, const FontPatch& patch)
+    {
+        const RemoteFont& font = *item.font;
+        std::string url = patch.remoteFile;
+        if (this->mirrors && this->mirrors->serves(url))
+        {
+            auto ranked = this->mirrors->ranked();
+            if (!ranked.empty())
+            {
+                url = this->mirrors->rewrite(url, ranked.front());
+            }
+        }
+        std::string deltaFile = item.localFile + ".delta";
+        boost::system::error_code ignored;
+        try
+        {
+            FONTSYNC_LOG_TRIVIAL(trace) << "Downloading delta [" << url << "] for " << item.localFile << "...";
+            fetch(deltaFile, url, font.getHashAlgorithm());
+            item.digest = applyDelta(item.localFile, deltaFile, item.stagingFile, font.getHashAlgorithm());
+            boost::filesystem::remove(deltaFile, ignored);
+        }
+        catch (const std::runtime_error& e)
+        {
+            boost::filesystem::remove(deltaFile, ignored);
+            FONTSYNC_LOG_TRIVIAL(warning) << "Unable to patch " << item.localFile << ", downloading it whole: " << e.what();
+            return false;
+        }
+        if (!font.getHash().empty() && !sameDigest(item.digest, font.getHash()))
+        {
+            boost::filesystem::remove(item.stagingFile, ignored);
+            FONTSYNC_LOG_TRIVIAL(warning) << "Patching " << item.localFile << " produced " << item.digest << ", expected " << font.getHash() << ", downloading it whole...";
+            return false;
+        }
+        FONTSYNC_LOG_TRIVIAL(debug) << "Patched " << item.localFile << " from " << item.localDigest << " to " << item.digest;
+        return true;
+    }
+
+    /// whether the index lists chunk digests that describe the whole font
+    static bool chunked(const RemoteFont& font)
+    {
+        return font.getChunkSize() > 0 && !font.getChunks().empty() &&
+            (font.getSize() + font.getChunkSize() - 1) / font.getChunkSize() == font.getChunks().size();
+    }
+
+    /// assembles a font from the chunks of an interrupted download and the installed revision that
+    /// still match, fetching only the rest with range requests; a failure keeps every verified chunk
+    /// staged, so the next attempt resumes from there
+    std::string fetchChunks(SyncItem& item, const std::string& url)
+    {
+        const RemoteFont& font = *item.font;
+        FontChunks chunks = { font.getSize(), font.getChunkSize(), font.getChunks() };
+        auto result = fetchChunked(item.stagingFile, item.localFile, font.getHashAlgorithm(), chunks,
+            [&url](uint64_t offset, uint64_t length, const RangeSink& sink) { return fetchRange(url, offset, length, sink); });
+        if (!result.complete)
+        {
+            FONTSYNC_LOG_TRIVIAL(debug) << url << " does not support range requests, downloading it whole...";
+            return fetch(item.stagingFile, url, font.getHashAlgorithm());
+        }
+        countDownload();
+        FONTSYNC_LOG_TRIVIAL(debug) << "Assembled " << item.localFile << " from " << result.resumed << " resumed, " << result.reused <<
+            " unchanged and " << result.fetched << " fetched chunk(s)";
+        return result.digest;
+    }
+
+    /// fetch: patches a font into its staging file when the index offers a delta from the installed
+    /// revision, otherwise downloads it, a chunk at a time if the index lists chunks, or whole, hashing
+    /// it on the wire; fonts on the mirrors come from the best one, failing over to the next on errors,
+    /// and a server is only tried again after the retry delay
+    bool fetchFont(SyncItem& item)
+    {
+        const RemoteFont& font = *item.font;
+        const FontPatch* patch = item.localDigest.empty() ? nullptr : font.getPatchFrom(item.localDigest);
+        if (patch != nullptr && this->patchFont(item, *patch))
+        {
+            return true;
+        }
+        std::vector<Mirror> candidates;
+        if (this->mirrors && this->mirrors->serves(font.getRemoteFile()))
+        {
+            candidates = this->mirrors->ranked();
+        }
+        /// give every mirror a chance before giving up
+        unsigned int attemptLimit = (std::max)(this->failedDownloadRetryAttempts, static_cast<unsigned int>(candidates.size()));
+        unsigned int attempts = 0;
+        while (true)
+        {
+            const Mirror* mirror = candidates.empty() ? nullptr : &candidates[attempts % candidates.size()];
+            std::string url = mirror != nullptr ? this->mirrors->rewrite(font.getRemoteFile(), *mirror) : font.getRemoteFile();
+            FONTSYNC_LOG_TRIVIAL(trace) << "Downloading [" << url << "] (priority " << font.getPriority() << ")...";
+            try
             {
-                bool remove = true;
-                for (const auto& remote : remoteFonts)
+                item.digest = this->chunked(font) ? this->fetchChunks(item, url) : fetch(item.stagingFile, url, font.getHashAlgorithm());
+                if (mirror != nullptr)
                 {
-                    if (font.getLocalFile()
-                            .substr(font.getLocalFile().find_last_of("/\\") + 1) == 
-                        remote.getRemoteFile()
-                            .substr(remote.getRemoteFile().find_last_of("/\\") + 1))
-                    {
-                        remove = false;
-                        break;
-                    }
+                    this->mirrors->reportSuccess(*mirror);
                 }
-                if (remove)
+                return true;
+            }
+            catch (const std::runtime_error& e)
+            {
+                /// a font missing from one mirror fails over without cooling the mirror down
+                if (mirror != nullptr && HttpStatusError::blamesServer(e))
                 {
-                    try
-                    {
-                        if (boost::filesystem::exists(font.getLocalFile()))
-                        {
-                            FONTSYNC_LOG_TRIVIAL(trace) << 
-                                "Removing orphaned font: " << font.getLocalFile() << "...";
-                            int refs = 0;
-                            while (RemoveFontResource(font.getLocalFile().c_str()))
-                            {
-                                refs++;
-                            }
-                            FONTSYNC_LOG_TRIVIAL(trace) << "Removed " << 
-                                refs << " references to " << font.getLocalFile() << "...";
-                            boost::filesystem::remove(font.getLocalFile());
-                            FONTSYNC_LOG_TRIVIAL(trace) << "Deleted local font " << 
-                                font.getLocalFile() << " from the filesystem...";
-                        }
-                    }
-                    catch (const boost::filesystem::filesystem_error& e)
-                    {
-                        FONTSYNC_LOG_TRIVIAL(warning) << "Failed to remove orphaned font: " << 
-                            font.getLocalFile() << "[" << e.what() << "]...";
-                    }
+                    this->mirrors->reportFailure(*mirror);
                 }
+                if (++attempts >= attemptLimit)
+                {
+                    FONTSYNC_LOG_TRIVIAL(error) << "Failed to download " << url << ": " << e.what() << "\nattempt " << attempts << " of " << attemptLimit;
+                    return false;
+                }
+                FONTSYNC_LOG_TRIVIAL(warning) << "Failed to download " << url << ": " << e.what() << "\nattempt " << attempts << " of " << attemptLimit;
+            }
+            /// failing over to the next mirror is immediate; trying the same server again waits, unless the service is stopping
+            if (!candidates.empty() && attempts % candidates.size() != 0)
+            {
+                continue;
+            }
+            auto retryAt = std::chrono::steady_clock::now() + std::chrono::milliseconds(this->failedDownloadRetryDelay);
+            while (!this->abandoned() && std::chrono::steady_clock::now() < retryAt)
+            {
+                std::this_thread::sleep_for((std::min)(std::chrono::duration_cast<std::chrono::milliseconds>(retryAt - std::chrono::steady_clock::now()), std::chrono::milliseconds(50)));
+            }
+            if (this->abandoned())
+            {
+                FONTSYNC_LOG_TRIVIAL(warning) << "Gave up on " << url << ", the service is stopping";
+                return false;
+            }
+        }
+    }
+
+    /// whether waiting is pointless, because the cache or the service is stopping
+    bool abandoned() const
+    {
+        return this->stopping || (this->cancelled && this->cancelled());
+    }
+
+    /// verify: checks a staged font against the digest the index expects, and that it is a well formed font
+    bool verifyFont(SyncItem& item)
+    {
+        const RemoteFont& font = *item.font;
+        if (!font.getHash().empty() && !sameDigest(item.digest, font.getHash()))
+        {
+            boost::system::error_code ignored;
+            boost::filesystem::remove(item.stagingFile, ignored);
+            FONTSYNC_LOG_TRIVIAL(error) << "Failed to download " << font.getRemoteFile() << ": received " << item.digest << ", expected " << font.getHash();
+            return false;
+        }
+        /// a font GDI cannot make sense of never reaches it, nor replaces a working one
+        if (isSfntFile(item.localFile))
+        {
+            try
+            {
+                auto start = std::chrono::steady_clock::now();
+                SfntInfo info = validateSfntFile(item.stagingFile);
+                FONTSYNC_LOG_TRIVIAL(trace) << "Validated " << font.getName() << " (family " << info.family << ", " << info.tables << " table(s)) in " <<
+                    std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() << "us";
+            }
+            catch (const std::runtime_error& e)
+            {
+                boost::system::error_code ignored;
+                boost::filesystem::remove(item.stagingFile, ignored);
+                FONTSYNC_LOG_TRIVIAL(error) << "Rejected " << font.getRemoteFile() << ": " << e.what();
+                return false;
             }
         }
+        return true;
     }
 
+    /// install: releases the font being replaced and swaps the staged font in
+    bool installFont(SyncItem& item)
+    {
+        const RemoteFont& font = *item.font;
+        item.existed = boost::filesystem::exists(item.localFile);
+        if (item.existed)
+        {
+            while (RemoveFontResource(item.localFile.c_str()))
+            {
+                item.refs++;
+            }
+            FONTSYNC_LOG_TRIVIAL(trace) << "Removed " << item.refs << " reference(s) to " << font.getName();
+            FONTSYNC_LOG_TRIVIAL(trace) << "Sending WM_FONTCHANGE broadcast...";
+            SendMessage(HWND_BROADCAST, WM_FONTCHANGE, NULL, NULL);
+        }
+        boost::system::error_code error;
+        boost::filesystem::rename(item.stagingFile, item.localFile, error);
+        if (error)
+        {
+            boost::system::error_code ignored;
+            boost::filesystem::remove(item.stagingFile, ignored);
+            FONTSYNC_LOG_TRIVIAL(error) << "Failed to install " << item.localFile << ": " << error.message();
+        }
+        else
+        {
+            /// persisted once per page rather than per font, which would rewrite the whole cache each time
+            this->hashCache.record(item.localFile, font.getHashAlgorithm(), item.digest);
+            this->written.insert(keyFor(item.localFile));
+            item.installed = true;
+        }
+        /// even a failed install has references to restore
+        return true;
+    }
+
+    /// register: restores the references released during install, and loads new fonts
+    bool registerInstalledFont(SyncItem& item)
+    {
+        const RemoteFont& font = *item.font;
+        if (item.existed)
+        {
+            int restored = item.refs;
+            while (item.refs--)
+            {
+                AddFontResource(item.localFile.c_str());
+            }
+            FONTSYNC_LOG_TRIVIAL(trace) << "Restored " << restored << " reference(s) to " << font.getName() << "...";
+        }
+        /// new fonts are loaded, and so are replacements for fonts that were not loaded: ones verification
+        /// unloaded because they no longer matched, or that failed to load before
+        bool loaded = item.existed && this->ledger.find(item.localFile) != this->ledger.end();
+        if (item.installed && !loaded && this->filter.matches(font))
+        {
+            LocalFont installed(font.getName(), font.getCategory(), font.getType(), item.localFile, item.digest, font.getHashAlgorithm());
+            if (!this->registerFont(installed))
+            {
+                FONTSYNC_LOG_TRIVIAL(warning) << "Failed to load managed font: " << item.localFile << "[" << errorString(GetLastError()) << "]...";
+            }
+        }
+        FONTSYNC_LOG_TRIVIAL(trace) << "Sending WM_FONTCHANGE broadcast...";
+        SendMessage(HWND_BROADCAST, WM_FONTCHANGE, NULL, NULL);
+        return true;
+    }
+
+    /// runs the plan, fetch, verify, install and register stages, each with its own
+    /// workers, connected by bounded queues so network, disk and GDI work overlap
     void downloadUpdates(const std::vector<RemoteFont>& remoteFonts)
     {
         FONTSYNC_LOG_TRIVIAL(trace) << "Downloading updates...";
-        for (const auto& font : remoteFonts)
+        auto start = std::chrono::steady_clock::now();
+        auto pending = this->plan(remoteFonts);
+        auto planned = std::chrono::steady_clock::now();
+        if (pending.empty())
         {
-            std::stringstream ss;
-            ss << this->fontDirectory << '\\' << font.getRemoteFile().substr(font.getRemoteFile().find_last_of("/\\") + 1);
-            boost::filesystem::path localPath(ss.str());
-            bool exists = boost::filesystem::exists(localPath);
-            bool upToDate = exists && md5(ss.str()) == font.getMD5();
-            if (!exists || !upToDate)
+            return;
+        }
+
+        auto firstFont = planned;
+        size_t downloaded = 0;
+        BoundedQueue<SyncItem> toFetch(this->queueDepth), toVerify(this->queueDepth), toInstall(this->queueDepth), toRegister(this->queueDepth);
+        PipelineStage<SyncItem> fetchStage("fetch", this->fetchWorkers, toFetch, &toVerify, [this](SyncItem& item) { return this->fetchFont(item); });
+        PipelineStage<SyncItem> verifyStage("verify", this->verifyWorkers, toVerify, &toInstall, [this](SyncItem& item) { return this->verifyFont(item); });
+        /// replacing files and talking to GDI stay serialized
+        PipelineStage<SyncItem> installStage("install", 1, toInstall, &toRegister, [this](SyncItem& item) { return this->installFont(item); });
+        PipelineStage<SyncItem> registerStage("register", 1, toRegister, nullptr, [this, &firstFont, &downloaded](SyncItem& item)
+        {
+            this->registerInstalledFont(item);
+            if (item.installed && downloaded++ == 0)
             {
-                int refs = 0;
-                if (exists)
-                {
-                    while (RemoveFontResource(localPath.string().c_str()))
-                    {
-                        refs++;
-                    }
-                    FONTSYNC_LOG_TRIVIAL(trace) << "Removed " << refs << " reference(s) to " << font.getName();
-                }
+                firstFont = std::chrono::steady_clock::now();
+            }
+            return true;
+        });
+        for (auto& item : pending)
+        {
+            toFetch.push(std::move(item));
+        }
+        toFetch.close();
+        registerStage.join();
 
-                FONTSYNC_LOG_TRIVIAL(trace) << "Sending WM_FONTCHANGE broadcast...";
-                SendMessage(HWND_BROADCAST, WM_FONTCHANGE, NULL, NULL);
+        auto milliseconds = [start](std::chrono::steady_clock::time_point end)
+        {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+        };
+        FONTSYNC_LOG_TRIVIAL(info) << "Downloaded " << downloaded << " of " << pending.size() << " out of date font(s); time to first font: " << 
+            milliseconds(firstFont) << "ms, time to all fonts: " << milliseconds(std::chrono::steady_clock::now()) << "ms";
+        FONTSYNC_LOG_TRIVIAL(info) << "Synchronization stages: plan: " << milliseconds(planned) << "ms; " << fetchStage.report() << "; " << 
+            verifyStage.report() << "; " << installStage.report() << "; " << registerStage.report();
+    }
 
-                if (!exists)
+    /// registers the provided fonts with GDI, keeping track of the ones that loaded
+    void load(std::vector<LocalFont>& fonts)
+    {
+        for (auto& font : fonts)
+        {
+            if (!this->filter.matches(font))
+            {
+                FONTSYNC_LOG_TRIVIAL(trace) << "Not loading unsubscribed font: " << font.getLocalFile() << "...";
+            }
+            else if (this->registerFont(font))
+            {
+                FONTSYNC_LOG_TRIVIAL(trace) << "Loaded managed font: " << font.getLocalFile() << "...";
+            }
+            else
+            {
+                FONTSYNC_LOG_TRIVIAL(warning) << "Failed to load managed font: " << font.getLocalFile() << "[" << errorString(GetLastError()) << "]...";
+            }
+        }
+    }
+
+    /// checks the fonts loaded from the startup manifest against their recorded digests,
+    /// unloading any that no longer match; the next synchronization replaces them
+    void verify()
+    {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<const LocalFont*> fonts;
+        for (const auto& entry : this->ledger)
+        {
+            fonts.push_back(&entry.second.font);
+        }
+        const size_t sliceSize = 32;
+        size_t verified = 0;
+        std::vector<std::string> mismatched;
+        for (size_t slice = 0; slice < fonts.size() && !this->stopping; slice += sliceSize)
+        {
+            size_t end = (std::min)(slice + sliceSize, fonts.size());
+            std::vector<std::pair<std::string, HashAlgorithm>> files;
+            for (size_t i = slice; i < end; ++i)
+            {
+                files.push_back(std::make_pair(fonts[i]->getLocalFile(), fonts[i]->getHashAlgorithm()));
+            }
+            auto digests = this->hashCache.digests(files);
+            for (size_t i = slice; i < end; ++i)
+            {
+                if (!sameDigest(digests[i - slice], fonts[i]->getHash()))
                 {
-                    FONTSYNC_LOG_TRIVIAL(trace) << "Downloading new font [" << font.getRemoteFile() << "]...";
+                    mismatched.push_back(fonts[i]->getLocalFile());
                 }
-                else
+            }
+            verified = end;
+        }
+        for (const auto& localFile : mismatched)
+        {
+            FONTSYNC_LOG_TRIVIAL(warning) << localFile << " does not match its recorded digest, unloading it until it is replaced...";
+            this->unregisterFont(localFile);
+        }
+        this->persistHashes();
+        FONTSYNC_LOG_TRIVIAL(info) << "Verified " << verified << " of " << fonts.size() << " cached font(s) in " <<
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() << "ms";
+    }
+
+	void synchronize(const IndexPages& nextPage)
+	{
+        /// the first synchronization waits for startup verification, so the two never touch the same font
+        if (this->verifier.joinable())
+        {
+            this->verifier.join();
+        }
+        this->takeLocalChanges();
+
+        std::string keysFile = getManagedKeysPath();
+        try
+        {
+            this->ensureManagedKeys(keysFile);
+        }
+        catch (const std::exception& e)
+        {
+            FONTSYNC_LOG_TRIVIAL(warning) << "Unable to sort the fonts listed by the local index, orphans it lists are kept: " << e.what();
+        }
+
+        /// each page goes through the pipeline and is dropped; only the keys of the fonts
+        /// it listed are kept, spilling to disk once they outgrow their share of the budget
+        KeySorter current(keysFile + ".run", this->memoryBudget / 4);
+        std::unique_ptr<StartupManifestWriter> manifest;
+        try
+        {
+            manifest.reset(new StartupManifestWriter(getStartupManifestPath()));
+        }
+        catch (const std::runtime_error& e)
+        {
+            FONTSYNC_LOG_TRIVIAL(warning) << e.what();
+        }
+        DownloadTotals before = downloadTotals();
+        std::vector<RemoteFont> page;
+        size_t pages = 0;
+        uint64_t listed = 0;
+        while (nextPage(page))
+        {
+            ++pages;
+            listed += page.size();
+            this->downloadUpdates(page);
+            this->persistHashes();
+            for (const auto& font : page)
+            {
+                if (!this->filter.matches(font))
                 {
-                    FONTSYNC_LOG_TRIVIAL(trace) << "Updating existing font [" << font.getRemoteFile() << "]...";
+                    continue;
                 }
+                std::string localFile = this->localFileFor(font);
+                current.add(keyFor(localFile));
+                /// records what is installed now, so the next startup can load it without the index;
+                /// a font that failed to update is recorded with the digest of what is installed instead
+                std::string digest;
+                if (manifest && this->hashCache.lookup(localFile, font.getHashAlgorithm(), digest))
                 {
-                    unsigned int attempts = 0;
-                    do
+                    try
                     {
-                        try
-                        {
-
-                            download(ss.str(), font.getRemoteFile());
-                            break;
-                        }
-                        catch (const std::runtime_error& e)
-                        {
-                            if (++attempts >= this->failedDownloadRetryAttempts)
-                            {
-                                FONTSYNC_LOG_TRIVIAL(error) << "Failed to download " << font.getRemoteFile() << ": " << e.what() << "\nattempt " << attempts << " of " << this->failedDownloadRetryAttempts;
-                                break;
-                            }
-                            else
-                            {
-                                FONTSYNC_LOG_TRIVIAL(warning) << "Failed to download " << font.getRemoteFile() << ": " << e.what() << "\nattempt " << attempts << " of " << this->failedDownloadRetryAttempts;
-                            }
-                        }
-                    } while (attempts < this->failedDownloadRetryAttempts);
-                }
-                if (exists)
-                {
-                   int restored = refs;
-                    while (refs--)
+                        manifest->append(LocalFont(font.getName(), font.getCategory(), font.getType(), localFile, digest, font.getHashAlgorithm()));
+                    }
+                    catch (const std::runtime_error& e)
                     {
-                        AddFontResource(localPath.string().c_str());
+                        FONTSYNC_LOG_TRIVIAL(warning) << e.what();
+                        manifest.reset();
                     }
-                    FONTSYNC_LOG_TRIVIAL(trace) << "Restored " << restored << " reference(s) to " << font.getName() << "...";
-                    FONTSYNC_LOG_TRIVIAL(trace) << "Sending WM_FONTCHANGE broadcast...";
-                    SendMessage(HWND_BROADCAST, WM_FONTCHANGE, NULL, NULL);
                 }
             }
-            else
-            {
-                FONTSYNC_LOG_TRIVIAL(trace) << localPath << " was already up to date...";
-            }
         }
-    }
 
-	void synchronize(const std::vector<RemoteFont>& remoteFonts)
-	{
-        this->deleteOrphans(remoteFonts);
-        
-        this->downloadUpdates(remoteFonts);
+        /// orphans can only be told apart once the whole index is known
+        std::string currentKeys = keysFile + ".tmp";
+        uint64_t managed = current.finish(currentKeys);
+        this->deleteOrphans(keysFile, currentKeys);
+
+        /// commit: only once every font has been through the pipeline
+        auto start = std::chrono::steady_clock::now();
+        this->persistHashes();
         FONTSYNC_LOG_TRIVIAL(trace) << "Committing current index...";
         commitAppData();
-        
+        if (manifest)
+        {
+            try
+            {
+                manifest->commit();
+            }
+            catch (const std::runtime_error& e)
+            {
+                FONTSYNC_LOG_TRIVIAL(warning) << e.what();
+            }
+        }
+        try
+        {
+            replaceFile(currentKeys, keysFile);
+        }
+        catch (const std::runtime_error& e)
+        {
+            FONTSYNC_LOG_TRIVIAL(warning) << "Unable to save the sorted list of managed fonts: " << e.what();
+        }
+        /// every font has been looked at, so only changes reported from here on need to be; this
+        /// synchronization's own writes are drained now, so the fonts it installed are not hashed again
+        this->rescan = !this->drainWatcher();
+        this->written.clear();
+        FONTSYNC_LOG_TRIVIAL(debug) << "Committed the current index in " << 
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() << "ms";
+        DownloadTotals after = downloadTotals();
+        if (after.downloads > before.downloads)
+        {
+            uint64_t decoded = after.decodedBytes - before.decodedBytes;
+            uint64_t wire = after.wireBytes - before.wireBytes;
+            FONTSYNC_LOG_TRIVIAL(info) << "Downloaded " << after.downloads - before.downloads << " font(s): " << decoded / 1024 << " KiB, " <<
+                wire / 1024 << " KiB on the wire (" << (wire < decoded ? 100 - wire * 100 / decoded : 0) << "% saved by compression)";
+        }
+        FONTSYNC_LOG_TRIVIAL(info) << "Synchronized " << listed << " listed font(s) from " << pages << " index page(s); " << managed << " managed, " <<
+            current.spills() << " key run(s) spilled to disk";
 	}
 
-    FontCacheImpl(const std::string& fontDirectory, unsigned int failedDownloadRetryDelay, unsigned int failedDownloadRetryAttempts) :
-        fontDirectory(fontDirectory), failedDownloadRetryDelay(failedDownloadRetryDelay), failedDownloadRetryAttempts(failedDownloadRetryAttempts)
+    FontCacheImpl(const std::string& fontDirectory, unsigned int failedDownloadRetryDelay, unsigned int failedDownloadRetryAttempts, const FontFilter& filter) :
+        fontDirectory(fontDirectory), failedDownloadRetryDelay(failedDownloadRetryDelay), failedDownloadRetryAttempts(failedDownloadRetryAttempts),
+        fetchWorkers(4), verifyWorkers(1), queueDepth(8), memoryBudget(128 * 1024 * 1024), hashCache(getHashCachePath()), rescan(true), filter(filter), stopping(false)
 	{
         boost::filesystem::path path(fontDirectory);
 		if (!boost::filesystem::exists(path))
@@ -170,43 +799,120 @@ struct FontCache::FontCacheImpl
                 throw std::runtime_error(std::string("cannot create local font directory: ").append(error.what()));
             }
 		}
-        if (boost::filesystem::exists(getLocalCacheIndexPath()))
+        /// fast path: load what the last synchronization installed straight from the
+        /// startup manifest, leaving the hashing to a background verification pass
+        auto start = std::chrono::steady_clock::now();
+        std::vector<LocalFont> manifest;
+        bool fromManifest = false;
+        try
+        {
+            manifest = readStartupManifest(getStartupManifestPath());
+            fromManifest = true;
+        }
+        catch (const std::runtime_error& e)
         {
-            for (auto font : getManagedFonts(this->fontDirectory))
+            FONTSYNC_LOG_TRIVIAL(info) << "Loading fonts from the local index instead of the startup manifest (" << e.what() << ")";
+        }
+        if (fromManifest)
+        {
+            this->load(manifest);
+            FONTSYNC_LOG_TRIVIAL(info) << "Loaded " << this->ledger.size() << " cached font(s) from the startup manifest in " <<
+                std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() << "ms";
+            if (!this->ledger.empty())
             {
-                if (AddFontResourceA(font.getLocalFile().c_str()) > 0)
-                {
-                    cache.push_back(font);
-                }
-                else
-                {
-                    FONTSYNC_LOG_TRIVIAL(warning) << "Failed to load managed font: " << font.getLocalFile() << "[" << errorString(GetLastError()) << "]...";
-                }
+                this->verifier = std::thread([this]() { this->verify(); });
             }
         }
+        else if (boost::filesystem::exists(getLocalCacheIndexPath()))
+        {
+            auto fonts = getManagedFonts(this->fontDirectory, this->hashCache);
+            this->load(fonts);
+            this->persistHashes();
+        }
 	}
 
 	~FontCacheImpl()
 	{
-        for (auto font : getManagedFonts(this->fontDirectory))
+        this->watcher.reset();
+        this->stopping = true;
+        if (this->verifier.joinable())
         {
-            if (RemoveFontResourceA(font.getLocalFile().c_str()) == 0)
-            {
-                FONTSYNC_LOG_TRIVIAL(warning) << "Failed to unload managed font: " << font.getLocalFile() << "[" << errorString(GetLastError()) << "]...";
-            }
+            this->verifier.join();
         }
+        /// unregister exactly what was registered, without touching the disk
+        auto start = std::chrono::steady_clock::now();
+        size_t fonts = this->ledger.size();
+        while (!this->ledger.empty())
+        {
+            this->unregisterFont(this->ledger.begin()->first);
+        }
+        FONTSYNC_LOG_TRIVIAL(info) << "Unloaded " << fonts << " managed font(s) in " <<
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() << "ms";
 	}
 };
 
-FontCache::FontCache(const std::string& fontDirectory, unsigned int failedDownloadRetryDelay, unsigned int failedDownloadRetryAttempts) :
-impl(new FontCacheImpl(fontDirectory, failedDownloadRetryDelay, failedDownloadRetryAttempts))
+FontCache::FontCache(const std::string& fontDirectory, unsigned int failedDownloadRetryDelay, unsigned int failedDownloadRetryAttempts, const FontFilter& filter) :
+impl(new FontCacheImpl(fontDirectory, failedDownloadRetryDelay, failedDownloadRetryAttempts, filter))
 {
 
 }
 
 void FontCache::synchronize(const std::vector<RemoteFont>& remoteFonts)
 {
-	this->impl->synchronize(remoteFonts);
+    bool delivered = false;
+	this->impl->synchronize([&remoteFonts, &delivered](std::vector<RemoteFont>& page)
+    {
+        if (delivered)
+        {
+            return false;
+        }
+        page = remoteFonts;
+        delivered = true;
+        return true;
+    });
+}
+
+void FontCache::synchronize(const IndexPages& nextPage)
+{
+    this->impl->synchronize(nextPage);
+}
+
+void FontCache::setWatching(bool watching)
+{
+    this->impl->setWatching(watching);
+}
+
+void FontCache::setMemoryBudget(uint64_t bytes)
+{
+    this->impl->memoryBudget = bytes;
+}
+
+void FontCache::setFilter(const FontFilter& filter)
+{
+    this->impl->filter = filter;
+}
+
+void FontCache::setPipelineBudget(unsigned int fetchWorkers, unsigned int verifyWorkers, unsigned int queueDepth)
+{
+    this->impl->fetchWorkers = fetchWorkers;
+    this->impl->verifyWorkers = verifyWorkers;
+    this->impl->queueDepth = queueDepth;
+}
+
+void FontCache::setMirrors(const std::shared_ptr<MirrorSet>& mirrors)
+{
+    this->impl->mirrors = mirrors;
+}
+
+void FontCache::setCancellation(const std::function<bool()>& cancelled)
+{
+    this->impl->cancelled = cancelled;
+}
+
+void FontCache::setRetryPolicy(unsigned int failedDownloadRetryDelay, unsigned int failedDownloadRetryAttempts)
+{
+    this->impl->failedDownloadRetryDelay = failedDownloadRetryDelay;
+    this->impl->failedDownloadRetryAttempts = failedDownloadRetryAttempts;
 }
 
 FontCache::~FontCache()
@@ -6,9 +6,13 @@
 # pragma once
 #endif
 
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <vector>
+#include "FontFilter.hpp"
 #include "LocalFont.hpp"
+#include "MirrorSet.hpp"
 #include "RemoteFont.hpp"
 
 /**
@@ -28,6 +32,17 @@ class FontCache
 
 public:
 
+	/**
+	 * Retrieves the next page of an index, replacing the contents of the
+	 * provided page.
+	 *
+	 * @return false once the index is exhausted
+	 *
+	 * @throws std::runtime_error if the page cannot be retrieved
+	 *
+	 */
+	typedef std::function<bool(std::vector<RemoteFont>&)> IndexPages;
+
 	/**
 	 * Constructs a FontCache that manages the provided directory
 	 *
@@ -35,10 +50,22 @@ public:
 	 *
 	 * @param cacheImmediately should the fonts be cached immediately?
 	 *
+	 * @param filter the fonts to subscribe to; managed fonts that do not pass
+	 *        it are not loaded
+	 *
 	 * @throws std::runtime_error if any caching error occurs
 	 *
 	 */
-	FontCache(const std::string& fontDirectory, unsigned int failedDownloadRetryDelay, unsigned int failedDownloadRetryAttempts);
+	FontCache(const std::string& fontDirectory, unsigned int failedDownloadRetryDelay, unsigned int failedDownloadRetryAttempts, const FontFilter& filter = FontFilter());
+
+	/**
+	 * Changes which fonts this cache subscribes to.  Installed fonts that
+	 * no longer pass the filter are removed on the next synchronization.
+	 *
+	 * @param filter the subscription filter
+	 *
+	 */
+	void setFilter(const FontFilter& filter);
 
 	/**
 	 * Synchronizes this cache with its remote counterpart.
@@ -47,6 +74,96 @@ public:
 	 *
 	 */
 	void synchronize(const std::vector<RemoteFont>& remoteFonts);
+
+	/**
+	 * Synchronizes this cache with its remote counterpart, a page of the
+	 * index at a time, so the index never has to be held in memory at once.
+	 *
+	 * Each page is downloaded, installed and dropped before the next one is
+	 * retrieved.  Orphans are found by merging the sorted keys of the fonts
+	 * listed by every page with those of the previous synchronization, once
+	 * the last page is in; an index that fails part way deletes nothing and
+	 * commits nothing.
+	 *
+	 * @param nextPage retrieves the pages of the index in turn
+	 *
+	 * @throws std::runtime_error if any synchronization error occurs
+	 *
+	 */
+	void synchronize(const IndexPages& nextPage);
+
+	/**
+	 * Changes the memory synchronization may use, from the next
+	 * synchronization on.  A quarter of it holds the keys orphans are found
+	 * by before they are spilled to disk; the rest is left to index pages,
+	 * whose size the update server bounds, and the pipeline.
+	 *
+	 * The budget only bounds these per-synchronization buffers.  The hash
+	 * cache and the ledger of loaded fonts hold an entry per installed font
+	 * for as long as the cache lives, and are not counted against it.
+	 *
+	 * @param bytes the memory budget, in bytes
+	 *
+	 */
+	void setMemoryBudget(uint64_t bytes);
+
+	/**
+	 * Changes whether the font directory is watched for local changes.
+	 *
+	 * While watching, a synchronization only checks the fonts that changed
+	 * since the previous one, trusting the recorded digests of the rest;
+	 * otherwise, or whenever changes may have been missed, every managed
+	 * font is checked.  A directory that cannot be watched is logged and
+	 * checked in full every synchronization.
+	 *
+	 * @param watching whether to watch the font directory
+	 *
+	 */
+	void setWatching(bool watching);
+
+	/**
+	 * Changes how failed downloads are retried from the next synchronization on.
+	 *
+	 * Registered fonts are not touched.
+	 *
+	 */
+	void setRetryPolicy(unsigned int failedDownloadRetryDelay, unsigned int failedDownloadRetryAttempts);
+
+	/**
+	 * Changes the worker budget of the synchronization pipeline from the next
+	 * synchronization on.  Installing and registering fonts always use a
+	 * single worker each.
+	 *
+	 * @param fetchWorkers the number of fonts downloaded at once
+	 *
+	 * @param verifyWorkers the number of fonts verified at once
+	 *
+	 * @param queueDepth the most fonts waiting between any two stages
+	 *
+	 */
+	void setPipelineBudget(unsigned int fetchWorkers, unsigned int verifyWorkers, unsigned int queueDepth);
+
+	/**
+	 * Downloads fonts hosted on the provided mirrors from the best of them,
+	 * failing over to the next best when a download fails.  Fonts hosted
+	 * elsewhere are downloaded from where the index says.
+	 *
+	 * @param mirrors the mirrors serving the fonts, or nullptr
+	 *
+	 */
+	void setMirrors(const std::shared_ptr<MirrorSet>& mirrors);
+
+	/**
+	 * Provides a way to abandon synchronization, e.g. on shutdown.  The
+	 * predicate is checked while waiting to retry a failed download; once
+	 * it returns true, the font is given up on instead.
+	 * Must not be called concurrently with a synchronization.
+	 *
+	 * @param cancelled returns true once synchronization should be abandoned;
+	 *                  it is called from the fetch workers and must be cheap
+	 *
+	 */
+	void setCancellation(const std::function<bool()>& cancelled);
     
 	/**
 	 * Default Destructor
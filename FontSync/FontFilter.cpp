@@ -0,0 +1,177 @@
+#include "FontFilter.hpp"
+
+#include <cctype>
+
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/trim.hpp>
+
+namespace
+{
+    std::vector<std::string> splitList(const std::string& list)
+    {
+        std::vector<std::string> items;
+        boost::algorithm::split(items, list, boost::algorithm::is_any_of(","));
+        std::vector<std::string> rv;
+        for (auto& item : items)
+        {
+            boost::algorithm::trim(item);
+            if (!item.empty())
+            {
+                rv.push_back(std::move(item));
+            }
+        }
+        return rv;
+    }
+
+    bool contains(const std::vector<std::string>& list, const std::string& value)
+    {
+        for (const auto& item : list)
+        {
+            if (boost::algorithm::iequals(item, value))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool anyGlobMatches(const std::vector<std::string>& globs, const std::string& name)
+    {
+        for (const auto& glob : globs)
+        {
+            if (FontFilter::globMatch(name, glob))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::string percentEncode(const std::string& value)
+    {
+        static const char digits[] = "0123456789ABCDEF";
+        std::string rv;
+        for (unsigned char c : value)
+        {
+            if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~' || c == '*' || c == '?')
+            {
+                rv.push_back(static_cast<char>(c));
+            }
+            else
+            {
+                rv.push_back('%');
+                rv.push_back(digits[c >> 4]);
+                rv.push_back(digits[c & 0xF]);
+            }
+        }
+        return rv;
+    }
+
+    void appendParameter(std::string& query, const char* key, const std::vector<std::string>& values)
+    {
+        if (values.empty())
+        {
+            return;
+        }
+        if (!query.empty())
+        {
+            query.push_back('&');
+        }
+        query.append(key).push_back('=');
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            if (i > 0)
+            {
+                query.append("%2C");
+            }
+            query.append(percentEncode(values[i]));
+        }
+    }
+}
+
+FontFilter::FontFilter()
+{
+
+}
+
+FontFilter::FontFilter(const Config::Settings& settings) :
+    includeCategories(splitList(settings.include_categories)),
+    excludeCategories(splitList(settings.exclude_categories)),
+    includeTypes(splitList(settings.include_types)),
+    excludeTypes(splitList(settings.exclude_types)),
+    includeNames(splitList(settings.include_names)),
+    excludeNames(splitList(settings.exclude_names))
+{
+
+}
+
+bool FontFilter::matches(const std::string& name, const std::string& category, const std::string& type) const
+{
+    return (this->includeCategories.empty() || contains(this->includeCategories, category)) &&
+        !contains(this->excludeCategories, category) &&
+        (this->includeTypes.empty() || contains(this->includeTypes, type)) &&
+        !contains(this->excludeTypes, type) &&
+        (this->includeNames.empty() || anyGlobMatches(this->includeNames, name)) &&
+        !anyGlobMatches(this->excludeNames, name);
+}
+
+bool FontFilter::matches(const FontBase& font) const
+{
+    return this->matches(font.getName(), font.getCategory(), font.getType());
+}
+
+bool FontFilter::empty() const
+{
+    return this->includeCategories.empty() && this->excludeCategories.empty() &&
+        this->includeTypes.empty() && this->excludeTypes.empty() &&
+        this->includeNames.empty() && this->excludeNames.empty();
+}
+
+std::string FontFilter::toQueryString() const
+{
+    std::string query;
+    appendParameter(query, "category", this->includeCategories);
+    appendParameter(query, "exclude_category", this->excludeCategories);
+    appendParameter(query, "type", this->includeTypes);
+    appendParameter(query, "exclude_type", this->excludeTypes);
+    appendParameter(query, "name", this->includeNames);
+    appendParameter(query, "exclude_name", this->excludeNames);
+    return query;
+}
+
+bool FontFilter::globMatch(const std::string& name, const std::string& glob)
+{
+    /// iterative matching with backtracking to the most recent '*'
+    size_t n = 0, g = 0;
+    size_t star = std::string::npos, resume = 0;
+    while (n < name.size())
+    {
+        if (g < glob.size() && (glob[g] == '?' ||
+            std::tolower(static_cast<unsigned char>(glob[g])) == std::tolower(static_cast<unsigned char>(name[n]))))
+        {
+            ++n;
+            ++g;
+        }
+        else if (g < glob.size() && glob[g] == '*')
+        {
+            star = g++;
+            resume = n;
+        }
+        else if (star != std::string::npos)
+        {
+            g = star + 1;
+            n = ++resume;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while (g < glob.size() && glob[g] == '*')
+    {
+        ++g;
+    }
+    return g == glob.size();
+}
@@ -0,0 +1,106 @@
+#ifndef FONT_FILTER_HPP_INCLUDED
+#define FONT_FILTER_HPP_INCLUDED
+
+/// some microsoft compilers still benefit from the use of #pragma once
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif
+
+#include <string>
+#include <vector>
+
+#include "Config.hpp"
+#include "FontBase.hpp"
+
+/**
+ * The subset of the remote index a client subscribes to.
+ *
+ * A font is subscribed to if its category, type and name each pass their
+ * include and exclude lists.  An empty include list includes everything,
+ * and an exclusion always beats an inclusion.  Categories and types are
+ * compared exactly (ignoring case); names are matched against globs, where
+ * '*' matches any run of characters and '?' matches any single character.
+ *
+ */
+class FontFilter
+{
+    std::vector<std::string> includeCategories;
+    std::vector<std::string> excludeCategories;
+    std::vector<std::string> includeTypes;
+    std::vector<std::string> excludeTypes;
+    std::vector<std::string> includeNames;
+    std::vector<std::string> excludeNames;
+
+public:
+
+    /**
+     * Constructs a FontFilter that subscribes to every font.
+     *
+     */
+    FontFilter();
+
+    /**
+     * Constructs a FontFilter from the include_* and exclude_* options of
+     * the provided configuration; each is a comma separated list.
+     *
+     * @param settings the configuration to read the filter from
+     *
+     */
+    explicit FontFilter(const Config::Settings& settings);
+
+    /**
+     * Determines whether a font is subscribed to.
+     *
+     * @param name the name of the font
+     *
+     * @param category the category of the font
+     *
+     * @param type the type of the font
+     *
+     * @return true if the font is subscribed to, otherwise false
+     *
+     */
+    bool matches(const std::string& name, const std::string& category, const std::string& type) const;
+
+    /**
+     * Determines whether a font is subscribed to.
+     *
+     * @param font the font to check
+     *
+     * @return true if the font is subscribed to, otherwise false
+     *
+     */
+    bool matches(const FontBase& font) const;
+
+    /**
+     * Determines whether this filter subscribes to every font.
+     *
+     * @return true if nothing is filtered out, otherwise false
+     *
+     */
+    bool empty() const;
+
+    /**
+     * Encodes this filter as URL query parameters, so the update server can
+     * leave unsubscribed fonts out of the index it sends.
+     *
+     * @return the (percent-encoded) query parameters, without a leading '?';
+     *         empty if nothing is filtered out
+     *
+     */
+    std::string toQueryString() const;
+
+    /**
+     * Matches a name against a glob, ignoring case.
+     *
+     * @param name the name to match
+     *
+     * @param glob the glob to match against
+     *
+     * @return true if the name matches the glob, otherwise false
+     *
+     */
+    static bool globMatch(const std::string& name, const std::string& glob);
+};
+
+#endif
@@ -0,0 +1,304 @@
+#include "HashCache.hpp"
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#if defined(_WIN32)
+# ifndef WIN32_LEAN_AND_MEAN
+#  define WIN32_LEAN_AND_MEAN
+# endif
+# include <Windows.h>
+#else
+# include <sys/stat.h>
+#endif
+
+#include "Logging.hpp"
+#include "MultiBufferMD5.hpp"
+#include "Utilities.hpp"
+
+struct HashCache::HashCacheImpl
+{
+    struct Entry
+    {
+        uintmax_t size;
+        /// the last write time, in the finest unit the file system keeps; only ever compared
+        uint64_t modified;
+        HashAlgorithm algorithm;
+        std::string digest;
+    };
+
+    std::string cacheFile;
+
+    /// keyed by case-folded path, like suspects
+    std::unordered_map<std::string, Entry> entries;
+
+    bool dirty;
+
+    /// whether unchanged entries are handed out without checking their files
+    bool trusting;
+
+    /// files reported changed while trusting, case-folded; hashed again on their next lookup
+    std::unordered_set<std::string> suspects;
+
+    mutable std::mutex mutex;
+
+    /// the key a file is recorded and suspected under; the file system, and so the watcher, ignores case
+    static std::string fold(const std::string& file)
+    {
+        return boost::algorithm::to_lower_copy(file);
+    }
+
+    /// the size and modification time of the file as it is now; whole seconds would let a rewrite of
+    /// the same size within the second pass for the file that was hashed, so the full resolution is kept
+    static bool statFile(const std::string& file, uintmax_t& size, uint64_t& modified)
+    {
+#if defined(_WIN32)
+        WIN32_FILE_ATTRIBUTE_DATA attributes;
+        if (!GetFileAttributesExA(file.c_str(), GetFileExInfoStandard, &attributes))
+        {
+            return false;
+        }
+        size = (static_cast<uintmax_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+        modified = (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+#else
+        struct stat status;
+        if (::stat(file.c_str(), &status) != 0)
+        {
+            return false;
+        }
+        size = static_cast<uintmax_t>(status.st_size);
+        modified = static_cast<uint64_t>(status.st_mtim.tv_sec) * 1000000000 + static_cast<uint64_t>(status.st_mtim.tv_nsec);
+#endif
+        return true;
+    }
+
+    bool lookup(const std::string& file, HashAlgorithm algorithm, std::string& digest) const
+    {
+        std::string key = fold(file);
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            auto entry = this->entries.find(key);
+            if (this->trusting && this->suspects.count(key) != 0)
+            {
+                /// a change can keep the size and modification time, so only hashing settles it
+                return false;
+            }
+            if (this->trusting && entry != this->entries.end() && entry->second.algorithm == algorithm)
+            {
+                digest = entry->second.digest;
+                return true;
+            }
+        }
+        uintmax_t size;
+        uint64_t modified;
+        if (!statFile(file, size, modified))
+        {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(this->mutex);
+        auto entry = this->entries.find(key);
+        if (entry == this->entries.end() ||
+            entry->second.algorithm != algorithm ||
+            entry->second.size != size ||
+            entry->second.modified != modified)
+        {
+            return false;
+        }
+        digest = entry->second.digest;
+        return true;
+    }
+
+    void record(const std::string& file, HashAlgorithm algorithm, const std::string& digest)
+    {
+        Entry entry = { 0, 0, algorithm, digest };
+        if (!statFile(file, entry.size, entry.modified))
+        {
+            return;
+        }
+        std::string key = fold(file);
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->entries[key] = std::move(entry);
+        this->suspects.erase(key);
+        this->dirty = true;
+    }
+
+    void load()
+    {
+        if (!boost::filesystem::exists(this->cacheFile))
+        {
+            return;
+        }
+        try
+        {
+            boost::property_tree::ptree tree;
+            boost::property_tree::json_parser::read_json(this->cacheFile, tree);
+            for (const auto& file : tree)
+            {
+                Entry entry =
+                {
+                    file.second.get<uintmax_t>("size"),
+                    file.second.get<uint64_t>("modified"),
+                    parseHashAlgorithm(file.second.get<std::string>("hash_algorithm")),
+                    file.second.get<std::string>("hash")
+                };
+                /// entries written before write times were kept at full resolution simply no longer match
+                this->entries[fold(file.second.get<std::string>("file"))] = std::move(entry);
+            }
+        }
+        catch (const std::exception& e)
+        {
+            FONTSYNC_LOG_TRIVIAL(warning) << "Discarding unreadable hash cache " << this->cacheFile << "[" << e.what() << "]...";
+            this->entries.clear();
+        }
+    }
+
+    void flush()
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (!this->dirty)
+        {
+            return;
+        }
+        boost::property_tree::ptree tree;
+        for (const auto& entry : this->entries)
+        {
+            boost::property_tree::ptree file;
+            file.put("file", entry.first);
+            file.put("size", entry.second.size);
+            file.put("modified", entry.second.modified);
+            file.put("hash_algorithm", toString(entry.second.algorithm));
+            file.put("hash", entry.second.digest);
+            tree.push_back(std::make_pair("", file));
+        }
+        /// write next to the cache and swap it in, so a crash never leaves a torn cache behind
+        std::string temp = this->cacheFile + ".tmp";
+        try
+        {
+            boost::filesystem::path parent = boost::filesystem::path(this->cacheFile).parent_path();
+            if (!parent.empty() && !boost::filesystem::exists(parent))
+            {
+                boost::filesystem::create_directories(parent);
+            }
+            boost::property_tree::json_parser::write_json(temp, tree, std::locale(), false);
+            replaceFile(temp, this->cacheFile);
+        }
+        catch (const std::exception& e)
+        {
+            throw std::runtime_error(std::string("unable to save hash cache: ").append(e.what()));
+        }
+        this->dirty = false;
+    }
+
+    HashCacheImpl(const std::string& cacheFile) : cacheFile(cacheFile), dirty(false), trusting(false)
+    {
+        this->load();
+    }
+};
+
+HashCache::HashCache(const std::string& cacheFile) : impl(new HashCacheImpl(cacheFile))
+{
+
+}
+
+bool HashCache::lookup(const std::string& file, HashAlgorithm algorithm, std::string& digest) const
+{
+    return this->impl->lookup(file, algorithm, digest);
+}
+
+void HashCache::record(const std::string& file, HashAlgorithm algorithm, const std::string& digest)
+{
+    this->impl->record(file, algorithm, digest);
+}
+
+std::vector<std::string> HashCache::digests(const std::vector<std::pair<std::string, HashAlgorithm>>& files)
+{
+    std::vector<std::string> rv(files.size());
+    std::vector<size_t> md5Misses;
+    std::vector<std::string> md5Files;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        if (this->impl->lookup(files[i].first, files[i].second, rv[i]))
+        {
+            continue;
+        }
+        if (files[i].second == HashAlgorithm::MD5)
+        {
+            md5Misses.push_back(i);
+            md5Files.push_back(files[i].first);
+        }
+        else
+        {
+            try
+            {
+                rv[i] = hashFile(files[i].first, files[i].second);
+                this->impl->record(files[i].first, files[i].second, rv[i]);
+            }
+            catch (const std::runtime_error&)
+            {
+                /// unreadable files are reported with an empty digest
+            }
+        }
+    }
+    auto md5Digests = md5Batch(md5Files);
+    for (size_t i = 0; i < md5Misses.size(); ++i)
+    {
+        rv[md5Misses[i]] = std::move(md5Digests[i]);
+        if (!rv[md5Misses[i]].empty())
+        {
+            this->impl->record(md5Files[i], HashAlgorithm::MD5, rv[md5Misses[i]]);
+        }
+    }
+    return rv;
+}
+
+void HashCache::forget(const std::string& file)
+{
+    std::lock_guard<std::mutex> lock(this->impl->mutex);
+    if (this->impl->entries.erase(HashCacheImpl::fold(file)) > 0)
+    {
+        this->impl->dirty = true;
+    }
+}
+
+void HashCache::setTrusting(bool trusting)
+{
+    std::lock_guard<std::mutex> lock(this->impl->mutex);
+    this->impl->trusting = trusting;
+    if (!trusting)
+    {
+        this->impl->suspects.clear();
+    }
+}
+
+void HashCache::suspect(const std::string& file)
+{
+    std::lock_guard<std::mutex> lock(this->impl->mutex);
+    if (this->impl->trusting)
+    {
+        this->impl->suspects.insert(HashCacheImpl::fold(file));
+    }
+}
+
+void HashCache::flush()
+{
+    this->impl->flush();
+}
+
+HashCache::~HashCache()
+{
+    try
+    {
+        this->impl->flush();
+    }
+    catch (const std::runtime_error& e)
+    {
+        FONTSYNC_LOG_TRIVIAL(warning) << e.what();
+    }
+}
@@ -0,0 +1,133 @@
+#ifndef HASH_CACHE_HPP_INCLUDED
+#define HASH_CACHE_HPP_INCLUDED
+
+/// some microsoft compilers still benefit from the use of #pragma once
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Hashing.hpp"
+
+/**
+ * A persistent record of the digests of local files.
+ *
+ * Every digest is stored together with the size and modification time the
+ * file had when it was hashed; a digest is only handed out again while the
+ * file still has that size and modification time, so an unchanged font is
+ * never read back from disk just to be hashed.  While trusting, neither is
+ * checked; files reported as possibly changed are simply hashed again.
+ *
+ */
+class HashCache
+{
+    /// Private Implementation
+    struct HashCacheImpl;
+
+    /// Private Implementation
+    std::unique_ptr<HashCacheImpl> impl;
+
+public:
+
+    /**
+     * Constructs a HashCache persisted in the provided file, loading the
+     * digests it already holds.  A missing or unreadable file simply yields
+     * an empty cache.
+     *
+     * @param cacheFile the file the digests are persisted in
+     *
+     */
+    explicit HashCache(const std::string& cacheFile);
+
+    /**
+     * Looks up the digest of the provided file.
+     *
+     * @param file the file to look up
+     *
+     * @param algorithm the algorithm the digest must have been produced with
+     *
+     * @param digest receives the digest, if one is found
+     *
+     * @return true if a digest of the file as it is now was found, otherwise false
+     *
+     */
+    bool lookup(const std::string& file, HashAlgorithm algorithm, std::string& digest) const;
+
+    /**
+     * Records the digest of the provided file as it is now.  The record is
+     * held in memory until the next flush.
+     *
+     * @param file the file that was hashed
+     *
+     * @param algorithm the algorithm the digest was produced with
+     *
+     * @param digest the digest of the file, as hex
+     *
+     */
+    void record(const std::string& file, HashAlgorithm algorithm, const std::string& digest);
+
+    /**
+     * Retrieves the digests of the provided files, hashing (and recording)
+     * only those without a current digest.  MD5 digests are calculated
+     * together with md5Batch.
+     *
+     * @param files the files to hash, each with the algorithm to hash it with
+     *
+     * @return the digest of each file, in the same order; the entry for a
+     *         file that cannot be read is empty
+     *
+     */
+    std::vector<std::string> digests(const std::vector<std::pair<std::string, HashAlgorithm>>& files);
+
+    /**
+     * Forgets the digest of the provided file.
+     *
+     * @param file the file to forget
+     *
+     */
+    void forget(const std::string& file);
+
+    /**
+     * Changes whether recorded digests are trusted.  While trusting, a
+     * digest is handed out without checking the size and modification time
+     * of its file, unless the file has been reported through suspect since;
+     * this is only sound while something, such as a DirectoryWatcher, reports
+     * every change to the files.  Ceasing to trust forgets what was
+     * reported.
+     *
+     * @param trusting whether to trust recorded digests
+     *
+     */
+    void setTrusting(bool trusting);
+
+    /**
+     * Reports that the provided file may have changed, so it is hashed
+     * again rather than looked up until its digest is recorded anew, even
+     * if its size and modification time are unchanged.  File names are
+     * matched regardless of case.  Has no effect while not trusting.
+     *
+     * @param file the file that may have changed
+     *
+     */
+    void suspect(const std::string& file);
+
+    /**
+     * Persists any changed records.
+     *
+     * @throws std::runtime_error if the cache file cannot be written
+     *
+     */
+    void flush();
+
+    /**
+     * Destructor, persists any changed records.
+     *
+     */
+    ~HashCache();
+};
+
+#endif
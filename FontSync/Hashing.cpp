@@ -0,0 +1,256 @@
+#include "Hashing.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#define CRYPTOPP_ENABLE_NAMESPACE_WEAK 1
+
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <cryptopp/hex.h>
+#include <cryptopp/md5.h>
+
+#include "FileReader.hpp"
+
+namespace
+{
+    std::string toHex(const unsigned char* digest, std::size_t size)
+    {
+        static const char digits[] = "0123456789ABCDEF";
+        std::string hex(2 * size, '0');
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            hex[2 * i] = digits[digest[i] >> 4];
+            hex[2 * i + 1] = digits[digest[i] & 0xF];
+        }
+        return hex;
+    }
+
+    class MD5Hasher : public Hasher
+    {
+        CryptoPP::Weak::MD5 hash;
+
+    public:
+
+        void update(const unsigned char* data, std::size_t size)
+        {
+            this->hash.Update(data, size);
+        }
+
+        std::string digest()
+        {
+            unsigned char digest[CryptoPP::Weak::MD5::DIGESTSIZE];
+            this->hash.Final(digest);
+            return toHex(digest, sizeof(digest));
+        }
+    };
+
+    /// XXH64, as specified at https://github.com/Cyan4973/xxHash (seed 0)
+    class XXH64Hasher : public Hasher
+    {
+        static const uint64_t prime1 = 11400714785074694791ULL;
+        static const uint64_t prime2 = 14029467366897019727ULL;
+        static const uint64_t prime3 = 1609587929392839161ULL;
+        static const uint64_t prime4 = 9650029242287828579ULL;
+        static const uint64_t prime5 = 2870177450012600261ULL;
+
+        uint64_t accumulators[4];
+
+        uint64_t length;
+
+        unsigned char pending[32];
+
+        std::size_t pendingSize;
+
+        static uint64_t rotate(uint64_t value, int bits)
+        {
+            return (value << bits) | (value >> (64 - bits));
+        }
+
+        static uint64_t read64(const unsigned char* data)
+        {
+            uint64_t value;
+            std::memcpy(&value, data, sizeof(value));
+            return value;
+        }
+
+        static uint32_t read32(const unsigned char* data)
+        {
+            uint32_t value;
+            std::memcpy(&value, data, sizeof(value));
+            return value;
+        }
+
+        static uint64_t round(uint64_t accumulator, uint64_t input)
+        {
+            accumulator += input * prime2;
+            return rotate(accumulator, 31) * prime1;
+        }
+
+        static uint64_t merge(uint64_t hash, uint64_t accumulator)
+        {
+            hash ^= round(0, accumulator);
+            return hash * prime1 + prime4;
+        }
+
+        void stripe(const unsigned char* data)
+        {
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                this->accumulators[lane] = round(this->accumulators[lane], read64(data + 8 * lane));
+            }
+        }
+
+    public:
+
+        XXH64Hasher() : length(0), pendingSize(0)
+        {
+            this->accumulators[0] = prime1 + prime2;
+            this->accumulators[1] = prime2;
+            this->accumulators[2] = 0;
+            this->accumulators[3] = 0 - prime1;
+        }
+
+        void update(const unsigned char* data, std::size_t size)
+        {
+            this->length += size;
+            if (this->pendingSize + size < 32)
+            {
+                std::memcpy(this->pending + this->pendingSize, data, size);
+                this->pendingSize += size;
+                return;
+            }
+            if (this->pendingSize > 0)
+            {
+                std::size_t fill = 32 - this->pendingSize;
+                std::memcpy(this->pending + this->pendingSize, data, fill);
+                this->stripe(this->pending);
+                data += fill;
+                size -= fill;
+                this->pendingSize = 0;
+            }
+            while (size >= 32)
+            {
+                this->stripe(data);
+                data += 32;
+                size -= 32;
+            }
+            std::memcpy(this->pending, data, size);
+            this->pendingSize = size;
+        }
+
+        std::string digest()
+        {
+            uint64_t hash;
+            if (this->length >= 32)
+            {
+                hash = rotate(this->accumulators[0], 1) + rotate(this->accumulators[1], 7) +
+                       rotate(this->accumulators[2], 12) + rotate(this->accumulators[3], 18);
+                for (int lane = 0; lane < 4; ++lane)
+                {
+                    hash = merge(hash, this->accumulators[lane]);
+                }
+            }
+            else
+            {
+                hash = prime5;
+            }
+            hash += this->length;
+
+            const unsigned char* data = this->pending;
+            std::size_t size = this->pendingSize;
+            for (; size >= 8; data += 8, size -= 8)
+            {
+                hash ^= round(0, read64(data));
+                hash = rotate(hash, 27) * prime1 + prime4;
+            }
+            if (size >= 4)
+            {
+                hash ^= static_cast<uint64_t>(read32(data)) * prime1;
+                hash = rotate(hash, 23) * prime2 + prime3;
+                data += 4;
+                size -= 4;
+            }
+            for (; size > 0; ++data, --size)
+            {
+                hash ^= *data * prime5;
+                hash = rotate(hash, 11) * prime1;
+            }
+            hash ^= hash >> 33;
+            hash *= prime2;
+            hash ^= hash >> 29;
+            hash *= prime3;
+            hash ^= hash >> 32;
+
+            /// canonical (big endian) representation
+            unsigned char digest[8];
+            for (int i = 0; i < 8; ++i)
+            {
+                digest[i] = static_cast<unsigned char>(hash >> (56 - 8 * i));
+            }
+            return toHex(digest, sizeof(digest));
+        }
+    };
+}
+
+HashAlgorithm parseHashAlgorithm(const std::string& name)
+{
+    if (boost::algorithm::iequals(name, "md5"))
+    {
+        return HashAlgorithm::MD5;
+    }
+    else if (boost::algorithm::iequals(name, "xxh64"))
+    {
+        return HashAlgorithm::XXH64;
+    }
+    throw std::invalid_argument("unsupported hash algorithm: " + name);
+}
+
+const char* toString(HashAlgorithm algorithm)
+{
+    switch (algorithm)
+    {
+    case HashAlgorithm::XXH64:
+        return "xxh64";
+    case HashAlgorithm::MD5:
+    default:
+        return "md5";
+    }
+}
+
+Hasher::~Hasher()
+{
+
+}
+
+std::unique_ptr<Hasher> Hasher::create(HashAlgorithm algorithm)
+{
+    switch (algorithm)
+    {
+    case HashAlgorithm::XXH64:
+        return std::unique_ptr<Hasher>(new XXH64Hasher());
+    case HashAlgorithm::MD5:
+    default:
+        return std::unique_ptr<Hasher>(new MD5Hasher());
+    }
+}
+
+std::string hashFile(const std::string& file, HashAlgorithm algorithm)
+{
+    auto reader = FileReader::open(file);
+    auto hasher = Hasher::create(algorithm);
+    const unsigned char* data;
+    std::size_t size;
+    while (reader->next(data, size))
+    {
+        hasher->update(data, size);
+    }
+    return hasher->digest();
+}
+
+bool sameDigest(const std::string& first, const std::string& second)
+{
+    return boost::algorithm::iequals(first, second);
+}
\ No newline at end of file
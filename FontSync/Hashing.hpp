@@ -0,0 +1,111 @@
+#ifndef HASHING_HPP_INCLUDED
+#define HASHING_HPP_INCLUDED
+
+/// some microsoft compilers still benefit from the use of #pragma once
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+/**
+ * The content hash algorithms an index entry can be verified with.
+ *
+ */
+enum class HashAlgorithm
+{
+    /// the original (and default) index digest
+    MD5,
+
+    /// 64 bit xxHash; non-cryptographic, but many times faster than MD5
+    XXH64
+};
+
+/**
+ * Looks up a hash algorithm by its index name ("md5" or "xxh64").
+ *
+ * @param name the index name of the algorithm
+ *
+ * @return the named hash algorithm
+ *
+ * @throws std::invalid_argument if the algorithm is not supported
+ *
+ */
+HashAlgorithm parseHashAlgorithm(const std::string& name);
+
+/**
+ * Retrieves the index name of the provided hash algorithm.
+ *
+ * @param algorithm the hash algorithm
+ *
+ * @return the index name of the provided hash algorithm
+ *
+ */
+const char* toString(HashAlgorithm algorithm);
+
+/**
+ * An incremental digest calculation.
+ *
+ */
+class Hasher
+{
+public:
+
+    /**
+     * Creates a hasher for the provided algorithm.
+     *
+     * @param algorithm the algorithm to hash with
+     *
+     * @return a hasher for the provided algorithm
+     *
+     */
+    static std::unique_ptr<Hasher> create(HashAlgorithm algorithm);
+
+    /**
+     * Feeds the provided bytes into the digest.
+     *
+     * @param data the bytes to hash
+     *
+     * @param size the number of bytes to hash
+     *
+     */
+    virtual void update(const unsigned char* data, std::size_t size) = 0;
+
+    /**
+     * Completes the digest.  The hasher must not be updated afterwards.
+     *
+     * @return the digest, as upper case hex
+     *
+     */
+    virtual std::string digest() = 0;
+
+    /**
+     * Virtual Destructor
+     *
+     */
+    virtual ~Hasher();
+};
+
+/**
+ * Calculates the digest of the provided file.
+ *
+ * @param file the file to hash
+ *
+ * @param algorithm the algorithm to hash with
+ *
+ * @return the digest of the provided file, as upper case hex
+ *
+ * @throws std::runtime_error if any hashing error occurs
+ *
+ */
+std::string hashFile(const std::string& file, HashAlgorithm algorithm);
+
+/**
+ * Compares two hex digests, ignoring case.
+ *
+ */
+bool sameDigest(const std::string& first, const std::string& second);
+
+#endif
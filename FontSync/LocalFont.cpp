@@ -1,34 +1,35 @@
 #include "LocalFont.hpp"
 
-#include "Utilities.hpp"
+#include <utility>
 
-struct LocalFont::LocalFontImpl
+LocalFont::LocalFont(const std::string& name,
+	const std::string& category,
+	const std::string& type,
+	const std::string& localFile,
+	HashAlgorithm hashAlgorithm) :
+	FontBase(name, category, type),
+	localFile(localFile),
+	hash(hashFile(localFile, hashAlgorithm)),
+	hashAlgorithm(hashAlgorithm)
 {
-	std::string localFile;
-	std::string md5Hash;
-
-	LocalFontImpl(const std::string& localFile) : localFile(localFile), md5Hash(md5(localFile))
-	{
 
-	}
-
-	LocalFontImpl(const std::string& localFile, const std::string& md5Hash) : localFile(localFile), md5Hash(md5Hash)
-	{
-
-	}
-};
+}
 
 LocalFont::LocalFont(const std::string& name,
 	const std::string& category,
 	const std::string& type,
-	const std::string& localFile) :
+	const std::string& localFile,
+	const std::string& hash,
+	HashAlgorithm hashAlgorithm) :
 	FontBase(name, category, type),
-	impl(new LocalFontImpl(localFile))
+	localFile(localFile),
+	hash(hash),
+	hashAlgorithm(hashAlgorithm)
 {
 
 }
 
-LocalFont::LocalFont(const LocalFont& other) : FontBase(other), impl(new LocalFontImpl(other.impl->localFile, other.impl->md5Hash))
+LocalFont::LocalFont(const LocalFont& other) : FontBase(other), localFile(other.localFile), hash(other.hash), hashAlgorithm(other.hashAlgorithm)
 {
 
 }
@@ -36,18 +37,39 @@ LocalFont::LocalFont(const LocalFont& other) : FontBase(other), impl(new LocalFo
 LocalFont& LocalFont::operator=(const LocalFont& other)
 {
 	FontBase::operator=(other);
-	this->impl->md5Hash = other.impl->md5Hash;
+	this->localFile = other.localFile;
+	this->hash = other.hash;
+	this->hashAlgorithm = other.hashAlgorithm;
 	return *this;
 }
 
-const std::string& LocalFont::getMD5() const
+LocalFont::LocalFont(LocalFont&& other) BOOST_NOEXCEPT : FontBase(std::move(other)), localFile(std::move(other.localFile)), hash(std::move(other.hash)), hashAlgorithm(other.hashAlgorithm)
+{
+
+}
+
+LocalFont& LocalFont::operator=(LocalFont&& other) BOOST_NOEXCEPT
+{
+	FontBase::operator=(std::move(other));
+	this->localFile = std::move(other.localFile);
+	this->hash = std::move(other.hash);
+	this->hashAlgorithm = other.hashAlgorithm;
+	return *this;
+}
+
+const std::string& LocalFont::getHash() const
+{
+	return this->hash;
+}
+
+HashAlgorithm LocalFont::getHashAlgorithm() const
 {
-	return this->impl->md5Hash;
+	return this->hashAlgorithm;
 }
 
 const std::string& LocalFont::getLocalFile() const
 {
-	return this->impl->localFile;
+	return this->localFile;
 }
 
 LocalFont::~LocalFont()
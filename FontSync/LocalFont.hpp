@@ -6,21 +6,45 @@
 # pragma once
 #endif
 
-#include <memory>
 #include "FontBase.hpp"
 
 class LocalFont : public FontBase
 {
-	/// Private Implementation
-	struct LocalFontImpl;
+	/// the local file that holds this font
+	std::string localFile;
 
-	/// Private Implementation
-	std::unique_ptr<LocalFontImpl> impl;
+	/// the content hash of this font
+	std::string hash;
+
+	/// the algorithm that produced the content hash of this font
+	HashAlgorithm hashAlgorithm;
 
 public:
 
 	/**
-	* Constructs a LocalFont with the provided name, category, type, and md5 hash
+	* Constructs a LocalFont with the provided name, category, and type, hashing
+	* the provided local file
+	*
+	* @param name the name of this font
+	*
+	* @param category the category of this font
+	*
+	* @param type the type of this font
+	*
+	* @param localFile the local file that holds this font
+	*
+	* @param hashAlgorithm the algorithm to hash the local file with
+	*
+	*/
+	LocalFont(const std::string& name,
+		const std::string& category,
+		const std::string& type,
+		const std::string& localFile,
+		HashAlgorithm hashAlgorithm = HashAlgorithm::MD5);
+
+	/**
+	* Constructs a LocalFont with the provided name, category, and type, using
+	* an already computed content hash of the provided local file
 	*
 	* @param name the name of this font
 	*
@@ -28,11 +52,19 @@ public:
 	*
 	* @param type the type of this font
 	*
+	* @param localFile the local file that holds this font
+	*
+	* @param hash the content hash of the local file, as hex
+	*
+	* @param hashAlgorithm the algorithm that produced the content hash
+	*
 	*/
 	LocalFont(const std::string& name,
 		const std::string& category,
 		const std::string& type,
-		const std::string& localFile);
+		const std::string& localFile,
+		const std::string& hash,
+		HashAlgorithm hashAlgorithm);
 
 	/**
 	* Copy Constructor
@@ -47,12 +79,32 @@ public:
 	LocalFont& operator=(const LocalFont&);
 
 	/**
-	* Retrieves the MD5 hash of this font
+	* Move Constructor
+	*
+	*/
+	LocalFont(LocalFont&&) BOOST_NOEXCEPT;
+
+	/**
+	* Move Assignment
+	*
+	*/
+	LocalFont& operator=(LocalFont&&) BOOST_NOEXCEPT;
+
+	/**
+	* Retrieves the content hash of this font
+	*
+	* @return the content hash of this font, as hex
+	*
+	*/
+	virtual const std::string& getHash() const;
+
+	/**
+	* Retrieves the algorithm that produced the content hash of this font
 	*
-	* @return the MD5 hash of this font
+	* @return the algorithm that produced the content hash of this font
 	*
 	*/
-	virtual const std::string& getMD5() const;
+	virtual HashAlgorithm getHashAlgorithm() const;
 
 	/**
 	 * Retrieves the local file that holds this font
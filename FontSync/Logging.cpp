@@ -1,38 +1,434 @@
 #include "Logging.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <boost/core/null_deleter.hpp>
+#include <boost/filesystem.hpp>
 #include <boost/log/sources/severity_feature.hpp>
 #include <boost/log/sources/severity_logger.hpp>
 #include <boost/log/sinks.hpp>
-
 #include <boost/log/utility/setup.hpp>
+#include <boost/make_shared.hpp>
 
 #include "Config.hpp"
 
-bool initialized = false;
+std::atomic<int> fontsync_log_threshold { boost::log::trivial::trace };
 
-bool fontsync_logging_initialized()
+namespace
 {
-    return initialized;
+    /**
+     * A bounded, lock-free multi-producer queue (Vyukov's array based design).
+     *
+     * Producers never block; a push onto a full queue simply fails.
+     *
+     */
+    template<typename T>
+    class BoundedQueue
+    {
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            T data;
+        };
+
+        std::unique_ptr<Cell[]> cells;
+
+        size_t mask;
+
+        /// keep the producer and consumer cursors on separate cache lines
+        char pad0[64];
+        std::atomic<size_t> enqueuePosition;
+        char pad1[64];
+        std::atomic<size_t> dequeuePosition;
+        char pad2[64];
+
+    public:
+
+        explicit BoundedQueue(size_t capacity) : enqueuePosition(0), dequeuePosition(0)
+        {
+            size_t size = 2;
+            while (size < capacity)
+            {
+                size <<= 1;
+            }
+            this->cells.reset(new Cell[size]);
+            this->mask = size - 1;
+            for (size_t i = 0; i < size; ++i)
+            {
+                this->cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        bool push(T&& value)
+        {
+            size_t position = this->enqueuePosition.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                Cell& cell = this->cells[position & this->mask];
+                size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+                if (difference == 0)
+                {
+                    if (this->enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        cell.data = std::move(value);
+                        cell.sequence.store(position + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (difference < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    position = this->enqueuePosition.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /// how many values are queued; only a snapshot while others push or pop
+        size_t size() const
+        {
+            size_t pushed = this->enqueuePosition.load(std::memory_order_relaxed);
+            size_t popped = this->dequeuePosition.load(std::memory_order_relaxed);
+            return pushed > popped ? pushed - popped : 0;
+        }
+
+        /// how many values have ever been popped, so a producer can tell whether the consumer is keeping up
+        size_t popped() const
+        {
+            return this->dequeuePosition.load(std::memory_order_relaxed);
+        }
+
+        size_t capacity() const
+        {
+            return this->mask + 1;
+        }
+
+        bool pop(T& value)
+        {
+            size_t position = this->dequeuePosition.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                Cell& cell = this->cells[position & this->mask];
+                size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+                if (difference == 0)
+                {
+                    if (this->dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        value = std::move(cell.data);
+                        cell.sequence.store(position + this->mask + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (difference < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    position = this->dequeuePosition.load(std::memory_order_relaxed);
+                }
+            }
+        }
+    };
+
+    /**
+     * A sink backend that hands formatted records to a background thread.
+     *
+     * Records are formatted on the logging thread (only once they have passed
+     * the filter) and queued without locking.  The background thread writes
+     * them to the wrapped backend in batches and flushes it every flush interval,
+     * or immediately once a record at or above the flush severity was written.
+     * The thread is also woken once the queue is half full, so a burst is
+     * written as it is logged rather than at the next flush interval.
+     * Records below the flush severity that are logged while the queue is full
+     * wait for room while the thread makes progress, and are dropped and
+     * counted only once it stalls; the others always wait for room.
+     *
+     */
+    template<typename Backend>
+    class AsyncBackend : public boost::log::sinks::basic_formatted_sink_backend<char, boost::log::sinks::concurrent_feeding>
+    {
+        struct Entry
+        {
+            boost::log::record_view record;
+            std::string message;
+            bool urgent;
+        };
+
+        boost::shared_ptr<Backend> backend;
+
+        BoundedQueue<Entry> queue;
+
+        std::atomic<size_t> dropped;
+
+        std::atomic<bool> urgent;
+
+        /// set once the queue passes its high-water mark, until the worker wakes for it
+        std::atomic<bool> backlog;
+
+        boost::log::trivial::severity_level flushSeverity;
+
+        size_t batchSize;
+
+        std::chrono::milliseconds flushInterval;
+
+        std::mutex mutex;
+
+        std::condition_variable wakeup;
+
+        bool stopping;
+
+        std::thread worker;
+
+        /// the most recently written record, reused to report dropped records
+        boost::log::record_view last;
+
+        /// writes up to one batch, returning the number of records written
+        size_t drain(bool& flush)
+        {
+            size_t written = 0;
+            Entry entry;
+            while (written < this->batchSize && this->queue.pop(entry))
+            {
+                this->backend->consume(entry.record, entry.message);
+                flush = flush || entry.urgent;
+                this->last = std::move(entry.record);
+                ++written;
+            }
+            return written;
+        }
+
+        /// raises a flag the worker waits on and wakes it; taking the lock in between
+        /// keeps the wakeup from slipping past a worker about to wait
+        void wake(std::atomic<bool>& flag)
+        {
+            flag = true;
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+            }
+            this->wakeup.notify_one();
+        }
+
+        void run()
+        {
+            auto lastFlush = std::chrono::steady_clock::now();
+            bool pending = false;
+            bool stopped = false;
+            while (!stopped)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(this->mutex);
+                    this->wakeup.wait_for(lock, this->flushInterval, [this]() { return this->stopping || this->urgent.load() || this->backlog.load(); });
+                    stopped = this->stopping;
+                }
+                this->urgent = false;
+                this->backlog = false;
+                bool flush = stopped;
+                size_t written;
+                do
+                {
+                    written = this->drain(flush);
+                    pending = pending || written > 0;
+                } while (written == this->batchSize);
+
+                size_t lost = this->dropped.exchange(0);
+                if (lost > 0 && this->last)
+                {
+                    this->backend->consume(this->last, "[" + std::to_string(lost) + " log record(s) dropped, logging queue full]");
+                    pending = true;
+                }
+
+                auto now = std::chrono::steady_clock::now();
+                if (pending && (flush || now - lastFlush >= this->flushInterval))
+                {
+                    this->backend->flush();
+                    lastFlush = now;
+                    pending = false;
+                }
+            }
+        }
+
+    public:
+
+        AsyncBackend(const boost::shared_ptr<Backend>& backend, const Config::Settings& settings) :
+            backend(backend),
+            queue(settings.logging_queue_size),
+            dropped(0),
+            urgent(false),
+            backlog(false),
+            flushSeverity(settings.logging_flush_severity),
+            batchSize(settings.logging_batch_size > 0 ? settings.logging_batch_size : 1),
+            flushInterval(settings.logging_flush_interval > 0 ? settings.logging_flush_interval : 1),
+            stopping(false)
+        {
+            this->worker = std::thread([this]() { this->run(); });
+        }
+
+        void consume(const boost::log::record_view& record, const string_type& message)
+        {
+            auto severity = boost::log::extract<boost::log::trivial::severity_level>("Severity", record);
+            bool flush = severity && *severity >= this->flushSeverity;
+            Entry entry = { record, message, flush };
+            if (!flush)
+            {
+                /// a full queue is only given up on once the worker stops freeing room in it
+                auto stalledAt = std::chrono::steady_clock::now() + std::chrono::milliseconds(10);
+                size_t popped = this->queue.popped();
+                while (!this->queue.push(std::move(entry)))
+                {
+                    this->wake(this->backlog);
+                    std::this_thread::yield();
+                    auto now = std::chrono::steady_clock::now();
+                    if (this->queue.popped() != popped)
+                    {
+                        popped = this->queue.popped();
+                        stalledAt = now + std::chrono::milliseconds(10);
+                    }
+                    else if (now >= stalledAt)
+                    {
+                        ++this->dropped;
+                        return;
+                    }
+                }
+                if (this->queue.size() > this->queue.capacity() / 2 && !this->backlog.load())
+                {
+                    this->wake(this->backlog);
+                }
+                return;
+            }
+            /// records at or above the flush severity are never dropped; wait for room instead
+            this->urgent = true;
+            while (!this->queue.push(std::move(entry)))
+            {
+                this->wakeup.notify_one();
+                std::this_thread::yield();
+            }
+            this->wakeup.notify_one();
+        }
+
+        void flush()
+        {
+            this->urgent = true;
+            this->wakeup.notify_one();
+        }
+
+        ~AsyncBackend()
+        {
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->stopping = true;
+            }
+            this->wakeup.notify_one();
+            if (this->worker.joinable())
+            {
+                this->worker.join();
+            }
+        }
+    };
 }
 
+typedef boost::log::sinks::unlocked_sink<AsyncBackend<boost::log::sinks::text_ostream_backend>> ConsoleSink;
 
-void initLogging(const Config& config)
+typedef boost::log::sinks::unlocked_sink<AsyncBackend<boost::log::sinks::text_file_backend>> FileSink;
+
+boost::shared_ptr<ConsoleSink> consoleSink;
+
+boost::shared_ptr<FileSink> fileSink;
+
+void installConsoleSink(const Config::Settings& settings)
 {
-    if (config.get<bool>("console_logging_enabled"))
+    if (consoleSink)
     {
-        boost::log::add_console_log(std::cout,
-            boost::log::keywords::format = config.get<std::string>("console_logging_format"),
-            boost::log::keywords::auto_flush = true);
+        boost::log::core::get()->remove_sink(consoleSink);
+        consoleSink.reset();
     }
-    if (config.get<bool>("file_logging_enabled"))
-    {
-        boost::log::add_file_log(
-            boost::log::keywords::file_name = config.get<std::string>("file_name_format"),
-            boost::log::keywords::rotation_size = config.get<int>("max_individual_file_size"),
-            boost::log::keywords::max_size = config.get<int>("max_cumulative_file_size"),
-            boost::log::keywords::format = config.get<std::string>("file_logging_format"),
-            boost::log::keywords::auto_flush = true);
+    if (settings.console_logging_enabled)
+    {
+        auto backend = boost::make_shared<boost::log::sinks::text_ostream_backend>();
+        backend->add_stream(boost::shared_ptr<std::ostream>(&std::cout, boost::null_deleter()));
+        backend->auto_flush(false);
+        consoleSink = boost::make_shared<ConsoleSink>(boost::make_shared<AsyncBackend<boost::log::sinks::text_ostream_backend>>(backend, settings));
+        consoleSink->set_formatter(boost::log::parse_formatter(settings.console_logging_format));
+        boost::log::core::get()->add_sink(consoleSink);
     }
+}
+
+void installFileSink(const Config::Settings& settings)
+{
+    if (fileSink)
+    {
+        boost::log::core::get()->remove_sink(fileSink);
+        fileSink.reset();
+    }
+    if (settings.file_logging_enabled)
+    {
+        auto backend = boost::make_shared<boost::log::sinks::text_file_backend>(
+            boost::log::keywords::file_name = settings.file_name_format,
+            boost::log::keywords::rotation_size = settings.max_individual_file_size,
+            boost::log::keywords::open_mode = std::ios_base::out | std::ios_base::app);
+        backend->auto_flush(false);
+        /// the collector enforces max_cumulative_file_size and continues the file counter across restarts
+        auto target = boost::filesystem::absolute(settings.file_name_format).parent_path();
+        backend->set_file_collector(boost::log::sinks::file::make_collector(
+            boost::log::keywords::target = target,
+            boost::log::keywords::max_size = settings.max_cumulative_file_size));
+        backend->scan_for_files();
+        fileSink = boost::make_shared<FileSink>(boost::make_shared<AsyncBackend<boost::log::sinks::text_file_backend>>(backend, settings));
+        fileSink->set_formatter(boost::log::parse_formatter(settings.file_logging_format));
+        boost::log::core::get()->add_sink(fileSink);
+    }
+}
+
+void setThreshold(const Config::Settings& settings)
+{
+    boost::log::core::get()->set_filter(boost::log::trivial::severity >= settings.logging_severity_filter);
+    fontsync_log_threshold = settings.logging_severity_filter;
+}
+
+void initLogging(const Config::Settings& settings)
+{
+    installConsoleSink(settings);
+    installFileSink(settings);
     boost::log::core::get()->add_global_attribute("TimeStamp", boost::log::attributes::local_clock());
-    boost::log::core::get()->set_filter(boost::log::trivial::severity >= config.get<boost::log::trivial::severity_level>("logging_severity_filter"));
-    initialized = true;
-}
\ No newline at end of file
+    setThreshold(settings);
+}
+
+void reconfigureLogging(const Config::Settings& previous, const Config::Settings& current)
+{
+    bool queueChanged = previous.logging_queue_size != current.logging_queue_size ||
+        previous.logging_batch_size != current.logging_batch_size ||
+        previous.logging_flush_interval != current.logging_flush_interval ||
+        previous.logging_flush_severity != current.logging_flush_severity;
+    if (queueChanged ||
+        previous.console_logging_enabled != current.console_logging_enabled ||
+        previous.console_logging_format != current.console_logging_format)
+    {
+        installConsoleSink(current);
+    }
+    if (queueChanged ||
+        previous.file_logging_enabled != current.file_logging_enabled ||
+        previous.file_name_format != current.file_name_format ||
+        previous.max_individual_file_size != current.max_individual_file_size ||
+        previous.max_cumulative_file_size != current.max_cumulative_file_size ||
+        previous.file_logging_format != current.file_logging_format)
+    {
+        installFileSink(current);
+    }
+    setThreshold(current);
+}
+
+void shutdownLogging()
+{
+    boost::log::core::get()->remove_all_sinks();
+    consoleSink.reset();
+    fileSink.reset();
+}
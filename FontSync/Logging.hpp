@@ -1,17 +1,29 @@
 #ifndef LOGGING_HPP
 #define LOGGING_HPP
+#include <atomic>
 #include <boost/log/trivial.hpp>
-class Config;
+#include "Config.hpp"
 
-bool fontsync_logging_initialized();
+/// the lowest severity that can pass the logging filter
+extern std::atomic<int> fontsync_log_threshold;
 
-void initLogging(const Config& config);
+/// cheap pre-filter, consulted before a record is opened
+inline bool fontsync_log_enabled(boost::log::trivial::severity_level severity)
+{
+    return severity >= fontsync_log_threshold.load(std::memory_order_relaxed);
+}
 
+void initLogging(const Config::Settings& settings);
+
+/// applies a reloaded configuration, rebuilding only the sinks whose options changed
+void reconfigureLogging(const Config::Settings& previous, const Config::Settings& current);
+
+/// drains and flushes every queued record, then detaches the sinks
+void shutdownLogging();
+
+/// records below the threshold are discarded before any of their arguments are evaluated
 #define FONTSYNC_LOG_TRIVIAL(X) \
-    if(!fontsync_logging_initialized()) \
-    { \
-        BOOST_LOG_TRIVIAL(warning) << "Logging configuration is not complete."; \
-    } \
+    if (!fontsync_log_enabled(boost::log::trivial::X)) {} else \
     BOOST_LOG_TRIVIAL(X)
 
 #endif
\ No newline at end of file
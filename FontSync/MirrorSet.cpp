@@ -0,0 +1,373 @@
+#include "MirrorSet.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/asio.hpp>
+
+#include "Connector.hpp"
+#include "Logging.hpp"
+
+namespace
+{
+    /// the cooldown after a first failure; doubled for each further one
+    const std::chrono::seconds baseCooldown(30);
+
+    /// the most times the cooldown is doubled
+    const unsigned maxBackoff = 5;
+
+    /// the weight of a new round trip time sample
+    const double smoothing = 0.3;
+
+    /// parses host, host:port or [address]:port
+    Mirror parseMirror(const std::string& text, uint16_t defaultPort)
+    {
+        Mirror mirror;
+        mirror.port = defaultPort;
+        std::string::size_type colon;
+        if (!text.empty() && text[0] == '[')
+        {
+            auto close = text.find(']');
+            if (close == std::string::npos || (close + 1 < text.size() && text[close + 1] != ':'))
+            {
+                throw std::invalid_argument("expected [address]:port, not " + text);
+            }
+            mirror.host = text.substr(1, close - 1);
+            colon = close + 1 < text.size() ? close + 1 : std::string::npos;
+        }
+        else
+        {
+            colon = text.find(':');
+            mirror.host = text.substr(0, colon);
+        }
+        if (mirror.host.empty())
+        {
+            throw std::invalid_argument("missing host in " + text);
+        }
+        if (colon != std::string::npos)
+        {
+            std::string port = text.substr(colon + 1);
+            if (port.empty() || port.size() > 5 || port.find_first_not_of("0123456789") != std::string::npos || std::stoul(port) == 0 || std::stoul(port) > 0xFFFF)
+            {
+                throw std::invalid_argument("invalid port in " + text);
+            }
+            mirror.port = static_cast<uint16_t>(std::stoul(port));
+        }
+        return mirror;
+    }
+
+    /// the port a mirror serves the provided scheme on; mirrors are listed by their http port,
+    /// so one on the default http port serves https on the default https port
+    uint16_t portFor(const std::string& scheme, const Mirror& mirror)
+    {
+        return scheme == "https" && mirror.port == 80 ? 443 : mirror.port;
+    }
+
+    /// splits an absolute URL into its scheme, authority and everything after the authority
+    bool splitUrl(const std::string& url, std::string& scheme, Mirror& authority, std::string& rest)
+    {
+        auto separator = url.find("://");
+        if (separator == std::string::npos)
+        {
+            return false;
+        }
+        scheme = boost::algorithm::to_lower_copy(url.substr(0, separator));
+        if (scheme != "http" && scheme != "https")
+        {
+            return false;
+        }
+        auto start = separator + 3;
+        auto end = url.find_first_of("/?#", start);
+        rest = end == std::string::npos ? "" : url.substr(end);
+        try
+        {
+            authority = parseMirror(url.substr(start, end == std::string::npos ? std::string::npos : end - start), scheme == "https" ? 443 : 80);
+        }
+        catch (const std::invalid_argument&)
+        {
+            return false;
+        }
+        return true;
+    }
+}
+
+bool operator==(const Mirror& first, const Mirror& second)
+{
+    return first.port == second.port && boost::algorithm::iequals(first.host, second.host);
+}
+
+std::string toString(const Mirror& mirror)
+{
+    bool bracket = mirror.host.find(':') != std::string::npos;
+    return (bracket ? "[" + mirror.host + "]" : mirror.host) + ":" + std::to_string(mirror.port);
+}
+
+std::chrono::milliseconds connectProbe(const Mirror& mirror)
+{
+    boost::asio::io_service service;
+    boost::asio::ip::tcp::socket socket(service);
+    try
+    {
+        auto endpoints = sharedResolverCache().resolve(mirror.host, mirror.port);
+        auto start = std::chrono::steady_clock::now();
+        raceConnect(service, socket, endpoints, std::chrono::milliseconds(250), std::chrono::milliseconds(2000));
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    }
+    catch (const boost::system::system_error& e)
+    {
+        throw std::runtime_error("cannot connect to " + toString(mirror) + ": " + e.what());
+    }
+}
+
+struct MirrorSet::MirrorSetImpl
+{
+    struct State
+    {
+        Mirror mirror;
+
+        /// smoothed round trip time in milliseconds; negative until measured
+        double rtt;
+
+        unsigned failures;
+
+        std::chrono::steady_clock::time_point coolingUntil;
+    };
+
+    mutable std::mutex mutex;
+
+    std::vector<State> states;
+
+    Probe probe;
+
+    State* find(const Mirror& mirror)
+    {
+        for (auto& state : this->states)
+        {
+            if (state.mirror == mirror)
+            {
+                return &state;
+            }
+        }
+        return nullptr;
+    }
+
+    void reconfigure(const std::vector<Mirror>& mirrors)
+    {
+        std::vector<State> next;
+        for (const auto& mirror : mirrors)
+        {
+            State* previous = this->find(mirror);
+            if (previous != nullptr)
+            {
+                next.push_back(*previous);
+            }
+            else
+            {
+                State state = { mirror, -1.0, 0, std::chrono::steady_clock::time_point() };
+                next.push_back(state);
+            }
+        }
+        this->states.swap(next);
+    }
+
+    void succeeded(State& state)
+    {
+        if (state.failures > 0)
+        {
+            FONTSYNC_LOG_TRIVIAL(info) << "Mirror " << toString(state.mirror) << " has recovered";
+        }
+        state.failures = 0;
+        state.coolingUntil = std::chrono::steady_clock::time_point();
+    }
+
+    void failed(State& state)
+    {
+        auto cooldown = baseCooldown * (1 << (std::min)(state.failures, maxBackoff));
+        ++state.failures;
+        state.coolingUntil = std::chrono::steady_clock::now() + cooldown;
+        FONTSYNC_LOG_TRIVIAL(warning) << "Mirror " << toString(state.mirror) << " failed " << state.failures << " time(s) in a row; passing over it for " <<
+            std::chrono::duration_cast<std::chrono::seconds>(cooldown).count() << "s";
+    }
+
+    MirrorSetImpl(const std::vector<Mirror>& mirrors, const Probe& probe) : probe(probe)
+    {
+        this->reconfigure(mirrors);
+    }
+};
+
+std::vector<Mirror> MirrorSet::parse(const std::string& primaryHost, uint16_t primaryPort, const std::string& mirrors)
+{
+    std::vector<Mirror> rv;
+    Mirror primary = { primaryHost, primaryPort };
+    rv.push_back(primary);
+    std::vector<std::string> entries;
+    boost::algorithm::split(entries, mirrors, boost::algorithm::is_any_of(","));
+    for (auto& entry : entries)
+    {
+        boost::algorithm::trim(entry);
+        if (entry.empty())
+        {
+            continue;
+        }
+        Mirror mirror = parseMirror(entry, 80);
+        if (std::find(rv.begin(), rv.end(), mirror) == rv.end())
+        {
+            rv.push_back(mirror);
+        }
+    }
+    return rv;
+}
+
+MirrorSet::MirrorSet(const std::vector<Mirror>& mirrors, const Probe& probe) :
+    impl(new MirrorSetImpl(mirrors, probe))
+{
+
+}
+
+void MirrorSet::reconfigure(const std::vector<Mirror>& mirrors)
+{
+    std::lock_guard<std::mutex> lock(this->impl->mutex);
+    this->impl->reconfigure(mirrors);
+}
+
+void MirrorSet::probe()
+{
+    std::vector<Mirror> mirrors;
+    {
+        std::lock_guard<std::mutex> lock(this->impl->mutex);
+        for (const auto& state : this->impl->states)
+        {
+            mirrors.push_back(state.mirror);
+        }
+    }
+    /// probe without holding the lock, so requests are never held up by a slow mirror
+    for (const auto& mirror : mirrors)
+    {
+        bool reached = false;
+        std::chrono::milliseconds rtt(0);
+        try
+        {
+            rtt = this->impl->probe(mirror);
+            reached = true;
+        }
+        catch (const std::exception& e)
+        {
+            FONTSYNC_LOG_TRIVIAL(debug) << "Probing mirror " << toString(mirror) << " failed: " << e.what();
+        }
+        std::lock_guard<std::mutex> lock(this->impl->mutex);
+        auto state = this->impl->find(mirror);
+        if (state == nullptr)
+        {
+            continue;
+        }
+        if (reached)
+        {
+            state->rtt = state->rtt < 0 ? rtt.count() : (1 - smoothing) * state->rtt + smoothing * rtt.count();
+            FONTSYNC_LOG_TRIVIAL(debug) << "Mirror " << toString(mirror) << " round trip time: " << rtt.count() << "ms (smoothed " << state->rtt << "ms)";
+            this->impl->succeeded(*state);
+        }
+        else
+        {
+            this->impl->failed(*state);
+        }
+    }
+}
+
+std::vector<Mirror> MirrorSet::ranked() const
+{
+    std::vector<MirrorSetImpl::State> states;
+    {
+        std::lock_guard<std::mutex> lock(this->impl->mutex);
+        states = this->impl->states;
+    }
+    auto now = std::chrono::steady_clock::now();
+    std::stable_sort(states.begin(), states.end(), [now](const MirrorSetImpl::State& first, const MirrorSetImpl::State& second)
+    {
+        bool firstCooling = first.coolingUntil > now;
+        bool secondCooling = second.coolingUntil > now;
+        if (firstCooling != secondCooling)
+        {
+            return secondCooling;
+        }
+        if (firstCooling)
+        {
+            return first.coolingUntil < second.coolingUntil;
+        }
+        if ((first.rtt < 0) != (second.rtt < 0))
+        {
+            return second.rtt < 0;
+        }
+        return first.rtt < second.rtt;
+    });
+    std::vector<Mirror> rv;
+    for (const auto& state : states)
+    {
+        rv.push_back(state.mirror);
+    }
+    return rv;
+}
+
+void MirrorSet::reportSuccess(const Mirror& mirror)
+{
+    std::lock_guard<std::mutex> lock(this->impl->mutex);
+    auto state = this->impl->find(mirror);
+    if (state != nullptr)
+    {
+        this->impl->succeeded(*state);
+    }
+}
+
+void MirrorSet::reportFailure(const Mirror& mirror)
+{
+    std::lock_guard<std::mutex> lock(this->impl->mutex);
+    auto state = this->impl->find(mirror);
+    if (state != nullptr)
+    {
+        this->impl->failed(*state);
+    }
+}
+
+bool MirrorSet::serves(const std::string& url) const
+{
+    std::string scheme, rest;
+    Mirror authority;
+    if (!splitUrl(url, scheme, authority, rest))
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(this->impl->mutex);
+    for (const auto& state : this->impl->states)
+    {
+        if (portFor(scheme, state.mirror) == authority.port && boost::algorithm::iequals(state.mirror.host, authority.host))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string MirrorSet::rewrite(const std::string& url, const Mirror& mirror) const
+{
+    if (!this->serves(url))
+    {
+        return url;
+    }
+    std::string scheme, rest;
+    Mirror authority;
+    splitUrl(url, scheme, authority, rest);
+    uint16_t port = portFor(scheme, mirror);
+    bool defaultPort = (scheme == "http" && port == 80) || (scheme == "https" && port == 443);
+    std::string host = mirror.host.find(':') != std::string::npos ? "[" + mirror.host + "]" : mirror.host;
+    return scheme + "://" + (defaultPort ? host : host + ":" + std::to_string(port)) + rest;
+}
+
+MirrorSet::~MirrorSet()
+{
+
+}
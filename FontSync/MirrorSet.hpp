@@ -0,0 +1,181 @@
+#ifndef MIRROR_SET_HPP_INCLUDED
+#define MIRROR_SET_HPP_INCLUDED
+
+/// some microsoft compilers still benefit from the use of #pragma once
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * An update server that serves the index and the fonts it lists.
+ *
+ */
+struct Mirror
+{
+    std::string host;
+    uint16_t port;
+};
+
+/**
+ * Compares two mirrors, ignoring the case of their host names.
+ *
+ */
+bool operator==(const Mirror& first, const Mirror& second);
+
+/**
+ * Formats a mirror as host:port.
+ *
+ * @param mirror the mirror to format
+ *
+ * @return the mirror as host:port
+ *
+ */
+std::string toString(const Mirror& mirror);
+
+/**
+ * Measures the round trip time to a mirror by timing a TCP connection to it.
+ *
+ * @param mirror the mirror to measure
+ *
+ * @return the time taken to connect
+ *
+ * @throws std::runtime_error if the mirror cannot be reached within 2 seconds
+ *
+ */
+std::chrono::milliseconds connectProbe(const Mirror& mirror);
+
+/**
+ * The mirrors that serve the same index and fonts, ranked by health and
+ * round trip time.
+ *
+ * Every mirror keeps a smoothed round trip time, measured by probing it, and
+ * a count of consecutive failures.  A mirror that fails is passed over for a
+ * cooldown that doubles with each consecutive failure, until it is probed or
+ * used successfully again.  Safe to use from several threads at once.
+ *
+ */
+class MirrorSet
+{
+    /// Private Implementation
+    struct MirrorSetImpl;
+
+    /// Private Implementation
+    std::unique_ptr<MirrorSetImpl> impl;
+
+public:
+
+    /**
+     * Measures the round trip time to a mirror.
+     *
+     * @throws std::runtime_error if the mirror cannot be reached
+     *
+     */
+    typedef std::function<std::chrono::milliseconds(const Mirror&)> Probe;
+
+    /**
+     * Parses a mirror list.
+     *
+     * @param primaryHost the configured update server, which is always the first mirror
+     *
+     * @param primaryPort the port of the configured update server
+     *
+     * @param mirrors a comma separated list of further mirrors, each as host or host:port
+     *
+     * @return the primary update server followed by the listed mirrors, without duplicates
+     *
+     * @throws std::invalid_argument if the list is malformed
+     *
+     */
+    static std::vector<Mirror> parse(const std::string& primaryHost, uint16_t primaryPort, const std::string& mirrors);
+
+    /**
+     * Constructs a MirrorSet with no measurements yet.
+     *
+     * @param mirrors the mirrors, in order of preference until they are measured
+     *
+     * @param probe measures the round trip time to a mirror
+     *
+     */
+    explicit MirrorSet(const std::vector<Mirror>& mirrors, const Probe& probe = connectProbe);
+
+    /**
+     * Replaces the mirrors, keeping the measurements of the ones that remain.
+     *
+     * @param mirrors the mirrors, in order of preference until they are measured
+     *
+     */
+    void reconfigure(const std::vector<Mirror>& mirrors);
+
+    /**
+     * Probes every mirror, updating its round trip time and health.
+     *
+     */
+    void probe();
+
+    /**
+     * Retrieves the mirrors, best first: healthy mirrors by round trip time
+     * (unmeasured ones after measured ones), then the ones cooling down, by
+     * how soon they recover.  Ties keep the configured order.
+     *
+     * @return every mirror, best first
+     *
+     */
+    std::vector<Mirror> ranked() const;
+
+    /**
+     * Records a successful request to a mirror, ending any cooldown.
+     *
+     * @param mirror the mirror that served the request
+     *
+     */
+    void reportSuccess(const Mirror& mirror);
+
+    /**
+     * Records a failed request to a mirror, starting or extending its cooldown.
+     * Only failures of the mirror itself count, such as an unreachable mirror
+     * or a server error; a resource it does not have does not.
+     *
+     * @param mirror the mirror that failed the request
+     *
+     */
+    void reportFailure(const Mirror& mirror);
+
+    /**
+     * Determines whether a URL points at one of the mirrors.
+     *
+     * @param url an absolute http or https URL
+     *
+     * @return true if the URL's host and port belong to a mirror; a mirror
+     *         on port 80 also serves https URLs on port 443
+     *
+     */
+    bool serves(const std::string& url) const;
+
+    /**
+     * Points a URL served by the mirrors at the provided mirror instead.
+     *
+     * @param url an absolute http or https URL
+     *
+     * @param mirror the mirror to fetch the URL from
+     *
+     * @return the rewritten URL, keeping its scheme, or the provided URL if
+     *         the mirrors do not serve it
+     *
+     */
+    std::string rewrite(const std::string& url, const Mirror& mirror) const;
+
+    /**
+     * Destructor
+     *
+     */
+    ~MirrorSet();
+};
+
+#endif
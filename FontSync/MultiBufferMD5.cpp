@@ -0,0 +1,477 @@
+#include "MultiBufferMD5.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#include <emmintrin.h>
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+# include <intrin.h>
+#endif
+
+#include "FileReader.hpp"
+
+/// the vector kernels are compiled whenever the compiler can emit them; they
+/// are only ever run after the CPU has been checked at runtime.  Microsoft
+/// compilers emit any intrinsic regardless of /arch, while GCC and clang
+/// compile each wider kernel under its own target below, so neither needs
+/// the whole build raised to AVX2 or AVX-512
+#if defined(_MSC_VER) || defined(__GNUC__)
+# define FONTSYNC_MD5_AVX2 1
+#endif
+
+#if (defined(_MSC_VER) && _MSC_VER >= 1911) || (defined(__GNUC__) && (__GNUC__ >= 5 || defined(__clang__)))
+# define FONTSYNC_MD5_AVX512 1
+#endif
+
+namespace
+{
+    const uint32_t constants[64] =
+    {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+        0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+        0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+        0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+        0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+        0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+        0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+        0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+    };
+
+    const uint32_t initialState[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+
+    /// one 32 bit word per lane
+    struct ScalarVector
+    {
+        typedef uint32_t type;
+        static const int lanes = 1;
+        static type load(const uint32_t* words) { return words[0]; }
+        static void store(uint32_t* words, type value) { words[0] = value; }
+        static type set1(uint32_t value) { return value; }
+        static type add(type a, type b) { return a + b; }
+        static type bitAnd(type a, type b) { return a & b; }
+        static type bitOr(type a, type b) { return a | b; }
+        static type bitXor(type a, type b) { return a ^ b; }
+        static type bitNot(type a) { return ~a; }
+        template<int Bits> static type rotate(type a) { return (a << Bits) | (a >> (32 - Bits)); }
+    };
+
+    struct SSE2Vector
+    {
+        typedef __m128i type;
+        static const int lanes = 4;
+        static type load(const uint32_t* words) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(words)); }
+        static void store(uint32_t* words, type value) { _mm_storeu_si128(reinterpret_cast<__m128i*>(words), value); }
+        static type set1(uint32_t value) { return _mm_set1_epi32(static_cast<int>(value)); }
+        static type add(type a, type b) { return _mm_add_epi32(a, b); }
+        static type bitAnd(type a, type b) { return _mm_and_si128(a, b); }
+        static type bitOr(type a, type b) { return _mm_or_si128(a, b); }
+        static type bitXor(type a, type b) { return _mm_xor_si128(a, b); }
+        static type bitNot(type a) { return _mm_xor_si128(a, _mm_set1_epi32(-1)); }
+        template<int Bits> static type rotate(type a) { return _mm_or_si128(_mm_slli_epi32(a, Bits), _mm_srli_epi32(a, 32 - Bits)); }
+    };
+
+#include "MultiBufferMD5Kernel.inl"
+
+    /// feeds one file to one lane, one padded 64 byte block at a time
+    class LaneSource
+    {
+        std::unique_ptr<FileReader> reader;
+
+        /// the current chunk of the file
+        const unsigned char* data;
+
+        std::size_t offset;
+
+        std::size_t size;
+
+        uint64_t length;
+
+        /// 0 = reading data, 1 = only the length block remains, 2 = finished
+        int phase;
+
+        bool error;
+
+    public:
+
+        LaneSource() : data(nullptr), offset(0), size(0), length(0), phase(2), error(false)
+        {
+
+        }
+
+        bool open(const std::string& file)
+        {
+            this->reader.reset();
+            this->data = nullptr;
+            this->offset = this->size = 0;
+            this->length = 0;
+            this->phase = 0;
+            this->error = false;
+            try
+            {
+                this->reader = FileReader::open(file);
+            }
+            catch (const std::runtime_error&)
+            {
+                return false;
+            }
+            return true;
+        }
+
+        bool failed() const
+        {
+            return this->error;
+        }
+
+        /// writes the next block into block; returns true if it was the file's last
+        bool next(unsigned char* block)
+        {
+            if (this->phase == 1)
+            {
+                std::memset(block, 0, 56);
+                this->finish(block);
+                return true;
+            }
+            /// blocks may straddle the chunks the reader hands out
+            std::size_t filled = 0;
+            while (filled < 64)
+            {
+                if (this->offset == this->size)
+                {
+                    if (!this->reader || !this->fetch())
+                    {
+                        this->reader.reset();
+                        break;
+                    }
+                }
+                std::size_t count = std::min<std::size_t>(64 - filled, this->size - this->offset);
+                std::memcpy(block + filled, this->data + this->offset, count);
+                filled += count;
+                this->offset += count;
+            }
+            this->length += filled;
+            if (filled == 64)
+            {
+                return false;
+            }
+            block[filled] = 0x80;
+            std::memset(block + filled + 1, 0, 63 - filled);
+            if (filled < 56)
+            {
+                this->finish(block);
+                return true;
+            }
+            this->phase = 1;
+            return false;
+        }
+
+    private:
+
+        bool fetch()
+        {
+            try
+            {
+                this->offset = 0;
+                return this->reader->next(this->data, this->size);
+            }
+            catch (const std::runtime_error&)
+            {
+                this->error = true;
+                this->size = 0;
+                return false;
+            }
+        }
+
+        void finish(unsigned char* block)
+        {
+            uint64_t bits = this->length * 8;
+            for (int i = 0; i < 8; ++i)
+            {
+                block[56 + i] = static_cast<unsigned char>(bits >> (8 * i));
+            }
+            this->phase = 2;
+        }
+    };
+
+    std::string toHex(const uint32_t* words)
+    {
+        static const char digits[] = "0123456789ABCDEF";
+        std::string hex(32, '0');
+        for (int i = 0; i < 16; ++i)
+        {
+            unsigned char byte = static_cast<unsigned char>(words[i / 4] >> (8 * (i % 4)));
+            hex[2 * i] = digits[byte >> 4];
+            hex[2 * i + 1] = digits[byte & 0xF];
+        }
+        return hex;
+    }
+
+    /// hashes the files Lanes at a time with the provided compression
+    /// function; each lane moves on to the next unhashed file as soon as its
+    /// current one is finished
+    template<int Lanes>
+    std::vector<std::string> hashAll(const std::vector<std::string>& files, void (*compress)(uint32_t*, const uint32_t*))
+    {
+        const int lanes = Lanes;
+        std::vector<std::string> digests(files.size());
+        std::vector<LaneSource> sources(lanes);
+        std::vector<std::size_t> assigned(lanes);
+        std::vector<bool> active(lanes, false);
+
+        /// lane-interleaved (structure of arrays) state and message words
+        std::vector<uint32_t> state(4 * lanes);
+        std::vector<uint32_t> words(16 * lanes);
+        unsigned char block[64];
+        std::vector<bool> last(lanes);
+
+        std::size_t nextFile = 0;
+        auto assign = [&](int lane)
+        {
+            active[lane] = false;
+            while (nextFile < files.size())
+            {
+                std::size_t file = nextFile++;
+                if (sources[lane].open(files[file]))
+                {
+                    assigned[lane] = file;
+                    active[lane] = true;
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        state[i * lanes + lane] = initialState[i];
+                    }
+                    return;
+                }
+            }
+        };
+        int running = 0;
+        for (int lane = 0; lane < lanes; ++lane)
+        {
+            assign(lane);
+            running += active[lane] ? 1 : 0;
+        }
+
+        while (running > 0)
+        {
+            for (int lane = 0; lane < lanes; ++lane)
+            {
+                if (active[lane])
+                {
+                    last[lane] = sources[lane].next(block);
+                    for (int i = 0; i < 16; ++i)
+                    {
+                        uint32_t word;
+                        std::memcpy(&word, block + 4 * i, sizeof(word));
+                        words[i * lanes + lane] = word;
+                    }
+                }
+            }
+            compress(state.data(), words.data());
+            for (int lane = 0; lane < lanes; ++lane)
+            {
+                if (active[lane] && last[lane])
+                {
+                    if (!sources[lane].failed())
+                    {
+                        uint32_t digest[4];
+                        for (int i = 0; i < 4; ++i)
+                        {
+                            digest[i] = state[i * lanes + lane];
+                        }
+                        digests[assigned[lane]] = toHex(digest);
+                    }
+                    assign(lane);
+                    running -= active[lane] ? 0 : 1;
+                }
+            }
+        }
+        return digests;
+    }
+
+    void cpuid(int leaf, int subleaf, int info[4])
+    {
+#if defined(_MSC_VER)
+        __cpuidex(info, leaf, subleaf);
+#else
+        __asm__ __volatile__("cpuid" : "=a"(info[0]), "=b"(info[1]), "=c"(info[2]), "=d"(info[3]) : "a"(leaf), "c"(subleaf));
+#endif
+    }
+
+#if defined(FONTSYNC_MD5_AVX2) || defined(FONTSYNC_MD5_AVX512)
+    /// the register state the operating system saves on context switches
+    uint64_t enabledRegisterState()
+    {
+        int info[4];
+        cpuid(1, 0, info);
+        if ((info[2] & (1 << 27)) == 0)
+        {
+            return 0;
+        }
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#else
+        uint32_t low, high;
+        __asm__ __volatile__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+        return (static_cast<uint64_t>(high) << 32) | low;
+#endif
+    }
+#endif
+}
+
+#if defined(FONTSYNC_MD5_AVX2)
+#if defined(__clang__)
+# pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#elif defined(__GNUC__)
+# pragma GCC push_options
+# pragma GCC target("avx2")
+#endif
+namespace
+{
+    namespace avx2
+    {
+        struct AVX2Vector
+        {
+            typedef __m256i type;
+            static const int lanes = 8;
+            static type load(const uint32_t* words) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words)); }
+            static void store(uint32_t* words, type value) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(words), value); }
+            static type set1(uint32_t value) { return _mm256_set1_epi32(static_cast<int>(value)); }
+            static type add(type a, type b) { return _mm256_add_epi32(a, b); }
+            static type bitAnd(type a, type b) { return _mm256_and_si256(a, b); }
+            static type bitOr(type a, type b) { return _mm256_or_si256(a, b); }
+            static type bitXor(type a, type b) { return _mm256_xor_si256(a, b); }
+            static type bitNot(type a) { return _mm256_xor_si256(a, _mm256_set1_epi32(-1)); }
+            template<int Bits> static type rotate(type a) { return _mm256_or_si256(_mm256_slli_epi32(a, Bits), _mm256_srli_epi32(a, 32 - Bits)); }
+        };
+
+#include "MultiBufferMD5Kernel.inl"
+    }
+}
+#if defined(__clang__)
+# pragma clang attribute pop
+#elif defined(__GNUC__)
+# pragma GCC pop_options
+#endif
+#endif
+
+#if defined(FONTSYNC_MD5_AVX512)
+#if defined(__clang__)
+# pragma clang attribute push (__attribute__((target("avx512f"))), apply_to = function)
+#elif defined(__GNUC__)
+# pragma GCC push_options
+# pragma GCC target("avx512f")
+#endif
+namespace
+{
+    namespace avx512
+    {
+        struct AVX512Vector
+        {
+            typedef __m512i type;
+            static const int lanes = 16;
+            static type load(const uint32_t* words) { return _mm512_loadu_si512(words); }
+            static void store(uint32_t* words, type value) { _mm512_storeu_si512(words, value); }
+            static type set1(uint32_t value) { return _mm512_set1_epi32(static_cast<int>(value)); }
+            static type add(type a, type b) { return _mm512_add_epi32(a, b); }
+            static type bitAnd(type a, type b) { return _mm512_and_si512(a, b); }
+            static type bitOr(type a, type b) { return _mm512_or_si512(a, b); }
+            static type bitXor(type a, type b) { return _mm512_xor_si512(a, b); }
+            static type bitNot(type a) { return _mm512_xor_si512(a, _mm512_set1_epi32(-1)); }
+            template<int Bits> static type rotate(type a) { return _mm512_rol_epi32(a, Bits); }
+        };
+
+#include "MultiBufferMD5Kernel.inl"
+    }
+}
+#if defined(__clang__)
+# pragma clang attribute pop
+#elif defined(__GNUC__)
+# pragma GCC pop_options
+#endif
+#endif
+
+bool isSupported(MD5Engine engine)
+{
+    int info[4];
+    switch (engine)
+    {
+    case MD5Engine::Scalar:
+        return true;
+    case MD5Engine::SSE2:
+        cpuid(1, 0, info);
+        return (info[3] & (1 << 26)) != 0;
+    case MD5Engine::AVX2:
+#if defined(FONTSYNC_MD5_AVX2)
+        cpuid(7, 0, info);
+        return (info[1] & (1 << 5)) != 0 && (enabledRegisterState() & 0x6) == 0x6;
+#else
+        return false;
+#endif
+    case MD5Engine::AVX512:
+#if defined(FONTSYNC_MD5_AVX512)
+        cpuid(7, 0, info);
+        return (info[1] & (1 << 16)) != 0 && (enabledRegisterState() & 0xE6) == 0xE6;
+#else
+        return false;
+#endif
+    default:
+        return false;
+    }
+}
+
+MD5Engine detectMD5Engine()
+{
+    static const MD5Engine detected = isSupported(MD5Engine::AVX512) ? MD5Engine::AVX512 :
+                                      isSupported(MD5Engine::AVX2) ? MD5Engine::AVX2 :
+                                      isSupported(MD5Engine::SSE2) ? MD5Engine::SSE2 :
+                                      MD5Engine::Scalar;
+    return detected;
+}
+
+const char* toString(MD5Engine engine)
+{
+    switch (engine)
+    {
+    case MD5Engine::SSE2:
+        return "sse2";
+    case MD5Engine::AVX2:
+        return "avx2";
+    case MD5Engine::AVX512:
+        return "avx512";
+    case MD5Engine::Scalar:
+    default:
+        return "scalar";
+    }
+}
+
+std::vector<std::string> md5Batch(const std::vector<std::string>& files, MD5Engine engine)
+{
+    if (!isSupported(engine))
+    {
+        engine = detectMD5Engine();
+    }
+    /// a lane costs as much as a whole file, so don't use more lanes than files
+    if (files.size() <= 1)
+    {
+        engine = MD5Engine::Scalar;
+    }
+    switch (engine)
+    {
+#if defined(FONTSYNC_MD5_AVX512)
+    case MD5Engine::AVX512:
+        return hashAll<avx512::AVX512Vector::lanes>(files, &avx512::compress<avx512::AVX512Vector>);
+#endif
+#if defined(FONTSYNC_MD5_AVX2)
+    case MD5Engine::AVX2:
+        return hashAll<avx2::AVX2Vector::lanes>(files, &avx2::compress<avx2::AVX2Vector>);
+#endif
+    case MD5Engine::SSE2:
+        return hashAll<SSE2Vector::lanes>(files, &compress<SSE2Vector>);
+    case MD5Engine::Scalar:
+    default:
+        return hashAll<ScalarVector::lanes>(files, &compress<ScalarVector>);
+    }
+}
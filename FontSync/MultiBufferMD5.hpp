@@ -0,0 +1,76 @@
+#ifndef MULTI_BUFFER_MD5_HPP_INCLUDED
+#define MULTI_BUFFER_MD5_HPP_INCLUDED
+
+/// some microsoft compilers still benefit from the use of #pragma once
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif
+
+#include <string>
+#include <vector>
+
+/**
+ * The MD5 kernels available to md5Batch.
+ *
+ * MD5 is a serial chain within a single message, so the vector kernels gain
+ * their throughput by hashing one file per SIMD lane, in lock-step.
+ *
+ */
+enum class MD5Engine
+{
+    /// one file at a time
+    Scalar,
+
+    /// 4 files at a time
+    SSE2,
+
+    /// 8 files at a time
+    AVX2,
+
+    /// 16 files at a time
+    AVX512
+};
+
+/**
+ * Retrieves the widest MD5 engine supported by both this build and this CPU.
+ *
+ * @return the widest supported MD5 engine
+ *
+ */
+MD5Engine detectMD5Engine();
+
+/**
+ * Determines whether the provided engine can run on this build and CPU.
+ *
+ * @param engine the engine to check
+ *
+ * @return true if the provided engine is usable, otherwise false
+ *
+ */
+bool isSupported(MD5Engine engine);
+
+/**
+ * Retrieves a human readable name for the provided engine.
+ *
+ * @param engine the engine to name
+ *
+ * @return the name of the provided engine
+ *
+ */
+const char* toString(MD5Engine engine);
+
+/**
+ * Calculates the MD5 hashes of many files at once.
+ *
+ * @param files the files to hash
+ *
+ * @param engine the engine to hash with; unsupported engines fall back to
+ *        the widest supported one
+ *
+ * @return the MD5 hash of each file, in the same order and format as md5();
+ *         the entry for a file that cannot be read is empty
+ *
+ */
+std::vector<std::string> md5Batch(const std::vector<std::string>& files, MD5Engine engine = detectMD5Engine());
+
+#endif
@@ -0,0 +1,70 @@
+/// the MD5 compression function, generic over the vector type V.  It has no
+/// include guard: MultiBufferMD5.cpp includes it once per instruction set,
+/// each time into its own namespace and under its own target, so that the
+/// wider kernels are compiled without raising the target of the whole file.
+
+/// the four MD5 round functions, written to need as few operations as possible
+template<typename V> typename V::type roundF(typename V::type b, typename V::type c, typename V::type d) { return V::bitXor(d, V::bitAnd(b, V::bitXor(c, d))); }
+template<typename V> typename V::type roundG(typename V::type b, typename V::type c, typename V::type d) { return V::bitXor(c, V::bitAnd(d, V::bitXor(b, c))); }
+template<typename V> typename V::type roundH(typename V::type b, typename V::type c, typename V::type d) { return V::bitXor(b, V::bitXor(c, d)); }
+template<typename V> typename V::type roundI(typename V::type b, typename V::type c, typename V::type d) { return V::bitXor(c, V::bitOr(b, V::bitNot(d))); }
+
+#define FONTSYNC_MD5_STEP(f, a, b, c, d, word, bits, i) \
+    a = V::add(b, V::template rotate<bits>(V::add(V::add(a, f<V>(b, c, d)), V::add(V::set1(constants[i]), w[word]))));
+
+/// runs the MD5 compression function over one block per lane
+template<typename V>
+void compress(uint32_t* state, const uint32_t* block)
+{
+    typedef typename V::type vector;
+    vector w[16];
+    for (int i = 0; i < 16; ++i)
+    {
+        w[i] = V::load(block + i * V::lanes);
+    }
+    vector a = V::load(state), b = V::load(state + V::lanes), c = V::load(state + 2 * V::lanes), d = V::load(state + 3 * V::lanes);
+    vector aa = a, bb = b, cc = c, dd = d;
+
+    FONTSYNC_MD5_STEP(roundF, a, b, c, d,  0,  7,  0) FONTSYNC_MD5_STEP(roundF, d, a, b, c,  1, 12,  1)
+    FONTSYNC_MD5_STEP(roundF, c, d, a, b,  2, 17,  2) FONTSYNC_MD5_STEP(roundF, b, c, d, a,  3, 22,  3)
+    FONTSYNC_MD5_STEP(roundF, a, b, c, d,  4,  7,  4) FONTSYNC_MD5_STEP(roundF, d, a, b, c,  5, 12,  5)
+    FONTSYNC_MD5_STEP(roundF, c, d, a, b,  6, 17,  6) FONTSYNC_MD5_STEP(roundF, b, c, d, a,  7, 22,  7)
+    FONTSYNC_MD5_STEP(roundF, a, b, c, d,  8,  7,  8) FONTSYNC_MD5_STEP(roundF, d, a, b, c,  9, 12,  9)
+    FONTSYNC_MD5_STEP(roundF, c, d, a, b, 10, 17, 10) FONTSYNC_MD5_STEP(roundF, b, c, d, a, 11, 22, 11)
+    FONTSYNC_MD5_STEP(roundF, a, b, c, d, 12,  7, 12) FONTSYNC_MD5_STEP(roundF, d, a, b, c, 13, 12, 13)
+    FONTSYNC_MD5_STEP(roundF, c, d, a, b, 14, 17, 14) FONTSYNC_MD5_STEP(roundF, b, c, d, a, 15, 22, 15)
+
+    FONTSYNC_MD5_STEP(roundG, a, b, c, d,  1,  5, 16) FONTSYNC_MD5_STEP(roundG, d, a, b, c,  6,  9, 17)
+    FONTSYNC_MD5_STEP(roundG, c, d, a, b, 11, 14, 18) FONTSYNC_MD5_STEP(roundG, b, c, d, a,  0, 20, 19)
+    FONTSYNC_MD5_STEP(roundG, a, b, c, d,  5,  5, 20) FONTSYNC_MD5_STEP(roundG, d, a, b, c, 10,  9, 21)
+    FONTSYNC_MD5_STEP(roundG, c, d, a, b, 15, 14, 22) FONTSYNC_MD5_STEP(roundG, b, c, d, a,  4, 20, 23)
+    FONTSYNC_MD5_STEP(roundG, a, b, c, d,  9,  5, 24) FONTSYNC_MD5_STEP(roundG, d, a, b, c, 14,  9, 25)
+    FONTSYNC_MD5_STEP(roundG, c, d, a, b,  3, 14, 26) FONTSYNC_MD5_STEP(roundG, b, c, d, a,  8, 20, 27)
+    FONTSYNC_MD5_STEP(roundG, a, b, c, d, 13,  5, 28) FONTSYNC_MD5_STEP(roundG, d, a, b, c,  2,  9, 29)
+    FONTSYNC_MD5_STEP(roundG, c, d, a, b,  7, 14, 30) FONTSYNC_MD5_STEP(roundG, b, c, d, a, 12, 20, 31)
+
+    FONTSYNC_MD5_STEP(roundH, a, b, c, d,  5,  4, 32) FONTSYNC_MD5_STEP(roundH, d, a, b, c,  8, 11, 33)
+    FONTSYNC_MD5_STEP(roundH, c, d, a, b, 11, 16, 34) FONTSYNC_MD5_STEP(roundH, b, c, d, a, 14, 23, 35)
+    FONTSYNC_MD5_STEP(roundH, a, b, c, d,  1,  4, 36) FONTSYNC_MD5_STEP(roundH, d, a, b, c,  4, 11, 37)
+    FONTSYNC_MD5_STEP(roundH, c, d, a, b,  7, 16, 38) FONTSYNC_MD5_STEP(roundH, b, c, d, a, 10, 23, 39)
+    FONTSYNC_MD5_STEP(roundH, a, b, c, d, 13,  4, 40) FONTSYNC_MD5_STEP(roundH, d, a, b, c,  0, 11, 41)
+    FONTSYNC_MD5_STEP(roundH, c, d, a, b,  3, 16, 42) FONTSYNC_MD5_STEP(roundH, b, c, d, a,  6, 23, 43)
+    FONTSYNC_MD5_STEP(roundH, a, b, c, d,  9,  4, 44) FONTSYNC_MD5_STEP(roundH, d, a, b, c, 12, 11, 45)
+    FONTSYNC_MD5_STEP(roundH, c, d, a, b, 15, 16, 46) FONTSYNC_MD5_STEP(roundH, b, c, d, a,  2, 23, 47)
+
+    FONTSYNC_MD5_STEP(roundI, a, b, c, d,  0,  6, 48) FONTSYNC_MD5_STEP(roundI, d, a, b, c,  7, 10, 49)
+    FONTSYNC_MD5_STEP(roundI, c, d, a, b, 14, 15, 50) FONTSYNC_MD5_STEP(roundI, b, c, d, a,  5, 21, 51)
+    FONTSYNC_MD5_STEP(roundI, a, b, c, d, 12,  6, 52) FONTSYNC_MD5_STEP(roundI, d, a, b, c,  3, 10, 53)
+    FONTSYNC_MD5_STEP(roundI, c, d, a, b, 10, 15, 54) FONTSYNC_MD5_STEP(roundI, b, c, d, a,  1, 21, 55)
+    FONTSYNC_MD5_STEP(roundI, a, b, c, d,  8,  6, 56) FONTSYNC_MD5_STEP(roundI, d, a, b, c, 15, 10, 57)
+    FONTSYNC_MD5_STEP(roundI, c, d, a, b,  6, 15, 58) FONTSYNC_MD5_STEP(roundI, b, c, d, a, 13, 21, 59)
+    FONTSYNC_MD5_STEP(roundI, a, b, c, d,  4,  6, 60) FONTSYNC_MD5_STEP(roundI, d, a, b, c, 11, 10, 61)
+    FONTSYNC_MD5_STEP(roundI, c, d, a, b,  2, 15, 62) FONTSYNC_MD5_STEP(roundI, b, c, d, a,  9, 21, 63)
+
+    V::store(state, V::add(a, aa));
+    V::store(state + V::lanes, V::add(b, bb));
+    V::store(state + 2 * V::lanes, V::add(c, cc));
+    V::store(state + 3 * V::lanes, V::add(d, dd));
+}
+
+#undef FONTSYNC_MD5_STEP
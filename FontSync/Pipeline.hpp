@@ -0,0 +1,286 @@
+#ifndef PIPELINE_HPP_INCLUDED
+#define PIPELINE_HPP_INCLUDED
+
+/// some microsoft compilers still benefit from the use of #pragma once
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "Logging.hpp"
+
+/**
+ * A thread safe, bounded, first in first out queue connecting two pipeline
+ * stages.
+ *
+ * Producers block while the queue is full, so a slow stage holds back the
+ * stages feeding it instead of letting work pile up in memory.
+ *
+ */
+template<typename T>
+class BoundedQueue
+{
+    std::deque<T> items;
+
+    std::size_t capacity;
+
+    bool closed;
+
+    std::mutex mutex;
+
+    std::condition_variable notFull;
+
+    std::condition_variable notEmpty;
+
+public:
+
+    /**
+     * Constructs an empty, open BoundedQueue.
+     *
+     * @param capacity the most items the queue holds at once (at least 1)
+     *
+     */
+    explicit BoundedQueue(std::size_t capacity) : capacity(capacity > 0 ? capacity : 1), closed(false)
+    {
+
+    }
+
+    /**
+     * Appends an item, waiting for room if the queue is full.
+     *
+     * @param item the item to append
+     *
+     * @return true if the item was appended, false if the queue was closed
+     *
+     */
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->notFull.wait(lock, [this]() { return this->closed || this->items.size() < this->capacity; });
+        if (this->closed)
+        {
+            return false;
+        }
+        this->items.push_back(std::move(item));
+        this->notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * Removes the oldest item, waiting for one if the queue is empty.
+     *
+     * @param item receives the removed item
+     *
+     * @return true if an item was removed, false if the queue is closed and drained
+     *
+     */
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->notEmpty.wait(lock, [this]() { return this->closed || !this->items.empty(); });
+        if (this->items.empty())
+        {
+            return false;
+        }
+        item = std::move(this->items.front());
+        this->items.pop_front();
+        this->notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * Closes the queue; no more items can be pushed, and consumers stop once
+     * the items already queued are drained.
+     *
+     */
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->closed = true;
+        this->notFull.notify_all();
+        this->notEmpty.notify_all();
+    }
+};
+
+/**
+ * A pool of workers that takes items from one queue, processes them and
+ * passes them on to the next.
+ *
+ * The stage measures how long its workers spend processing, as opposed to
+ * waiting on either queue, so the stage that limits the pipeline can be
+ * told apart from the stages waiting on it.  The output queue is closed
+ * once the input queue is closed and every worker has finished.
+ *
+ */
+template<typename T>
+class PipelineStage
+{
+public:
+
+    /**
+     * Processes an item.
+     *
+     * @return true to pass the item on to the next stage, false to drop it
+     *
+     */
+    typedef std::function<bool(T&)> Process;
+
+private:
+
+    std::string name;
+
+    BoundedQueue<T>& input;
+
+    BoundedQueue<T>* output;
+
+    Process process;
+
+    std::vector<std::thread> workers;
+
+    std::atomic<unsigned> running;
+
+    std::atomic<int64_t> busyMicroseconds;
+
+    std::atomic<uint64_t> processed;
+
+    std::chrono::steady_clock::time_point started;
+
+    std::chrono::steady_clock::time_point finished;
+
+    bool done;
+
+    std::mutex mutex;
+
+    void work()
+    {
+        T item;
+        while (this->input.pop(item))
+        {
+            auto start = std::chrono::steady_clock::now();
+            bool passOn = false;
+            try
+            {
+                passOn = this->process(item);
+            }
+            catch (const std::exception& e)
+            {
+                FONTSYNC_LOG_TRIVIAL(error) << "Unexpected error in the " << this->name << " stage: " << e.what();
+            }
+            this->busyMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+            ++this->processed;
+            if (passOn && this->output != nullptr)
+            {
+                this->output->push(std::move(item));
+            }
+        }
+        if (--this->running == 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->finished = std::chrono::steady_clock::now();
+                this->done = true;
+            }
+            if (this->output != nullptr)
+            {
+                this->output->close();
+            }
+        }
+    }
+
+public:
+
+    /**
+     * Constructs a PipelineStage and starts its workers.
+     *
+     * @param name the name the stage is reported under
+     *
+     * @param workers the number of workers to process items with (at least 1)
+     *
+     * @param input the queue to take items from
+     *
+     * @param output the queue to pass items on to, or nullptr for the last stage
+     *
+     * @param process invoked for each item, concurrently if there are several workers
+     *
+     */
+    PipelineStage(const std::string& name, unsigned workers, BoundedQueue<T>& input, BoundedQueue<T>* output, const Process& process) :
+        name(name), input(input), output(output), process(process), running(workers > 0 ? workers : 1), busyMicroseconds(0), processed(0),
+        started(std::chrono::steady_clock::now()), finished(started), done(false)
+    {
+        for (unsigned i = 0, count = this->running; i < count; ++i)
+        {
+            this->workers.push_back(std::thread([this]() { this->work(); }));
+        }
+    }
+
+    /**
+     * Waits for every worker to finish.
+     *
+     */
+    void join()
+    {
+        for (auto& worker : this->workers)
+        {
+            if (worker.joinable())
+            {
+                worker.join();
+            }
+        }
+    }
+
+    /**
+     * Retrieves the share of the stage's worker time spent processing.
+     *
+     * @return the utilization of the stage, [0, 1]
+     *
+     */
+    double utilization()
+    {
+        std::chrono::steady_clock::time_point end;
+        {
+            std::lock_guard<std::mutex> lock(this->mutex);
+            end = this->done ? this->finished : std::chrono::steady_clock::now();
+        }
+        double available = std::chrono::duration<double, std::micro>(end - this->started).count() * this->workers.size();
+        return available > 0 ? (std::min)(1.0, this->busyMicroseconds / available) : 0.0;
+    }
+
+    /**
+     * Describes the stage's workload, e.g. "fetch: 12 item(s), 4 worker(s), 93% busy".
+     *
+     * @return a description of the stage's workload
+     *
+     */
+    std::string report()
+    {
+        std::stringstream ss;
+        ss << this->name << ": " << this->processed << " item(s), " << this->workers.size() << " worker(s), " <<
+            static_cast<int>(this->utilization() * 100 + 0.5) << "% busy";
+        return ss.str();
+    }
+
+    /**
+     * Destructor, waits for every worker to finish.
+     *
+     */
+    ~PipelineStage()
+    {
+        this->join();
+    }
+};
+
+#endif
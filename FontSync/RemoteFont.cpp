@@ -1,30 +1,27 @@
 #include "RemoteFont.hpp"
 
-struct RemoteFont::RemoteFontImpl
-{
-	std::string remoteFile;
-
-	std::string md5Hash;
-
-
-	RemoteFontImpl(const std::string& remoteFile, const std::string& md5Hash) : remoteFile(remoteFile), md5Hash(md5Hash)
-	{
-
-	}
-};
+#include <utility>
 
 RemoteFont::RemoteFont(const std::string& name,
 	const std::string& category,
 	const std::string& type,
 	const std::string& remoteFile,
-	const std::string& md5Hash) :
+	const std::string& hash,
+	HashAlgorithm hashAlgorithm,
+	int priority,
+	uint64_t size) :
 	FontBase(name, category, type),
-	impl(new RemoteFontImpl(remoteFile, md5Hash))
+	remoteFile(remoteFile),
+	hash(hash),
+	hashAlgorithm(hashAlgorithm),
+	priority(priority),
+	size(size),
+	chunkSize(0)
 {
 
 }
 
-RemoteFont::RemoteFont(const RemoteFont& other) : FontBase(other), impl(new RemoteFontImpl(other.impl->remoteFile, other.impl->md5Hash))
+RemoteFont::RemoteFont(const RemoteFont& other) : FontBase(other), remoteFile(other.remoteFile), hash(other.hash), hashAlgorithm(other.hashAlgorithm), priority(other.priority), size(other.size), patches(other.patches), chunkSize(other.chunkSize), chunks(other.chunks)
 {
 
 }
@@ -32,22 +29,105 @@ RemoteFont::RemoteFont(const RemoteFont& other) : FontBase(other), impl(new Remo
 RemoteFont& RemoteFont::operator=(const RemoteFont& other)
 {
 	FontBase::operator=(other);
-	this->impl->remoteFile = other.impl->remoteFile;
-	this->impl->md5Hash = other.impl->md5Hash;
+	this->remoteFile = other.remoteFile;
+	this->hash = other.hash;
+	this->hashAlgorithm = other.hashAlgorithm;
+	this->priority = other.priority;
+	this->size = other.size;
+	this->patches = other.patches;
+	this->chunkSize = other.chunkSize;
+	this->chunks = other.chunks;
+	return *this;
+}
+
+RemoteFont::RemoteFont(RemoteFont&& other) BOOST_NOEXCEPT : FontBase(std::move(other)), remoteFile(std::move(other.remoteFile)), hash(std::move(other.hash)), hashAlgorithm(other.hashAlgorithm), priority(other.priority), size(other.size), patches(std::move(other.patches)), chunkSize(other.chunkSize), chunks(std::move(other.chunks))
+{
+
+}
+
+RemoteFont& RemoteFont::operator=(RemoteFont&& other) BOOST_NOEXCEPT
+{
+	FontBase::operator=(std::move(other));
+	this->remoteFile = std::move(other.remoteFile);
+	this->hash = std::move(other.hash);
+	this->hashAlgorithm = other.hashAlgorithm;
+	this->priority = other.priority;
+	this->size = other.size;
+	this->patches = std::move(other.patches);
+	this->chunkSize = other.chunkSize;
+	this->chunks = std::move(other.chunks);
 	return *this;
 }
 
 const std::string& RemoteFont::getRemoteFile() const
 {
-	return this->impl->remoteFile;
+	return this->remoteFile;
+}
+
+const std::string& RemoteFont::getHash() const
+{
+	return this->hash;
+}
+
+HashAlgorithm RemoteFont::getHashAlgorithm() const
+{
+	return this->hashAlgorithm;
+}
+
+int RemoteFont::getPriority() const
+{
+	return this->priority;
+}
+
+uint64_t RemoteFont::getSize() const
+{
+	return this->size;
+}
+
+void RemoteFont::setPatches(std::vector<FontPatch> patches)
+{
+	this->patches = std::move(patches);
+}
+
+const FontPatch* RemoteFont::getPatchFrom(const std::string& digest) const
+{
+	for (const auto& patch : this->patches)
+	{
+		if (sameDigest(patch.from, digest))
+		{
+			return &patch;
+		}
+	}
+	return nullptr;
 }
 
-const std::string& RemoteFont::getMD5() const
+void RemoteFont::setChunks(uint64_t chunkSize, std::vector<std::string> chunks)
 {
-	return this->impl->md5Hash;
+	this->chunkSize = chunkSize;
+	this->chunks = std::move(chunks);
+}
+
+uint64_t RemoteFont::getChunkSize() const
+{
+	return this->chunkSize;
+}
+
+const std::vector<std::string>& RemoteFont::getChunks() const
+{
+	return this->chunks;
 }
 
 RemoteFont::~RemoteFont()
 {
 
+}
+
+bool downloadsBefore(const RemoteFont& first, const RemoteFont& second)
+{
+	if (first.getPriority() != second.getPriority())
+	{
+		return first.getPriority() > second.getPriority();
+	}
+	/// an unknown size (0) sorts after every known size
+	return first.getSize() - 1 < second.getSize() - 1;
 }
\ No newline at end of file
@@ -6,22 +6,58 @@
 # pragma once
 #endif
 
-#include <memory>
+#include <cstdint>
 #include <string>
+#include <vector>
 #include "FontBase.hpp"
 
+/**
+ * A delta the server offers from an earlier revision of a font to the
+ * revision the index lists, as written by createDelta.
+ *
+ */
+struct FontPatch
+{
+	/// the digest of the earlier revision, with the font's hash algorithm
+	std::string from;
+
+	/// the remote delta file
+	std::string remoteFile;
+
+	/// the size of the remote delta file in bytes, or 0 if unknown
+	uint64_t size;
+};
+
 class RemoteFont : public FontBase
 {
-	/// Private Implementation
-	struct RemoteFontImpl;
+	/// the remote font file
+	std::string remoteFile;
+
+	/// the content hash of this font
+	std::string hash;
+
+	/// the algorithm that produced the content hash of this font
+	HashAlgorithm hashAlgorithm;
+
+	/// the download priority of this font; higher is sooner
+	int priority;
+
+	/// the size of the remote font file in bytes, or 0 if unknown
+	uint64_t size;
 
-	/// Private Implementation
-	std::unique_ptr<RemoteFontImpl> impl;
+	/// the deltas offered from earlier revisions of this font
+	std::vector<FontPatch> patches;
+
+	/// the size of the chunks listed, or 0 if none are
+	uint64_t chunkSize;
+
+	/// the digest of each chunk of the remote font file, for large files
+	std::vector<std::string> chunks;
 
 public:
 
 	/**
-	* Constructs a RemoteFont with the provided name, category, type, and md5 hash
+	* Constructs a RemoteFont with the provided name, category, type, and content hash
 	*
 	* @param name the name of this font
 	*
@@ -29,12 +65,25 @@ public:
 	*
 	* @param type the type of this font
 	*
+	* @param remoteFile the remote font file
+	*
+	* @param hash the content hash of this font, as hex
+	*
+	* @param hashAlgorithm the algorithm that produced the content hash
+	*
+	* @param priority the download priority of this font; higher is sooner
+	*
+	* @param size the size of the remote font file in bytes, or 0 if unknown
+	*
 	*/
 	RemoteFont(const std::string& name,
 		const std::string& category,
 		const std::string& type,
 		const std::string& remoteFile, 
-		const std::string& md5Hash);
+		const std::string& hash,
+		HashAlgorithm hashAlgorithm = HashAlgorithm::MD5,
+		int priority = 0,
+		uint64_t size = 0);
 
 	/**
 	* Copy Constructor
@@ -48,6 +97,18 @@ public:
 	*/
 	RemoteFont& operator=(const RemoteFont&);
 
+	/**
+	* Move Constructor
+	*
+	*/
+	RemoteFont(RemoteFont&&) BOOST_NOEXCEPT;
+
+	/**
+	* Move Assignment
+	*
+	*/
+	RemoteFont& operator=(RemoteFont&&) BOOST_NOEXCEPT;
+
 	/**
 	 * Retrieves the remote font file
 	 *
@@ -57,12 +118,80 @@ public:
 	const std::string& getRemoteFile() const;
 
 	/**
-	* Retrieves the MD5 hash of this font
+	* Retrieves the content hash of this font
+	*
+	* @return the content hash of this font, as hex
+	*
+	*/
+	virtual const std::string& getHash() const;
+
+	/**
+	* Retrieves the algorithm that produced the content hash of this font
+	*
+	* @return the algorithm that produced the content hash of this font
+	*
+	*/
+	virtual HashAlgorithm getHashAlgorithm() const;
+
+	/**
+	* Retrieves the download priority of this font
 	*
-	* @return the MD5 hash of this font
+	* @return the download priority of this font; higher is sooner
 	*
 	*/
-	virtual const std::string& getMD5() const;
+	int getPriority() const;
+
+	/**
+	* Retrieves the size of the remote font file
+	*
+	* @return the size of the remote font file in bytes, or 0 if unknown
+	*
+	*/
+	uint64_t getSize() const;
+
+	/**
+	* Changes the deltas offered from earlier revisions of this font
+	*
+	* @param patches the deltas offered, each from a different revision
+	*
+	*/
+	void setPatches(std::vector<FontPatch> patches);
+
+	/**
+	* Looks up the delta offered from the provided revision of this font
+	*
+	* @param digest the digest of the revision to patch
+	*
+	* @return the delta from that revision, or nullptr if none is offered
+	*
+	*/
+	const FontPatch* getPatchFrom(const std::string& digest) const;
+
+	/**
+	* Changes the chunk digests of the remote font file
+	*
+	* @param chunkSize the size of every chunk but the last, in bytes
+	*
+	* @param chunks the digest of each chunk, in order, with this font's hash algorithm
+	*
+	*/
+	void setChunks(uint64_t chunkSize, std::vector<std::string> chunks);
+
+	/**
+	* Retrieves the size of the chunks of the remote font file
+	*
+	* @return the size of every chunk but the last, or 0 if no chunks are listed
+	*
+	*/
+	uint64_t getChunkSize() const;
+
+	/**
+	* Retrieves the chunk digests of the remote font file
+	*
+	* @return the digest of each chunk, in order; empty if none are listed
+	*
+	*/
+	const std::vector<std::string>& getChunks() const;
 
 	/**
 	* Virtual Destructor
@@ -71,4 +200,18 @@ public:
 	virtual ~RemoteFont();
 };
 
+/**
+ * Orders fonts for downloading, so the most critical fonts become usable
+ * earliest: higher priorities first, then smaller files first, with files
+ * of unknown size last.
+ *
+ * @param first the first font to compare
+ *
+ * @param second the second font to compare
+ *
+ * @return true if the first font should be downloaded before the second
+ *
+ */
+bool downloadsBefore(const RemoteFont& first, const RemoteFont& second);
+
 #endif
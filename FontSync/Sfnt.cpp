@@ -0,0 +1,332 @@
+#include "Sfnt.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <emmintrin.h>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/filesystem.hpp>
+
+#include "FileReader.hpp"
+
+namespace
+{
+    uint16_t read16(const unsigned char* data)
+    {
+        return static_cast<uint16_t>((data[0] << 8) | data[1]);
+    }
+
+    uint32_t read32(const unsigned char* data)
+    {
+        return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) | (static_cast<uint32_t>(data[2]) << 8) | data[3];
+    }
+
+    uint32_t makeTag(const char* name)
+    {
+        return read32(reinterpret_cast<const unsigned char*>(name));
+    }
+
+    std::string tagName(uint32_t tag)
+    {
+        std::string rv(4, ' ');
+        for (int i = 0; i < 4; ++i)
+        {
+            char c = static_cast<char>(tag >> (24 - 8 * i));
+            rv[i] = c >= 0x20 && c < 0x7F ? c : '?';
+        }
+        return "'" + rv + "'";
+    }
+
+    void fail(const std::string& problem)
+    {
+        throw std::runtime_error("invalid font: " + problem);
+    }
+
+    /// the versions of a single font's table directory; 'true' and 'typ1' are older apple fonts
+    bool isSfntVersion(uint32_t version)
+    {
+        return version == 0x00010000 || version == makeTag("OTTO") || version == makeTag("true") || version == makeTag("typ1");
+    }
+
+    void appendUtf8(std::string& out, uint32_t codePoint)
+    {
+        if (codePoint < 0x80)
+        {
+            out += static_cast<char>(codePoint);
+        }
+        else if (codePoint < 0x800)
+        {
+            out += static_cast<char>(0xC0 | (codePoint >> 6));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+        else if (codePoint < 0x10000)
+        {
+            out += static_cast<char>(0xE0 | (codePoint >> 12));
+            out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+        else
+        {
+            out += static_cast<char>(0xF0 | (codePoint >> 18));
+            out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codePoint & 0x3F));
+        }
+    }
+
+    /// names for unicode and windows platforms are UTF-16BE; unpaired surrogates become U+FFFD
+    std::string fromUtf16(const unsigned char* data, std::size_t size)
+    {
+        std::string rv;
+        for (std::size_t i = 0; i + 1 < size; i += 2)
+        {
+            uint32_t unit = read16(data + i);
+            if (unit >= 0xD800 && unit < 0xDC00 && i + 3 < size && read16(data + i + 2) >= 0xDC00 && read16(data + i + 2) < 0xE000)
+            {
+                appendUtf8(rv, 0x10000 + ((unit - 0xD800) << 10) + (read16(data + i + 2) - 0xDC00));
+                i += 2;
+            }
+            else
+            {
+                appendUtf8(rv, unit >= 0xD800 && unit < 0xE000 ? 0xFFFD : unit);
+            }
+        }
+        return rv;
+    }
+
+    /// the family name (name ID 1), preferring the US English windows name GDI itself goes by
+    std::string familyName(const unsigned char* table, uint32_t length)
+    {
+        if (length < 6)
+        {
+            fail("truncated 'name' table");
+        }
+        uint32_t count = read16(table + 2);
+        uint32_t strings = read16(table + 4);
+        if (6 + count * 12 > length || strings > length)
+        {
+            fail("truncated 'name' table");
+        }
+        std::string rv;
+        int best = 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const unsigned char* record = table + 6 + i * 12;
+            uint16_t platform = read16(record);
+            uint16_t encoding = read16(record + 2);
+            uint16_t language = read16(record + 4);
+            uint16_t nameId = read16(record + 6);
+            uint32_t size = read16(record + 8);
+            uint32_t offset = strings + read16(record + 10);
+            if (offset + size > length)
+            {
+                fail("a 'name' record lies outside the 'name' table");
+            }
+            if (nameId != 1)
+            {
+                continue;
+            }
+            int rank = 0;
+            if (platform == 3 && (encoding == 0 || encoding == 1 || encoding == 10))
+            {
+                rank = language == 0x409 ? 4 : 3;
+            }
+            else if (platform == 0)
+            {
+                rank = 2;
+            }
+            else if (platform == 1 && encoding == 0)
+            {
+                rank = 1;
+            }
+            if (rank <= best)
+            {
+                continue;
+            }
+            if (platform == 1)
+            {
+                /// mac roman agrees with ascii, which is all a family name needs in practice
+                rv.clear();
+                for (uint32_t c = 0; c < size; ++c)
+                {
+                    rv += table[offset + c] < 0x80 ? static_cast<char>(table[offset + c]) : '?';
+                }
+            }
+            else
+            {
+                rv = fromUtf16(table + offset, size);
+            }
+            best = rank;
+        }
+        if (rv.empty())
+        {
+            fail("the 'name' table does not name the family");
+        }
+        return rv;
+    }
+
+    /// checks the table directory at the provided offset, and every table it describes
+    void validateFont(const unsigned char* data, std::size_t size, uint32_t offset, SfntInfo& info)
+    {
+        if (offset > size || size - offset < 12)
+        {
+            fail("truncated table directory");
+        }
+        const unsigned char* directory = data + offset;
+        if (!isSfntVersion(read32(directory)))
+        {
+            fail("unknown sfnt version " + tagName(read32(directory)));
+        }
+        uint32_t tables = read16(directory + 4);
+        if (tables == 0 || size - offset - 12 < tables * 16)
+        {
+            fail("truncated table directory");
+        }
+        const unsigned char* names = nullptr;
+        uint32_t namesLength = 0;
+        bool head = false, cmap = false, maxp = false, hhea = false, hmtx = false, glyf = false, loca = false, cff = false;
+        for (uint32_t i = 0; i < tables; ++i)
+        {
+            const unsigned char* entry = directory + 12 + i * 16;
+            uint32_t tag = read32(entry);
+            uint32_t checksum = read32(entry + 4);
+            uint32_t tableOffset = read32(entry + 8);
+            uint32_t length = read32(entry + 12);
+            if (static_cast<uint64_t>(tableOffset) + length > size)
+            {
+                fail("the " + tagName(tag) + " table lies outside the file");
+            }
+            const unsigned char* table = data + tableOffset;
+            uint32_t sum = sfntChecksum(table, length);
+            if (tag == makeTag("head"))
+            {
+                if (length < 54 || read32(table + 12) != 0x5F0F3CF5)
+                {
+                    fail("malformed 'head' table");
+                }
+                /// the 'head' checksum is taken with its checkSumAdjustment zeroed
+                sum -= read32(table + 8);
+                head = true;
+            }
+            if (sum != checksum)
+            {
+                fail("checksum mismatch in the " + tagName(tag) + " table");
+            }
+            if (tag == makeTag("name"))
+            {
+                names = table;
+                namesLength = length;
+            }
+            cmap = cmap || tag == makeTag("cmap");
+            maxp = maxp || tag == makeTag("maxp");
+            hhea = hhea || tag == makeTag("hhea");
+            hmtx = hmtx || tag == makeTag("hmtx");
+            glyf = glyf || tag == makeTag("glyf");
+            loca = loca || tag == makeTag("loca");
+            cff = cff || tag == makeTag("CFF ") || tag == makeTag("CFF2");
+        }
+        if (!head || !cmap || !maxp || !hhea || !hmtx || names == nullptr)
+        {
+            fail("a required table is missing");
+        }
+        if (!(glyf && loca) && !cff)
+        {
+            fail("no glyph outlines");
+        }
+        std::string family = familyName(names, namesLength);
+        if (info.family.empty())
+        {
+            info.family = std::move(family);
+        }
+        info.tables += tables;
+        ++info.fonts;
+    }
+}
+
+uint32_t sfntChecksum(const unsigned char* data, std::size_t size)
+{
+    /// four words at a time: each is byte swapped to host order in its lane, then summed per lane
+    __m128i lanes = _mm_setzero_si128();
+    std::size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        words = _mm_or_si128(_mm_slli_epi16(words, 8), _mm_srli_epi16(words, 8));
+        words = _mm_shufflehi_epi16(_mm_shufflelo_epi16(words, 0xB1), 0xB1);
+        lanes = _mm_add_epi32(lanes, words);
+    }
+    uint32_t sums[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), lanes);
+    uint32_t rv = sums[0] + sums[1] + sums[2] + sums[3];
+    for (; i + 4 <= size; i += 4)
+    {
+        rv += read32(data + i);
+    }
+    if (i < size)
+    {
+        unsigned char tail[4] = { 0, 0, 0, 0 };
+        std::memcpy(tail, data + i, size - i);
+        rv += read32(tail);
+    }
+    return rv;
+}
+
+SfntInfo validateSfnt(const unsigned char* data, std::size_t size)
+{
+    SfntInfo info = { std::string(), 0, 0 };
+    if (size < 12)
+    {
+        fail("too short to be a font");
+    }
+    if (read32(data) != makeTag("ttcf"))
+    {
+        validateFont(data, size, 0, info);
+        return info;
+    }
+    uint32_t fonts = read32(data + 8);
+    if (fonts == 0 || (size - 12) / 4 < fonts)
+    {
+        fail("truncated collection header");
+    }
+    for (uint32_t i = 0; i < fonts; ++i)
+    {
+        validateFont(data, size, read32(data + 12 + i * 4), info);
+    }
+    return info;
+}
+
+SfntInfo validateSfntFile(const std::string& file)
+{
+    boost::system::error_code error;
+    uintmax_t size = boost::filesystem::file_size(file, error);
+    if (error)
+    {
+        throw std::runtime_error("unable to read " + file + ": " + error.message());
+    }
+    auto reader = FileReader::open(file, IOBackend::Mapped);
+    const unsigned char* data = nullptr;
+    std::size_t length = 0;
+    if (!reader->next(data, length))
+    {
+        fail("empty file");
+    }
+    if (length == size)
+    {
+        return validateSfnt(data, length);
+    }
+    /// larger than a single view, which only the largest collections are
+    std::vector<unsigned char> whole(data, data + length);
+    while (reader->next(data, length))
+    {
+        whole.insert(whole.end(), data, data + length);
+    }
+    return validateSfnt(whole.data(), whole.size());
+}
+
+bool isSfntFile(const std::string& file)
+{
+    std::string extension = boost::algorithm::to_lower_copy(boost::filesystem::path(file).extension().string());
+    return extension == ".ttf" || extension == ".otf" || extension == ".ttc" || extension == ".otc";
+}
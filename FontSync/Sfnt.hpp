@@ -0,0 +1,86 @@
+#ifndef SFNT_HPP_INCLUDED
+#define SFNT_HPP_INCLUDED
+
+/// some microsoft compilers still benefit from the use of #pragma once
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * What validating an sfnt (TrueType or OpenType) font found out about it.
+ *
+ */
+struct SfntInfo
+{
+    /// the family name from the name table of the (first) font, as UTF-8
+    std::string family;
+
+    /// the number of fonts in the file; more than one for a collection
+    unsigned int fonts;
+
+    /// the number of tables checked, across every font in the file
+    unsigned int tables;
+};
+
+/**
+ * Calculates an sfnt table checksum: the sum of the data as big-endian
+ * 32-bit words, zero-padded to a whole word, modulo 2^32.
+ *
+ * @param data the start of the data to sum
+ *
+ * @param size the size of the data, in bytes
+ *
+ * @return the checksum of the data
+ *
+ */
+uint32_t sfntChecksum(const unsigned char* data, std::size_t size);
+
+/**
+ * Validates the structure of an sfnt font, or font collection, in memory.
+ *
+ * The table directory must fit the data, list the tables a font cannot be
+ * rendered without, and describe tables that lie within the data and match
+ * their checksums; the name table must be well formed and name the family.
+ * Nothing is copied: the tables are checked where they lie.
+ *
+ * @param data the start of the font
+ *
+ * @param size the size of the font, in bytes
+ *
+ * @return what was found out about the font
+ *
+ * @throws std::runtime_error describing the first problem found
+ *
+ */
+SfntInfo validateSfnt(const unsigned char* data, std::size_t size);
+
+/**
+ * Validates the structure of an sfnt font file, mapping it into memory
+ * rather than reading it.
+ *
+ * @param file the font file to validate
+ *
+ * @return what was found out about the font
+ *
+ * @throws std::runtime_error if the file cannot be read, or describing the
+ *         first problem found
+ *
+ */
+SfntInfo validateSfntFile(const std::string& file);
+
+/**
+ * Retrieves whether the provided file should hold an sfnt font, going by
+ * its extension (.ttf, .otf, .ttc or .otc).
+ *
+ * @param file the font file
+ *
+ * @return true if the file should be validated as an sfnt font
+ *
+ */
+bool isSfntFile(const std::string& file);
+
+#endif
@@ -0,0 +1,192 @@
+#include "SortedKeys.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+
+#include <boost/filesystem.hpp>
+
+namespace
+{
+    /// the most runs merged at once, which bounds the number of open files
+    const std::size_t mergeFanIn = 32;
+
+    /// merges sorted key files into one, dropping duplicates
+    uint64_t mergeRuns(const std::vector<std::string>& inputs, const std::string& output)
+    {
+        std::vector<std::unique_ptr<std::ifstream>> streams;
+        typedef std::pair<std::string, std::size_t> Head;
+        std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+        for (const auto& input : inputs)
+        {
+            streams.push_back(std::unique_ptr<std::ifstream>(new std::ifstream(input, std::ios::binary)));
+            if (!*streams.back())
+            {
+                throw std::runtime_error("unable to read sorted run " + input);
+            }
+            std::string key;
+            if (std::getline(*streams.back(), key))
+            {
+                heads.push(std::make_pair(std::move(key), streams.size() - 1));
+            }
+        }
+        std::ofstream out(output, std::ios::binary | std::ios::trunc);
+        uint64_t written = 0;
+        std::string previous;
+        while (!heads.empty())
+        {
+            Head head = heads.top();
+            heads.pop();
+            if (written == 0 || head.first != previous)
+            {
+                out << head.first << '\n';
+                previous = head.first;
+                ++written;
+            }
+            std::string key;
+            if (std::getline(*streams[head.second], key))
+            {
+                heads.push(std::make_pair(std::move(key), head.second));
+            }
+        }
+        if (!out.flush())
+        {
+            throw std::runtime_error("unable to write sorted keys " + output);
+        }
+        return written;
+    }
+}
+
+KeySorter::KeySorter(const std::string& spillPrefix, std::size_t memoryBudget) :
+    spillPrefix(spillPrefix), memoryBudget(memoryBudget), buffered(0), spilled(0)
+{
+
+}
+
+void KeySorter::spill()
+{
+    std::sort(this->buffer.begin(), this->buffer.end());
+    this->buffer.erase(std::unique(this->buffer.begin(), this->buffer.end()), this->buffer.end());
+    std::string run = this->spillPrefix + "." + std::to_string(this->spilled);
+    {
+        std::ofstream out(run, std::ios::binary | std::ios::trunc);
+        for (const auto& key : this->buffer)
+        {
+            out << key << '\n';
+        }
+        if (!out.flush())
+        {
+            throw std::runtime_error("unable to spill sorted run " + run);
+        }
+    }
+    this->runs.push_back(run);
+    ++this->spilled;
+    std::vector<std::string>().swap(this->buffer);
+    this->buffered = 0;
+}
+
+void KeySorter::add(const std::string& key)
+{
+    if (key.find_first_of("\r\n") != std::string::npos)
+    {
+        throw std::invalid_argument("keys cannot contain line breaks: " + key);
+    }
+    this->buffer.push_back(key);
+    this->buffered += key.size() + sizeof(std::string);
+    if (this->buffered > this->memoryBudget)
+    {
+        this->spill();
+    }
+}
+
+uint64_t KeySorter::finish(const std::string& sortedFile)
+{
+    if (this->runs.empty())
+    {
+        std::sort(this->buffer.begin(), this->buffer.end());
+        this->buffer.erase(std::unique(this->buffer.begin(), this->buffer.end()), this->buffer.end());
+        std::ofstream out(sortedFile, std::ios::binary | std::ios::trunc);
+        for (const auto& key : this->buffer)
+        {
+            out << key << '\n';
+        }
+        if (!out.flush())
+        {
+            throw std::runtime_error("unable to write sorted keys " + sortedFile);
+        }
+        uint64_t written = this->buffer.size();
+        std::vector<std::string>().swap(this->buffer);
+        this->buffered = 0;
+        return written;
+    }
+    if (!this->buffer.empty())
+    {
+        this->spill();
+    }
+    /// merge in passes, so a tiny budget never opens too many files at once
+    while (this->runs.size() > mergeFanIn)
+    {
+        std::vector<std::string> batch(this->runs.begin(), this->runs.begin() + mergeFanIn);
+        std::string run = this->spillPrefix + "." + std::to_string(this->spilled++);
+        mergeRuns(batch, run);
+        boost::system::error_code ignored;
+        for (const auto& merged : batch)
+        {
+            boost::filesystem::remove(merged, ignored);
+        }
+        this->runs.erase(this->runs.begin(), this->runs.begin() + mergeFanIn);
+        this->runs.push_back(run);
+    }
+    uint64_t written = mergeRuns(this->runs, sortedFile);
+    boost::system::error_code ignored;
+    for (const auto& run : this->runs)
+    {
+        boost::filesystem::remove(run, ignored);
+    }
+    this->runs.clear();
+    return written;
+}
+
+std::size_t KeySorter::spills() const
+{
+    return this->spilled;
+}
+
+KeySorter::~KeySorter()
+{
+    boost::system::error_code ignored;
+    for (const auto& run : this->runs)
+    {
+        boost::filesystem::remove(run, ignored);
+    }
+}
+
+void forEachMissing(const std::string& before, const std::string& after, const std::function<void(const std::string&)>& missing)
+{
+    std::ifstream previous(before, std::ios::binary);
+    if (!previous)
+    {
+        return;
+    }
+    std::ifstream current(after, std::ios::binary);
+    if (!current)
+    {
+        throw std::runtime_error("unable to read sorted keys " + after);
+    }
+    std::string key, present;
+    bool more = static_cast<bool>(std::getline(current, present));
+    while (std::getline(previous, key))
+    {
+        while (more && present < key)
+        {
+            more = static_cast<bool>(std::getline(current, present));
+        }
+        if (!more || present != key)
+        {
+            missing(key);
+        }
+    }
+}
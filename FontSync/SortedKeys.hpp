@@ -0,0 +1,106 @@
+#ifndef SORTED_KEYS_HPP_INCLUDED
+#define SORTED_KEYS_HPP_INCLUDED
+
+/// some microsoft compilers still benefit from the use of #pragma once
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Sorts any number of keys within a memory budget.
+ *
+ * Keys are collected in memory until they outgrow the budget, at which point
+ * they are sorted and spilled to a run file next to the output.  Finishing
+ * merges the runs into a single sorted file holding each distinct key once,
+ * one per line, so arbitrarily large key sets can be compared with
+ * forEachMissing without ever being held in memory at once.
+ *
+ */
+class KeySorter
+{
+    std::string spillPrefix;
+
+    std::size_t memoryBudget;
+
+    std::vector<std::string> buffer;
+
+    std::size_t buffered;
+
+    std::vector<std::string> runs;
+
+    std::size_t spilled;
+
+    void spill();
+
+public:
+
+    /**
+     * Constructs an empty KeySorter.
+     *
+     * @param spillPrefix the path run files are created under, suffixed with their number
+     *
+     * @param memoryBudget roughly how many bytes of keys are held in memory before spilling
+     *
+     */
+    KeySorter(const std::string& spillPrefix, std::size_t memoryBudget);
+
+    /**
+     * Adds a key.
+     *
+     * @param key the key to add
+     *
+     * @throws std::invalid_argument if the key contains a line break
+     *
+     * @throws std::runtime_error if a run cannot be spilled
+     *
+     */
+    void add(const std::string& key);
+
+    /**
+     * Writes every distinct key added so far to a file, in ascending byte
+     * order, one per line, and removes the run files.
+     *
+     * @param sortedFile the file to write
+     *
+     * @return the number of distinct keys written
+     *
+     * @throws std::runtime_error if a run or the output cannot be read or written
+     *
+     */
+    uint64_t finish(const std::string& sortedFile);
+
+    /**
+     * Retrieves how many runs have been spilled to disk.
+     *
+     * @return the number of runs spilled so far
+     *
+     */
+    std::size_t spills() const;
+
+    /**
+     * Destructor, removes any run files left behind.
+     *
+     */
+    ~KeySorter();
+};
+
+/**
+ * Merge joins two sorted key files, as written by KeySorter::finish.
+ *
+ * @param before the keys that were present before; a missing file holds no keys
+ *
+ * @param after the keys that are present now
+ *
+ * @param missing invoked, in order, for every key in before that is not in after
+ *
+ * @throws std::runtime_error if after cannot be read
+ *
+ */
+void forEachMissing(const std::string& before, const std::string& after, const std::function<void(const std::string&)>& missing);
+
+#endif
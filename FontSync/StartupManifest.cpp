@@ -0,0 +1,142 @@
+#include "StartupManifest.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "Utilities.hpp"
+
+namespace
+{
+    const char* header = "FontSync startup manifest 1";
+
+    const std::size_t fieldCount = 6;
+}
+
+std::vector<LocalFont> readStartupManifest(const std::string& manifestFile)
+{
+    std::ifstream in(manifestFile, std::ios::binary);
+    if (!in)
+    {
+        throw std::runtime_error("unable to read startup manifest " + manifestFile);
+    }
+    std::string line;
+    if (!std::getline(in, line) || line != header)
+    {
+        throw std::runtime_error("unrecognized startup manifest " + manifestFile);
+    }
+    std::vector<LocalFont> rv;
+    while (std::getline(in, line))
+    {
+        if (line.empty())
+        {
+            continue;
+        }
+        std::string fields[fieldCount];
+        std::size_t field = 0;
+        std::size_t start = 0;
+        for (std::size_t tab; field < fieldCount - 1 && (tab = line.find('\t', start)) != std::string::npos; start = tab + 1)
+        {
+            fields[field++] = line.substr(start, tab - start);
+        }
+        fields[field++] = line.substr(start);
+        if (field != fieldCount || fields[fieldCount - 1].find('\t') != std::string::npos)
+        {
+            throw std::runtime_error("malformed startup manifest entry: " + line);
+        }
+        HashAlgorithm algorithm;
+        try
+        {
+            algorithm = parseHashAlgorithm(fields[3]);
+        }
+        catch (const std::invalid_argument& e)
+        {
+            throw std::runtime_error(std::string("malformed startup manifest entry: ").append(e.what()));
+        }
+        rv.push_back(LocalFont(fields[0], fields[1], fields[2], fields[5], fields[4], algorithm));
+    }
+    return rv;
+}
+
+StartupManifestWriter::StartupManifestWriter(const std::string& manifestFile) :
+    manifestFile(manifestFile), temp(manifestFile + ".tmp"), open(true)
+{
+    /// write next to the manifest and swap it in, so a crash never leaves a torn manifest behind
+    this->out.open(this->temp, std::ios::binary | std::ios::trunc);
+    this->out << header << '\n';
+    if (!this->out)
+    {
+        this->abandon();
+        throw std::runtime_error("unable to save startup manifest " + manifestFile);
+    }
+}
+
+void StartupManifestWriter::abandon()
+{
+    boost::system::error_code ignored;
+    this->out.close();
+    boost::filesystem::remove(this->temp, ignored);
+    this->open = false;
+}
+
+void StartupManifestWriter::append(const LocalFont& font)
+{
+    if (!this->open)
+    {
+        throw std::runtime_error("the startup manifest " + this->manifestFile + " was abandoned");
+    }
+    for (const std::string* field : { &font.getName(), &font.getCategory(), &font.getType(), &font.getHash(), &font.getLocalFile() })
+    {
+        if (field->find_first_of("\t\r\n") != std::string::npos)
+        {
+            boost::system::error_code ignored;
+            this->abandon();
+            boost::filesystem::remove(this->manifestFile, ignored);
+            throw std::runtime_error("unable to save startup manifest: " + font.getName() + " cannot be represented");
+        }
+    }
+    this->out << font.getName() << '\t' << font.getCategory() << '\t' << font.getType() << '\t' <<
+        toString(font.getHashAlgorithm()) << '\t' << font.getHash() << '\t' << font.getLocalFile() << '\n';
+}
+
+void StartupManifestWriter::commit()
+{
+    if (!this->open)
+    {
+        throw std::runtime_error("the startup manifest " + this->manifestFile + " was abandoned");
+    }
+    if (!this->out.flush())
+    {
+        this->abandon();
+        throw std::runtime_error("unable to save startup manifest " + this->manifestFile);
+    }
+    this->out.close();
+    this->open = false;
+    try
+    {
+        replaceFile(this->temp, this->manifestFile);
+    }
+    catch (const std::runtime_error& e)
+    {
+        throw std::runtime_error(std::string("unable to save startup manifest: ").append(e.what()));
+    }
+}
+
+StartupManifestWriter::~StartupManifestWriter()
+{
+    if (this->open)
+    {
+        this->abandon();
+    }
+}
+
+void writeStartupManifest(const std::string& manifestFile, const std::vector<LocalFont>& fonts)
+{
+    StartupManifestWriter writer(manifestFile);
+    for (const auto& font : fonts)
+    {
+        writer.append(font);
+    }
+    writer.commit();
+}
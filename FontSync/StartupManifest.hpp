@@ -0,0 +1,111 @@
+#ifndef STARTUP_MANIFEST_HPP_INCLUDED
+#define STARTUP_MANIFEST_HPP_INCLUDED
+
+/// some microsoft compilers still benefit from the use of #pragma once
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "LocalFont.hpp"
+
+/**
+ * The fonts installed by the last synchronization, in a form that can be
+ * loaded at startup without parsing the index or hashing any font.
+ *
+ * The manifest is a line oriented text file: a version line followed by one
+ * line per font holding its name, category, type, hash algorithm, digest and
+ * local file, separated by tabs.  The digest is the one the font was verified
+ * against when it was downloaded; it is only re-checked later, off of the
+ * startup path.
+ *
+ */
+
+/**
+ * Reads a startup manifest.
+ *
+ * @param manifestFile the manifest to read
+ *
+ * @return the fonts listed in the manifest, carrying their recorded digests
+ *
+ * @throws std::runtime_error if the manifest cannot be read or is malformed
+ *
+ */
+std::vector<LocalFont> readStartupManifest(const std::string& manifestFile);
+
+/**
+ * Writes a startup manifest a font at a time, so the fonts never have to be
+ * held in memory at once.  The previous manifest is only replaced on commit;
+ * a writer destroyed without committing leaves it untouched.
+ *
+ */
+class StartupManifestWriter
+{
+    std::string manifestFile;
+
+    std::string temp;
+
+    std::ofstream out;
+
+    bool open;
+
+    void abandon();
+
+public:
+
+    /**
+     * Starts writing a startup manifest.
+     *
+     * @param manifestFile the manifest to replace on commit
+     *
+     * @throws std::runtime_error if the manifest cannot be written
+     *
+     */
+    explicit StartupManifestWriter(const std::string& manifestFile);
+
+    /**
+     * Appends a font.
+     *
+     * @param font an installed font, carrying its verified digest
+     *
+     * @throws std::runtime_error if the font cannot be represented in the
+     *         manifest (the writer is abandoned and the previous manifest is
+     *         removed, so the next startup takes the slow path rather than a
+     *         stale one), or the writer was already abandoned
+     *
+     */
+    void append(const LocalFont& font);
+
+    /**
+     * Replaces the previous manifest with the fonts appended so far.
+     *
+     * @throws std::runtime_error if the manifest cannot be written
+     *
+     */
+    void commit();
+
+    /**
+     * Destructor, discards the manifest unless it was committed.
+     *
+     */
+    ~StartupManifestWriter();
+};
+
+/**
+ * Writes a startup manifest, replacing any previous one atomically.
+ *
+ * @param manifestFile the manifest to write
+ *
+ * @param fonts the installed fonts, carrying their verified digests
+ *
+ * @throws std::runtime_error if the manifest cannot be written, or a font
+ *         cannot be represented in it (the previous manifest is removed, so
+ *         the next startup takes the slow path rather than a stale one)
+ *
+ */
+void writeStartupManifest(const std::string& manifestFile, const std::vector<LocalFont>& fonts);
+
+#endif
@@ -0,0 +1,18 @@
+#include "StringPool.hpp"
+
+#include <mutex>
+#include <unordered_set>
+
+namespace
+{
+	std::mutex mutex;
+
+	/// node based, so references to the elements remain valid as it grows
+	std::unordered_set<std::string> pool;
+}
+
+const std::string& StringPool::intern(const std::string& value)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return *pool.insert(value).first;
+}
\ No newline at end of file
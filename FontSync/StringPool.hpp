@@ -0,0 +1,34 @@
+#ifndef STRING_POOL_HPP_INCLUDED
+#define STRING_POOL_HPP_INCLUDED
+
+/// some microsoft compilers still benefit from the use of #pragma once
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif
+
+#include <string>
+
+/**
+ * Interns the low-cardinality strings shared by many fonts (categories and
+ * types), so that every font record refers to a single shared copy.
+ *
+ * Interned strings are never released and their addresses never change.
+ *
+ */
+class StringPool
+{
+public:
+
+	/**
+	 * Retrieves the interned copy of the provided string, interning it if
+	 * this is the first time it has been seen.
+	 *
+	 * @param value the string to intern
+	 *
+	 * @return the interned copy of the provided string
+	 *
+	 */
+	static const std::string& intern(const std::string& value);
+};
+
+#endif
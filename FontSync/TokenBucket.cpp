@@ -0,0 +1,207 @@
+#include "TokenBucket.hpp"
+
+#include <cstdio>
+#include <ctime>
+#include <stdexcept>
+#include <thread>
+
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/trim.hpp>
+
+#include "Logging.hpp"
+
+TokenBucket::TokenBucket(uint64_t rate, uint64_t burst, const Clock& clock) :
+    clock(clock),
+    rate(rate),
+    burst(burst),
+    tokens(static_cast<double>(burst)),
+    updated(clock())
+{
+
+}
+
+void TokenBucket::refill(std::chrono::steady_clock::time_point now)
+{
+    if (now > this->updated)
+    {
+        double elapsed = std::chrono::duration<double>(now - this->updated).count();
+        this->tokens += elapsed * this->rate;
+        if (this->tokens > this->burst)
+        {
+            this->tokens = static_cast<double>(this->burst);
+        }
+        this->updated = now;
+    }
+}
+
+void TokenBucket::reconfigure(uint64_t rate, uint64_t burst)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->refill(this->clock());
+    if (this->rate == 0)
+    {
+        /// nothing was metered while unlimited, so start out full
+        this->tokens = static_cast<double>(burst);
+    }
+    this->rate = rate;
+    this->burst = burst;
+    if (this->tokens > burst)
+    {
+        this->tokens = static_cast<double>(burst);
+    }
+}
+
+std::chrono::microseconds TokenBucket::reserve(uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->rate == 0)
+    {
+        return std::chrono::microseconds(0);
+    }
+    this->refill(this->clock());
+    this->tokens -= static_cast<double>(bytes);
+    if (this->tokens >= 0)
+    {
+        return std::chrono::microseconds(0);
+    }
+    return std::chrono::microseconds(static_cast<int64_t>(-this->tokens * 1000000.0 / this->rate + 0.5));
+}
+
+uint64_t TokenBucket::getRate() const
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->rate;
+}
+
+namespace
+{
+    unsigned parseTimeOfDay(const std::string& text)
+    {
+        unsigned hours, minutes;
+        char colon, trailing;
+        if (std::sscanf(text.c_str(), "%2u%c%2u%c", &hours, &colon, &minutes, &trailing) != 3 || colon != ':' || hours > 24 || minutes > 59 || (hours == 24 && minutes != 0))
+        {
+            throw std::invalid_argument("expected a time of day (HH:MM), not \"" + text + "\"");
+        }
+        return hours * 60 + minutes;
+    }
+
+    unsigned minuteOfDay()
+    {
+        std::time_t now = std::time(nullptr);
+        std::tm local;
+#ifdef _WIN32
+        localtime_s(&local, &now);
+#else
+        localtime_r(&now, &local);
+#endif
+        return static_cast<unsigned>(local.tm_hour * 60 + local.tm_min);
+    }
+
+    struct DownloadBandwidth
+    {
+        std::mutex mutex;
+        uint64_t limit = 0;
+        uint64_t burst = 0;
+        BandwidthSchedule schedule;
+        TokenBucket bucket;
+
+        DownloadBandwidth() : bucket(0, 0)
+        {
+
+        }
+    };
+
+    DownloadBandwidth& downloadBandwidth()
+    {
+        static DownloadBandwidth bandwidth;
+        return bandwidth;
+    }
+}
+
+BandwidthSchedule::BandwidthSchedule(const std::string& schedule)
+{
+    std::vector<std::string> entries;
+    boost::algorithm::split(entries, schedule, boost::algorithm::is_any_of(","));
+    for (auto& entry : entries)
+    {
+        boost::algorithm::trim(entry);
+        if (entry.empty())
+        {
+            continue;
+        }
+        auto dash = entry.find('-');
+        auto equals = entry.find('=');
+        if (dash == std::string::npos || equals == std::string::npos || equals < dash)
+        {
+            throw std::invalid_argument("expected HH:MM-HH:MM=rate, not \"" + entry + "\"");
+        }
+        Window window;
+        window.start = parseTimeOfDay(boost::algorithm::trim_copy(entry.substr(0, dash))) % 1440;
+        window.end = parseTimeOfDay(boost::algorithm::trim_copy(entry.substr(dash + 1, equals - dash - 1))) % 1440;
+        auto rate = boost::algorithm::trim_copy(entry.substr(equals + 1));
+        if (rate.empty() || rate.find_first_not_of("0123456789") != std::string::npos || rate.size() > 12)
+        {
+            throw std::invalid_argument("expected a rate in KiB per second, not \"" + rate + "\"");
+        }
+        window.rate = std::stoull(rate) * 1024;
+        this->windows.push_back(window);
+    }
+}
+
+uint64_t BandwidthSchedule::rateAt(unsigned minuteOfDay, uint64_t fallback) const
+{
+    for (const auto& window : this->windows)
+    {
+        bool inside = window.start <= window.end ?
+            minuteOfDay >= window.start && minuteOfDay < window.end :
+            minuteOfDay >= window.start || minuteOfDay < window.end;
+        if (inside)
+        {
+            return window.rate;
+        }
+    }
+    return fallback;
+}
+
+void configureDownloadBandwidth(const Config::Settings& settings)
+{
+    BandwidthSchedule schedule;
+    try
+    {
+        schedule = BandwidthSchedule(settings.bandwidth_schedule);
+    }
+    catch (const std::invalid_argument& e)
+    {
+        FONTSYNC_LOG_TRIVIAL(warning) << "Ignoring bandwidth_schedule: " << e.what();
+    }
+    auto& bandwidth = downloadBandwidth();
+    std::lock_guard<std::mutex> lock(bandwidth.mutex);
+    bandwidth.limit = static_cast<uint64_t>(settings.bandwidth_limit) * 1024;
+    bandwidth.burst = static_cast<uint64_t>(settings.bandwidth_burst) * 1024;
+    bandwidth.schedule = schedule;
+    bandwidth.bucket.reconfigure(bandwidth.schedule.rateAt(minuteOfDay(), bandwidth.limit), bandwidth.burst);
+}
+
+void throttleDownload(uint64_t bytes)
+{
+    auto& bandwidth = downloadBandwidth();
+    std::chrono::microseconds wait;
+    {
+        /// the schedule is consulted on every chunk, so a window opening or
+        /// closing takes effect in the middle of a long download
+        std::lock_guard<std::mutex> lock(bandwidth.mutex);
+        uint64_t rate = bandwidth.schedule.rateAt(minuteOfDay(), bandwidth.limit);
+        if (rate != bandwidth.bucket.getRate())
+        {
+            FONTSYNC_LOG_TRIVIAL(debug) << "Download bandwidth limit is now " << rate / 1024 << " KiB/s (0 is unlimited)";
+            bandwidth.bucket.reconfigure(rate, bandwidth.burst);
+        }
+        wait = bandwidth.bucket.reserve(bytes);
+    }
+    if (wait.count() > 0)
+    {
+        std::this_thread::sleep_for(wait);
+    }
+}
@@ -0,0 +1,168 @@
+#ifndef TOKEN_BUCKET_HPP_INCLUDED
+#define TOKEN_BUCKET_HPP_INCLUDED
+
+/// some microsoft compilers still benefit from the use of #pragma once
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Config.hpp"
+
+/**
+ * A thread safe token bucket, metering bytes.
+ *
+ * Tokens accrue at the configured rate up to the burst size.  Callers reserve
+ * the bytes they are about to transfer and are told how long to wait before
+ * doing so; a reservation may overdraw the bucket, in which case the debt is
+ * paid back (and later callers wait behind it) at the configured rate.  This
+ * keeps the long term rate exact no matter how the transfers are chunked, and
+ * shares it fairly between every thread drawing from the same bucket.
+ *
+ */
+class TokenBucket
+{
+public:
+
+    /**
+     * The source of time; injectable so that shaping can be tested without
+     * waiting on a real clock.
+     *
+     */
+    typedef std::function<std::chrono::steady_clock::time_point()> Clock;
+
+private:
+
+    Clock clock;
+
+    mutable std::mutex mutex;
+
+    uint64_t rate;
+
+    uint64_t burst;
+
+    /// may go negative while reservations are being paid back
+    double tokens;
+
+    std::chrono::steady_clock::time_point updated;
+
+    /// credits the tokens that accrued since the last update
+    void refill(std::chrono::steady_clock::time_point now);
+
+public:
+
+    /**
+     * Constructs a full TokenBucket.
+     *
+     * @param rate the sustained rate, in bytes per second; 0 is unlimited
+     *
+     * @param burst the most bytes that can be transferred without waiting
+     *
+     * @param clock the source of time
+     *
+     */
+    TokenBucket(uint64_t rate, uint64_t burst, const Clock& clock = std::chrono::steady_clock::now);
+
+    /**
+     * Changes the rate and burst size, keeping any outstanding debt.  A
+     * bucket that was unlimited starts out full.
+     *
+     * @param rate the sustained rate, in bytes per second; 0 is unlimited
+     *
+     * @param burst the most bytes that can be transferred without waiting
+     *
+     */
+    void reconfigure(uint64_t rate, uint64_t burst);
+
+    /**
+     * Reserves the provided number of bytes.
+     *
+     * @param bytes the number of bytes about to be transferred
+     *
+     * @return how long the caller has to wait before transferring them
+     *
+     */
+    std::chrono::microseconds reserve(uint64_t bytes);
+
+    /**
+     * Retrieves the sustained rate.
+     *
+     * @return the sustained rate, in bytes per second; 0 is unlimited
+     *
+     */
+    uint64_t getRate() const;
+};
+
+/**
+ * Time of day overrides for the bandwidth limit.
+ *
+ * A schedule is a comma separated list of windows, each written as
+ * "HH:MM-HH:MM=rate" with the rate in KiB per second (0 is unlimited).  A
+ * window includes its start and excludes its end, and may wrap past
+ * midnight.  The first window containing the time of day wins; outside of
+ * every window the default limit applies.
+ *
+ */
+class BandwidthSchedule
+{
+    struct Window
+    {
+        unsigned start;
+        unsigned end;
+        uint64_t rate;
+    };
+
+    std::vector<Window> windows;
+
+public:
+
+    /**
+     * Parses a schedule.
+     *
+     * @param schedule the schedule, or empty for no overrides
+     *
+     * @throws std::invalid_argument if the schedule is malformed
+     *
+     */
+    explicit BandwidthSchedule(const std::string& schedule = "");
+
+    /**
+     * Retrieves the limit in effect at the provided time of day.
+     *
+     * @param minuteOfDay minutes since local midnight, [0, 1440)
+     *
+     * @param fallback the limit outside of every window, in bytes per second
+     *
+     * @return the limit in effect, in bytes per second; 0 is unlimited
+     *
+     */
+    uint64_t rateAt(unsigned minuteOfDay, uint64_t fallback) const;
+};
+
+/**
+ * Applies the bandwidth_* options to every download in this process.
+ *
+ * Config rejects an invalid bandwidth_schedule; one that is set some other
+ * way is logged and ignored.
+ *
+ * @param settings the configuration to read the limits from
+ *
+ */
+void configureDownloadBandwidth(const Config::Settings& settings);
+
+/**
+ * Waits until the provided number of downloaded bytes fits within the
+ * download bandwidth limit in effect at this time of day.
+ *
+ * @param bytes the number of bytes just received
+ *
+ */
+void throttleDownload(uint64_t bytes);
+
+#endif
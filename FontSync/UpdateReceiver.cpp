@@ -1,26 +1,173 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <set>
+
+#include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
 #include <boost/asio.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
 
+#include "ChunkedFetch.hpp"
+#include "Connector.hpp"
+#include "MirrorSet.hpp"
 #include "RemoteFont.hpp"
 #include "UpdateReceiver.hpp"
 #include "Utilities.hpp"
 
 #include "Logging.hpp"
 
+namespace
+{
+	/// the initial buffer for a body of unknown size; doubled as needed
+	const std::size_t initialBodyCapacity = 64 * 1024;
+
+	/// the most a single read of a body of unknown size asks for
+	const std::size_t readWindow = 64 * 1024;
+
+	/// reads a string in place, rather than copying it like std::istringstream
+	struct MemoryBuffer : std::streambuf
+	{
+		MemoryBuffer(const std::string& data)
+		{
+			char* begin = const_cast<char*>(data.data());
+			this->setg(begin, begin, begin + data.size());
+		}
+	};
+}
+
 struct UpdateReceiver::UpdateReceiverImpl
 {
 	boost::asio::io_service service;
 	std::string host;
 	uint16_t port;
 	std::string resource;
+	FontFilter filter;
+	std::shared_ptr<MirrorSet> mirrors;
+	std::function<bool()> cancelled;
+	unsigned int connectTimeout;
+	unsigned int headerTimeout;
+	unsigned int bodyTimeout;
+	unsigned int totalTimeout;
+	uint64_t maxSize;
+	TransferStats lastTransfer;
+	unsigned int pageSize;
+	/// the request for the next page of the index being read; empty once it is exhausted
+	std::string nextPage;
+	/// every page requested since beginIndex, so an index whose pages form a loop is caught
+	std::set<std::string> requested;
+	unsigned int pages;
+	uint64_t staged;
+
+	/// the request for the index, or for its first page
+	std::string firstPage() const
+	{
+		std::string path = this->resource;
+		/// let the server leave unsubscribed fonts out, and paginate; servers that don't know the parameters ignore them
+		std::string query = this->filter.toQueryString();
+		if (this->pageSize > 0)
+		{
+			query += (query.empty() ? "page_size=" : "&page_size=") + std::to_string(this->pageSize);
+		}
+		if (!query.empty())
+		{
+			path += (path.find('?') == std::string::npos ? '?' : '&') + query;
+		}
+		return path;
+	}
 
-	void createRequest(boost::asio::streambuf& request)
+	/// drops unsubscribed fonts before anything is cached, downloaded or
+	/// hashed, so previously installed ones are treated as orphans
+	void filterIndex(boost::property_tree::ptree& fonts) const
+	{
+		if (this->filter.empty())
+		{
+			return;
+		}
+		size_t dropped = 0;
+		for (auto font = fonts.begin(); font != fonts.end();)
+		{
+			if (this->filter.matches(font->second.get<std::string>("name"), font->second.get<std::string>("category"), font->second.get<std::string>("type")))
+			{
+				++font;
+			}
+			else
+			{
+				font = fonts.erase(font);
+				++dropped;
+			}
+		}
+		FONTSYNC_LOG_TRIVIAL(trace) << "Filtered " << dropped << " unsubscribed font(s) out of the index...";
+	}
+
+	/// loads up some easy to use font objects for the caller
+	static void toRemoteFonts(const boost::property_tree::ptree& fonts, std::vector<RemoteFont>& remoteFonts)
+	{
+		remoteFonts.reserve(remoteFonts.size() + fonts.size());
+		for (const auto& font : fonts)
+		{
+			HashAlgorithm algorithm;
+			std::string hash;
+			readIndexHash(font.second, algorithm, hash);
+			remoteFonts.push_back(RemoteFont(
+			font.second.get_child("name").data(),
+			font.second.get_child("category").data(),
+			font.second.get_child("type").data(),
+			font.second.get_child("remote_file").data(),
+			hash,
+			algorithm,
+			font.second.get<int>("priority", 0),
+			font.second.get<uint64_t>("size", 0)));
+			auto patches = font.second.get_child_optional("patches");
+			if (patches)
+			{
+				std::vector<FontPatch> offered;
+				for (const auto& patch : *patches)
+				{
+					FontPatch delta = { patch.second.get<std::string>("from"), patch.second.get<std::string>("remote_file"), patch.second.get<uint64_t>("size", 0) };
+					offered.push_back(std::move(delta));
+				}
+				remoteFonts.back().setPatches(std::move(offered));
+			}
+			auto chunks = font.second.get_child_optional("chunks");
+			if (chunks)
+			{
+				std::vector<std::string> digests;
+				for (const auto& chunk : *chunks)
+				{
+					digests.push_back(chunk.second.data());
+				}
+				uint64_t chunkSize = font.second.get<uint64_t>("chunk_size", 0);
+				if (chunkSize > maxChunkSize)
+				{
+					/// every fetch worker would hold a chunk this large in memory; the font is downloaded whole instead
+					FONTSYNC_LOG_TRIVIAL(warning) << "Ignoring the chunk list of " << remoteFonts.back().getRemoteFile() << ": chunks of " << chunkSize <<
+						" bytes exceed the limit of " << maxChunkSize;
+				}
+				else
+				{
+					remoteFonts.back().setChunks(chunkSize, std::move(digests));
+				}
+			}
+		}
+	}
+
+	void createRequest(boost::asio::streambuf& request, const Mirror& mirror, const std::string& path)
 	{
 		std::ostream stream(&request);
-		stream << "GET /" << this->resource << " HTTP/1.0\r\n";
-		stream << "Host: " << this->host << "\r\n";
+		stream << "GET /" << path;
+		stream << " HTTP/1.0\r\n";
+		stream << "Host: " << mirror.host;
+		if (mirror.port != 80)
+		{
+			stream << ":" << mirror.port;
+		}
+		stream << "\r\n";
 		stream << "Accept: */*\r\n";
 		stream << "Connection: close\r\n\r\n";
 	}
@@ -38,88 +185,355 @@ struct UpdateReceiver::UpdateReceiverImpl
 		}
 		else if (statusCode != 200)
 		{
-			throw std::runtime_error("http response code " + std::to_string(statusCode));
+			throw HttpStatusError("http response code " + std::to_string(statusCode), statusCode);
 		}
 	}
 
-    void connect(boost::asio::ip::tcp::socket& socket)
-    {
-        using namespace boost::asio::ip;
-        tcp::resolver resolver(service);
-        tcp::resolver::query query(host, "http");
-        tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
-        tcp::resolver::iterator end;
+	/// the headers that determine how the body is framed
+	struct ResponseHeaders
+	{
+		bool hasLength;
+		uint64_t length;
+		bool chunked;
+	};
 
-        boost::system::error_code error = boost::asio::error::host_not_found;
-        while (error && endpoint_iterator != end)
-        {
-            socket.close();
-            socket.connect(*endpoint_iterator++, error);
-        }
-        if (error)
-        {
-            throw boost::system::system_error(error);
-        }
-    }
+	/// reads the header lines that follow the status line, up to and including the empty line
+	static ResponseHeaders parseHeaders(std::istream& stream)
+	{
+		ResponseHeaders headers = { false, 0, false };
+		std::string line;
+		/// the rest of the status line
+		std::getline(stream, line);
+		while (std::getline(stream, line) && line != "\r" && !line.empty())
+		{
+			auto colon = line.find(':');
+			if (colon == std::string::npos)
+			{
+				continue;
+			}
+			std::string name = boost::algorithm::to_lower_copy(boost::algorithm::trim_copy(line.substr(0, colon)));
+			std::string value = boost::algorithm::trim_copy(line.substr(colon + 1));
+			if (name == "content-length")
+			{
+				if (value.empty() || value.size() > 19 || value.find_first_not_of("0123456789") != std::string::npos)
+				{
+					throw std::runtime_error("invalid Content-Length: " + value);
+				}
+				headers.hasLength = true;
+				headers.length = std::stoull(value);
+			}
+			else if (name == "transfer-encoding")
+			{
+				headers.chunked = boost::algorithm::icontains(value, "chunked");
+			}
+		}
+		return headers;
+	}
 
-	std::string readJson()
+	/// decodes a chunked body in place, returning the number of bytes moved
+	static uint64_t dechunk(std::string& body)
 	{
-        
-		boost::asio::ip::tcp::socket socket(service);
-        FONTSYNC_LOG_TRIVIAL(trace) << "Connecting to " << host << ":" << port << "/" << resource << "...";
-        connect(socket);
-        FONTSYNC_LOG_TRIVIAL(trace) << "Sending HTTP request headers...";
+		std::size_t in = 0;
+		std::size_t out = 0;
+		uint64_t moved = 0;
+		for (;;)
 		{
-			boost::asio::streambuf request;
-			createRequest(request);
-			boost::asio::write(socket, request);
+			auto lineEnd = body.find("\r\n", in);
+			if (lineEnd == std::string::npos)
+			{
+				throw std::runtime_error("truncated chunked body");
+			}
+			/// chunk extensions follow a semicolon
+			std::string size = body.substr(in, (std::min)(lineEnd, body.find(';', in)) - in);
+			boost::algorithm::trim(size);
+			if (size.empty() || size.size() > 15 || size.find_first_not_of("0123456789abcdefABCDEF") != std::string::npos)
+			{
+				throw std::runtime_error("invalid chunk size: " + size);
+			}
+			std::size_t length = static_cast<std::size_t>(std::stoull(size, nullptr, 16));
+			in = lineEnd + 2;
+			if (length == 0)
+			{
+				break;
+			}
+			if (body.size() - in < length + 2)
+			{
+				throw std::runtime_error("truncated chunked body");
+			}
+			std::memmove(&body[0] + out, body.data() + in, length);
+			moved += length;
+			out += length;
+			in += length + 2;
 		}
-        FONTSYNC_LOG_TRIVIAL(trace) << "Awaiting response...";;
-		boost::asio::streambuf response;
-		std::istream stream(&response);
+		body.resize(out);
+		return moved;
+	}
 
-        FONTSYNC_LOG_TRIVIAL(trace) << "Validating response headers...";
-		boost::asio::read_until(socket, response, "\r\n");
-		validate(stream);
+	typedef std::function<void(const boost::system::error_code&, std::size_t)> Handler;
 
-        FONTSYNC_LOG_TRIVIAL(trace) << "Discarding additional headers...";
-		boost::asio::read_until(socket, response, "\r\n\r\n");
+	/// a deadline the provided number of milliseconds from now; 0 is no deadline
+	static std::chrono::steady_clock::time_point deadlineAfter(unsigned int milliseconds)
+	{
+		return milliseconds > 0 ? std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds) : std::chrono::steady_clock::time_point::max();
+	}
+
+	void checkCancelled()
+	{
+		if (this->cancelled && this->cancelled())
 		{
-			std::string dummy;
-			while (std::getline(stream, dummy) && dummy != "\r");
+			throw boost::system::system_error(boost::asio::error::operation_aborted, "cancelled");
 		}
+	}
 
-        FONTSYNC_LOG_TRIVIAL(trace) << "Receiving response body...";
-		/// read the response data
-		std::stringstream json;
-		boost::system::error_code ec;
+	/// runs an asynchronous socket operation to completion, closing the socket once the deadline passes or the request is cancelled
+	/// returns false if the operation ended at the end of the stream
+	bool await(boost::asio::ip::tcp::socket& socket, std::chrono::steady_clock::time_point deadline, const std::string& phase, const std::function<void(const Handler&)>& start,
+	           std::size_t* transferred = nullptr)
+	{
+		/// how often cancellation is checked for while waiting
+		const std::chrono::milliseconds pollInterval(100);
+		boost::system::error_code result = boost::asio::error::would_block;
+		boost::system::error_code abort;
+		boost::asio::deadline_timer tick(this->service);
+		this->service.reset();
+		start([&result, transferred](const boost::system::error_code& error, std::size_t bytes)
+		{
+			result = error;
+			if (transferred != nullptr)
+			{
+				*transferred = bytes;
+			}
+		});
+		while (result == boost::asio::error::would_block)
+		{
+			auto now = std::chrono::steady_clock::now();
+			if (!abort)
+			{
+				if (this->cancelled && this->cancelled())
+				{
+					abort = boost::asio::error::operation_aborted;
+				}
+				else if (now >= deadline)
+				{
+					abort = boost::asio::error::timed_out;
+				}
+				if (abort)
+				{
+					/// closing the socket completes the operation with operation_aborted
+					boost::system::error_code ignored;
+					socket.close(ignored);
+				}
+			}
+			auto wait = abort ? pollInterval : (std::min)(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now) + std::chrono::milliseconds(1), pollInterval);
+			tick.expires_from_now(boost::posix_time::milliseconds(wait.count()));
+			tick.async_wait([](const boost::system::error_code&) {});
+			this->service.run_one();
+		}
+		boost::system::error_code ignored;
+		tick.cancel(ignored);
+		this->service.run();
+		if (abort)
+		{
+			throw boost::system::system_error(abort, abort == boost::asio::error::timed_out ? "timed out " + phase : "cancelled " + phase);
+		}
+		if (result == boost::asio::error::eof)
+		{
+			if (transferred != nullptr)
+			{
+				*transferred = 0;
+			}
+			return false;
+		}
+		if (result)
+		{
+			throw boost::system::system_error(result, phase);
+		}
+		return true;
+	}
 
-		if (response.size() > 0)
+	std::string readJson(const Mirror& mirror, const std::string& path, std::chrono::steady_clock::time_point budget)
+	{
+		boost::asio::ip::tcp::socket socket(service);
+		FONTSYNC_LOG_TRIVIAL(trace) << "Connecting to " << toString(mirror) << "/" << path << "...";
+		this->checkCancelled();
 		{
-			json << &response;
+			auto deadline = (std::min)(deadlineAfter(this->connectTimeout), budget);
+			auto timeout = deadline == std::chrono::steady_clock::time_point::max() ? std::chrono::milliseconds(std::chrono::hours(24)) :
+				(std::max)(std::chrono::milliseconds(1), std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()));
+			connectTo(service, socket, mirror.host, mirror.port, timeout);
 		}
 
-		while (boost::asio::read(socket, response, boost::asio::transfer_at_least(1), ec))
+		/// the request and the response headers share a deadline
+		auto headerDeadline = (std::min)(deadlineAfter(this->headerTimeout), budget);
+		FONTSYNC_LOG_TRIVIAL(trace) << "Sending HTTP request headers...";
+		boost::asio::streambuf request;
+		createRequest(request, mirror, path);
+		this->await(socket, headerDeadline, "sending the request", [&](const Handler& handler)
+		{
+			boost::asio::async_write(socket, request, handler);
+		});
+
+		FONTSYNC_LOG_TRIVIAL(trace) << "Awaiting response...";
+		boost::asio::streambuf response;
+		std::istream stream(&response);
+		if (!this->await(socket, headerDeadline, "waiting for the response headers", [&](const Handler& handler)
 		{
-			json << &response;
+			boost::asio::async_read_until(socket, response, "\r\n\r\n", handler);
+		}))
+		{
+			throw std::runtime_error("connection closed before the response headers");
+		}
+
+		FONTSYNC_LOG_TRIVIAL(trace) << "Validating response headers...";
+		validate(stream);
+		ResponseHeaders headers = parseHeaders(stream);
+
+		FONTSYNC_LOG_TRIVIAL(trace) << "Receiving response body...";
+		TransferStats stats = {};
+		std::string body;
+		/// grows the body to at least the provided capacity, counting the allocations it takes
+		auto reserve = [&](std::size_t capacity)
+		{
+			if (capacity > body.capacity())
+			{
+				body.reserve(capacity);
+				++stats.allocations;
+			}
+		};
+		auto tooLarge = [this](uint64_t size)
+		{
+			return std::runtime_error("the index (" + std::to_string(size) + " bytes or more) exceeds the limit of " + std::to_string(this->maxSize) + " bytes");
+		};
+		/// whatever arrived along with the headers is the start of the body
+		auto takeBuffered = [&](std::size_t limit)
+		{
+			std::size_t count = (std::min)(limit, response.size());
+			std::size_t offset = body.size();
+			body.resize(offset + count);
+			boost::asio::buffer_copy(boost::asio::buffer(&body[0] + offset, count), response.data());
+			response.consume(count);
+			stats.copiedBytes += count;
+		};
+		if (headers.hasLength && !headers.chunked)
+		{
+			if (this->maxSize > 0 && headers.length > this->maxSize)
+			{
+				throw tooLarge(headers.length);
+			}
+			/// the exact size is known: allocate once and read straight into place
+			std::size_t length = static_cast<std::size_t>(headers.length);
+			reserve(length);
+			takeBuffered(length);
+			std::size_t received = body.size();
+			body.resize(length);
+			while (received < length)
+			{
+				std::size_t count = 0;
+				if (!this->await(socket, (std::min)(deadlineAfter(this->bodyTimeout), budget), "waiting for the response body", [&](const Handler& handler)
+				{
+					socket.async_read_some(boost::asio::buffer(&body[0] + received, length - received), handler);
+				}, &count))
+				{
+					throw std::runtime_error("connection closed after " + std::to_string(received) + " of " + std::to_string(length) + " body bytes");
+				}
+				received += count;
+			}
+		}
+		else
+		{
+			/// the body runs until the connection closes; grow geometrically, reading into the spare capacity
+			reserve((std::max)(response.size(), initialBodyCapacity));
+			takeBuffered(response.size());
+			for (;;)
+			{
+				if (this->maxSize > 0 && body.size() > this->maxSize)
+				{
+					throw tooLarge(body.size());
+				}
+				if (body.size() == body.capacity())
+				{
+					reserve(body.capacity() * 2);
+				}
+				/// only a read's worth of the spare capacity is zeroed, so small reads don't touch all of it every time
+				std::size_t received = body.size();
+				std::size_t count = 0;
+				body.resize(received + (std::min)(body.capacity() - received, readWindow));
+				bool more = this->await(socket, (std::min)(deadlineAfter(this->bodyTimeout), budget), "waiting for the response body", [&](const Handler& handler)
+				{
+					socket.async_read_some(boost::asio::buffer(&body[0] + received, body.size() - received), handler);
+				}, &count);
+				body.resize(received + count);
+				if (!more)
+				{
+					break;
+				}
+			}
+			if (headers.chunked)
+			{
+				stats.copiedBytes += dechunk(body);
+			}
 		}
 		{
 			boost::system::error_code ignored;
 			socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
 			socket.close(ignored);
 		}
-		if (ec != boost::asio::error::eof)
+		stats.bytes = body.size();
+		this->lastTransfer = stats;
+		FONTSYNC_LOG_TRIVIAL(debug) << "Received a " << stats.bytes << " byte index from " << toString(mirror) << " (" <<
+			(headers.chunked ? "chunked" : headers.hasLength ? "Content-Length" : "until close") << "): " << stats.allocations << " allocation(s), " << stats.copiedBytes << " byte(s) copied";
+		return body;
+	}
+
+	/// reads the provided resource from the best mirror, failing over to the next one on any error
+	std::string readJson(const std::string& path)
+	{
+		std::vector<Mirror> candidates;
+		if (this->mirrors)
+		{
+			candidates = this->mirrors->ranked();
+		}
+		else
+		{
+			Mirror primary = { this->host, this->port };
+			candidates.push_back(primary);
+		}
+		auto budget = deadlineAfter(this->totalTimeout);
+		for (size_t i = 0; ; ++i)
 		{
-			throw boost::system::system_error(ec);
+			try
+			{
+				auto json = this->readJson(candidates[i], path, budget);
+				if (this->mirrors)
+				{
+					this->mirrors->reportSuccess(candidates[i]);
+				}
+				return json;
+			}
+			catch (const std::exception& e)
+			{
+				/// neither shutting down nor running out of time is the mirror's fault
+				if ((this->cancelled && this->cancelled()) || std::chrono::steady_clock::now() >= budget)
+				{
+					throw;
+				}
+				/// nor is a missing index, though another mirror may still have it
+				if (this->mirrors && HttpStatusError::blamesServer(e))
+				{
+					this->mirrors->reportFailure(candidates[i]);
+				}
+				if (i + 1 == candidates.size())
+				{
+					throw;
+				}
+				FONTSYNC_LOG_TRIVIAL(warning) << "Unable to read the index from " << toString(candidates[i]) << " (" << e.what() << "), trying " << toString(candidates[i + 1]) << "...";
+			}
 		}
-        auto rv = json.str();
-        FONTSYNC_LOG_TRIVIAL(trace) << "Preparing to copy to application storage...";
-        initAppData(rv);
-		return rv;
 	}
 
 	UpdateReceiverImpl(const std::string& host, uint16_t port, const std::string& resource) :
-		host(host), port(port), resource(resource)
+		host(host), port(port), resource(resource), connectTimeout(10000), headerTimeout(15000), bodyTimeout(15000), totalTimeout(120000),
+		maxSize(16 * 1024 * 1024), lastTransfer(), pageSize(1000), pages(0), staged(0)
 	{
 
 	}
@@ -127,7 +541,10 @@ struct UpdateReceiver::UpdateReceiverImpl
 
 std::string UpdateReceiver::readJSON()
 {
-    return this->impl->readJson();
+    auto json = this->impl->readJson(this->impl->firstPage());
+    FONTSYNC_LOG_TRIVIAL(trace) << "Preparing to copy to application storage...";
+    initAppData(json);
+    return json;
 }
 
 UpdateReceiver::UpdateReceiver(const std::string& host, uint16_t port, const std::string& resource) :
@@ -136,25 +553,123 @@ UpdateReceiver::UpdateReceiver(const std::string& host, uint16_t port, const std
 
 }
 
-std::vector<RemoteFont> UpdateReceiver::getRemoteFontIndex()
+void UpdateReceiver::setMirrors(const std::shared_ptr<MirrorSet>& mirrors)
+{
+	this->impl->mirrors = mirrors;
+}
+
+void UpdateReceiver::setTimeouts(unsigned int connectTimeout, unsigned int headerTimeout, unsigned int bodyTimeout, unsigned int totalTimeout)
+{
+	this->impl->connectTimeout = connectTimeout;
+	this->impl->headerTimeout = headerTimeout;
+	this->impl->bodyTimeout = bodyTimeout;
+	this->impl->totalTimeout = totalTimeout;
+}
+
+void UpdateReceiver::setSizeLimit(uint64_t maxBytes)
+{
+	this->impl->maxSize = maxBytes;
+}
+
+TransferStats UpdateReceiver::lastTransfer() const
+{
+	return this->impl->lastTransfer;
+}
+
+void UpdateReceiver::setCancellation(const std::function<bool()>& cancelled)
 {
-	/// create an input stream from the json read from the sync server
-	std::istringstream iss(this->impl->readJson());
+	this->impl->cancelled = cancelled;
+}
 
-	/// populate a property tree based on the json
+void UpdateReceiver::setFilter(const FontFilter& filter)
+{
+	this->impl->filter = filter;
+}
+
+void UpdateReceiver::reconfigure(const std::string& host, uint16_t port, const std::string& resource)
+{
+	this->impl->host = host;
+	this->impl->port = port;
+	this->impl->resource = resource;
+}
+
+void UpdateReceiver::setPageSize(unsigned int pageSize)
+{
+	this->impl->pageSize = pageSize;
+}
+
+void UpdateReceiver::beginIndex()
+{
+	this->impl->nextPage = this->impl->firstPage();
+	this->impl->requested.clear();
+	this->impl->requested.insert(this->impl->nextPage);
+	this->impl->pages = 0;
+	this->impl->staged = 0;
+}
+
+bool UpdateReceiver::nextIndexPage(std::vector<RemoteFont>& page)
+{
+	page.clear();
+	if (this->impl->nextPage.empty())
+	{
+		return false;
+	}
 	boost::property_tree::ptree tree;
-	boost::property_tree::json_parser::read_json(iss, tree);
+	{
+		/// create an input stream over the json read from the sync server, without copying it
+		std::string json = this->impl->readJson(this->impl->nextPage);
+		MemoryBuffer buffer(json);
+		std::istream iss(&buffer);
+		boost::property_tree::json_parser::read_json(iss, tree);
+	}
 
-	/// load up some easy to use font objects to return to the caller
+	/// a page is an object listing its fonts and the request for the next page;
+	/// anything else is the whole index at once
+	boost::property_tree::ptree fonts;
+	std::string next;
+	auto listed = tree.get_child_optional("fonts");
+	if (listed)
+	{
+		fonts.swap(*listed);
+		next = tree.get<std::string>("next", "");
+		if (!next.empty() && next[0] == '/')
+		{
+			next.erase(0, 1);
+		}
+		if (!next.empty() && !this->impl->requested.insert(next).second)
+		{
+			throw std::runtime_error("index page " + this->impl->nextPage + " leads back to " + next);
+		}
+	}
+	else
+	{
+		fonts.swap(tree);
+	}
+	++this->impl->pages;
+
+	this->impl->filterIndex(fonts);
+	FONTSYNC_LOG_TRIVIAL(trace) << "Preparing to copy to application storage...";
+	appendAppData(fonts, this->impl->staged);
+	this->impl->staged += fonts.size();
+	if (next.empty())
+	{
+		finishAppData();
+	}
+	UpdateReceiverImpl::toRemoteFonts(fonts, page);
+	FONTSYNC_LOG_TRIVIAL(debug) << "Read index page " << this->impl->pages << " (" << page.size() << " font(s))" << (next.empty() ? ", the last" : "");
+	this->impl->nextPage = next;
+	return true;
+}
+
+std::vector<RemoteFont> UpdateReceiver::getRemoteFontIndex()
+{
 	std::vector<RemoteFont> remoteFonts;
-	for (auto font : tree)
-	{
-		remoteFonts.push_back(RemoteFont(
-		font.second.get_child("name").data(),
-		font.second.get_child("category").data(),
-		font.second.get_child("type").data(),
-		font.second.get_child("remote_file").data(),
-		font.second.get_child("md5").data()));
+	std::vector<RemoteFont> page;
+	this->beginIndex();
+	while (this->nextIndexPage(page))
+	{
+		remoteFonts.reserve(remoteFonts.size() + page.size());
+		std::move(page.begin(), page.end(), std::back_inserter(remoteFonts));
 	}
 	return remoteFonts;
 }
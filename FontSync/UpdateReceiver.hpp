@@ -6,11 +6,31 @@
 # pragma once
 #endif
 
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
+#include "FontFilter.hpp"
+#include "MirrorSet.hpp"
 #include "RemoteFont.hpp"
 
+/**
+ * How the body of an index response was received.
+ *
+ */
+struct TransferStats
+{
+	/// the size of the body
+	uint64_t bytes;
+
+	/// the number of times a buffer was allocated for the body
+	unsigned allocations;
+
+	/// the number of body bytes copied after being received
+	uint64_t copiedBytes;
+};
+
 /**
  * A networking helper to retrieve the current remote font index
  *
@@ -36,6 +56,103 @@ public:
 	 *
 	 */
 	UpdateReceiver(const std::string& host, uint16_t port, const std::string& resource);
+
+	/**
+	 * Points this UpdateReceiver at a (possibly) different update server.
+	 *
+	 * Takes effect on the next request; must not be called concurrently with one.
+	 *
+	 * @param host the IP address of the machine that hosts the update server
+	 *
+	 * @param port the port that the update server is listening on
+	 *
+	 * @param resource the resource string to use in order to request an updated index
+	 *
+	 */
+	void reconfigure(const std::string& host, uint16_t port, const std::string& resource);
+
+	/**
+	 * Restricts the index to the fonts the provided filter subscribes to.
+	 *
+	 * The filter is sent to the update server as query parameters, and
+	 * applied to the index it returns, in case the server ignores them.
+	 * Takes effect on the next request; must not be called concurrently with one.
+	 *
+	 * @param filter the subscription filter
+	 *
+	 */
+	void setFilter(const FontFilter& filter);
+
+	/**
+	 * Reads the index from the best of the provided mirrors, failing over to
+	 * the next best on any error.  Without mirrors, only the host and port
+	 * this UpdateReceiver was constructed with are used.
+	 * Takes effect on the next request; must not be called concurrently with one.
+	 *
+	 * @param mirrors the mirrors serving the index, or nullptr
+	 *
+	 */
+	void setMirrors(const std::shared_ptr<MirrorSet>& mirrors);
+
+	/**
+	 * Changes the time limits of reading the index, from the next request on.
+	 * A limit of 0 disables it.
+	 * Takes effect on the next request; must not be called concurrently with one.
+	 *
+	 * @param connectTimeout the most time (in milliseconds) connecting may take
+	 *
+	 * @param headerTimeout the most time (in milliseconds) between connecting and receiving the response headers
+	 *
+	 * @param bodyTimeout the most time (in milliseconds) the response body may stall for
+	 *
+	 * @param totalTimeout the most time (in milliseconds) reading the index may take, failovers included
+	 *
+	 */
+	void setTimeouts(unsigned int connectTimeout, unsigned int headerTimeout, unsigned int bodyTimeout, unsigned int totalTimeout);
+
+	/**
+	 * Changes the largest index that is accepted, from the next request on.
+	 * The body is read into a single buffer, sized from Content-Length where
+	 * the server sends it.
+	 * Must not be called concurrently with a request.
+	 *
+	 * @param maxBytes the largest index body accepted, in bytes; 0 is no limit
+	 *
+	 */
+	void setSizeLimit(uint64_t maxBytes);
+
+	/**
+	 * Describes how the body of the last index read was received.
+	 * Must not be called concurrently with a request.
+	 *
+	 * @return the size of, allocations for and copies of the last index body
+	 *
+	 */
+	TransferStats lastTransfer() const;
+
+	/**
+	 * Provides a way to abandon requests, e.g. on shutdown.  The predicate is
+	 * checked while waiting on the update server; once it returns true, the
+	 * request fails without trying further mirrors.  Connecting is only
+	 * bounded by the connect timeout.
+	 * Must not be called concurrently with a request.
+	 *
+	 * @param cancelled returns true once requests should be abandoned; it is
+	 *                  called from the requesting thread and must be cheap
+	 *
+	 */
+	void setCancellation(const std::function<bool()>& cancelled);
+
+	/**
+	 * Changes how many fonts are asked for per page of the index, from the
+	 * next index on.  Servers that do not paginate ignore it.
+	 * Must not be called concurrently with a request.
+	 *
+	 * @param pageSize the number of fonts to ask for per page; 0 asks for the whole index at once
+	 *
+	 */
+	void setPageSize(unsigned int pageSize);
+
     std::string readJSON();
 	/**
 	 * Retrieves the current remote font index from the update server
@@ -47,6 +164,31 @@ public:
 	 */
 	std::vector<RemoteFont> getRemoteFontIndex();
 
+	/**
+	 * Starts reading the current remote font index a page at a time.
+	 *
+	 * A server may answer with a page, {"fonts": [...], "next": "..."}, where
+	 * next is the request for the following page and is left out (or empty)
+	 * on the last one; or with the whole index as a plain array, which is
+	 * treated as a single page.  Mirrors are chosen afresh for every page.
+	 *
+	 */
+	void beginIndex();
+
+	/**
+	 * Retrieves the next page of the index started by beginIndex, staging it
+	 * in application storage.
+	 *
+	 * @param page receives the fonts listed by the page, replacing its contents
+	 *
+	 * @return false once the index is exhausted
+	 *
+	 * @throws std::runtime_error if any error occurs, including a page that
+	 *         leads back to one already read since beginIndex
+	 *
+	 */
+	bool nextIndexPage(std::vector<RemoteFont>& page);
+
 	/**
 	 * Default Destructor
 	 *
@@ -1,8 +1,7 @@
 #include "Utilities.hpp"
 
-#define CRYPTOPP_ENABLE_NAMESPACE_WEAK 1
-
 #include "Logging.hpp"
+#include "TokenBucket.hpp"
 
 #include <wininet.h>
 #include <urlmon.h>
@@ -10,14 +9,16 @@
 #include <Shlobj.h>
 #include <Shlwapi.h>
 
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
 #include <boost/filesystem.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
 
-#include <cryptopp/files.h>
-#include <cryptopp/hex.h>
-#include <cryptopp/md5.h>
-
 void WriteEventLogEntry(const wchar_t* pszMessage)
 {
     std::wcout << pszMessage << std::endl;
@@ -49,45 +50,305 @@ std::wstring errorString(DWORD errorCode)
 
 std::string md5(const std::string& file)
 {
-	try
-	{
-		CryptoPP::Weak::MD5 hash;
-		byte buffer[2 * CryptoPP::Weak::MD5::DIGESTSIZE];
+	return hashFile(file, HashAlgorithm::MD5);
+}
 
-		CryptoPP::FileSource f(file.c_str(), true,
-			new CryptoPP::HashFilter(hash,
-			new CryptoPP::HexEncoder(new CryptoPP::ArraySink(buffer, 2 * CryptoPP::Weak::MD5::DIGESTSIZE))));
-		return std::string((const char*)buffer, 2 * CryptoPP::Weak::MD5::DIGESTSIZE);
-	}
-	catch (const std::exception& error)
-	{
-		throw std::runtime_error(error.what());
-	}
+void readIndexHash(const boost::property_tree::ptree& entry, HashAlgorithm& algorithm, std::string& hash)
+{
+    auto name = entry.get_optional<std::string>("hash_algorithm");
+    if (name)
+    {
+        try
+        {
+            algorithm = parseHashAlgorithm(*name);
+            hash = entry.get<std::string>("hash");
+            return;
+        }
+        catch (const std::invalid_argument&)
+        {
+            /// fall back to md5 below
+        }
+    }
+    algorithm = HashAlgorithm::MD5;
+    hash = entry.get<std::string>("md5");
 }
 
-void download(const std::string& writeTo, const std::string& readFrom)
+namespace
 {
-	DeleteUrlCacheEntry(readFrom.c_str());
+    struct InternetHandleCloser
+    {
+        void operator()(void* handle) const
+        {
+            InternetCloseHandle(handle);
+        }
+    };
 
-	HRESULT hr = URLDownloadToFile(NULL,
-		                           readFrom.c_str(),
-    		                       writeTo.c_str(),
-		                           0,
-		                           NULL);
-	if (!SUCCEEDED(hr))
-	{
-		throw std::runtime_error("error downloading file");
-	}
+    typedef std::unique_ptr<void, InternetHandleCloser> InternetHandle;
+
+    std::atomic_bool compressedDownloads(true);
+
+    std::mutex totalsMutex;
+
+    DownloadTotals totals = { 0, 0, 0 };
+
+    /// the encoded length of a compressed body, or 0 if the body is not compressed or its length is not announced
+    uint64_t encodedLength(HINTERNET request)
+    {
+        char encoding[64];
+        DWORD encodingSize = sizeof(encoding);
+        if (!HttpQueryInfoA(request, HTTP_QUERY_CONTENT_ENCODING, encoding, &encodingSize, NULL))
+        {
+            return 0;
+        }
+        char length[32];
+        DWORD lengthSize = sizeof(length);
+        if (!HttpQueryInfoA(request, HTTP_QUERY_CONTENT_LENGTH, length, &lengthSize, NULL))
+        {
+            return 0;
+        }
+        return std::strtoull(length, nullptr, 10);
+    }
+}
+
+void setCompressedDownloads(bool enabled)
+{
+    compressedDownloads = enabled;
+}
+
+DownloadTotals downloadTotals()
+{
+    std::lock_guard<std::mutex> lock(totalsMutex);
+    return totals;
+}
+
+std::string fetch(const std::string& stagingFile, const std::string& readFrom, HashAlgorithm algorithm)
+{
+    auto fail = [&stagingFile](const std::string& reason) -> std::runtime_error
+    {
+        boost::system::error_code ignored;
+        boost::filesystem::remove(stagingFile, ignored);
+        return std::runtime_error("error downloading file: " + reason);
+    };
+
+    InternetHandle session(InternetOpenA("FontSync", INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0));
+    if (!session)
+    {
+        throw fail("cannot open session [" + std::to_string(GetLastError()) + "]");
+    }
+    /// wininet decodes gzip and deflate bodies as they are read, so the rest of the download never sees them
+    const char* acceptEncoding = NULL;
+    if (compressedDownloads)
+    {
+        BOOL decode = TRUE;
+        if (InternetSetOptionA(session.get(), INTERNET_OPTION_HTTP_DECODING, &decode, sizeof(decode)))
+        {
+            acceptEncoding = "Accept-Encoding: gzip, deflate\r\n";
+        }
+    }
+    InternetHandle request(InternetOpenUrlA(session.get(), readFrom.c_str(), acceptEncoding, acceptEncoding != NULL ? static_cast<DWORD>(-1) : 0,
+        INTERNET_FLAG_RELOAD | INTERNET_FLAG_NO_CACHE_WRITE, 0));
+    if (!request)
+    {
+        throw fail("cannot open " + readFrom + " [" + std::to_string(GetLastError()) + "]");
+    }
+    DWORD status = 0;
+    DWORD statusSize = sizeof(status);
+    /// a body whose status is unknown may be an error page, so it is never staged
+    if (!HttpQueryInfoA(request.get(), HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER, &status, &statusSize, NULL))
+    {
+        throw fail("no HTTP status [" + std::to_string(GetLastError()) + "]");
+    }
+    if (status != 200)
+    {
+        throw HttpStatusError(fail("HTTP status " + std::to_string(status)).what(), status);
+    }
+
+    /// hash each chunk as it is written, so the file never has to be read back
+    auto hasher = Hasher::create(algorithm);
+    uint64_t decoded = 0;
+    {
+        std::ofstream out(stagingFile, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            throw fail("cannot write " + stagingFile);
+        }
+        const DWORD bufferSize = 64 * 1024;
+        std::unique_ptr<char[]> buffer(new char[bufferSize]);
+        DWORD received = 0;
+        do
+        {
+            if (!InternetReadFile(request.get(), buffer.get(), bufferSize, &received))
+            {
+                out.close();
+                throw fail("connection lost [" + std::to_string(GetLastError()) + "]");
+            }
+            /// wininet does not say what each read took on the wire, so decoded bytes are throttled;
+            /// compressed bodies use correspondingly less of the link than the limit
+            throttleDownload(received);
+            decoded += received;
+            hasher->update(reinterpret_cast<const unsigned char*>(buffer.get()), received);
+            if (!out.write(buffer.get(), received))
+            {
+                out.close();
+                throw fail("cannot write " + stagingFile);
+            }
+        } while (received > 0);
+    }
+    uint64_t encoded = encodedLength(request.get());
+    if (encoded > 0)
+    {
+        FONTSYNC_LOG_TRIVIAL(debug) << "Received " << readFrom << " compressed, " << encoded << " of " << decoded << " byte(s) on the wire";
+    }
+    {
+        std::lock_guard<std::mutex> lock(totalsMutex);
+        ++totals.downloads;
+        totals.decodedBytes += decoded;
+        totals.wireBytes += encoded > 0 ? encoded : decoded;
+    }
+    return hasher->digest();
+}
+
+bool fetchRange(const std::string& readFrom, uint64_t offset, uint64_t length, const RangeSink& sink)
+{
+    if (length == 0)
+    {
+        return true;
+    }
+    InternetHandle session(InternetOpenA("FontSync", INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0));
+    if (!session)
+    {
+        throw std::runtime_error("error downloading range: cannot open session [" + std::to_string(GetLastError()) + "]");
+    }
+    std::string range = "Range: bytes=" + std::to_string(offset) + "-" + std::to_string(offset + length - 1) + "\r\n";
+    InternetHandle request(InternetOpenUrlA(session.get(), readFrom.c_str(), range.c_str(), static_cast<DWORD>(range.size()),
+        INTERNET_FLAG_RELOAD | INTERNET_FLAG_NO_CACHE_WRITE, 0));
+    if (!request)
+    {
+        throw std::runtime_error("error downloading range: cannot open " + readFrom + " [" + std::to_string(GetLastError()) + "]");
+    }
+    DWORD status = 0;
+    DWORD statusSize = sizeof(status);
+    if (!HttpQueryInfoA(request.get(), HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER, &status, &statusSize, NULL))
+    {
+        throw std::runtime_error("error downloading range: no HTTP status [" + std::to_string(GetLastError()) + "]");
+    }
+    /// a server without range support sends the whole file instead, which is left to a whole download
+    if (status == 200)
+    {
+        return false;
+    }
+    if (status != 206)
+    {
+        throw HttpStatusError("error downloading range: HTTP status " + std::to_string(status), status);
+    }
+    const DWORD bufferSize = 64 * 1024;
+    std::unique_ptr<unsigned char[]> buffer(new unsigned char[bufferSize]);
+    uint64_t total = 0;
+    DWORD received = 0;
+    do
+    {
+        if (!InternetReadFile(request.get(), buffer.get(), bufferSize, &received))
+        {
+            throw std::runtime_error("error downloading range: connection lost [" + std::to_string(GetLastError()) + "]");
+        }
+        throttleDownload(received);
+        total += received;
+        sink(buffer.get(), received);
+    } while (received > 0);
+    {
+        std::lock_guard<std::mutex> lock(totalsMutex);
+        totals.decodedBytes += total;
+        totals.wireBytes += total;
+    }
+    return true;
+}
+
+void countDownload()
+{
+    std::lock_guard<std::mutex> lock(totalsMutex);
+    ++totals.downloads;
+}
+
+std::string download(const std::string& writeTo, const std::string& readFrom, HashAlgorithm algorithm, const std::string& expectedHash)
+{
+    std::string partial = writeTo + ".part";
+    std::string digest = fetch(partial, readFrom, algorithm);
+    auto fail = [&partial](const std::string& reason) -> std::runtime_error
+    {
+        boost::system::error_code ignored;
+        boost::filesystem::remove(partial, ignored);
+        return std::runtime_error("error downloading file: " + reason);
+    };
+    if (!expectedHash.empty() && !sameDigest(digest, expectedHash))
+    {
+        throw fail("received " + digest + ", expected " + expectedHash);
+    }
+    try
+    {
+        replaceFile(partial, writeTo);
+    }
+    catch (const std::runtime_error& e)
+    {
+        throw fail(e.what());
+    }
+    return digest;
+}
+
+void replaceFile(const std::string& temp, const std::string& file)
+{
+    /// a rename over an existing file replaces it atomically (MoveFileEx with MOVEFILE_REPLACE_EXISTING)
+    boost::system::error_code error;
+    boost::filesystem::rename(temp, file, error);
+    if (error)
+    {
+        boost::system::error_code ignored;
+        boost::filesystem::remove(temp, ignored);
+        throw std::runtime_error("unable to replace " + file + ": " + error.message());
+    }
 }
 
 void initAppData(const std::string& json)
 {
-    FONTSYNC_LOG_TRIVIAL(trace) << "Writing to local staging cache...";
+    boost::property_tree::ptree tree;
     try
+    {
+        std::stringstream ss;
+        ss << json;
+        boost::property_tree::json_parser::read_json(ss, tree);
+    }
+    catch (...)
+    {
+        throw std::runtime_error("unable to save temporary local cache");
+    }
+    initAppData(tree);
+}
+
+namespace
+{
+    /// replaces the local application data directory when set
+    std::string appDataDirectory;
+
+    /// resolves the local application data directory, as SHGetFolderPathA does
+    HRESULT getLocalAppData(CHAR* path)
+    {
+        if (appDataDirectory.empty())
+        {
+            return SHGetFolderPathA(NULL, CSIDL_LOCAL_APPDATA, NULL, 0, path);
+        }
+        if (appDataDirectory.size() >= MAX_PATH)
+        {
+            return E_INVALIDARG;
+        }
+        memcpy(path, appDataDirectory.c_str(), appDataDirectory.size() + 1);
+        return S_OK;
+    }
+
+    /// the index being synchronized, until it is committed
+    std::string getAppDataStagingPath()
     {
         CHAR path[MAX_PATH];
         HRESULT result;
-        if ((result = SHGetFolderPathA(NULL, CSIDL_LOCAL_APPDATA, NULL, 0, path)) == S_OK)
+        if ((result = getLocalAppData(path)) == S_OK)
         {
             PathAppendA(path, "FontSync");
             if (!boost::filesystem::exists(path))
@@ -100,13 +361,80 @@ void initAppData(const std::string& json)
         {
             throw std::exception(_com_error(result).ErrorMessage());
         }
-        boost::property_tree::ptree tree;
+        return path;
+    }
+
+    /// record the digest each font was verified with, so the cache is
+    /// self-describing regardless of the index version it came from
+    void recordIndexHashes(boost::property_tree::ptree& tree)
+    {
+        for (auto& font : tree)
+        {
+            HashAlgorithm algorithm;
+            std::string hash;
+            readIndexHash(font.second, algorithm, hash);
+            font.second.put("hash_algorithm", toString(algorithm));
+            font.second.put("hash", hash);
+        }
+    }
+}
+
+void initAppData(boost::property_tree::ptree& tree)
+{
+    FONTSYNC_LOG_TRIVIAL(trace) << "Writing to local staging cache...";
+    try
+    {
+        std::string path = getAppDataStagingPath();
+        recordIndexHashes(tree);
+        boost::property_tree::json_parser::write_json(path, tree);
+    }
+    catch (...)
+    {
+        throw std::runtime_error("unable to save temporary local cache");
+    }
+}
+
+void appendAppData(boost::property_tree::ptree& fonts, uint64_t staged)
+{
+    FONTSYNC_LOG_TRIVIAL(trace) << "Appending " << fonts.size() << " font(s) to the local staging cache...";
+    try
+    {
+        std::string path = getAppDataStagingPath();
+        recordIndexHashes(fonts);
+        std::ofstream out(path, staged == 0 ? std::ios::binary | std::ios::trunc : std::ios::binary | std::ios::app);
+        if (staged == 0)
+        {
+            out << "[\n";
+        }
+        for (const auto& font : fonts)
+        {
+            if (staged++ > 0)
+            {
+                out << ",\n";
+            }
+            boost::property_tree::json_parser::write_json(out, font.second, false);
+        }
+        if (!out.flush())
+        {
+            throw std::runtime_error(path);
+        }
+    }
+    catch (...)
+    {
+        throw std::runtime_error("unable to save temporary local cache");
+    }
+}
+
+void finishAppData()
+{
+    try
+    {
+        std::ofstream out(getAppDataStagingPath(), std::ios::binary | std::ios::app);
+        out << "]\n";
+        if (!out.flush())
         {
-            std::stringstream ss;
-            ss << json;
-            boost::property_tree::json_parser::read_json(ss, tree);
+            throw std::runtime_error("unable to save temporary local cache");
         }
-        boost::property_tree::json_parser::write_json(std::string(path), tree);
     }
     catch (...)
     {
@@ -114,11 +442,77 @@ void initAppData(const std::string& json)
     }
 }
 
+void setAppDataDirectory(const std::string& directory)
+{
+    appDataDirectory = directory;
+}
+
+std::string getManagedKeysPath()
+{
+    CHAR path[MAX_PATH];
+    HRESULT result;
+    if ((result = getLocalAppData(path)) == S_OK)
+    {
+        /// keys are case-folded since this file name, so the case-sensitive
+        /// keys of managed_fonts.txt are rebuilt rather than merged against
+        PathAppendA(path, "FontSync\\managed_keys.txt");
+        return path;
+    }
+    else
+    {
+        throw std::runtime_error(_com_error(result).ErrorMessage());
+    }
+}
+
+std::vector<std::string> getManagedFiles(const std::string& fontDirectory)
+{
+    boost::property_tree::ptree tree;
+    boost::property_tree::json_parser::read_json(getLocalCacheIndexPath(), tree);
+    std::vector<std::string> rv;
+    rv.reserve(tree.size());
+    for (const auto& font : tree)
+    {
+        const std::string& remoteFile = font.second.get_child("remote_file").data();
+        rv.push_back(fontDirectory + '\\' + remoteFile.substr(remoteFile.find_last_of("/\\") + 1));
+    }
+    return rv;
+}
+
+std::string getHashCachePath()
+{
+    CHAR path[MAX_PATH];
+    HRESULT result;
+    if ((result = getLocalAppData(path)) == S_OK)
+    {
+        PathAppendA(path, "FontSync\\hash_cache.json");
+        return path;
+    }
+    else
+    {
+        throw std::runtime_error(_com_error(result).ErrorMessage());
+    }
+}
+
+std::string getStartupManifestPath()
+{
+    CHAR path[MAX_PATH];
+    HRESULT result;
+    if ((result = getLocalAppData(path)) == S_OK)
+    {
+        PathAppendA(path, "FontSync\\startup_fonts.txt");
+        return path;
+    }
+    else
+    {
+        throw std::runtime_error(_com_error(result).ErrorMessage());
+    }
+}
+
 std::string getLocalCacheIndexPath()
 {
     CHAR path[MAX_PATH];
     HRESULT result;
-    if ((result = SHGetFolderPathA(NULL, CSIDL_LOCAL_APPDATA, NULL, 0, path)) == S_OK)
+    if ((result = getLocalAppData(path)) == S_OK)
     {
         PathAppendA(path, "FontSync\\local_cache.json");
         return path;
@@ -133,13 +527,12 @@ void commitAppData()
 {
     CHAR temp[MAX_PATH], perm[MAX_PATH];
     HRESULT result;
-    if ((result = SHGetFolderPathA(NULL, CSIDL_LOCAL_APPDATA, NULL, 0, temp)) == S_OK)
+    if ((result = getLocalAppData(temp)) == S_OK)
     {
         memcpy(perm, temp, MAX_PATH);
         PathAppendA(temp, "FontSync\\local_cache_temp.json");
         PathAppendA(perm, "FontSync\\local_cache.json");
-        DeleteFile(perm);
-        rename(temp, perm);
+        replaceFile(temp, perm);
     }
     else
     {
@@ -147,13 +540,13 @@ void commitAppData()
     }
 }
 
-std::vector<LocalFont> getManagedFonts(const std::string& fontDirectory)
+std::vector<LocalFont> getManagedFonts(const std::string& fontDirectory, HashCache& hashCache)
 {
     boost::property_tree::ptree tree;
     {
         CHAR path[MAX_PATH];
         HRESULT result;
-        if ((result = SHGetFolderPathA(NULL, CSIDL_LOCAL_APPDATA, NULL, 0, path)) == S_OK)
+        if ((result = getLocalAppData(path)) == S_OK)
         {
             PathAppendA(path, "FontSync\\local_cache.json");
             boost::property_tree::json_parser::read_json(path, tree);
@@ -164,22 +557,42 @@ std::vector<LocalFont> getManagedFonts(const std::string& fontDirectory)
         }
     }
 
-    std::vector<LocalFont> rv;
+    /// resolve every managed font first, so the fonts that have to be hashed at all are hashed in one batch
+    std::vector<const boost::property_tree::ptree*> entries;
+    std::vector<std::pair<std::string, HashAlgorithm>> files;
+    entries.reserve(tree.size());
+    files.reserve(tree.size());
 
-    for (auto font : tree)
+    for (const auto& font : tree)
     {
         std::stringstream ss;
         ss << fontDirectory << '\\' << font.second.get_child("remote_file").data().substr(font.second.get_child("remote_file").data().find_last_of("/\\") + 1);
         boost::filesystem::path localPath(ss.str());
         if (boost::filesystem::exists(localPath))
         {
-            rv.push_back(LocalFont(
-                font.second.get_child("name").data(),
-                font.second.get_child("category").data(),
-                font.second.get_child("type").data(),
-                ss.str()
-                ));
+            HashAlgorithm algorithm;
+            std::string hash;
+            readIndexHash(font.second, algorithm, hash);
+            entries.push_back(&font.second);
+            files.push_back(std::make_pair(ss.str(), algorithm));
         }
     }
+
+    auto digests = hashCache.digests(files);
+
+    std::vector<LocalFont> rv;
+    rv.reserve(entries.size());
+
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        rv.push_back(LocalFont(
+            entries[i]->get_child("name").data(),
+            entries[i]->get_child("category").data(),
+            entries[i]->get_child("type").data(),
+            files[i].first,
+            digests[i],
+            files[i].second
+            ));
+    }
     return rv;
 }
\ No newline at end of file
@@ -6,14 +6,62 @@
 # pragma once
 #endif
 
+#include <cstdint>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
+#include <boost/property_tree/ptree_fwd.hpp>
+
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
+#include "ChunkedFetch.hpp"
 #include "Config.hpp"
+#include "HashCache.hpp"
+#include "Hashing.hpp"
 #include "LocalFont.hpp"
 
+/**
+ * A request the server answered, but with an unexpected HTTP status.
+ *
+ */
+class HttpStatusError : public std::runtime_error
+{
+    unsigned int code;
+
+public:
+
+    HttpStatusError(const std::string& what, unsigned int status) : std::runtime_error(what), code(status)
+    {
+
+    }
+
+    /**
+     * @return the HTTP status the server answered with
+     *
+     */
+    unsigned int status() const
+    {
+        return this->code;
+    }
+
+    /**
+     * Determines whether a failed request is the server's fault, rather than
+     * the fault of the resource asked for.
+     *
+     * @param error the error the request failed with
+     *
+     * @return false for 4xx answers, such as a missing resource; true for
+     *         anything else, such as a server error or a lost connection
+     *
+     */
+    static bool blamesServer(const std::exception& error)
+    {
+        auto answered = dynamic_cast<const HttpStatusError*>(&error);
+        return answered == nullptr || answered->status() < 400 || answered->status() >= 500;
+    }
+};
+
 /**
 * Retrieves the error associated with the provided error code
 *
@@ -37,18 +85,193 @@ std::wstring errorString(DWORD errorCode);
 std::string md5(const std::string& file);
 
 /**
- * Attempts to download the provided remote file, saving it to the provided local file.
+ * Determines which digest an index entry is to be verified against.
+ *
+ * Entries carrying a "hash_algorithm" this client supports are verified
+ * against their "hash"; older indexes (and unsupported algorithms) fall back
+ * to the legacy "md5" field.
+ *
+ * @param entry the index entry
+ *
+ * @param algorithm receives the algorithm to verify with
+ *
+ * @param hash receives the digest to verify against
+ *
+ * @throws boost::property_tree::ptree_error if the entry carries no usable digest
+ *
+ */
+void readIndexHash(const boost::property_tree::ptree& entry, HashAlgorithm& algorithm, std::string& hash);
+
+/**
+ * Downloads the provided remote file into the provided staging file, hashing
+ * the body as it is received.
+ *
+ * @param stagingFile the file to write the body to; removed if the download fails
+ *
+ * @param readFrom the remote file to download
+ *
+ * @param algorithm the algorithm to hash the received body with
+ *
+ * @return the digest of the received body, as upper case hex
  *
  * @throws std::runtime_error if any downloading error occurs
  *
  */
-void download(const std::string& writeTo, const std::string& readFrom);
+std::string fetch(const std::string& stagingFile, const std::string& readFrom, HashAlgorithm algorithm);
+
+/**
+ * Downloads a range of the provided remote file with an HTTP range request,
+ * passing its bytes to the provided sink as they are received.  Ranges are
+ * never compressed, since a range of a compressed body is of no use.
+ *
+ * @param readFrom the remote file to download from
+ *
+ * @param offset the offset of the first byte of the range
+ *
+ * @param length the length of the range, in bytes
+ *
+ * @param sink receives the bytes of the range, in order
+ *
+ * The bytes of the range are added to the download totals, but the range
+ * is not counted as a download of its own; see countDownload.
+ *
+ * @return false if the server ignored the range, in which case nothing was
+ *         passed to the sink
+ *
+ * @throws std::runtime_error if any downloading error occurs, or whatever the sink throws
+ *
+ */
+bool fetchRange(const std::string& readFrom, uint64_t offset, uint64_t length, const RangeSink& sink);
+
+/**
+ * Changes whether downloads offer to receive compressed (gzip or deflate)
+ * bodies.  Compressed bodies are decoded as they are received, so staged
+ * files, and their digests, are always of the decoded font.
+ *
+ * @param enabled whether to offer to receive compressed bodies
+ *
+ */
+void setCompressedDownloads(bool enabled);
+
+/**
+ * How much the downloads made by this process have received.
+ *
+ */
+struct DownloadTotals
+{
+    /// the number of completed downloads
+    uint64_t downloads;
+
+    /// the bytes written to staging files, once decoded
+    uint64_t decodedBytes;
+
+    /// the bytes the bodies took on the wire; bodies whose encoded length
+    /// the server did not announce are counted at their decoded length
+    uint64_t wireBytes;
+};
+
+/**
+ * Retrieves how much the downloads made by this process have received.
+ *
+ * @return the totals since the process started
+ *
+ */
+DownloadTotals downloadTotals();
+
+/**
+ * Counts a download assembled from ranges in the download totals, once
+ * for however many ranges it took.
+ *
+ */
+void countDownload();
+
+/**
+ * Attempts to download the provided remote file, saving it to the provided local file.
+ *
+ * The body is hashed as it is received and staged next to the local file;
+ * the local file is only replaced once the whole body has been received
+ * (and, if an expected digest is provided, verified).
+ *
+ * @param writeTo the local file to save to
+ *
+ * @param readFrom the remote file to download
+ *
+ * @param algorithm the algorithm to hash the received body with
+ *
+ * @param expectedHash the digest the received body must have, or empty to skip verification
+ *
+ * @return the digest of the received body, as upper case hex
+ *
+ * @throws std::runtime_error if any downloading error occurs, or the received body does not match the expected digest
+ *
+ */
+std::string download(const std::string& writeTo, const std::string& readFrom, HashAlgorithm algorithm = HashAlgorithm::MD5, const std::string& expectedHash = "");
+
+/**
+ * Swaps a fully written temporary file in for the provided file in a single
+ * step, so a crash leaves either the old file or the new one behind, never a
+ * torn one.
+ *
+ * @param temp the temporary file, on the same volume as the file it
+ *             replaces; it is removed if it cannot be swapped in
+ *
+ * @param file the file to replace, which need not exist yet
+ *
+ * @throws std::runtime_error if the temporary file cannot be swapped in
+ *
+ */
+void replaceFile(const std::string& temp, const std::string& file);
 void WriteEventLogEntry(const wchar_t* pszMessage);
 std::string getLocalCacheIndexPath();
+std::string getHashCachePath();
+std::string getStartupManifestPath();
+std::string getManagedKeysPath();
+
+/**
+ * Moves every file kept in the local application data directory (the
+ * committed and staged indexes, the hash cache, the startup manifest and
+ * the managed keys) under another directory, so tests can synchronize
+ * without touching the service's own state.  Not safe to call while a
+ * synchronization is running.
+ *
+ * @param directory the directory to use in place of the local application
+ *        data directory, which need not exist; empty restores the real one
+ *
+ */
+void setAppDataDirectory(const std::string& directory);
 
 void initAppData(const std::string& json);
+void initAppData(boost::property_tree::ptree& tree);
+
+/**
+ * Stages one page of an index that is read a page at a time; finishAppData
+ * completes the staged index once the last page has been appended.
+ *
+ * @param fonts the fonts listed by the page
+ *
+ * @param staged the number of fonts staged by earlier pages of the same
+ *               index; 0 starts a new staged index
+ *
+ * @throws std::runtime_error if the staged index cannot be written
+ *
+ */
+void appendAppData(boost::property_tree::ptree& fonts, uint64_t staged);
+void finishAppData();
 void commitAppData();
 
-std::vector<LocalFont> getManagedFonts(const std::string& fontDirectory);
+/**
+ * Lists the local files of the fonts in the committed index, without
+ * touching the files themselves.
+ *
+ * @param fontDirectory the directory fonts are installed to
+ *
+ * @return the local file of every font in the committed index
+ *
+ * @throws std::exception if the committed index cannot be read
+ *
+ */
+std::vector<std::string> getManagedFiles(const std::string& fontDirectory);
+
+std::vector<LocalFont> getManagedFonts(const std::string& fontDirectory, HashCache& hashCache);
 
 #endif
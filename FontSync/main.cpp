@@ -1,16 +1,26 @@
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <csignal>
 #include <string>
 #include <thread>
+#include <vector>
 
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+
 #include "Config.hpp"
+#include "Connector.hpp"
+#include "FileReader.hpp"
 #include "FontCache.hpp"
 #include "Logging.hpp"
+#include "MirrorSet.hpp"
+#include "TokenBucket.hpp"
 #include "UpdateReceiver.hpp"
+#include "Utilities.hpp"
 
 std::atomic_bool stop { false };
 
@@ -32,6 +42,56 @@ void registerSignals()
     signal(SIGTERM,  handler);
 }
 
+/// splits the memory budget between the index pages being received and the
+/// keys orphans are found by
+void configureMemory(const Config::Settings& settings, UpdateReceiver& receiver, FontCache& fontCache)
+{
+    uint64_t budget = static_cast<uint64_t>((std::max)(settings.sync_memory_budget, 1024u)) * 1024;
+    uint64_t limit = static_cast<uint64_t>(settings.index_max_size) * 1024;
+    /// a parsed page takes several times the size of its body
+    if (limit == 0 || limit > budget / 8)
+    {
+        limit = budget / 8;
+    }
+    receiver.setSizeLimit(limit);
+    receiver.setPageSize(settings.index_page_size);
+    fontCache.setMemoryBudget(budget);
+}
+
+/// applies the configured I/O backend, measuring the font directory's storage
+/// if the backend is to be picked automatically
+void configureIOBackend(const Config::Settings& settings)
+{
+    /// the configuration only admits auto or a known backend
+    IOBackend backend;
+    if (!boost::algorithm::iequals(settings.io_backend, "auto"))
+    {
+        backend = parseIOBackend(settings.io_backend);
+    }
+    else
+    {
+        std::vector<std::string> sample;
+        boost::system::error_code error;
+        for (boost::filesystem::directory_iterator it(settings.local_font_dir, error), end; !error && it != end && sample.size() < 24; it.increment(error))
+        {
+            if (boost::filesystem::is_regular_file(it->status()))
+            {
+                sample.push_back(it->path().string());
+            }
+        }
+        backend = selectIOBackend(sample);
+    }
+    setDefaultIOBackend(backend);
+    FONTSYNC_LOG_TRIVIAL(info) << "Reading fonts with the " << toString(backend) << " I/O backend";
+}
+
+/// the configured update server followed by its mirrors; the configuration
+/// only admits a mirror list that parses
+std::vector<Mirror> configuredMirrors(const Config::Settings& settings)
+{
+    return MirrorSet::parse(settings.host, settings.port, settings.mirrors);
+}
+
 /**
  * Entry point for the executable.
  * 
@@ -47,34 +107,93 @@ void registerSignals()
  */
 int main(int argc, char** argv)
 {
+    auto started = std::chrono::steady_clock::now();
     ShowWindow(GetConsoleWindow(), SW_SHOW);
     try
     {
         Config config(argc > 1 ? argv[1] : "");
-        initLogging(config);
-        FontCache fontCache(config.get<std::string>("local_font_dir"), 
-                                 config.get<int>("failed_download_delay"), 
-                                 config.get<int>("failed_download_retries"));
-        UpdateReceiver receiver(config.get<std::string>("host"), 
-                                config.get<int>("port"), 
-                                config.get<std::string>("resource"));
+        auto settings = config.settings();
+        initLogging(*settings);
+        configureDownloadBandwidth(*settings);
+        setCompressedDownloads(settings->compressed_downloads);
+        sharedResolverCache().setTtl(std::chrono::seconds(settings->dns_cache_ttl));
+        /// the storage is measured before the cache loads, hashes or verifies a single font, so the
+        /// sample is read cold and alone, and the fonts are then read with the backend it picks
+        configureIOBackend(*settings);
+        FontCache fontCache(settings->local_font_dir, 
+                                 settings->failed_download_delay, 
+                                 settings->failed_download_retries,
+                                 FontFilter(*settings));
+        fontCache.setPipelineBudget(settings->sync_fetch_workers, settings->sync_verify_workers, settings->sync_queue_depth);
+        fontCache.setWatching(settings->watch_font_dir);
+        FONTSYNC_LOG_TRIVIAL(info) << "Fonts available " << 
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count() << "ms after startup";
+        UpdateReceiver receiver(settings->host, 
+                                settings->port, 
+                                settings->resource);
+        receiver.setFilter(FontFilter(*settings));
+        receiver.setTimeouts(settings->index_connect_timeout, settings->index_header_timeout, settings->index_body_timeout, settings->index_total_timeout);
+        configureMemory(*settings, receiver, fontCache);
+        receiver.setCancellation([]() { return stop.load(); });
+        fontCache.setCancellation([]() { return stop.load(); });
+        auto mirrors = std::make_shared<MirrorSet>(configuredMirrors(*settings));
+        receiver.setMirrors(mirrors);
+        fontCache.setMirrors(mirrors);
         registerSignals();
-        auto lastSync = std::chrono::system_clock::now() - std::chrono::milliseconds(config.get<int>("sync_interval"));
+        config.watch([](const Config::Settings& previous, const Config::Settings& current)
+        {
+            reconfigureLogging(previous, current);
+        });
+        auto lastSync = std::chrono::system_clock::now() - std::chrono::milliseconds(settings->sync_interval);
+        auto lastProbe = std::chrono::system_clock::time_point();
         do
         {
+            /// pick up any reloaded configuration between synchronizations,
+            /// without touching the fonts that are already loaded
+            auto current = config.settings();
+            if (current != settings)
+            {
+                receiver.reconfigure(current->host, current->port, current->resource);
+                fontCache.setRetryPolicy(current->failed_download_delay, current->failed_download_retries);
+                fontCache.setPipelineBudget(current->sync_fetch_workers, current->sync_verify_workers, current->sync_queue_depth);
+                fontCache.setWatching(current->watch_font_dir);
+                receiver.setFilter(FontFilter(*current));
+                receiver.setTimeouts(current->index_connect_timeout, current->index_header_timeout, current->index_body_timeout, current->index_total_timeout);
+                configureMemory(*current, receiver, fontCache);
+                mirrors->reconfigure(configuredMirrors(*current));
+                fontCache.setFilter(FontFilter(*current));
+                configureDownloadBandwidth(*current);
+                setCompressedDownloads(current->compressed_downloads);
+                sharedResolverCache().setTtl(std::chrono::seconds(current->dns_cache_ttl));
+                if (current->io_backend != settings->io_backend)
+                {
+                    configureIOBackend(*current);
+                }
+                if (current->local_font_dir != settings->local_font_dir)
+                {
+                    FONTSYNC_LOG_TRIVIAL(warning) << "local_font_dir changes take effect after a restart";
+                }
+                settings = current;
+            }
             auto now = std::chrono::system_clock::now();
-            if (std::chrono::duration_cast<std::chrono::milliseconds>(now - lastSync).count() > config.get<int>("sync_interval"))
+            if (settings->mirror_probe_interval > 0 && now - lastProbe > std::chrono::milliseconds(settings->mirror_probe_interval))
+            {
+                lastProbe = now;
+                mirrors->probe();
+            }
+            if (now - lastSync > std::chrono::milliseconds(settings->sync_interval))
             {
                 lastSync = std::chrono::system_clock::now();
                 try
                 {
-                    fontCache.synchronize(receiver.getRemoteFontIndex());
+                    receiver.beginIndex();
+                    fontCache.synchronize([&receiver](std::vector<RemoteFont>& page) { return receiver.nextIndexPage(page); });
                     FONTSYNC_LOG_TRIVIAL(info) << "Font Synchronization Complete";
                 }
                 catch (const std::runtime_error& e)
                 {
                     FONTSYNC_LOG_TRIVIAL(error) << "Font Synchronization Failed: " << e.what();
-                    lastSync = std::chrono::system_clock::now() - std::chrono::milliseconds(config.get<int>("sync_interval") - config.get<int>("failed_sync_delay"));
+                    lastSync = std::chrono::system_clock::now() - std::chrono::milliseconds(settings->sync_interval) + std::chrono::milliseconds(settings->failed_sync_delay);
                 }
             }
             else
@@ -91,5 +210,6 @@ int main(int argc, char** argv)
     {
         FONTSYNC_LOG_TRIVIAL(fatal) << "Unknown Fatal Exception";
     }
+    shutdownLogging();
     return 0;
 }
@@ -0,0 +1,164 @@
+#include "../FontSync/ChunkedFetch.cpp"
+#include <gtest/gtest.h>
+
+namespace
+{
+	/// a scratch file, removed when it goes out of scope
+	struct ScratchFile
+	{
+		std::string path;
+
+		explicit ScratchFile(const std::string& name) : path((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path(name + "-%%%%%%%%")).string())
+		{
+
+		}
+
+		void write(const std::vector<char>& contents) const
+		{
+			std::ofstream out(this->path, std::ios::binary | std::ios::trunc);
+			out.write(contents.data(), contents.size());
+		}
+
+		std::vector<char> read() const
+		{
+			std::ifstream in(this->path, std::ios::binary);
+			return std::vector<char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		}
+
+		~ScratchFile()
+		{
+			boost::system::error_code ignored;
+			boost::filesystem::remove(this->path, ignored);
+		}
+	};
+
+	const uint64_t chunkSize = 1000;
+
+	std::string digestOf(const char* data, std::size_t size)
+	{
+		auto hasher = Hasher::create(HashAlgorithm::XXH64);
+		hasher->update(reinterpret_cast<const unsigned char*>(data), size);
+		return hasher->digest();
+	}
+
+	/// a font of ten and a half chunks, and the chunk list the index would carry for it
+	struct ChunkedFont
+	{
+		std::vector<char> contents;
+		FontChunks chunks;
+
+		ChunkedFont()
+		{
+			for (int i = 0; i < 10500; ++i)
+			{
+				this->contents.push_back(static_cast<char>(i * 131 >> 4));
+			}
+			this->chunks.size = this->contents.size();
+			this->chunks.chunkSize = chunkSize;
+			for (uint64_t offset = 0; offset < this->contents.size(); offset += chunkSize)
+			{
+				this->chunks.digests.push_back(digestOf(this->contents.data() + offset, static_cast<std::size_t>((std::min)(chunkSize, this->contents.size() - offset))));
+			}
+		}
+	};
+
+	/// serves ranges of the font from memory, recording what was asked for
+	struct RangeServer
+	{
+		std::vector<char> contents;
+		std::vector<std::pair<uint64_t, uint64_t>> requests;
+		bool ranges = true;
+
+		RangeFetcher fetcher()
+		{
+			return [this](uint64_t offset, uint64_t length, const RangeSink& sink)
+			{
+				this->requests.push_back(std::make_pair(offset, length));
+				if (!this->ranges)
+				{
+					return false;
+				}
+				/// in uneven pieces, as a network would
+				for (uint64_t sent = 0; sent < length; )
+				{
+					std::size_t piece = static_cast<std::size_t>((std::min)(length - sent, static_cast<uint64_t>(777)));
+					sink(reinterpret_cast<const unsigned char*>(this->contents.data() + offset + sent), piece);
+					sent += piece;
+				}
+				return true;
+			};
+		}
+	};
+}
+
+TEST(ChunkedFetch, FreshDownload)
+{
+	ChunkedFont font;
+	RangeServer server;
+	server.contents = font.contents;
+	ScratchFile staging("staging"), local("local");
+	auto result = fetchChunked(staging.path, local.path, HashAlgorithm::XXH64, font.chunks, server.fetcher());
+	ASSERT_TRUE(result.complete);
+	ASSERT_EQ(11u, result.fetched);
+	ASSERT_EQ(1u, server.requests.size());
+	ASSERT_EQ(digestOf(font.contents.data(), font.contents.size()), result.digest);
+	ASSERT_TRUE(font.contents == staging.read());
+}
+
+TEST(ChunkedFetch, RepairsFlippedChunks)
+{
+	ChunkedFont font;
+	RangeServer server;
+	server.contents = font.contents;
+	ScratchFile staging("staging"), local("local");
+	auto damaged = font.contents;
+	damaged[3500] ^= 0x01;
+	damaged[10400] ^= 0x01;
+	local.write(damaged);
+	auto result = fetchChunked(staging.path, local.path, HashAlgorithm::XXH64, font.chunks, server.fetcher());
+	ASSERT_EQ(9u, result.reused);
+	ASSERT_EQ(2u, result.fetched);
+	ASSERT_EQ(2u, server.requests.size());
+	ASSERT_EQ(3000u, server.requests[0].first);
+	ASSERT_EQ(1000u, server.requests[0].second);
+	ASSERT_EQ(10000u, server.requests[1].first);
+	ASSERT_EQ(500u, server.requests[1].second);
+	ASSERT_TRUE(font.contents == staging.read());
+}
+
+TEST(ChunkedFetch, ResumesInterruptedDownloads)
+{
+	ChunkedFont font;
+	RangeServer server;
+	server.contents = font.contents;
+	ScratchFile staging("staging"), local("local");
+	/// two and a half chunks made it before the connection dropped
+	staging.write(std::vector<char>(font.contents.begin(), font.contents.begin() + 2500));
+	auto result = fetchChunked(staging.path, local.path, HashAlgorithm::XXH64, font.chunks, server.fetcher());
+	ASSERT_EQ(2u, result.resumed);
+	ASSERT_EQ(9u, result.fetched);
+	ASSERT_EQ(2000u, server.requests[0].first);
+	ASSERT_TRUE(font.contents == staging.read());
+}
+
+TEST(ChunkedFetch, Failures)
+{
+	ChunkedFont font;
+	RangeServer server;
+	server.contents = font.contents;
+	ScratchFile staging("staging"), local("local");
+
+	/// the server ignores ranges
+	server.ranges = false;
+	ASSERT_FALSE(fetchChunked(staging.path, local.path, HashAlgorithm::XXH64, font.chunks, server.fetcher()).complete);
+
+	/// the server sends a bad chunk; the good ones before it stay staged
+	server.ranges = true;
+	server.contents[4200] ^= 0x01;
+	ASSERT_THROW(fetchChunked(staging.path, local.path, HashAlgorithm::XXH64, font.chunks, server.fetcher()), std::runtime_error);
+	ASSERT_EQ(4000u, boost::filesystem::file_size(staging.path));
+
+	/// a chunk list that does not cover the font
+	font.chunks.digests.pop_back();
+	ASSERT_THROW(fetchChunked(staging.path, local.path, HashAlgorithm::XXH64, font.chunks, server.fetcher()), std::runtime_error);
+}
@@ -1,14 +1,18 @@
 #include <gtest/gtest.h>
 #include "../FontSync/Config.cpp"
 
+#include <fstream>
+#include <mutex>
+#include <thread>
+
 TEST(ConfigTest, DefaultConstructor)
 {
 	Config config;
-	ASSERT_STREQ("127.0.0.1", config.getHost().c_str());
-	ASSERT_EQ(80, config.getPort());
-	ASSERT_EQ(60000, config.getSyncMillis());
-	ASSERT_STREQ("update.php", config.getResource().c_str());
-	ASSERT_STREQ("C:\\FontSync\\Fonts", config.getLocalFontDirectory().c_str());	
+	ASSERT_STREQ("localhost", config.settings()->host.c_str());
+	ASSERT_EQ(80, config.settings()->port);
+	ASSERT_EQ(60000, config.settings()->sync_interval);
+	ASSERT_STREQ("update.php", config.settings()->resource.c_str());
+	ASSERT_STREQ("C:\\windows\\fonts", config.settings()->local_font_dir.c_str());	
 }
 
 TEST(ConfigTest, INIConstructor_Valid)
@@ -16,16 +20,16 @@ TEST(ConfigTest, INIConstructor_Valid)
 	Config* config = nullptr;
 	try
 	{
-		ASSERT_NO_THROW(config = new Config(L"valid_config.ini"));
+		ASSERT_NO_THROW(config = new Config("valid_config.ini"));
 
 	}
 	catch (...) { /*ignore*/ }
 
-	ASSERT_STREQ("127.0.0.1", config->getHost().c_str());
-	ASSERT_EQ(80, config->getPort());
-	ASSERT_EQ(5000, config->getSyncMillis());
-	ASSERT_STREQ("update.php", config->getResource().c_str());
-	ASSERT_STREQ("C:\\FontSync\\Fonts", config->getLocalFontDirectory().c_str());
+	ASSERT_STREQ("localhost", config->settings()->host.c_str());
+	ASSERT_EQ(80, config->settings()->port);
+	ASSERT_EQ(5000, config->settings()->sync_interval);
+	ASSERT_STREQ("update.php", config->settings()->resource.c_str());
+	ASSERT_STREQ("C:\\FontSync\\Fonts", config->settings()->local_font_dir.c_str());
 
 	if (config)
 	{
@@ -38,7 +42,7 @@ TEST(ConfigTest, INIConstructor_Invalid)
 	Config* config = nullptr;
 	try
 	{
-		ASSERT_THROW(config = new Config(L"invalid_config.ini"), std::runtime_error);
+		ASSERT_THROW(config = new Config("invalid_config.ini"), std::runtime_error);
 	}
 	catch (...) { /*ignore*/ }
 	if (config)
@@ -47,7 +51,7 @@ TEST(ConfigTest, INIConstructor_Invalid)
 	}
 	try
 	{
-		ASSERT_THROW(config = new Config(L"invalid_config_file_not_found.ini"), std::runtime_error);
+		ASSERT_THROW(config = new Config("invalid_config_file_not_found.ini"), std::runtime_error);
 	}
 	catch (...) { /*ignore*/ }
 	if (config)
@@ -59,17 +63,17 @@ TEST(ConfigTest, INIConstructor_Invalid)
 TEST(ConfigTest, CopyConstructor)
 {
 	Config* config = nullptr;
-	Config source(L"valid_config.ini");
+	Config source("valid_config.ini");
 	try
 	{
 		ASSERT_NO_THROW(config = new Config(source));
 	}
 	catch (...) { /*ignore*/ }
-	ASSERT_STREQ("127.0.0.1", config->getHost().c_str());
-	ASSERT_EQ(80, config->getPort());
-	ASSERT_EQ(5000, config->getSyncMillis());
-	ASSERT_STREQ("update.php", config->getResource().c_str());
-	ASSERT_STREQ("C:\\FontSync\\Fonts", config->getLocalFontDirectory().c_str());
+	ASSERT_STREQ("localhost", config->settings()->host.c_str());
+	ASSERT_EQ(80, config->settings()->port);
+	ASSERT_EQ(5000, config->settings()->sync_interval);
+	ASSERT_STREQ("update.php", config->settings()->resource.c_str());
+	ASSERT_STREQ("C:\\FontSync\\Fonts", config->settings()->local_font_dir.c_str());
 
 	if (config)
 	{
@@ -80,15 +84,184 @@ TEST(ConfigTest, CopyConstructor)
 TEST(ConfigTest, CopyAssignent)
 {
 	Config config;
-	Config source(L"valid_config.ini");
+	Config source("valid_config.ini");
 	try
 	{
 		ASSERT_NO_THROW(config = source);
 	}
 	catch (...) { /*ignore*/ }
-	ASSERT_STREQ("127.0.0.1", config.getHost().c_str());
-	ASSERT_EQ(80, config.getPort());
-	ASSERT_EQ(5000, config.getSyncMillis());
-	ASSERT_STREQ("update.php", config.getResource().c_str());
-	ASSERT_STREQ("C:\\FontSync\\Fonts", config.getLocalFontDirectory().c_str());
+	ASSERT_STREQ("localhost", config.settings()->host.c_str());
+	ASSERT_EQ(80, config.settings()->port);
+	ASSERT_EQ(5000, config.settings()->sync_interval);
+	ASSERT_STREQ("update.php", config.settings()->resource.c_str());
+	ASSERT_STREQ("C:\\FontSync\\Fonts", config.settings()->local_font_dir.c_str());
+}
+
+namespace
+{
+	/// a configuration file that is removed when it goes out of scope
+	struct ScratchConfig
+	{
+		std::string path;
+
+		ScratchConfig() : path((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("fontsync-%%%%%%%%.ini")).string())
+		{
+
+		}
+
+		/// replaces the file whole, so the watcher never sees it half written
+		void write(const std::string& contents) const
+		{
+			{
+				std::ofstream out(this->path + ".tmp", std::ios::binary | std::ios::trunc);
+				out << contents;
+			}
+			boost::filesystem::rename(this->path + ".tmp", this->path);
+		}
+
+		~ScratchConfig()
+		{
+			boost::system::error_code ignored;
+			boost::filesystem::remove(this->path, ignored);
+		}
+	};
+
+	/// records the ports every reload went from and to
+	struct ReloadLog
+	{
+		std::mutex mutex;
+		std::vector<std::pair<uint16_t, uint16_t>> reloads;
+
+		Config::ReloadListener listener()
+		{
+			return [this](const Config::Settings& previous, const Config::Settings& current)
+			{
+				std::lock_guard<std::mutex> lock(this->mutex);
+				this->reloads.push_back(std::make_pair(previous.port, current.port));
+			};
+		}
+
+		size_t count()
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			return this->reloads.size();
+		}
+
+		std::pair<uint16_t, uint16_t> at(size_t reload)
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			return this->reloads.at(reload);
+		}
+
+		/// waits for the provided number of reloads, or a second and a half
+		bool await(size_t reloads)
+		{
+			auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(1500);
+			while (this->count() < reloads && std::chrono::steady_clock::now() < deadline)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+			return this->count() >= reloads;
+		}
+	};
+}
+
+TEST(ConfigTest, Reload)
+{
+	ScratchConfig file;
+	file.write("config_reload_interval = 20\nport = 8080\n");
+	Config config(file.path);
+	ReloadLog log;
+	config.watch(log.listener());
+	auto before = config.settings();
+
+	/// the same size, most likely within the same second
+	file.write("config_reload_interval = 20\nport = 8081\n");
+	ASSERT_TRUE(log.await(1));
+	ASSERT_EQ(8081, config.settings()->port);
+	ASSERT_EQ(8080, log.at(0).first);
+	ASSERT_EQ(8081, log.at(0).second);
+
+	/// snapshots already handed out never change
+	ASSERT_EQ(8080, before->port);
+}
+
+TEST(ConfigTest, ReloadInvalid)
+{
+	ScratchConfig file;
+	file.write("config_reload_interval = 20\nport = 8080\n");
+	Config config(file.path);
+	ReloadLog log;
+	config.watch(log.listener());
+
+	/// one bad option keeps every option, valid or not, from being published
+	file.write("config_reload_interval = 20\nport = 8081\nsync_interval = soon\n");
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	ASSERT_EQ(0u, log.count());
+	ASSERT_EQ(8080, config.settings()->port);
+	ASSERT_EQ(60000, config.settings()->sync_interval);
+
+	/// until it is fixed
+	file.write("config_reload_interval = 20\nport = 8081\nsync_interval = 1000\n");
+	ASSERT_TRUE(log.await(1));
+	ASSERT_EQ(8081, config.settings()->port);
+	ASSERT_EQ(1000, config.settings()->sync_interval);
+}
+
+TEST(ConfigTest, IOBackend)
+{
+	ScratchConfig file;
+	file.write("io_backend = Mapped\n");
+	ASSERT_STREQ("Mapped", Config(file.path).settings()->io_backend.c_str());
+
+	/// an unknown backend is an invalid option, which keeps its default
+	file.write("io_backend = floppy\n");
+	ASSERT_STREQ("auto", Config(file.path).settings()->io_backend.c_str());
+
+	file.write("config_reload_interval = 20\nio_backend = buffered\n");
+	Config config(file.path);
+	ReloadLog log;
+	config.watch(log.listener());
+	file.write("config_reload_interval = 20\nio_backend = floppy\n");
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	ASSERT_EQ(0u, log.count());
+	ASSERT_STREQ("buffered", config.settings()->io_backend.c_str());
+}
+
+TEST(ConfigTest, BandwidthSchedule)
+{
+	ScratchConfig file;
+	file.write("bandwidth_schedule = 08:00-18:00=256, 18:00-08:00=0\n");
+	ASSERT_STREQ("08:00-18:00=256, 18:00-08:00=0", Config(file.path).settings()->bandwidth_schedule.c_str());
+
+	file.write("bandwidth_schedule = 08:00-25:00=256\n");
+	ASSERT_STREQ("", Config(file.path).settings()->bandwidth_schedule.c_str());
+
+	file.write("config_reload_interval = 20\nbandwidth_schedule = 08:00-18:00=256\n");
+	Config config(file.path);
+	ReloadLog log;
+	config.watch(log.listener());
+	file.write("config_reload_interval = 20\nbandwidth_schedule = weekdays=256\n");
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	ASSERT_EQ(0u, log.count());
+	ASSERT_STREQ("08:00-18:00=256", config.settings()->bandwidth_schedule.c_str());
+}
+
+TEST(ConfigTest, Mirrors)
+{
+	ScratchConfig file;
+	file.write("mirrors = mirror.example.com:8080, [::1]:80\n");
+	ASSERT_STREQ("mirror.example.com:8080, [::1]:80", Config(file.path).settings()->mirrors.c_str());
+
+	file.write("mirrors = mirror.example.com:http\n");
+	ASSERT_STREQ("", Config(file.path).settings()->mirrors.c_str());
+
+	file.write("config_reload_interval = 20\nmirrors = mirror.example.com\n");
+	Config config(file.path);
+	ReloadLog log;
+	config.watch(log.listener());
+	file.write("config_reload_interval = 20\nmirrors = mirror.example.com:99999\n");
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+	ASSERT_EQ(0u, log.count());
+	ASSERT_STREQ("mirror.example.com", config.settings()->mirrors.c_str());
 }
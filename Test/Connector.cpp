@@ -0,0 +1,173 @@
+#include "../FontSync/Connector.cpp"
+#include <gtest/gtest.h>
+
+namespace
+{
+	/// a clock that only moves when told to
+	struct ManualClock
+	{
+		std::chrono::steady_clock::time_point now;
+
+		ResolverCache::Clock function()
+		{
+			return [this]() { return this->now; };
+		}
+	};
+
+	/// a local server that accepts connections and does nothing else
+	struct LocalServer
+	{
+		boost::asio::io_service service;
+		boost::asio::ip::tcp::acceptor acceptor;
+
+		LocalServer() : acceptor(service, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0))
+		{
+
+		}
+
+		boost::asio::ip::tcp::endpoint endpoint() const
+		{
+			return this->acceptor.local_endpoint();
+		}
+	};
+
+	/// a loopback port nothing listens on
+	boost::asio::ip::tcp::endpoint closedEndpoint()
+	{
+		boost::asio::ip::tcp::endpoint rv;
+		{
+			LocalServer server;
+			rv = server.endpoint();
+		}
+		return rv;
+	}
+
+	std::vector<boost::asio::ip::tcp::endpoint> lookupLoopback(const std::string&, uint16_t port)
+	{
+		return std::vector<boost::asio::ip::tcp::endpoint>(1, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), port));
+	}
+}
+
+TEST(Connector, CachesUntilExpiry)
+{
+	ManualClock clock;
+	unsigned lookups = 0;
+	ResolverCache cache(std::chrono::seconds(60), [&lookups](const std::string& host, uint16_t port)
+	{
+		++lookups;
+		return lookupLoopback(host, port);
+	}, clock.function());
+	bool cached = true;
+	auto endpoints = cache.resolve("mirror.example.com", 8080, &cached);
+	ASSERT_FALSE(cached);
+	ASSERT_EQ(1u, endpoints.size());
+	ASSERT_EQ(8080, endpoints[0].port());
+	cache.resolve("mirror.example.com", 8080, &cached);
+	ASSERT_TRUE(cached);
+	ASSERT_EQ(1u, lookups);
+	/// the port is part of the key
+	cache.resolve("mirror.example.com", 80, &cached);
+	ASSERT_FALSE(cached);
+	ASSERT_EQ(2u, lookups);
+	clock.now += std::chrono::seconds(60);
+	cache.resolve("mirror.example.com", 8080, &cached);
+	ASSERT_FALSE(cached);
+	ASSERT_EQ(3u, lookups);
+}
+
+TEST(Connector, Invalidate)
+{
+	ManualClock clock;
+	unsigned lookups = 0;
+	ResolverCache cache(std::chrono::seconds(60), [&lookups](const std::string& host, uint16_t port)
+	{
+		++lookups;
+		return lookupLoopback(host, port);
+	}, clock.function());
+	cache.resolve("mirror.example.com", 80);
+	cache.invalidate("mirror.example.com", 80);
+	cache.resolve("mirror.example.com", 80);
+	ASSERT_EQ(2u, lookups);
+	cache.setTtl(std::chrono::seconds(0));
+	cache.resolve("mirror.example.com", 80);
+	cache.resolve("mirror.example.com", 80);
+	ASSERT_EQ(4u, lookups);
+}
+
+TEST(Connector, UnresolvableHost)
+{
+	ResolverCache cache(std::chrono::seconds(60), [](const std::string&, uint16_t)
+	{
+		return std::vector<boost::asio::ip::tcp::endpoint>();
+	});
+	ASSERT_THROW(cache.resolve("nowhere.invalid", 80), boost::system::system_error);
+}
+
+TEST(Connector, RaceSkipsRefusedEndpoints)
+{
+	LocalServer server;
+	std::vector<boost::asio::ip::tcp::endpoint> endpoints;
+	endpoints.push_back(closedEndpoint());
+	endpoints.push_back(closedEndpoint());
+	endpoints.push_back(server.endpoint());
+	boost::asio::io_service service;
+	boost::asio::ip::tcp::socket socket(service);
+	auto start = std::chrono::steady_clock::now();
+	auto connected = raceConnect(service, socket, endpoints, std::chrono::milliseconds(1000), std::chrono::milliseconds(5000));
+	/// refused attempts hand over straight away instead of waiting out the attempt delay
+	ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(1000));
+	ASSERT_EQ(server.endpoint(), connected);
+	ASSERT_TRUE(socket.is_open());
+	ASSERT_EQ(server.endpoint(), socket.remote_endpoint());
+}
+
+TEST(Connector, RaceDoesNotWaitOnUnreachableEndpoints)
+{
+	/// a non-routable address either never answers or fails outright; both must cost at most the attempt delay
+	LocalServer server;
+	std::vector<boost::asio::ip::tcp::endpoint> endpoints;
+	endpoints.push_back(boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string("10.255.255.1"), server.endpoint().port()));
+	endpoints.push_back(server.endpoint());
+	boost::asio::io_service service;
+	boost::asio::ip::tcp::socket socket(service);
+	auto start = std::chrono::steady_clock::now();
+	auto connected = raceConnect(service, socket, endpoints, std::chrono::milliseconds(100), std::chrono::milliseconds(10000));
+	ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(2000));
+	ASSERT_EQ(server.endpoint(), connected);
+}
+
+TEST(Connector, RaceFails)
+{
+	std::vector<boost::asio::ip::tcp::endpoint> endpoints;
+	endpoints.push_back(closedEndpoint());
+	boost::asio::io_service service;
+	boost::asio::ip::tcp::socket socket(service);
+	ASSERT_THROW(raceConnect(service, socket, endpoints), boost::system::system_error);
+	ASSERT_THROW(raceConnect(service, socket, std::vector<boost::asio::ip::tcp::endpoint>()), boost::system::system_error);
+	/// the io_service can be raced on again afterwards
+	LocalServer server;
+	endpoints.push_back(server.endpoint());
+	ASSERT_EQ(server.endpoint(), raceConnect(service, socket, endpoints));
+}
+
+TEST(Connector, ConnectToHonorsPort)
+{
+	LocalServer server;
+	boost::asio::io_service service;
+	boost::asio::ip::tcp::socket socket(service);
+	auto connected = connectTo(service, socket, "127.0.0.1", server.endpoint().port());
+	ASSERT_EQ(server.endpoint().port(), connected.port());
+	ASSERT_EQ(server.endpoint(), socket.remote_endpoint());
+}
+
+TEST(Connector, ConnectToKeepsToTimeout)
+{
+	/// a non-routable address in the cache; resolving it again must not start the timeout over
+	const std::string host = "10.255.255.1";
+	sharedResolverCache().resolve(host, 80);
+	boost::asio::io_service service;
+	boost::asio::ip::tcp::socket socket(service);
+	auto start = std::chrono::steady_clock::now();
+	ASSERT_THROW(connectTo(service, socket, host, 80, std::chrono::milliseconds(400)), boost::system::system_error);
+	ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(700));
+}
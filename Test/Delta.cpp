@@ -0,0 +1,104 @@
+#include "../FontSync/Delta.cpp"
+#include <gtest/gtest.h>
+
+namespace
+{
+	/// a scratch file, removed when it goes out of scope
+	struct ScratchFile
+	{
+		std::string path;
+
+		explicit ScratchFile(const std::string& name) : path((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path(name + "-%%%%%%%%")).string())
+		{
+
+		}
+
+		void write(const std::vector<unsigned char>& contents) const
+		{
+			std::ofstream out(this->path, std::ios::binary | std::ios::trunc);
+			out.write(reinterpret_cast<const char*>(contents.data()), contents.size());
+		}
+
+		~ScratchFile()
+		{
+			boost::system::error_code ignored;
+			boost::filesystem::remove(this->path, ignored);
+		}
+	};
+
+	const char* font = "TestFonts/OpenDyslexic3-Regular.ttf";
+
+	/// a revision of the test font with an edit, an insertion and a deletion
+	std::vector<unsigned char> revise(std::vector<unsigned char> revision)
+	{
+		for (size_t i = 1000; i < 1100; ++i)
+		{
+			revision[i] ^= 0x5A;
+		}
+		revision.insert(revision.begin() + 50000, 777, 0x42);
+		revision.erase(revision.begin() + 150000, revision.begin() + 160000);
+		return revision;
+	}
+}
+
+TEST(Delta, RoundTrip)
+{
+	ScratchFile revised("revised"), delta("delta"), patched("patched");
+	revised.write(revise(readWhole(font)));
+	uint64_t size = createDelta(font, revised.path, delta.path);
+	/// the changes, and little else
+	ASSERT_LT(size, 4096u);
+	ASSERT_EQ(size, boost::filesystem::file_size(delta.path));
+	std::string digest = applyDelta(font, delta.path, patched.path, HashAlgorithm::MD5);
+	ASSERT_STREQ(hashFile(revised.path, HashAlgorithm::MD5).c_str(), digest.c_str());
+	ASSERT_TRUE(readWhole(revised.path) == readWhole(patched.path));
+}
+
+TEST(Delta, UnrelatedFiles)
+{
+	/// nothing in common: the delta carries the whole target
+	ScratchFile base("base"), target("target"), delta("delta"), patched("patched");
+	base.write(std::vector<unsigned char>(1000, 0x11));
+	std::vector<unsigned char> contents;
+	for (int i = 0; i < 5000; ++i)
+	{
+		contents.push_back(static_cast<unsigned char>(i * 7919 >> 3));
+	}
+	target.write(contents);
+	createDelta(base.path, target.path, delta.path);
+	applyDelta(base.path, delta.path, patched.path, HashAlgorithm::XXH64);
+	ASSERT_TRUE(contents == readWhole(patched.path));
+
+	/// an empty target
+	target.write(std::vector<unsigned char>());
+	createDelta(base.path, target.path, delta.path);
+	applyDelta(base.path, delta.path, patched.path, HashAlgorithm::XXH64);
+	ASSERT_EQ(0u, boost::filesystem::file_size(patched.path));
+}
+
+TEST(Delta, MalformedDeltas)
+{
+	ScratchFile revised("revised"), delta("delta"), patched("patched");
+	revised.write(revise(readWhole(font)));
+	createDelta(font, revised.path, delta.path);
+	auto valid = readWhole(delta.path);
+
+	/// not a delta at all
+	ASSERT_THROW(applyDelta(font, font, patched.path, HashAlgorithm::MD5), std::runtime_error);
+
+	/// cut short
+	delta.write(std::vector<unsigned char>(valid.begin(), valid.begin() + valid.size() / 2));
+	ASSERT_THROW(applyDelta(font, delta.path, patched.path, HashAlgorithm::MD5), std::runtime_error);
+	ASSERT_FALSE(boost::filesystem::exists(patched.path));
+
+	/// applied to a base too short for its copies
+	delta.write(valid);
+	ASSERT_THROW(applyDelta(delta.path, delta.path, patched.path, HashAlgorithm::MD5), std::runtime_error);
+
+	/// announcing a shorter target than it produces
+	auto lying = valid;
+	lying[8] = 1;
+	lying[9] = lying[10] = lying[11] = 0;
+	delta.write(lying);
+	ASSERT_THROW(applyDelta(font, delta.path, patched.path, HashAlgorithm::MD5), std::runtime_error);
+}
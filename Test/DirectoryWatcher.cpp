@@ -0,0 +1,105 @@
+#include "../FontSync/DirectoryWatcher.cpp"
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+
+namespace
+{
+	/// a scratch directory, removed along with everything in it
+	struct ScratchDirectory
+	{
+		std::string path;
+
+		ScratchDirectory() : path((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("watched-%%%%%%%%")).string())
+		{
+			boost::filesystem::create_directory(this->path);
+		}
+
+		void write(const std::string& name, const std::string& contents) const
+		{
+			std::ofstream out((boost::filesystem::path(this->path) / name).string(), std::ios::binary | std::ios::trunc);
+			out << contents;
+		}
+
+		~ScratchDirectory()
+		{
+			boost::system::error_code ignored;
+			boost::filesystem::remove_all(this->path, ignored);
+		}
+	};
+
+	/// collects changes until the expected file shows up, or a second passes
+	bool changedWithin(DirectoryWatcher& watcher, const std::string& name, std::set<std::string>& changed)
+	{
+		changed.clear();
+		auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+		while (std::chrono::steady_clock::now() < deadline)
+		{
+			std::set<std::string> taken;
+			if (!watcher.takeChanges(taken))
+			{
+				return false;
+			}
+			changed.insert(taken.begin(), taken.end());
+			if (changed.count(name) > 0)
+			{
+				return true;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		return false;
+	}
+}
+
+TEST(DirectoryWatcher, ReportsChanges)
+{
+	ScratchDirectory directory;
+	directory.write("before.ttf", "before");
+	DirectoryWatcher watcher(directory.path);
+	std::set<std::string> changed;
+	/// nothing is known about changes made before the watch started
+	ASSERT_FALSE(watcher.takeChanges(changed));
+	ASSERT_TRUE(watcher.takeChanges(changed));
+	ASSERT_TRUE(changed.empty());
+
+	directory.write("added.ttf", "added");
+	ASSERT_TRUE(changedWithin(watcher, "added.ttf", changed));
+	ASSERT_EQ(0u, changed.count("before.ttf"));
+
+	directory.write("before.ttf", "edited");
+	ASSERT_TRUE(changedWithin(watcher, "before.ttf", changed));
+
+	boost::filesystem::remove(boost::filesystem::path(directory.path) / "added.ttf");
+	ASSERT_TRUE(changedWithin(watcher, "added.ttf", changed));
+
+	boost::filesystem::rename(boost::filesystem::path(directory.path) / "before.ttf", boost::filesystem::path(directory.path) / "after.ttf");
+	ASSERT_TRUE(changedWithin(watcher, "after.ttf", changed));
+	ASSERT_EQ(1u, changed.count("before.ttf"));
+	ASSERT_TRUE(watcher.watching());
+}
+
+TEST(DirectoryWatcher, RemovedDirectory)
+{
+	std::unique_ptr<ScratchDirectory> directory(new ScratchDirectory());
+	DirectoryWatcher watcher(directory->path);
+	std::set<std::string> changed;
+	watcher.takeChanges(changed);
+	directory.reset();
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+	while (watcher.watching() && std::chrono::steady_clock::now() < deadline)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	ASSERT_FALSE(watcher.watching());
+	/// a stopped watch asks for a rescan every time
+	ASSERT_FALSE(watcher.takeChanges(changed));
+	ASSERT_FALSE(watcher.takeChanges(changed));
+}
+
+TEST(DirectoryWatcher, MissingDirectory)
+{
+	ASSERT_THROW(DirectoryWatcher("I_DO_NOT_EXIST"), std::runtime_error);
+}
@@ -0,0 +1,350 @@
+#ifndef FAULT_SERVER_HPP_INCLUDED
+#define FAULT_SERVER_HPP_INCLUDED
+
+/// some microsoft compilers still benefit from the use of #pragma once
+#if defined(_MSC_VER) && (_MSC_VER >= 1200)
+# pragma once
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+/**
+ * What goes wrong with one response of a FaultServer.  The defaults serve
+ * the response as it is.
+ *
+ */
+struct Faults
+{
+	/// how long to wait after the request before answering
+	std::chrono::milliseconds latency;
+
+	/// read the request, then never answer it until the server is destroyed
+	bool stallHeaders;
+
+	/// the most body bytes sent per second; 0 is unlimited
+	uint64_t bandwidth;
+
+	/// reset the connection once this many body bytes have been sent; -1 never does
+	int64_t resetAfter;
+
+	/// stop sending once this many body bytes have been sent, holding the connection open until the server
+	/// is destroyed; 0 stalls right after the headers, -1 never does
+	int64_t stallAfter;
+
+	/// whether Content-Length is sent; without it the body ends with the connection, or as its encoding says
+	bool announceLength;
+
+	/// added to the Content-Length announced for the body
+	int64_t lengthError;
+
+	/// answer with this status and no body instead, such as 503; 0 serves the resource
+	unsigned int status;
+
+	/// offsets into the body whose bytes are inverted on the way out
+	std::vector<uint64_t> corrupt;
+
+	/// further headers, each ending in a line break, such as Content-Encoding: gzip
+	std::string headers;
+
+	Faults() : latency(0), stallHeaders(false), bandwidth(0), resetAfter(-1), stallAfter(-1), announceLength(true), lengthError(0), status(0)
+	{
+
+	}
+};
+
+/**
+ * A local HTTP server for tests that serves resources from memory, with
+ * faults scripted per request.
+ *
+ * Every connection carries a single request and is served on its own
+ * thread, so several clients (or one client with several workers) can be
+ * served at once.  Ranges of a single span are honoured with a 206.
+ *
+ */
+class FaultServer
+{
+	boost::asio::io_service service;
+	boost::asio::ip::tcp::acceptor acceptor;
+	std::atomic<bool> done;
+	mutable std::mutex lock;
+	std::map<std::string, std::string> resources;
+	std::deque<Faults> script;
+	Faults defaults;
+	std::vector<std::string> received;
+	std::vector<std::thread> connections;
+	std::thread listener;
+
+	/// sleeps for the provided time, waking early if the server is being destroyed
+	bool pause(std::chrono::milliseconds duration)
+	{
+		auto until = std::chrono::steady_clock::now() + duration;
+		while (!this->done && std::chrono::steady_clock::now() < until)
+		{
+			std::this_thread::sleep_for((std::min)(std::chrono::duration_cast<std::chrono::milliseconds>(until - std::chrono::steady_clock::now()), std::chrono::milliseconds(10)));
+		}
+		return !this->done;
+	}
+
+	static std::string reason(unsigned int status)
+	{
+		switch (status)
+		{
+		case 200: return "OK";
+		case 206: return "Partial Content";
+		case 404: return "Not Found";
+		case 500: return "Internal Server Error";
+		case 502: return "Bad Gateway";
+		case 503: return "Service Unavailable";
+		default: return "Error";
+		}
+	}
+
+	/// the faults of the next request: the next scripted ones, then the defaults
+	Faults next(const std::string& request)
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		this->received.push_back(request);
+		if (this->script.empty())
+		{
+			return this->defaults;
+		}
+		Faults faults = this->script.front();
+		this->script.pop_front();
+		return faults;
+	}
+
+	void accept()
+	{
+		while (!this->done)
+		{
+			std::shared_ptr<boost::asio::ip::tcp::socket> socket(new boost::asio::ip::tcp::socket(this->service));
+			boost::system::error_code error;
+			this->acceptor.accept(*socket, error);
+			if (this->done || error)
+			{
+				break;
+			}
+			std::lock_guard<std::mutex> guard(this->lock);
+			this->connections.push_back(std::thread([this, socket]() { this->serve(*socket); }));
+		}
+	}
+
+	void serve(boost::asio::ip::tcp::socket& socket)
+	{
+		boost::system::error_code error;
+		boost::asio::streambuf buffer;
+		boost::asio::read_until(socket, buffer, "\r\n\r\n", error);
+		if (error)
+		{
+			return;
+		}
+		std::istream in(&buffer);
+		std::string method, target, line;
+		in >> method >> target;
+		std::getline(in, line);
+		uint64_t first = 0, last = UINT64_MAX;
+		bool ranged = false;
+		while (std::getline(in, line) && line != "\r")
+		{
+			if (line.compare(0, 13, "Range: bytes=") == 0 || line.compare(0, 13, "range: bytes=") == 0)
+			{
+				std::istringstream range(line.substr(13));
+				char dash = 0;
+				range >> first >> dash;
+				if (!(range >> last))
+				{
+					last = UINT64_MAX;
+				}
+				ranged = true;
+			}
+		}
+		Faults faults = this->next(method + " " + target + (ranged ? " bytes=" + std::to_string(first) + "-" + (last == UINT64_MAX ? "" : std::to_string(last)) : ""));
+
+		if (faults.stallHeaders)
+		{
+			this->pause(std::chrono::hours(24));
+			return;
+		}
+		if (!this->pause(faults.latency))
+		{
+			return;
+		}
+
+		std::string body;
+		unsigned int status = faults.status;
+		std::string extra;
+		if (status == 0)
+		{
+			std::string path = target.substr(0, target.find('?'));
+			std::lock_guard<std::mutex> guard(this->lock);
+			auto resource = this->resources.find(path);
+			if (resource == this->resources.end())
+			{
+				status = 404;
+			}
+			else if (ranged && first < resource->second.size())
+			{
+				last = (std::min)(last, static_cast<uint64_t>(resource->second.size() - 1));
+				body = resource->second.substr(static_cast<std::size_t>(first), static_cast<std::size_t>(last - first + 1));
+				extra = "Content-Range: bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" + std::to_string(resource->second.size()) + "\r\n";
+				status = 206;
+			}
+			else
+			{
+				body = resource->second;
+				status = 200;
+			}
+		}
+		for (auto offset : faults.corrupt)
+		{
+			if (offset < body.size())
+			{
+				body[static_cast<std::size_t>(offset)] = ~body[static_cast<std::size_t>(offset)];
+			}
+		}
+		std::string headers = "HTTP/1.1 " + std::to_string(status) + " " + reason(status) + "\r\nContent-Type: application/octet-stream\r\n" + extra + faults.headers +
+			(faults.announceLength ? "Content-Length: " + std::to_string(static_cast<int64_t>(body.size()) + faults.lengthError) + "\r\n" : "") + "Connection: close\r\n\r\n";
+		boost::asio::write(socket, boost::asio::buffer(headers), error);
+
+		/// paced in slices of a twentieth of a second's worth, so a cap holds over short bodies too
+		std::size_t slice = faults.bandwidth > 0 ? static_cast<std::size_t>((std::max)(faults.bandwidth / 20, static_cast<uint64_t>(1))) : body.size();
+		auto start = std::chrono::steady_clock::now();
+		for (std::size_t sent = 0; sent < body.size() && !error; )
+		{
+			std::size_t count = (std::min)(slice, body.size() - sent);
+			if (faults.stallAfter >= 0 && sent + count > static_cast<uint64_t>(faults.stallAfter))
+			{
+				count = static_cast<std::size_t>(faults.stallAfter - sent);
+				boost::asio::write(socket, boost::asio::buffer(body.data() + sent, count), error);
+				this->pause(std::chrono::hours(24));
+				return;
+			}
+			if (faults.resetAfter >= 0 && sent + count > static_cast<uint64_t>(faults.resetAfter))
+			{
+				count = static_cast<std::size_t>(faults.resetAfter - sent);
+				boost::asio::write(socket, boost::asio::buffer(body.data() + sent, count), error);
+				/// a zero linger turns the close into a reset
+				socket.set_option(boost::asio::socket_base::linger(true, 0), error);
+				socket.close(error);
+				return;
+			}
+			boost::asio::write(socket, boost::asio::buffer(body.data() + sent, count), error);
+			sent += count;
+			if (faults.bandwidth > 0 && !this->pause(std::chrono::milliseconds(sent * 1000 / faults.bandwidth) -
+				std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start)))
+			{
+				return;
+			}
+		}
+		if (faults.stallAfter >= 0)
+		{
+			this->pause(std::chrono::hours(24));
+			return;
+		}
+		socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, error);
+		socket.close(error);
+	}
+
+public:
+
+	/**
+	 * Starts serving on an ephemeral loopback port.
+	 *
+	 */
+	FaultServer() : acceptor(service, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)), done(false)
+	{
+		this->listener = std::thread([this]() { this->accept(); });
+	}
+
+	/**
+	 * Serves a resource.
+	 *
+	 * @param path the path of the resource, such as /update.json; query strings are ignored
+	 *
+	 * @param body the contents of the resource
+	 *
+	 */
+	void serve(const std::string& path, const std::string& body)
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		this->resources[path] = body;
+	}
+
+	/**
+	 * Scripts the faults of the next requests, after any already scripted.
+	 *
+	 * @param faults what goes wrong with each of them
+	 *
+	 * @param requests how many requests they apply to
+	 *
+	 */
+	void then(const Faults& faults, unsigned int requests = 1)
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		this->script.insert(this->script.end(), requests, faults);
+	}
+
+	/**
+	 * Changes the faults of every request once the script has run out.
+	 *
+	 */
+	void always(const Faults& faults)
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		this->defaults = faults;
+	}
+
+	/**
+	 * @return every request received so far, as method, target and any range
+	 *
+	 */
+	std::vector<std::string> requests() const
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		return this->received;
+	}
+
+	uint16_t port() const
+	{
+		return this->acceptor.local_endpoint().port();
+	}
+
+	/**
+	 * @return the URL of a resource on this server
+	 *
+	 */
+	std::string url(const std::string& path) const
+	{
+		return "http://127.0.0.1:" + std::to_string(this->port()) + path;
+	}
+
+	~FaultServer()
+	{
+		this->done = true;
+		{
+			/// wake the listener with a connection of its own
+			boost::system::error_code ignored;
+			boost::asio::ip::tcp::socket wake(this->service);
+			wake.connect(this->acceptor.local_endpoint(), ignored);
+		}
+		this->listener.join();
+		for (auto& connection : this->connections)
+		{
+			connection.join();
+		}
+	}
+};
+
+#endif
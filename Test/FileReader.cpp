@@ -0,0 +1,74 @@
+#include "../FontSync/FileReader.cpp"
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+	std::string readAll(const std::string& file, IOBackend backend)
+	{
+		auto reader = FileReader::open(file, backend);
+		std::string contents;
+		const unsigned char* data;
+		std::size_t size;
+		while (reader->next(data, size))
+		{
+			contents.append(reinterpret_cast<const char*>(data), size);
+		}
+		return contents;
+	}
+
+	std::string readReference(const std::string& file)
+	{
+		std::ifstream stream(file, std::ios::binary);
+		std::stringstream contents;
+		contents << stream.rdbuf();
+		return contents.str();
+	}
+
+	const IOBackend backends[] = { IOBackend::Buffered, IOBackend::Mapped, IOBackend::Overlapped };
+}
+
+TEST(FileReader, Backends)
+{
+	ASSERT_EQ(IOBackend::Mapped, parseIOBackend("mapped"));
+	ASSERT_EQ(IOBackend::Overlapped, parseIOBackend("Overlapped"));
+	ASSERT_STREQ("buffered", toString(IOBackend::Buffered));
+	ASSERT_THROW(parseIOBackend("io_uring"), std::invalid_argument);
+}
+
+TEST(FileReader, ReadsWholeFiles)
+{
+	const char* empty = "file_reader_empty.ttf";
+	std::ofstream(empty).close();
+	const char* files[] = { "md5_me.ttf", "TestFonts/OpenDyslexic3-Regular.ttf", empty };
+	for (auto backend : backends)
+	{
+		for (auto file : files)
+		{
+			ASSERT_EQ(readReference(file), readAll(file, backend)) << toString(backend) << ": " << file;
+		}
+	}
+	std::remove(empty);
+}
+
+TEST(FileReader, MissingFiles)
+{
+	for (auto backend : backends)
+	{
+		ASSERT_THROW(FileReader::open("I_DO_NOT_EXIST.ttf", backend), std::runtime_error);
+	}
+}
+
+TEST(FileReader, selectIOBackend)
+{
+	std::vector<std::string> sample;
+	sample.push_back("md5_me.ttf");
+	ASSERT_EQ(IOBackend::Buffered, selectIOBackend(sample));
+	sample.push_back("TestFonts/OpenDyslexic3-Regular.ttf");
+	sample.push_back("valid_config.ini");
+	auto backend = selectIOBackend(sample);
+	ASSERT_NO_THROW(FileReader::open("md5_me.ttf", backend));
+}
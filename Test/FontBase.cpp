@@ -1,4 +1,5 @@
 #include "../FontSync/FontBase.cpp"
+#include "../FontSync/StringPool.cpp"
 #include <gtest/gtest.h>
 
 class TestFontBase : public FontBase
@@ -13,10 +14,16 @@ public:
 	}
 
 	/// N/A
-	const std::string& getMD5() const
+	const std::string& getHash() const
 	{
 		return dummy;
 	}
+
+	/// N/A
+	HashAlgorithm getHashAlgorithm() const
+	{
+		return HashAlgorithm::MD5;
+	}
 };
 
 TEST(FontBase, Constructor)
@@ -65,4 +72,21 @@ TEST(FontBase, CopyAssignment)
 	ASSERT_STREQ(source.getName().c_str(), test.getName().c_str());
 	ASSERT_STREQ(source.getCategory().c_str(), test.getCategory().c_str());
 	ASSERT_STREQ(source.getType().c_str(), test.getType().c_str());
+}
+
+TEST(FontBase, MoveConstructor)
+{
+	TestFontBase source("name", "category", "type");
+	TestFontBase test(std::move(source));
+	ASSERT_STREQ("name", test.getName().c_str());
+	ASSERT_STREQ("category", test.getCategory().c_str());
+	ASSERT_STREQ("type", test.getType().c_str());
+}
+
+TEST(FontBase, InternedCategoryAndType)
+{
+	TestFontBase first("first", "category", "type");
+	TestFontBase second("second", "category", "type");
+	ASSERT_EQ(&first.getCategory(), &second.getCategory());
+	ASSERT_EQ(&first.getType(), &second.getType());
 }
\ No newline at end of file
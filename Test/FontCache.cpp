@@ -2,103 +2,216 @@
 #include <gtest/gtest.h>
 #include "../FontSync/LocalFont.cpp"
 #include "../FontSync/Utilities.cpp"
+#include "FaultServer.hpp"
 
-//	FontCache(const std::string& fontDirectory, bool cacheImmediately = false);
-TEST(FontCache, ConstructorNoCacheImmediately)
+#include <fstream>
+#include <iterator>
+
+namespace
 {
-	FontCache* test = nullptr;
-	try
-	{
-		ASSERT_NO_THROW(test = new FontCache("TestFonts", false));
-		ASSERT_NE(nullptr, test);
-		ASSERT_EQ(false, test->isInitialized());
-	}
-	catch (...) { /*ignore*/ }
-	if (test != nullptr)
-	{
-		delete test;
-		test = nullptr;
-	}
-	try
+	/// a font directory and application data directory of their own, so synchronizing leaves the service's state alone
+	struct SyncSandbox
 	{
-		ASSERT_THROW(test = new FontCache("InvalidTestFonts$%^"), std::runtime_error);
-	}
-	catch (...) { /*ignore*/ }
-	if (test != nullptr)
+		boost::filesystem::path root;
+		std::string fontDirectory;
+		std::string font;
+
+		SyncSandbox() : root(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("fontsync-%%%%%%%%"))
+		{
+			boost::filesystem::create_directories(this->root / "Fonts");
+			boost::filesystem::create_directories(this->root / "AppData" / "FontSync");
+			this->fontDirectory = (this->root / "Fonts").string();
+			setAppDataDirectory((this->root / "AppData").string());
+			std::ifstream in("TestFonts/OpenDyslexic3-Regular.ttf", std::ios::binary);
+			this->font.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		}
+
+		std::string digest(std::size_t offset = 0, std::size_t length = std::string::npos) const
+		{
+			auto hasher = Hasher::create(HashAlgorithm::MD5);
+			length = (std::min)(length, this->font.size() - offset);
+			hasher->update(reinterpret_cast<const unsigned char*>(this->font.data() + offset), length);
+			return hasher->digest();
+		}
+
+		RemoteFont remoteFont(const FaultServer& server) const
+		{
+			return RemoteFont("OpenDyslexic 3", "Test", "Regular", server.url("/fonts/OpenDyslexic3-Regular.ttf"), this->digest(), HashAlgorithm::MD5, 0, this->font.size());
+		}
+
+		std::string installed() const
+		{
+			return this->fontDirectory + "\\OpenDyslexic3-Regular.ttf";
+		}
+
+		~SyncSandbox()
+		{
+			setAppDataDirectory("");
+			boost::system::error_code ignored;
+			boost::filesystem::remove_all(this->root, ignored);
+		}
+	};
+
+	/// how long synchronizing the provided fonts takes
+	std::chrono::milliseconds timeToSynchronize(FontCache& cache, const std::vector<RemoteFont>& fonts)
 	{
-		delete test;
+		auto start = std::chrono::steady_clock::now();
+		EXPECT_NO_THROW(cache.synchronize(fonts));
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
 	}
 }
 
-TEST(FontCache, ConstructorCacheImmediately)
+TEST(FontCache, Constructor)
 {
-	FontCache* test = nullptr;
-	try
+	SyncSandbox sandbox;
+	/// a missing font directory is created
+	boost::filesystem::remove(sandbox.fontDirectory);
 	{
-		ASSERT_NO_THROW(test = new FontCache("TestFonts", true));
-		ASSERT_NE(nullptr, test);
-		ASSERT_EQ(true, test->isInitialized());
-		ASSERT_EQ(1, test->getCachedFonts().size());
-	}
-	catch (...) { /*ignore*/ }
-	if (test != nullptr)
-	{
-		delete test;
-		test = nullptr;
+		ASSERT_NO_THROW(FontCache(sandbox.fontDirectory, 200, 1));
 	}
+	ASSERT_TRUE(boost::filesystem::is_directory(sandbox.fontDirectory));
 
-	try
-	{
-		ASSERT_THROW(test = new FontCache("TestFontsInvalid#$%", true), std::runtime_error);
-	}
-	catch (...) { /*ignore*/ }
-	if (test != nullptr)
+	/// one that cannot be created is an error
+	std::ofstream((sandbox.root / "file").string().c_str()) << "not a directory";
+	ASSERT_THROW(FontCache((sandbox.root / "file" / "Fonts").string(), 200, 1), std::runtime_error);
+}
+
+TEST(FontCache, Synchronize)
+{
+	SyncSandbox sandbox;
+	FaultServer server;
+	server.serve("/fonts/OpenDyslexic3-Regular.ttf", sandbox.font);
 	{
-		delete test;
-		test = nullptr;
+		FontCache cache(sandbox.fontDirectory, 200, 1);
+		timeToSynchronize(cache, std::vector<RemoteFont>(1, sandbox.remoteFont(server)));
+		ASSERT_EQ(sandbox.font.size(), boost::filesystem::file_size(sandbox.installed()));
+
+		/// an installed font that is still current is not downloaded again
+		timeToSynchronize(cache, std::vector<RemoteFont>(1, sandbox.remoteFont(server)));
+		ASSERT_EQ(1u, server.requests().size());
+
+		/// nor kept once it is no longer listed
+		timeToSynchronize(cache, std::vector<RemoteFont>());
+		ASSERT_FALSE(boost::filesystem::exists(sandbox.installed()));
 	}
+}
 
-	try
+TEST(FontCache, Cancellation)
+{
+	SyncSandbox sandbox;
+	FaultServer server;
+	Faults unavailable;
+	unavailable.status = 503;
+	server.always(unavailable);
 	{
-		ASSERT_THROW(test = new FontCache("InvalidTestFonts", true), std::runtime_error);
+		/// the retry delay is abandoned once the service stops, rather than sat out
+		FontCache cache(sandbox.fontDirectory, 60 * 1000, 3);
+		std::atomic<bool> stop(false);
+		cache.setCancellation([&stop]() { return stop.load(); });
+		std::thread stopper([&stop]() { std::this_thread::sleep_for(std::chrono::milliseconds(500)); stop = true; });
+		auto elapsed = timeToSynchronize(cache, std::vector<RemoteFont>(1, sandbox.remoteFont(server)));
+		stopper.join();
+		ASSERT_LT(elapsed.count(), 5000);
 	}
-	catch (...) { /*ignore*/ }
-	if (test != nullptr)
+	ASSERT_EQ(1u, server.requests().size());
+	ASSERT_FALSE(boost::filesystem::exists(sandbox.installed()));
+}
+
+TEST(FontCache, FaultRetries)
+{
+	SyncSandbox sandbox;
+	FaultServer server;
+	server.serve("/fonts/OpenDyslexic3-Regular.ttf", sandbox.font);
+
+	/// a burst of errors and a reset, each followed by the retry delay, then a capped download
+	Faults unavailable, reset, capped;
+	unavailable.status = 503;
+	reset.resetAfter = 10000;
+	capped.bandwidth = 512 * 1024;
+	server.then(unavailable, 2);
+	server.then(reset);
+	server.always(capped);
 	{
-		delete test;
-		test = nullptr;
+		FontCache cache(sandbox.fontDirectory, 200, 4);
+		auto elapsed = timeToSynchronize(cache, std::vector<RemoteFont>(1, sandbox.remoteFont(server)));
+		auto transfer = static_cast<long long>(sandbox.font.size() * 1000 / capped.bandwidth);
+		ASSERT_GE(elapsed.count(), 3 * 200 + transfer * 8 / 10);
+		ASSERT_LT(elapsed.count(), 3 * 200 + transfer * 2 + 3000);
 	}
+	ASSERT_EQ(4u, server.requests().size());
+	ASSERT_TRUE(boost::filesystem::exists(sandbox.installed()));
+	ASSERT_EQ(sandbox.font.size(), boost::filesystem::file_size(sandbox.installed()));
 }
 
-TEST(FontCache, UpdateCache)
+TEST(FontCache, FaultCorruption)
 {
-	FontCache* test = nullptr;
-	try
+	SyncSandbox sandbox;
+	FaultServer server;
+	server.serve("/fonts/OpenDyslexic3-Regular.ttf", sandbox.font);
+	Faults corrupt, shortened;
+	corrupt.corrupt.push_back(1000);
+	shortened.lengthError = 1000;
+	server.then(corrupt);
+	server.then(shortened);
 	{
-		ASSERT_NO_THROW(test = new FontCache("TestFonts", false));
-		ASSERT_EQ(false, test->isInitialized());
-		ASSERT_EQ(0, test->getCachedFonts().size());
-		ASSERT_NO_THROW(test->updateCache());
-		ASSERT_NE(nullptr, test);
-		ASSERT_EQ(true, test->isInitialized());
-		ASSERT_EQ(1, test->getCachedFonts().size());
+		FontCache cache(sandbox.fontDirectory, 200, 1);
+
+		/// a font that arrives corrupted is never installed
+		timeToSynchronize(cache, std::vector<RemoteFont>(1, sandbox.remoteFont(server)));
+		ASSERT_FALSE(boost::filesystem::exists(sandbox.installed()));
+
+		/// nor is one cut short of its announced length
+		timeToSynchronize(cache, std::vector<RemoteFont>(1, sandbox.remoteFont(server)));
+		ASSERT_FALSE(boost::filesystem::exists(sandbox.installed()));
 	}
-	catch (...) { /*ignore*/ }
-	if (test != nullptr)
+	ASSERT_EQ(2u, server.requests().size());
+}
+
+TEST(FontCache, FaultResume)
+{
+	SyncSandbox sandbox;
+	FaultServer server;
+	server.serve("/fonts/OpenDyslexic3-Regular.ttf", sandbox.font);
+	const std::size_t chunkSize = 16 * 1024;
+	std::vector<std::string> chunks;
+	for (std::size_t offset = 0; offset < sandbox.font.size(); offset += chunkSize)
 	{
-		delete test;
-		test = nullptr;
+		chunks.push_back(sandbox.digest(offset, chunkSize));
 	}
+	RemoteFont font = sandbox.remoteFont(server);
+	font.setChunks(chunkSize, chunks);
 
-	try
+	/// the first attempt is reset part way through the fourth chunk; the retry only asks for the rest
+	Faults reset;
+	reset.resetAfter = 3 * chunkSize + chunkSize / 2;
+	server.then(reset);
 	{
-		ASSERT_NO_THROW(test = new FontCache("InvalidTestFonts", false));
-		ASSERT_THROW(test->updateCache(), std::runtime_error);
+		FontCache cache(sandbox.fontDirectory, 100, 2);
+		timeToSynchronize(cache, std::vector<RemoteFont>(1, font));
 	}
-	catch (...) { /*ignore*/ }
-	if (test != nullptr)
+	auto requests = server.requests();
+	ASSERT_EQ(2u, requests.size());
+	ASSERT_NE(std::string::npos, requests[0].find("bytes=0-"));
+	ASSERT_NE(std::string::npos, requests[1].find("bytes=" + std::to_string(3 * chunkSize) + "-"));
+	ASSERT_EQ(sandbox.font.size(), boost::filesystem::file_size(sandbox.installed()));
+}
+
+TEST(FontCache, WatcherIgnoresOwnWrites)
+{
+	SyncSandbox sandbox;
+	FaultServer server;
+	server.serve("/fonts/OpenDyslexic3-Regular.ttf", sandbox.font);
 	{
-		delete test;
-		test = nullptr;
+		FontCache cache(sandbox.fontDirectory, 200, 1);
+		cache.setWatching(true);
+		timeToSynchronize(cache, std::vector<RemoteFont>(1, sandbox.remoteFont(server)));
+		ASSERT_TRUE(boost::filesystem::exists(sandbox.installed()));
+
+		/// the watcher saw the font being staged and installed, but its digest was recorded from the wire:
+		/// the next synchronization trusts it, so nothing is hashed and the hash cache is not written again
+		boost::filesystem::remove(getHashCachePath());
+		timeToSynchronize(cache, std::vector<RemoteFont>(1, sandbox.remoteFont(server)));
+		ASSERT_FALSE(boost::filesystem::exists(getHashCachePath()));
+		ASSERT_EQ(1u, server.requests().size());
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,43 @@
+#include "../FontSync/FontFilter.cpp"
+#include <gtest/gtest.h>
+
+TEST(FontFilter, EmptyFilter)
+{
+	FontFilter filter;
+	ASSERT_TRUE(filter.empty());
+	ASSERT_TRUE(filter.matches("Arial", "sans-serif", "truetype"));
+	ASSERT_STREQ("", filter.toQueryString().c_str());
+}
+
+TEST(FontFilter, globMatch)
+{
+	ASSERT_TRUE(FontFilter::globMatch("OpenDyslexic3-Regular", "opendyslexic*"));
+	ASSERT_TRUE(FontFilter::globMatch("OpenDyslexic3-Regular", "*-Regular"));
+	ASSERT_TRUE(FontFilter::globMatch("OpenDyslexic3-Regular", "OpenDyslexic?-*"));
+	ASSERT_TRUE(FontFilter::globMatch("", "*"));
+	ASSERT_FALSE(FontFilter::globMatch("OpenDyslexic3-Bold", "*-Regular"));
+	ASSERT_FALSE(FontFilter::globMatch("Arial", "Arial?"));
+}
+
+TEST(FontFilter, IncludeAndExclude)
+{
+	Config::Settings settings;
+	settings.include_categories = "Sans-Serif, Monospace";
+	settings.exclude_types = "type1";
+	settings.exclude_names = "*Bold*";
+	FontFilter filter(settings);
+	ASSERT_FALSE(filter.empty());
+	ASSERT_TRUE(filter.matches("Arial", "sans-serif", "truetype"));
+	ASSERT_TRUE(filter.matches("Consolas", "monospace", "opentype"));
+	ASSERT_FALSE(filter.matches("Times New Roman", "serif", "truetype"));
+	ASSERT_FALSE(filter.matches("Helvetica", "sans-serif", "type1"));
+	ASSERT_FALSE(filter.matches("Arial Bold", "sans-serif", "truetype"));
+}
+
+TEST(FontFilter, toQueryString)
+{
+	Config::Settings settings;
+	settings.include_categories = "sans-serif,call center";
+	settings.exclude_names = "*Bold*";
+	ASSERT_STREQ("category=sans-serif%2Ccall%20center&exclude_name=*Bold*", FontFilter(settings).toQueryString().c_str());
+}
@@ -0,0 +1,139 @@
+#include "../FontSync/HashCache.cpp"
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+namespace
+{
+	const char* cacheFile = "hash_cache_test.json";
+
+	const char* scratchFile = "hash_cache_scratch.ttf";
+
+	void writeScratch(const std::string& contents)
+	{
+		std::ofstream out(scratchFile, std::ios::binary | std::ios::trunc);
+		out << contents;
+	}
+}
+
+TEST(HashCache, LookupAndRecord)
+{
+	{
+		boost::filesystem::remove(cacheFile);
+		HashCache cache(cacheFile);
+		std::string digest;
+		ASSERT_FALSE(cache.lookup("md5_me.ttf", HashAlgorithm::MD5, digest));
+		cache.record("md5_me.ttf", HashAlgorithm::MD5, "0CBC6611F5540BD0809A388DC95A615B");
+		ASSERT_TRUE(cache.lookup("md5_me.ttf", HashAlgorithm::MD5, digest));
+		ASSERT_STREQ("0CBC6611F5540BD0809A388DC95A615B", digest.c_str());
+		ASSERT_FALSE(cache.lookup("md5_me.ttf", HashAlgorithm::XXH64, digest));
+		cache.forget("md5_me.ttf");
+		ASSERT_FALSE(cache.lookup("md5_me.ttf", HashAlgorithm::MD5, digest));
+	}
+	boost::filesystem::remove(cacheFile);
+}
+
+TEST(HashCache, Persistence)
+{
+	boost::filesystem::remove(cacheFile);
+	{
+		HashCache cache(cacheFile);
+		cache.record("md5_me.ttf", HashAlgorithm::XXH64, "DA83EFC38A8922B4");
+		cache.flush();
+	}
+	HashCache cache(cacheFile);
+	std::string digest;
+	ASSERT_TRUE(cache.lookup("md5_me.ttf", HashAlgorithm::XXH64, digest));
+	ASSERT_STREQ("DA83EFC38A8922B4", digest.c_str());
+	boost::filesystem::remove(cacheFile);
+}
+
+TEST(HashCache, StaleEntries)
+{
+	{
+		boost::filesystem::remove(cacheFile);
+		writeScratch("abc");
+		HashCache cache(cacheFile);
+		cache.record(scratchFile, HashAlgorithm::XXH64, "44BC2CF5AD770999");
+		writeScratch("abcd");
+		std::string digest;
+		ASSERT_FALSE(cache.lookup(scratchFile, HashAlgorithm::XXH64, digest));
+		boost::filesystem::remove(scratchFile);
+	}
+	boost::filesystem::remove(cacheFile);
+}
+
+TEST(HashCache, Digests)
+{
+	{
+		boost::filesystem::remove(cacheFile);
+		HashCache cache(cacheFile);
+		std::vector<std::pair<std::string, HashAlgorithm>> files;
+		files.push_back(std::make_pair("md5_me.ttf", HashAlgorithm::MD5));
+		files.push_back(std::make_pair("md5_me.ttf", HashAlgorithm::XXH64));
+		files.push_back(std::make_pair("I_DO_NOT_EXIST.ttf", HashAlgorithm::MD5));
+		auto digests = cache.digests(files);
+		ASSERT_STREQ("0CBC6611F5540BD0809A388DC95A615B", digests[0].c_str());
+		ASSERT_STREQ("DA83EFC38A8922B4", digests[1].c_str());
+		ASSERT_TRUE(digests[2].empty());
+		std::string digest;
+		ASSERT_TRUE(cache.lookup("md5_me.ttf", HashAlgorithm::MD5, digest));
+	}
+	boost::filesystem::remove(cacheFile);
+}
+
+TEST(HashCache, Trusting)
+{
+	{
+		boost::filesystem::remove(cacheFile);
+		writeScratch("abc");
+		HashCache cache(cacheFile);
+		cache.record(scratchFile, HashAlgorithm::XXH64, "44BC2CF5AD770999");
+		cache.setTrusting(true);
+		writeScratch("abcd");
+		std::string digest;
+		/// unreported changes go unnoticed while trusting
+		ASSERT_TRUE(cache.lookup(scratchFile, HashAlgorithm::XXH64, digest));
+		cache.suspect(scratchFile);
+		ASSERT_FALSE(cache.lookup(scratchFile, HashAlgorithm::XXH64, digest));
+		cache.setTrusting(false);
+		ASSERT_FALSE(cache.lookup(scratchFile, HashAlgorithm::XXH64, digest));
+		cache.record(scratchFile, HashAlgorithm::XXH64, "64C2FA5CEE08E09C");
+		cache.setTrusting(true);
+		/// a suspect is hashed again even though its size and modification time are unchanged,
+		/// whatever the case the watcher reported it in, until its digest is recorded anew
+		cache.suspect(boost::algorithm::to_upper_copy(std::string(scratchFile)));
+		ASSERT_FALSE(cache.lookup(scratchFile, HashAlgorithm::XXH64, digest));
+		cache.record(scratchFile, HashAlgorithm::XXH64, "64C2FA5CEE08E09C");
+		ASSERT_TRUE(cache.lookup(scratchFile, HashAlgorithm::XXH64, digest));
+		boost::filesystem::remove(scratchFile);
+		ASSERT_TRUE(cache.lookup(scratchFile, HashAlgorithm::XXH64, digest));
+		ASSERT_STREQ("64C2FA5CEE08E09C", digest.c_str());
+		boost::filesystem::remove(scratchFile);
+	}
+	boost::filesystem::remove(cacheFile);
+}
+
+TEST(HashCache, SameSecondRewrite)
+{
+	{
+		boost::filesystem::remove(cacheFile);
+		writeScratch("abc");
+		HashCache cache(cacheFile);
+		cache.record(scratchFile, HashAlgorithm::XXH64, "44BC2CF5AD770999");
+		/// a rewrite of the same size, well within the second the file was hashed in
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		writeScratch("xyz");
+		std::string digest;
+		ASSERT_FALSE(cache.lookup(scratchFile, HashAlgorithm::XXH64, digest));
+
+		/// entries are kept under the case-folded path, so differently cased paths share one
+		cache.record(scratchFile, HashAlgorithm::XXH64, "4DDCB3B6D4C4E1A8");
+		cache.forget(boost::algorithm::to_upper_copy(std::string(scratchFile)));
+		ASSERT_FALSE(cache.lookup(scratchFile, HashAlgorithm::XXH64, digest));
+		boost::filesystem::remove(scratchFile);
+	}
+	boost::filesystem::remove(cacheFile);
+}
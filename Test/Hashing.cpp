@@ -0,0 +1,33 @@
+#include "../FontSync/Hashing.cpp"
+#include <gtest/gtest.h>
+
+TEST(Hashing, Algorithms)
+{
+	ASSERT_EQ(HashAlgorithm::MD5, parseHashAlgorithm("md5"));
+	ASSERT_EQ(HashAlgorithm::XXH64, parseHashAlgorithm("XXH64"));
+	ASSERT_STREQ("xxh64", toString(HashAlgorithm::XXH64));
+	ASSERT_THROW(parseHashAlgorithm("crc32"), std::invalid_argument);
+}
+
+TEST(Hashing, hashFile)
+{
+	ASSERT_STREQ("0CBC6611F5540BD0809A388DC95A615B", hashFile("md5_me.ttf", HashAlgorithm::MD5).c_str());
+	ASSERT_STREQ("DA83EFC38A8922B4", hashFile("md5_me.ttf", HashAlgorithm::XXH64).c_str());
+	ASSERT_THROW(hashFile("I_DO_NOT_EXIST.ttf", HashAlgorithm::XXH64), std::runtime_error);
+}
+
+TEST(Hashing, Incremental)
+{
+	/// Ref: the xxHash reference implementation
+	auto hasher = Hasher::create(HashAlgorithm::XXH64);
+	hasher->update(reinterpret_cast<const unsigned char*>("a"), 1);
+	hasher->update(reinterpret_cast<const unsigned char*>("bc"), 2);
+	ASSERT_STREQ("44BC2CF5AD770999", hasher->digest().c_str());
+	ASSERT_STREQ("EF46DB3751D8E999", Hasher::create(HashAlgorithm::XXH64)->digest().c_str());
+}
+
+TEST(Hashing, sameDigest)
+{
+	ASSERT_TRUE(sameDigest("0cbc6611f5540bd0809a388dc95a615b", "0CBC6611F5540BD0809A388DC95A615B"));
+	ASSERT_FALSE(sameDigest("0CBC6611F5540BD0809A388DC95A615B", "DA83EFC38A8922B4"));
+}
\ No newline at end of file
@@ -6,5 +6,14 @@ TEST(LocalFont, ComprehensiveTest)
 	const std::string known_md5 = "0CBC6611F5540BD0809A388DC95A615B";
 	LocalFont test("name", "category", "type", "md5_me.ttf");
 	ASSERT_EQ("md5_me.ttf", test.getLocalFile());
-	ASSERT_STREQ(known_md5.c_str(), test.getMD5().c_str());
+	ASSERT_STREQ(known_md5.c_str(), test.getHash().c_str());
+	ASSERT_EQ(HashAlgorithm::MD5, test.getHashAlgorithm());
+}
+
+TEST(LocalFont, FastHash)
+{
+	const std::string known_xxh64 = "DA83EFC38A8922B4";
+	LocalFont test("name", "category", "type", "md5_me.ttf", HashAlgorithm::XXH64);
+	ASSERT_STREQ(known_xxh64.c_str(), test.getHash().c_str());
+	ASSERT_EQ(HashAlgorithm::XXH64, test.getHashAlgorithm());
 }
\ No newline at end of file
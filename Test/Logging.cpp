@@ -0,0 +1,35 @@
+#include "../FontSync/Logging.cpp"
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+TEST(Logging, BurstIsNotDropped)
+{
+	/// a burst of records below the flush severity, many times the queue and well inside one flush interval
+	Config::Settings settings;
+	settings.file_logging_enabled = false;
+	settings.console_logging_format = "%Message%";
+	settings.logging_severity_filter = boost::log::trivial::trace;
+	settings.logging_queue_size = 256;
+	settings.logging_flush_interval = 60 * 1000;
+	const unsigned int records = 16 * settings.logging_queue_size;
+	std::ostringstream captured;
+	std::streambuf* console = std::cout.rdbuf(captured.rdbuf());
+	initLogging(settings);
+	for (unsigned int i = 0; i < records; ++i)
+	{
+		FONTSYNC_LOG_TRIVIAL(trace) << "record " << i;
+	}
+	shutdownLogging();
+	std::cout.rdbuf(console);
+
+	std::istringstream lines(captured.str());
+	unsigned int written = 0;
+	for (std::string line; std::getline(lines, line); )
+	{
+		ASSERT_EQ(std::string::npos, line.find("dropped")) << line;
+		ASSERT_EQ("record " + std::to_string(written), line);
+		++written;
+	}
+	ASSERT_EQ(records, written);
+}
@@ -0,0 +1,173 @@
+#include "../FontSync/MirrorSet.cpp"
+#include <gtest/gtest.h>
+
+#include <map>
+#include <thread>
+
+namespace
+{
+	Mirror mirror(const std::string& host, uint16_t port)
+	{
+		Mirror rv = { host, port };
+		return rv;
+	}
+
+	/// a local server that accepts connections and does nothing else
+	struct LocalServer
+	{
+		boost::asio::io_service service;
+		boost::asio::ip::tcp::acceptor acceptor;
+
+		LocalServer() : acceptor(service, boost::asio::ip::tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0))
+		{
+
+		}
+
+		uint16_t port() const
+		{
+			return this->acceptor.local_endpoint().port();
+		}
+	};
+}
+
+TEST(MirrorSet, Parse)
+{
+	auto mirrors = MirrorSet::parse("primary.example.com", 80, " mirror.example.com:8080, [::1]:81,primary.example.com:80, mirror.example.com");
+	ASSERT_EQ(4u, mirrors.size());
+	ASSERT_TRUE(mirror("primary.example.com", 80) == mirrors[0]);
+	ASSERT_TRUE(mirror("mirror.example.com", 8080) == mirrors[1]);
+	ASSERT_TRUE(mirror("::1", 81) == mirrors[2]);
+	ASSERT_TRUE(mirror("mirror.example.com", 80) == mirrors[3]);
+	ASSERT_STREQ("[::1]:81", toString(mirrors[2]).c_str());
+	ASSERT_THROW(MirrorSet::parse("primary", 80, "mirror:http"), std::invalid_argument);
+	ASSERT_THROW(MirrorSet::parse("primary", 80, "mirror:70000"), std::invalid_argument);
+	ASSERT_THROW(MirrorSet::parse("primary", 80, ":8080"), std::invalid_argument);
+}
+
+TEST(MirrorSet, RankedByLatency)
+{
+	/// several local servers, with latency injected into the probe
+	LocalServer near, far, slow;
+	std::map<uint16_t, std::chrono::milliseconds> latency;
+	latency[near.port()] = std::chrono::milliseconds(5);
+	latency[far.port()] = std::chrono::milliseconds(40);
+	latency[slow.port()] = std::chrono::milliseconds(80);
+	std::vector<Mirror> mirrors;
+	mirrors.push_back(mirror("127.0.0.1", slow.port()));
+	mirrors.push_back(mirror("127.0.0.1", far.port()));
+	mirrors.push_back(mirror("127.0.0.1", near.port()));
+	MirrorSet set(mirrors, [&latency](const Mirror& mirror)
+	{
+		std::this_thread::sleep_for(latency[mirror.port]);
+		return connectProbe(mirror) + latency[mirror.port];
+	});
+
+	/// unmeasured mirrors keep their configured order
+	ASSERT_EQ(slow.port(), set.ranked()[0].port);
+
+	set.probe();
+	auto ranked = set.ranked();
+	ASSERT_EQ(near.port(), ranked[0].port);
+	ASSERT_EQ(far.port(), ranked[1].port);
+	ASSERT_EQ(slow.port(), ranked[2].port);
+}
+
+TEST(MirrorSet, Failover)
+{
+	std::map<uint16_t, std::chrono::milliseconds> latency;
+	latency[1] = std::chrono::milliseconds(10);
+	latency[2] = std::chrono::milliseconds(20);
+	latency[3] = std::chrono::milliseconds(30);
+	std::vector<Mirror> mirrors;
+	mirrors.push_back(mirror("a", 1));
+	mirrors.push_back(mirror("b", 2));
+	mirrors.push_back(mirror("c", 3));
+	MirrorSet set(mirrors, [&latency](const Mirror& mirror) { return latency[mirror.port]; });
+	set.probe();
+
+	/// a failing mirror is passed over until it recovers
+	set.reportFailure(mirrors[0]);
+	auto ranked = set.ranked();
+	ASSERT_TRUE(mirrors[1] == ranked[0]);
+	ASSERT_TRUE(mirrors[2] == ranked[1]);
+	ASSERT_TRUE(mirrors[0] == ranked[2]);
+
+	/// when every mirror is failing, the one that recovers soonest comes first
+	set.reportFailure(mirrors[1]);
+	set.reportFailure(mirrors[2]);
+	ranked = set.ranked();
+	ASSERT_EQ(3u, ranked.size());
+	ASSERT_TRUE(mirrors[0] == ranked[0]);
+	ASSERT_TRUE(mirrors[1] == ranked[1]);
+
+	set.reportSuccess(mirrors[2]);
+	ASSERT_TRUE(mirrors[2] == set.ranked()[0]);
+
+	/// a mirror that cannot be reached when probed cools down too
+	latency.erase(1);
+	MirrorSet unreachable(mirrors, [&latency](const Mirror& mirror) -> std::chrono::milliseconds
+	{
+		if (latency.find(mirror.port) == latency.end())
+		{
+			throw std::runtime_error("unreachable");
+		}
+		return latency[mirror.port];
+	});
+	unreachable.probe();
+	ASSERT_TRUE(mirrors[0] == unreachable.ranked()[2]);
+}
+
+TEST(MirrorSet, Reconfigure)
+{
+	std::vector<Mirror> mirrors;
+	mirrors.push_back(mirror("a", 1));
+	mirrors.push_back(mirror("b", 2));
+	MirrorSet set(mirrors, [](const Mirror& mirror) { return std::chrono::milliseconds(mirror.port == 2 ? 1 : 50); });
+	set.probe();
+	mirrors.insert(mirrors.begin(), mirror("c", 3));
+	set.reconfigure(mirrors);
+	/// measurements survive, unmeasured mirrors come after measured ones
+	auto ranked = set.ranked();
+	ASSERT_TRUE(mirror("b", 2) == ranked[0]);
+	ASSERT_TRUE(mirror("a", 1) == ranked[1]);
+	ASSERT_TRUE(mirror("c", 3) == ranked[2]);
+}
+
+TEST(MirrorSet, Rewrite)
+{
+	MirrorSet set(MirrorSet::parse("fonts.example.com", 80, "mirror.example.com:8080, secure.example.com:443"));
+	ASSERT_TRUE(set.serves("http://fonts.example.com/fonts/a.ttf"));
+	ASSERT_TRUE(set.serves("http://FONTS.example.com:80/fonts/a.ttf"));
+	ASSERT_FALSE(set.serves("http://fonts.example.com:8080/fonts/a.ttf"));
+	ASSERT_FALSE(set.serves("http://elsewhere.example.com/fonts/a.ttf"));
+	ASSERT_FALSE(set.serves("fonts/a.ttf"));
+	ASSERT_TRUE(set.serves("https://secure.example.com/a.ttf"));
+	ASSERT_STREQ("http://mirror.example.com:8080/fonts/a.ttf?v=2",
+		set.rewrite("http://fonts.example.com/fonts/a.ttf?v=2", mirror("mirror.example.com", 8080)).c_str());
+	ASSERT_STREQ("http://fonts.example.com/fonts/a.ttf",
+		set.rewrite("http://mirror.example.com:8080/fonts/a.ttf", mirror("fonts.example.com", 80)).c_str());
+	ASSERT_STREQ("http://elsewhere.example.com/a.ttf",
+		set.rewrite("http://elsewhere.example.com/a.ttf", mirror("mirror.example.com", 8080)).c_str());
+}
+
+TEST(MirrorSet, RewriteHttps)
+{
+	/// mirrors are listed by their http port; the default one stands for https on 443
+	MirrorSet set(MirrorSet::parse("fonts.example.com", 80, "mirror.example.com:8443"));
+	ASSERT_TRUE(set.serves("https://fonts.example.com/a.ttf"));
+	ASSERT_TRUE(set.serves("https://fonts.example.com:443/a.ttf"));
+	ASSERT_FALSE(set.serves("https://fonts.example.com:80/a.ttf"));
+	ASSERT_STREQ("https://fonts.example.com/a.ttf",
+		set.rewrite("https://mirror.example.com:8443/a.ttf", mirror("fonts.example.com", 80)).c_str());
+	ASSERT_STREQ("https://mirror.example.com:8443/a.ttf",
+		set.rewrite("https://fonts.example.com/a.ttf", mirror("mirror.example.com", 8443)).c_str());
+}
+
+TEST(MirrorSet, ConnectProbe)
+{
+	LocalServer server;
+	uint16_t port = server.port();
+	ASSERT_GE(connectProbe(mirror("127.0.0.1", port)).count(), 0);
+	server.acceptor.close();
+	ASSERT_THROW(connectProbe(mirror("127.0.0.1", port)), std::runtime_error);
+}
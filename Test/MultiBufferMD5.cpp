@@ -0,0 +1,128 @@
+#include "../FontSync/MultiBufferMD5.cpp"
+/// include *.hpp to appease the ODR.
+#include "../FontSync/Hashing.hpp"
+#include <gtest/gtest.h>
+
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+
+namespace
+{
+	std::vector<std::string> testFiles()
+	{
+		std::vector<std::string> files;
+		for (boost::filesystem::directory_iterator it("TestFonts"), end; it != end; ++it)
+		{
+			files.push_back(it->path().string());
+		}
+		files.push_back("md5_me.ttf");
+		files.push_back("valid_config.ini");
+		files.push_back("invalid_config.ini");
+		return files;
+	}
+
+	/// writes a file per length, of bytes that differ from file to file
+	std::vector<std::string> writeFiles(const boost::filesystem::path& directory, const std::vector<size_t>& lengths)
+	{
+		boost::filesystem::create_directories(directory);
+		std::vector<std::string> files;
+		for (size_t i = 0; i < lengths.size(); ++i)
+		{
+			std::string file = (directory / ("file" + std::to_string(i) + ".bin")).string();
+			std::ofstream out(file.c_str(), std::ios::binary);
+			for (size_t j = 0; j < lengths[i]; ++j)
+			{
+				out.put(static_cast<char>((j * 31 + i * 7) & 0xFF));
+			}
+			files.push_back(file);
+		}
+		return files;
+	}
+
+	void expectEveryEngineMatches(const std::vector<std::string>& files)
+	{
+		const MD5Engine engines[] = { MD5Engine::Scalar, MD5Engine::SSE2, MD5Engine::AVX2, MD5Engine::AVX512 };
+		for (auto engine : engines)
+		{
+			if (!isSupported(engine))
+			{
+				continue;
+			}
+			auto digests = md5Batch(files, engine);
+			ASSERT_EQ(files.size(), digests.size());
+			for (size_t i = 0; i < files.size(); ++i)
+			{
+				std::string expected = boost::filesystem::exists(files[i]) ? hashFile(files[i], HashAlgorithm::MD5) : "";
+				EXPECT_EQ(expected, digests[i]) << toString(engine) << ": " << files[i];
+			}
+		}
+	}
+}
+
+TEST(MultiBufferMD5, Engines)
+{
+	ASSERT_TRUE(isSupported(MD5Engine::Scalar));
+	ASSERT_TRUE(isSupported(detectMD5Engine()));
+	ASSERT_STREQ("avx2", toString(MD5Engine::AVX2));
+}
+
+TEST(MultiBufferMD5, MatchesMD5)
+{
+	auto files = testFiles();
+	const MD5Engine engines[] = { MD5Engine::Scalar, MD5Engine::SSE2, MD5Engine::AVX2, MD5Engine::AVX512 };
+	for (auto engine : engines)
+	{
+		if (!isSupported(engine))
+		{
+			continue;
+		}
+		auto digests = md5Batch(files, engine);
+		ASSERT_EQ(files.size(), digests.size());
+		for (size_t i = 0; i < files.size(); ++i)
+		{
+			ASSERT_EQ(hashFile(files[i], HashAlgorithm::MD5), digests[i]) << toString(engine) << ": " << files[i];
+		}
+	}
+}
+
+TEST(MultiBufferMD5, MissingFiles)
+{
+	std::vector<std::string> files;
+	files.push_back("I_DO_NOT_EXIST.ttf");
+	files.push_back("md5_me.ttf");
+	auto digests = md5Batch(files);
+	ASSERT_TRUE(digests[0].empty());
+	ASSERT_STREQ("0CBC6611F5540BD0809A388DC95A615B", digests[1].c_str());
+	ASSERT_TRUE(md5Batch(std::vector<std::string>()).empty());
+}
+
+TEST(MultiBufferMD5, PaddingBoundaries)
+{
+	/// either side of the lengths where the padding needs a block of its own
+	const size_t lengths[] = { 0, 55, 56, 63, 64, 119, 120 };
+	auto directory = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+	auto files = writeFiles(directory, std::vector<size_t>(std::begin(lengths), std::end(lengths)));
+	expectEveryEngineMatches(files);
+	ASSERT_STREQ("D41D8CD98F00B204E9800998ECF8427E", md5Batch(files)[0].c_str());
+	boost::filesystem::remove_all(directory);
+}
+
+TEST(MultiBufferMD5, MixedLengthsAcrossLanes)
+{
+	/// more files than the widest engine has lanes, so lanes finish at
+	/// different blocks and move on to new files while others are mid-file
+	std::vector<size_t> lengths;
+	for (size_t i = 0; i < 40; ++i)
+	{
+		lengths.push_back((i * 37) % 300);
+	}
+	lengths[3] = 200000;
+	lengths[17] = 65537;
+	auto directory = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+	auto files = writeFiles(directory, lengths);
+	files.insert(files.begin() + 5, "I_DO_NOT_EXIST.ttf");
+	expectEveryEngineMatches(files);
+	ASSERT_TRUE(md5Batch(files)[5].empty());
+	boost::filesystem::remove_all(directory);
+}
@@ -0,0 +1,94 @@
+/// Pipeline is header only
+#include "../FontSync/Pipeline.hpp"
+#include <gtest/gtest.h>
+
+#include <numeric>
+
+TEST(Pipeline, QueueOrderAndClose)
+{
+	BoundedQueue<int> queue(4);
+	ASSERT_TRUE(queue.push(1));
+	ASSERT_TRUE(queue.push(2));
+	queue.close();
+	ASSERT_FALSE(queue.push(3));
+	int item;
+	ASSERT_TRUE(queue.pop(item));
+	ASSERT_EQ(1, item);
+	ASSERT_TRUE(queue.pop(item));
+	ASSERT_EQ(2, item);
+	ASSERT_FALSE(queue.pop(item));
+}
+
+TEST(Pipeline, QueueIsBounded)
+{
+	BoundedQueue<int> queue(2);
+	std::atomic<int> pushed(0);
+	std::thread producer([&]()
+	{
+		for (int i = 0; i < 5; ++i)
+		{
+			queue.push(i);
+			++pushed;
+		}
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	ASSERT_EQ(2, pushed.load());
+	int item;
+	for (int i = 0; i < 5; ++i)
+	{
+		ASSERT_TRUE(queue.pop(item));
+		ASSERT_EQ(i, item);
+	}
+	producer.join();
+	ASSERT_EQ(5, pushed.load());
+}
+
+TEST(Pipeline, StagesPassItemsOn)
+{
+	BoundedQueue<int> first(2), second(2), last(64);
+	{
+		PipelineStage<int> square("square", 3, first, &second, [](int& item) { item *= item; return true; });
+		PipelineStage<int> odd("odd", 2, second, &last, [](int& item) { return item % 2 == 1; });
+		for (int i = 1; i <= 10; ++i)
+		{
+			first.push(i);
+		}
+		first.close();
+		odd.join();
+		ASSERT_NE(std::string::npos, square.report().find("square: 10 item(s), 3 worker(s)"));
+		ASSERT_GE(odd.utilization(), 0.0);
+		ASSERT_LE(odd.utilization(), 1.0);
+	}
+	std::vector<int> results;
+	int item;
+	while (last.pop(item))
+	{
+		results.push_back(item);
+	}
+	std::sort(results.begin(), results.end());
+	ASSERT_EQ(std::vector<int>({ 1, 9, 25, 49, 81 }), results);
+}
+
+TEST(Pipeline, ErrorsDropItems)
+{
+	BoundedQueue<int> input(4), output(4);
+	PipelineStage<int> stage("throws", 1, input, &output, [](int& item) -> bool
+	{
+		if (item == 2)
+		{
+			throw std::runtime_error("two");
+		}
+		return true;
+	});
+	input.push(1);
+	input.push(2);
+	input.push(3);
+	input.close();
+	stage.join();
+	int item;
+	ASSERT_TRUE(output.pop(item));
+	ASSERT_EQ(1, item);
+	ASSERT_TRUE(output.pop(item));
+	ASSERT_EQ(3, item);
+	ASSERT_FALSE(output.pop(item));
+}
@@ -5,5 +5,44 @@ TEST(RemoteFont, ComprehensiveTest)
 {
 	RemoteFont test("name", "category", "type", "remotefont.com/font.ttf", "0CBC6611F5540BD0809A388DC95A615B");
 	ASSERT_STREQ("remotefont.com/font.ttf", test.getRemoteFile().c_str());
-	ASSERT_STREQ("0CBC6611F5540BD0809A388DC95A615B", test.getMD5().c_str());
-}
\ No newline at end of file
+	ASSERT_STREQ("0CBC6611F5540BD0809A388DC95A615B", test.getHash().c_str());
+	ASSERT_EQ(HashAlgorithm::MD5, test.getHashAlgorithm());
+}
+
+TEST(RemoteFont, DownloadOrder)
+{
+	RemoteFont brand("brand", "category", "type", "brand.ttf", "", HashAlgorithm::MD5, 10, 500000);
+	RemoteFont small("small", "category", "type", "small.ttf", "", HashAlgorithm::MD5, 0, 1000);
+	RemoteFont large("large", "category", "type", "large.ttf", "", HashAlgorithm::MD5, 0, 20000000);
+	RemoteFont unknown("unknown", "category", "type", "unknown.ttf", "");
+	ASSERT_EQ(10, brand.getPriority());
+	ASSERT_EQ(1000u, small.getSize());
+	ASSERT_TRUE(downloadsBefore(brand, small));
+	ASSERT_TRUE(downloadsBefore(small, large));
+	ASSERT_TRUE(downloadsBefore(large, unknown));
+	ASSERT_FALSE(downloadsBefore(unknown, large));
+	ASSERT_FALSE(downloadsBefore(unknown, unknown));
+}
+
+TEST(RemoteFont, Patches)
+{
+	RemoteFont test("name", "category", "type", "font.ttf", "0CBC6611F5540BD0809A388DC95A615B");
+	ASSERT_EQ(nullptr, test.getPatchFrom("DA83EFC38A8922B4"));
+	FontPatch patch = { "da83efc38a8922b4", "font.ttf.da83efc38a8922b4.delta", 1234 };
+	test.setPatches(std::vector<FontPatch>(1, patch));
+	RemoteFont copy(test);
+	ASSERT_NE(nullptr, copy.getPatchFrom("DA83EFC38A8922B4"));
+	ASSERT_STREQ("font.ttf.da83efc38a8922b4.delta", copy.getPatchFrom("DA83EFC38A8922B4")->remoteFile.c_str());
+	ASSERT_EQ(nullptr, copy.getPatchFrom("0CBC6611F5540BD0809A388DC95A615B"));
+}
+
+TEST(RemoteFont, Chunks)
+{
+	RemoteFont test("name", "category", "type", "font.ttf", "0CBC6611F5540BD0809A388DC95A615B");
+	ASSERT_EQ(0u, test.getChunkSize());
+	ASSERT_TRUE(test.getChunks().empty());
+	test.setChunks(1024, std::vector<std::string>(3, "DA83EFC38A8922B4"));
+	RemoteFont moved(std::move(RemoteFont(test)));
+	ASSERT_EQ(1024u, moved.getChunkSize());
+	ASSERT_EQ(3u, moved.getChunks().size());
+}
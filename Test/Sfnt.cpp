@@ -0,0 +1,116 @@
+#include "../FontSync/Sfnt.cpp"
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <fstream>
+#include <iterator>
+
+namespace
+{
+	const char* validFont = "TestFonts/OpenDyslexic3-Regular.ttf";
+
+	std::vector<unsigned char> readFont(const std::string& file)
+	{
+		std::ifstream in(file, std::ios::binary);
+		return std::vector<unsigned char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+
+	/// the offset of a table, as listed by the table directory of a single font
+	uint32_t tableOffset(const std::vector<unsigned char>& font, const char* tag)
+	{
+		for (uint32_t i = 0; i < read16(font.data() + 4); ++i)
+		{
+			if (std::memcmp(font.data() + 12 + i * 16, tag, 4) == 0)
+			{
+				return read32(font.data() + 12 + i * 16 + 8);
+			}
+		}
+		return 0;
+	}
+}
+
+TEST(Sfnt, Checksum)
+{
+	/// every length, so every tail is exercised by both the vector and the scalar loops
+	unsigned char data[40];
+	for (size_t i = 0; i < sizeof(data); ++i)
+	{
+		data[i] = static_cast<unsigned char>(0xF0 + i * 37);
+	}
+	for (size_t size = 0; size <= sizeof(data); ++size)
+	{
+		uint32_t expected = 0;
+		for (size_t i = 0; i < size; ++i)
+		{
+			expected += static_cast<uint32_t>(data[i]) << (24 - 8 * (i % 4));
+		}
+		ASSERT_EQ(expected, sfntChecksum(data, size)) << size;
+	}
+}
+
+TEST(Sfnt, ValidFont)
+{
+	SfntInfo info = validateSfntFile(validFont);
+	ASSERT_STREQ("OpenDyslexic 3", info.family.c_str());
+	ASSERT_EQ(1u, info.fonts);
+	ASSERT_EQ(14u, info.tables);
+	ASSERT_TRUE(isSfntFile(validFont));
+	ASSERT_TRUE(isSfntFile("FONT.OTF"));
+	ASSERT_FALSE(isSfntFile("font.fon"));
+}
+
+TEST(Sfnt, InvalidFonts)
+{
+	ASSERT_THROW(validateSfntFile("InvalidTestFonts/corrupted_font.ttf"), std::runtime_error);
+	ASSERT_THROW(validateSfntFile("I_DO_NOT_EXIST.ttf"), std::runtime_error);
+
+	auto font = readFont(validFont);
+	ASSERT_NO_THROW(validateSfnt(font.data(), font.size()));
+
+	/// a single flipped bit in the outlines
+	auto flipped = font;
+	flipped[tableOffset(flipped, "glyf") + 100] ^= 0x08;
+	ASSERT_THROW(validateSfnt(flipped.data(), flipped.size()), std::runtime_error);
+
+	/// cut off part way through the last table
+	ASSERT_THROW(validateSfnt(font.data(), font.size() - 100), std::runtime_error);
+	ASSERT_THROW(validateSfnt(font.data(), 100), std::runtime_error);
+	ASSERT_THROW(validateSfnt(font.data(), 0), std::runtime_error);
+}
+
+TEST(Sfnt, Collection)
+{
+	/// a collection of the same font twice, sharing its tables
+	auto font = readFont(validFont);
+	std::vector<unsigned char> collection = { 't', 't', 'c', 'f', 0, 1, 0, 0, 0, 0, 0, 2, 0, 0, 0, 20, 0, 0, 0, 20 };
+	size_t shift = collection.size();
+	collection.insert(collection.end(), font.begin(), font.end());
+	/// table offsets are from the start of the collection
+	for (uint32_t i = 0; i < read16(font.data() + 4); ++i)
+	{
+		unsigned char* offset = collection.data() + shift + 12 + i * 16 + 8;
+		uint32_t moved = read32(offset) + static_cast<uint32_t>(shift);
+		offset[0] = static_cast<unsigned char>(moved >> 24);
+		offset[1] = static_cast<unsigned char>(moved >> 16);
+		offset[2] = static_cast<unsigned char>(moved >> 8);
+		offset[3] = static_cast<unsigned char>(moved);
+	}
+	SfntInfo info = validateSfnt(collection.data(), collection.size());
+	ASSERT_EQ(2u, info.fonts);
+	ASSERT_EQ(28u, info.tables);
+	ASSERT_STREQ("OpenDyslexic 3", info.family.c_str());
+}
+
+TEST(Sfnt, Speed)
+{
+	auto font = readFont(validFont);
+	const int rounds = 100;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < rounds; ++i)
+	{
+		validateSfnt(font.data(), font.size());
+	}
+	auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+	/// a couple of hundred kilobytes should take tens of microseconds; the bound leaves room for slow machines
+	ASSERT_LT(elapsed.count() / rounds, 2000);
+}
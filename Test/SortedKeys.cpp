@@ -0,0 +1,138 @@
+#include "../FontSync/SortedKeys.cpp"
+#include <gtest/gtest.h>
+
+#include <fstream>
+
+namespace
+{
+	/// a scratch file, removed along with any runs spilled next to it
+	struct ScratchFile
+	{
+		std::string path;
+
+		explicit ScratchFile(const std::string& name) : path((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path(name + "-%%%%%%%%")).string())
+		{
+
+		}
+
+		~ScratchFile()
+		{
+			boost::system::error_code ignored;
+			boost::filesystem::remove(this->path, ignored);
+		}
+	};
+
+	std::vector<std::string> readLines(const std::string& path)
+	{
+		std::ifstream in(path, std::ios::binary);
+		std::vector<std::string> rv;
+		for (std::string line; std::getline(in, line); )
+		{
+			rv.push_back(line);
+		}
+		return rv;
+	}
+
+	void writeLines(const std::string& path, const std::vector<std::string>& lines)
+	{
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		for (const auto& line : lines)
+		{
+			out << line << '\n';
+		}
+	}
+}
+
+TEST(SortedKeys, SortsInMemory)
+{
+	ScratchFile sorted("sorted");
+	KeySorter sorter(sorted.path + ".run", 1024 * 1024);
+	for (const char* key : { "c.ttf", "a.ttf", "b.ttf", "a.ttf" })
+	{
+		sorter.add(key);
+	}
+	ASSERT_EQ(3u, sorter.finish(sorted.path));
+	ASSERT_EQ(0u, sorter.spills());
+	std::vector<std::string> expected = { "a.ttf", "b.ttf", "c.ttf" };
+	ASSERT_EQ(expected, readLines(sorted.path));
+}
+
+TEST(SortedKeys, SpillsAndMerges)
+{
+	/// a budget this small spills every few keys, and needs more than one merge pass
+	ScratchFile sorted("sorted");
+	KeySorter sorter(sorted.path + ".run", 256);
+	std::vector<std::string> expected;
+	for (int i = 999; i >= 0; --i)
+	{
+		sorter.add("font" + std::to_string(i) + ".ttf");
+		if (i % 3 == 0)
+		{
+			sorter.add("font" + std::to_string(i) + ".ttf");
+		}
+		expected.push_back("font" + std::to_string(i) + ".ttf");
+	}
+	std::sort(expected.begin(), expected.end());
+	ASSERT_EQ(1000u, sorter.finish(sorted.path));
+	ASSERT_GT(sorter.spills(), 32u);
+	ASSERT_EQ(expected, readLines(sorted.path));
+	ASSERT_FALSE(boost::filesystem::exists(sorted.path + ".run.0"));
+}
+
+TEST(SortedKeys, RejectsLineBreaks)
+{
+	ScratchFile sorted("sorted");
+	KeySorter sorter(sorted.path + ".run", 1024);
+	ASSERT_THROW(sorter.add("a\nb"), std::invalid_argument);
+}
+
+TEST(SortedKeys, ForEachMissing)
+{
+	ScratchFile before("before"), after("after");
+	writeLines(before.path, { "a.ttf", "b.ttf", "d.ttf", "f.ttf" });
+	writeLines(after.path, { "b.ttf", "c.ttf", "d.ttf", "e.ttf" });
+	std::vector<std::string> missing;
+	forEachMissing(before.path, after.path, [&missing](const std::string& key) { missing.push_back(key); });
+	std::vector<std::string> expected = { "a.ttf", "f.ttf" };
+	ASSERT_EQ(expected, missing);
+
+	/// nothing was managed before
+	missing.clear();
+	ScratchFile absent("absent");
+	forEachMissing(absent.path, after.path, [&missing](const std::string& key) { missing.push_back(key); });
+	ASSERT_TRUE(missing.empty());
+
+	/// nothing is managed now
+	writeLines(after.path, {});
+	forEachMissing(before.path, after.path, [&missing](const std::string& key) { missing.push_back(key); });
+	ASSERT_EQ(4u, missing.size());
+}
+
+TEST(SortedKeys, FindsMissingAcrossSpills)
+{
+	/// both sides spill, as they do when more fonts are managed than the budget holds keys for
+	ScratchFile before("before"), after("after");
+	KeySorter previous(before.path + ".run", 256), current(after.path + ".run", 256);
+	std::vector<std::string> expected;
+	for (int i = 0; i < 500; ++i)
+	{
+		std::string key = "font" + std::to_string(i) + ".ttf";
+		previous.add(key);
+		if (i % 7 == 0)
+		{
+			expected.push_back(key);
+		}
+		else
+		{
+			current.add(key);
+		}
+	}
+	previous.finish(before.path);
+	current.finish(after.path);
+	ASSERT_GT(previous.spills(), 0u);
+	ASSERT_GT(current.spills(), 0u);
+	std::sort(expected.begin(), expected.end());
+	std::vector<std::string> missing;
+	forEachMissing(before.path, after.path, [&missing](const std::string& key) { missing.push_back(key); });
+	ASSERT_EQ(expected, missing);
+}
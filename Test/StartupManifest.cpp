@@ -0,0 +1,60 @@
+#include "../FontSync/StartupManifest.cpp"
+#include <gtest/gtest.h>
+
+#include <fstream>
+
+namespace
+{
+	const char* manifestFile = "startup_manifest_test.txt";
+}
+
+TEST(StartupManifest, RoundTrip)
+{
+	std::vector<LocalFont> fonts;
+	fonts.push_back(LocalFont("Brand Sans", "corporate", "ttf", "TestFonts\\brand.ttf", "0CBC6611F5540BD0809A388DC95A615B", HashAlgorithm::MD5));
+	fonts.push_back(LocalFont("Mono", "", "otf", "TestFonts\\mono.otf", "", HashAlgorithm::MD5));
+	writeStartupManifest(manifestFile, fonts);
+	auto read = readStartupManifest(manifestFile);
+	ASSERT_EQ(2u, read.size());
+	ASSERT_STREQ("Brand Sans", read[0].getName().c_str());
+	ASSERT_STREQ("corporate", read[0].getCategory().c_str());
+	ASSERT_STREQ("ttf", read[0].getType().c_str());
+	ASSERT_STREQ("TestFonts\\brand.ttf", read[0].getLocalFile().c_str());
+	ASSERT_STREQ("0CBC6611F5540BD0809A388DC95A615B", read[0].getHash().c_str());
+	ASSERT_EQ(HashAlgorithm::MD5, read[0].getHashAlgorithm());
+	ASSERT_STREQ("", read[1].getCategory().c_str());
+	ASSERT_STREQ("", read[1].getHash().c_str());
+	boost::filesystem::remove(manifestFile);
+}
+
+TEST(StartupManifest, Unrepresentable)
+{
+	std::vector<LocalFont> fonts;
+	fonts.push_back(LocalFont("Brand Sans", "corporate", "ttf", "TestFonts\\brand.ttf", "", HashAlgorithm::MD5));
+	writeStartupManifest(manifestFile, fonts);
+	fonts.push_back(LocalFont("Tab\tbed", "corporate", "ttf", "TestFonts\\tabbed.ttf", "", HashAlgorithm::MD5));
+	ASSERT_THROW(writeStartupManifest(manifestFile, fonts), std::runtime_error);
+	/// a stale manifest must not outlive a failed write
+	ASSERT_FALSE(boost::filesystem::exists(manifestFile));
+}
+
+TEST(StartupManifest, Malformed)
+{
+	ASSERT_THROW(readStartupManifest("I_DO_NOT_EXIST.txt"), std::runtime_error);
+	{
+		std::ofstream out(manifestFile);
+		out << "FontSync startup manifest 0\n";
+	}
+	ASSERT_THROW(readStartupManifest(manifestFile), std::runtime_error);
+	{
+		std::ofstream out(manifestFile);
+		out << "FontSync startup manifest 1\nname\tcategory\ttype\tmd5\n";
+	}
+	ASSERT_THROW(readStartupManifest(manifestFile), std::runtime_error);
+	{
+		std::ofstream out(manifestFile);
+		out << "FontSync startup manifest 1\nname\tcategory\ttype\tnope\thash\tfile\n";
+	}
+	ASSERT_THROW(readStartupManifest(manifestFile), std::runtime_error);
+	boost::filesystem::remove(manifestFile);
+}
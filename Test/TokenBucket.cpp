@@ -0,0 +1,98 @@
+#include "../FontSync/TokenBucket.cpp"
+#include <gtest/gtest.h>
+
+namespace
+{
+	/// a clock that only moves when told to
+	struct ManualClock
+	{
+		std::shared_ptr<std::chrono::steady_clock::time_point> now = std::make_shared<std::chrono::steady_clock::time_point>();
+
+		std::chrono::steady_clock::time_point operator()() const
+		{
+			return *now;
+		}
+
+		void advance(std::chrono::microseconds elapsed)
+		{
+			*now += elapsed;
+		}
+	};
+}
+
+TEST(TokenBucket, Burst)
+{
+	ManualClock clock;
+	TokenBucket bucket(1000, 4000, clock);
+	ASSERT_EQ(0, bucket.reserve(4000).count());
+	ASSERT_EQ(1000000, bucket.reserve(1000).count());
+}
+
+TEST(TokenBucket, SustainedRate)
+{
+	/// 64 KiB chunks at 256 KiB/s, however they are paced, average out to the limit
+	ManualClock clock;
+	TokenBucket bucket(256 * 1024, 64 * 1024, clock);
+	std::chrono::microseconds elapsed(0);
+	for (int i = 0; i < 64; ++i)
+	{
+		auto wait = bucket.reserve(64 * 1024);
+		clock.advance(wait);
+		elapsed += wait;
+	}
+	/// the first chunk came out of the burst; the other 63 were paced
+	ASSERT_NEAR(63 * 250000, elapsed.count(), 64);
+}
+
+TEST(TokenBucket, IdleRefillIsCapped)
+{
+	ManualClock clock;
+	TokenBucket bucket(1000, 2000, clock);
+	ASSERT_EQ(0, bucket.reserve(2000).count());
+	clock.advance(std::chrono::microseconds(3600000000LL));
+	ASSERT_EQ(0, bucket.reserve(2000).count());
+	ASSERT_EQ(500000, bucket.reserve(500).count());
+}
+
+TEST(TokenBucket, SharedBetweenDownloads)
+{
+	/// reservations queue behind one another, so two downloads sharing a
+	/// bucket each get half of the limit
+	ManualClock clock;
+	TokenBucket bucket(1000, 0, clock);
+	ASSERT_EQ(1000000, bucket.reserve(1000).count());
+	ASSERT_EQ(2000000, bucket.reserve(1000).count());
+	clock.advance(std::chrono::microseconds(2000000));
+	ASSERT_EQ(1000000, bucket.reserve(1000).count());
+}
+
+TEST(TokenBucket, Unlimited)
+{
+	ManualClock clock;
+	TokenBucket bucket(0, 0, clock);
+	ASSERT_EQ(0, bucket.reserve(1ULL << 40).count());
+	bucket.reconfigure(1000, 1000);
+	ASSERT_EQ(1000, bucket.getRate());
+	ASSERT_EQ(0, bucket.reserve(1000).count());
+	ASSERT_EQ(1000000, bucket.reserve(1000).count());
+}
+
+TEST(BandwidthSchedule, Windows)
+{
+	BandwidthSchedule schedule("08:00-18:00=256, 22:00-06:00=0");
+	ASSERT_EQ(256 * 1024u, schedule.rateAt(8 * 60, 64));
+	ASSERT_EQ(256 * 1024u, schedule.rateAt(18 * 60 - 1, 64));
+	ASSERT_EQ(64u, schedule.rateAt(18 * 60, 64));
+	ASSERT_EQ(0u, schedule.rateAt(23 * 60, 64));
+	ASSERT_EQ(0u, schedule.rateAt(5 * 60 + 59, 64));
+	ASSERT_EQ(64u, schedule.rateAt(7 * 60, 64));
+	ASSERT_EQ(64u, BandwidthSchedule().rateAt(12 * 60, 64));
+}
+
+TEST(BandwidthSchedule, Malformed)
+{
+	ASSERT_THROW(BandwidthSchedule("08:00-18:00"), std::invalid_argument);
+	ASSERT_THROW(BandwidthSchedule("8-18=256"), std::invalid_argument);
+	ASSERT_THROW(BandwidthSchedule("08:00-25:00=256"), std::invalid_argument);
+	ASSERT_THROW(BandwidthSchedule("08:00-18:00=fast"), std::invalid_argument);
+}
@@ -0,0 +1,477 @@
+#include "../FontSync/UpdateReceiver.cpp"
+#include <gtest/gtest.h>
+#include "FaultServer.hpp"
+
+#include <atomic>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+	/// an application data directory of its own, so reading an index leaves the service's state alone
+	struct AppDataSandbox
+	{
+		boost::filesystem::path root;
+
+		AppDataSandbox() : root(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("fontsync-%%%%%%%%"))
+		{
+			boost::filesystem::create_directories(this->root / "FontSync");
+			setAppDataDirectory(this->root.string());
+		}
+
+		~AppDataSandbox()
+		{
+			setAppDataDirectory("");
+			boost::system::error_code ignored;
+			boost::filesystem::remove_all(this->root, ignored);
+		}
+	};
+
+	/// how long reading the index takes to fail
+	std::chrono::milliseconds timeToFail(UpdateReceiver& receiver)
+	{
+		auto start = std::chrono::steady_clock::now();
+		EXPECT_THROW(receiver.getRemoteFontIndex(), boost::system::system_error);
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	}
+}
+
+TEST(UpdateReceiver, HeaderTimeout)
+{
+	AppDataSandbox appData;
+	/// reads the request, never answers
+	FaultServer server;
+	server.serve("/update.json", "[]");
+	Faults stall;
+	stall.stallHeaders = true;
+	server.always(stall);
+	UpdateReceiver receiver("127.0.0.1", server.port(), "update.json");
+	receiver.setTimeouts(1000, 300, 5000, 10000);
+	auto elapsed = timeToFail(receiver);
+	ASSERT_GE(elapsed.count(), 250);
+	ASSERT_LT(elapsed.count(), 2000);
+}
+
+TEST(UpdateReceiver, BodyTimeout)
+{
+	AppDataSandbox appData;
+	/// stops sending halfway through the body
+	FaultServer server;
+	server.serve("/update.json", "[{\"name\": \"Half\"}]");
+	Faults stall;
+	stall.stallAfter = 14;
+	server.always(stall);
+	UpdateReceiver receiver("127.0.0.1", server.port(), "update.json");
+	receiver.setTimeouts(1000, 5000, 300, 10000);
+	auto elapsed = timeToFail(receiver);
+	ASSERT_GE(elapsed.count(), 250);
+	ASSERT_LT(elapsed.count(), 2000);
+}
+
+TEST(UpdateReceiver, TotalTimeout)
+{
+	AppDataSandbox appData;
+	/// keeps the body trickling in, a couple of bytes at a time, so only the overall budget runs out
+	FaultServer server;
+	server.serve("/update.json", std::string(1000, ' '));
+	Faults trickle;
+	trickle.bandwidth = 50;
+	server.always(trickle);
+	UpdateReceiver receiver("127.0.0.1", server.port(), "update.json");
+	receiver.setTimeouts(1000, 5000, 300, 600);
+	auto elapsed = timeToFail(receiver);
+	ASSERT_GE(elapsed.count(), 550);
+	ASSERT_LT(elapsed.count(), 2000);
+}
+
+TEST(UpdateReceiver, Cancellation)
+{
+	AppDataSandbox appData;
+	/// answers, then sends nothing of the body
+	FaultServer server;
+	server.serve("/update.json", "[]");
+	Faults stall;
+	stall.stallAfter = 0;
+	server.always(stall);
+	UpdateReceiver receiver("127.0.0.1", server.port(), "update.json");
+	receiver.setTimeouts(1000, 5000, 60000, 120000);
+	std::atomic<bool> stop(false);
+	receiver.setCancellation([&stop]() { return stop.load(); });
+	std::thread stopper([&stop]()
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(300));
+		stop = true;
+	});
+	auto elapsed = timeToFail(receiver);
+	stopper.join();
+	ASSERT_LT(elapsed.count(), 1500);
+}
+
+TEST(UpdateReceiver, ErrorResponse)
+{
+	AppDataSandbox appData;
+	/// serves nothing, so the index is not found
+	FaultServer server;
+	UpdateReceiver receiver("127.0.0.1", server.port(), "update.json");
+	ASSERT_THROW(receiver.getRemoteFontIndex(), std::runtime_error);
+}
+
+TEST(UpdateReceiver, SizeLimit)
+{
+	AppDataSandbox appData;
+	/// rejected from Content-Length alone, before any of the body is read
+	FaultServer announced;
+	announced.serve("/update.json", "[");
+	Faults large;
+	large.lengthError = 1048575;
+	large.stallAfter = 1;
+	announced.always(large);
+	UpdateReceiver receiver("127.0.0.1", announced.port(), "update.json");
+	receiver.setSizeLimit(1024);
+	ASSERT_THROW(receiver.getRemoteFontIndex(), std::runtime_error);
+
+	/// without Content-Length, rejected once the body outgrows the limit, though the connection stays open
+	FaultServer unannounced;
+	unannounced.serve("/update.json", std::string(4096, ' '));
+	Faults unknown;
+	unknown.announceLength = false;
+	unknown.stallAfter = 4096;
+	unannounced.always(unknown);
+	receiver.reconfigure("127.0.0.1", unannounced.port(), "update.json");
+	receiver.setTimeouts(1000, 5000, 5000, 10000);
+	ASSERT_THROW(receiver.getRemoteFontIndex(), std::runtime_error);
+}
+
+TEST(UpdateReceiver, TruncatedBody)
+{
+	AppDataSandbox appData;
+	/// the connection closes before Content-Length bytes have arrived
+	FaultServer server;
+	server.serve("/update.json", "[]");
+	Faults shortened;
+	shortened.lengthError = 98;
+	server.always(shortened);
+	UpdateReceiver receiver("127.0.0.1", server.port(), "update.json");
+	ASSERT_THROW(receiver.getRemoteFontIndex(), std::runtime_error);
+}
+
+namespace
+{
+	/// an index listing the provided number of fonts
+	std::string makeIndex(unsigned int fonts)
+	{
+		std::string json = "[";
+		for (unsigned int i = 0; i < fonts; ++i)
+		{
+			json += std::string(i > 0 ? ",\n" : "\n") + "{\"name\": \"Font " + std::to_string(i) + "\", \"category\": \"Test\", \"type\": \"Regular\", " +
+				"\"remote_file\": \"http://127.0.0.1/fonts/font" + std::to_string(i) + ".ttf\", \"md5\": \"0CBC6611F5540BD0809A388DC95A615B\"}";
+		}
+		return json + "\n]";
+	}
+
+	/// how long reading the index takes to succeed
+	std::chrono::milliseconds timeToRead(UpdateReceiver& receiver, size_t expected)
+	{
+		auto start = std::chrono::steady_clock::now();
+		EXPECT_EQ(expected, receiver.getRemoteFontIndex().size());
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	}
+}
+
+TEST(UpdateReceiver, FaultLatency)
+{
+	AppDataSandbox appData;
+	FaultServer server;
+	server.serve("/update.json", makeIndex(10));
+	Faults slow;
+	slow.latency = std::chrono::milliseconds(300);
+	server.always(slow);
+	UpdateReceiver receiver("127.0.0.1", server.port(), "update.json");
+	receiver.setTimeouts(1000, 1000, 1000, 5000);
+	auto elapsed = timeToRead(receiver, 10);
+	ASSERT_GE(elapsed.count(), 250);
+	ASSERT_LT(elapsed.count(), 1000);
+
+	/// the same delay outlasts a shorter header timeout
+	receiver.setTimeouts(1000, 100, 1000, 5000);
+	elapsed = timeToFail(receiver);
+	ASSERT_GE(elapsed.count(), 80);
+	ASSERT_LT(elapsed.count(), 300);
+}
+
+TEST(UpdateReceiver, FaultBandwidth)
+{
+	AppDataSandbox appData;
+	/// about 20kB at 40kB/s; the body timeout applies between reads, so it never runs out
+	FaultServer server;
+	std::string index = makeIndex(120);
+	server.serve("/update.json", index);
+	Faults capped;
+	capped.bandwidth = 40 * 1024;
+	server.always(capped);
+	UpdateReceiver receiver("127.0.0.1", server.port(), "update.json");
+	receiver.setTimeouts(1000, 1000, 300, 5000);
+	auto elapsed = timeToRead(receiver, 120);
+	auto expected = static_cast<long long>(index.size() * 1000 / capped.bandwidth);
+	ASSERT_GE(elapsed.count(), expected * 8 / 10);
+	ASSERT_LT(elapsed.count(), expected * 2 + 500);
+	ASSERT_EQ(index.size(), receiver.lastTransfer().bytes);
+}
+
+TEST(UpdateReceiver, FaultReset)
+{
+	AppDataSandbox appData;
+	/// a reset fails the read at once, long before the body timeout
+	FaultServer server;
+	server.serve("/update.json", makeIndex(100));
+	Faults reset;
+	reset.resetAfter = 1000;
+	server.always(reset);
+	UpdateReceiver receiver("127.0.0.1", server.port(), "update.json");
+	receiver.setTimeouts(1000, 1000, 5000, 10000);
+	auto start = std::chrono::steady_clock::now();
+	ASSERT_ANY_THROW(receiver.getRemoteFontIndex());
+	ASSERT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(), 1000);
+}
+
+TEST(UpdateReceiver, FaultContentLength)
+{
+	AppDataSandbox appData;
+	FaultServer server;
+	server.serve("/update.json", makeIndex(10));
+	UpdateReceiver receiver("127.0.0.1", server.port(), "update.json");
+	receiver.setTimeouts(1000, 1000, 5000, 10000);
+
+	/// announces more than it sends, then hangs up
+	Faults longer;
+	longer.lengthError = 100;
+	server.then(longer);
+	auto start = std::chrono::steady_clock::now();
+	ASSERT_THROW(receiver.getRemoteFontIndex(), std::runtime_error);
+	ASSERT_LT(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(), 1000);
+
+	/// announces less than it sends, cutting the index short
+	Faults shorter;
+	shorter.lengthError = -10;
+	server.then(shorter);
+	ASSERT_THROW(receiver.getRemoteFontIndex(), std::runtime_error);
+
+	/// and then the index is served as it is
+	timeToRead(receiver, 10);
+}
+
+TEST(UpdateReceiver, FaultCorruption)
+{
+	AppDataSandbox appData;
+	FaultServer server;
+	server.serve("/update.json", makeIndex(10));
+	Faults corrupt;
+	corrupt.corrupt.push_back(0);
+	server.then(corrupt);
+	UpdateReceiver receiver("127.0.0.1", server.port(), "update.json");
+	ASSERT_THROW(receiver.getRemoteFontIndex(), std::runtime_error);
+}
+
+TEST(UpdateReceiver, FaultFailover)
+{
+	AppDataSandbox appData;
+	FaultServer primary, secondary;
+	primary.serve("/update.json", makeIndex(10));
+	secondary.serve("/update.json", makeIndex(10));
+	std::vector<Mirror> mirrors(2);
+	mirrors[0].host = mirrors[1].host = "127.0.0.1";
+	mirrors[0].port = primary.port();
+	mirrors[1].port = secondary.port();
+	auto mirrorSet = std::make_shared<MirrorSet>(mirrors);
+	UpdateReceiver receiver("127.0.0.1", primary.port(), "update.json");
+	receiver.setMirrors(mirrorSet);
+	receiver.setTimeouts(1000, 300, 1000, 5000);
+
+	/// an error from the primary is served by the secondary without delay
+	Faults unavailable;
+	unavailable.status = 503;
+	primary.then(unavailable);
+	auto elapsed = timeToRead(receiver, 10);
+	ASSERT_LT(elapsed.count(), 300);
+	ASSERT_EQ(1u, primary.requests().size());
+	ASSERT_EQ(1u, secondary.requests().size());
+
+	/// the primary is cooling down, so the secondary goes first until it stalls
+	Faults stalled;
+	stalled.stallHeaders = true;
+	secondary.then(stalled);
+	elapsed = timeToRead(receiver, 10);
+	ASSERT_GE(elapsed.count(), 250);
+	ASSERT_LT(elapsed.count(), 1000);
+	ASSERT_EQ(2u, primary.requests().size());
+}
+
+TEST(UpdateReceiver, FaultMissing)
+{
+	AppDataSandbox appData;
+	/// a mirror without the index fails over, but is not cooled down for it
+	FaultServer primary, secondary;
+	secondary.serve("/update.json", makeIndex(10));
+	std::vector<Mirror> mirrors(2);
+	mirrors[0].host = mirrors[1].host = "127.0.0.1";
+	mirrors[0].port = primary.port();
+	mirrors[1].port = secondary.port();
+	auto mirrorSet = std::make_shared<MirrorSet>(mirrors);
+	UpdateReceiver receiver("127.0.0.1", primary.port(), "update.json");
+	receiver.setMirrors(mirrorSet);
+	timeToRead(receiver, 10);
+	ASSERT_EQ(1u, primary.requests().size());
+	ASSERT_EQ(1u, secondary.requests().size());
+	ASSERT_TRUE(mirrors[0] == mirrorSet->ranked()[0]);
+
+	/// unlike a server error
+	Faults unavailable;
+	unavailable.status = 503;
+	primary.then(unavailable);
+	timeToRead(receiver, 10);
+	ASSERT_TRUE(mirrors[1] == mirrorSet->ranked()[0]);
+}
+
+namespace
+{
+	/// a page of an index, listing the provided number of fonts and leading to the provided page
+	std::string makePage(unsigned int fonts, const std::string& next)
+	{
+		return "{\"fonts\": " + makeIndex(fonts) + (next.empty() ? "" : ", \"next\": \"" + next + "\"") + "}";
+	}
+
+	/// the faults of a body sent with the chunked transfer encoding
+	Faults chunkedEncoding()
+	{
+		Faults chunked;
+		chunked.headers = "Transfer-Encoding: chunked\r\n";
+		chunked.announceLength = false;
+		return chunked;
+	}
+
+	/// encodes a body in chunks of the provided size, the first with an extension
+	std::string chunk(const std::string& body, size_t size)
+	{
+		std::string rv;
+		for (size_t offset = 0; offset < body.size(); offset += size)
+		{
+			size_t count = (std::min)(size, body.size() - offset);
+			std::ostringstream length;
+			length << std::hex << count;
+			rv += length.str() + (offset == 0 ? ";name=value" : "") + "\r\n" + body.substr(offset, count) + "\r\n";
+		}
+		return rv + "0\r\n\r\n";
+	}
+}
+
+TEST(UpdateReceiver, ChunkedBody)
+{
+	AppDataSandbox appData;
+	std::string index = makeIndex(50);
+	FaultServer server;
+	server.serve("/update.json", chunk(index, 1000));
+	server.always(chunkedEncoding());
+	UpdateReceiver receiver("127.0.0.1", server.port(), "update.json");
+	ASSERT_EQ(50u, receiver.getRemoteFontIndex().size());
+	ASSERT_EQ(index.size(), receiver.lastTransfer().bytes);
+}
+
+TEST(UpdateReceiver, ChunkedBodyMalformed)
+{
+	AppDataSandbox appData;
+	/// the connection closes before the last chunk
+	std::string chunked = chunk(makeIndex(10), 100);
+	FaultServer server;
+	server.serve("/update.json", chunked.substr(0, chunked.size() - 200));
+	server.always(chunkedEncoding());
+	UpdateReceiver receiver("127.0.0.1", server.port(), "update.json");
+	ASSERT_THROW(receiver.getRemoteFontIndex(), std::runtime_error);
+
+	/// a chunk length that is not hex
+	server.serve("/update.json", "zz\r\n[]\r\n0\r\n\r\n");
+	ASSERT_THROW(receiver.getRemoteFontIndex(), std::runtime_error);
+}
+
+TEST(UpdateReceiver, UnknownLengthBody)
+{
+	AppDataSandbox appData;
+	/// read until the connection closes, growing geometrically rather than once per read
+	std::string index = makeIndex(2000);
+	FaultServer server;
+	server.serve("/update.json", index);
+	Faults unknown;
+	unknown.announceLength = false;
+	server.always(unknown);
+	UpdateReceiver receiver("127.0.0.1", server.port(), "update.json");
+	receiver.setSizeLimit(0);
+	ASSERT_EQ(2000u, receiver.getRemoteFontIndex().size());
+	ASSERT_EQ(index.size(), receiver.lastTransfer().bytes);
+	ASSERT_LE(receiver.lastTransfer().allocations, 4u);
+}
+
+TEST(UpdateReceiver, Pagination)
+{
+	AppDataSandbox appData;
+	FaultServer server;
+	server.serve("/update.json", makePage(3, "/page2.json"));
+	server.serve("/page2.json", makePage(4, "page3.json"));
+	server.serve("/page3.json", makePage(5, ""));
+	UpdateReceiver receiver("127.0.0.1", server.port(), "update.json");
+	receiver.setPageSize(3);
+	receiver.beginIndex();
+	std::vector<RemoteFont> page;
+	std::vector<size_t> sizes;
+	while (receiver.nextIndexPage(page))
+	{
+		sizes.push_back(page.size());
+	}
+	ASSERT_EQ(3u, sizes.size());
+	ASSERT_EQ(3u, sizes[0]);
+	ASSERT_EQ(4u, sizes[1]);
+	ASSERT_EQ(5u, sizes[2]);
+	auto requests = server.requests();
+	ASSERT_EQ(3u, requests.size());
+	ASSERT_EQ("GET /update.json?page_size=3", requests[0]);
+	ASSERT_EQ("GET /page2.json", requests[1]);
+	ASSERT_EQ("GET /page3.json", requests[2]);
+
+	/// reading it again starts over
+	ASSERT_EQ(12u, receiver.getRemoteFontIndex().size());
+}
+
+TEST(UpdateReceiver, PaginationCycle)
+{
+	AppDataSandbox appData;
+	/// the third page leads back to the second, which would never end
+	FaultServer server;
+	server.serve("/update.json", makePage(1, "/page2.json"));
+	server.serve("/page2.json", makePage(1, "/page3.json"));
+	server.serve("/page3.json", makePage(1, "/page2.json"));
+	UpdateReceiver receiver("127.0.0.1", server.port(), "update.json");
+	ASSERT_THROW(receiver.getRemoteFontIndex(), std::runtime_error);
+	ASSERT_EQ(3u, server.requests().size());
+
+	/// as does a page leading to itself
+	server.serve("/page3.json", makePage(1, "/page3.json"));
+	ASSERT_THROW(receiver.getRemoteFontIndex(), std::runtime_error);
+}
+
+TEST(UpdateReceiver, ChunkSizeLimit)
+{
+	AppDataSandbox appData;
+	FaultServer server;
+	auto font = [](const std::string& name, uint64_t chunkSize)
+	{
+		return "{\"name\": \"" + name + "\", \"category\": \"Test\", \"type\": \"Regular\", \"remote_file\": \"http://127.0.0.1/fonts/" + name + ".ttf\", " +
+			"\"md5\": \"0CBC6611F5540BD0809A388DC95A615B\", \"size\": 16, \"chunk_size\": " + std::to_string(chunkSize) + ", \"chunks\": [\"0CBC6611F5540BD0809A388DC95A615B\"]}";
+	};
+	server.serve("/update.json", "[" + font("sane", 16) + ", " + font("huge", maxChunkSize + 1) + "]");
+	UpdateReceiver receiver("127.0.0.1", server.port(), "update.json");
+	auto fonts = receiver.getRemoteFontIndex();
+	ASSERT_EQ(2u, fonts.size());
+	ASSERT_EQ(16u, fonts[0].getChunkSize());
+	ASSERT_EQ(1u, fonts[0].getChunks().size());
+	/// a chunk list that would have every fetch worker hold a huge chunk is ignored, and the font downloaded whole
+	ASSERT_EQ(0u, fonts[1].getChunkSize());
+	ASSERT_TRUE(fonts[1].getChunks().empty());
+}
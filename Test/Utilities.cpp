@@ -2,6 +2,108 @@
 #include "../FontSync/Utilities.hpp"
 #include <gtest/gtest.h>
 
+#include "../FontSync/TokenBucket.hpp"
+#include "FaultServer.hpp"
+
+#include <fstream>
+#include <iterator>
+
+#include <boost/filesystem.hpp>
+
+namespace
+{
+	/// the CRC-32 a gzip member ends with
+	uint32_t crc32(const std::string& data)
+	{
+		uint32_t crc = 0xFFFFFFFF;
+		for (unsigned char byte : data)
+		{
+			crc ^= byte;
+			for (int bit = 0; bit < 8; ++bit)
+			{
+				crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+			}
+		}
+		return ~crc;
+	}
+
+	/// wraps a deflate stream in a gzip member of the provided data
+	std::string gzipMember(const std::string& deflated, const std::string& data)
+	{
+		std::string rv("\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\xff", 10);
+		rv += deflated;
+		for (uint32_t value : { crc32(data), static_cast<uint32_t>(data.size()) })
+		{
+			for (int shift = 0; shift < 32; shift += 8)
+			{
+				rv += static_cast<char>((value >> shift) & 0xFF);
+			}
+		}
+		return rv;
+	}
+
+	/// gzips the provided data in stored blocks, which take a little more than the data itself
+	std::string gzipStored(const std::string& data)
+	{
+		std::string deflated;
+		std::size_t offset = 0;
+		do
+		{
+			std::size_t length = (std::min)(data.size() - offset, static_cast<std::size_t>(0xFFFF));
+			deflated += static_cast<char>(offset + length == data.size() ? 1 : 0);
+			for (std::size_t field : { length, length ^ 0xFFFF })
+			{
+				deflated += static_cast<char>(field & 0xFF);
+				deflated += static_cast<char>((field >> 8) & 0xFF);
+			}
+			deflated.append(data, offset, length);
+			offset += length;
+		} while (offset < data.size());
+		return gzipMember(deflated, data);
+	}
+
+	/// gzips a run of one byte, 1 + 258 * matches long, as a literal followed by matches of the longest length
+	/// at distance 1, which deflate's fixed codes take 13 bits each for
+	std::string gzipRun(char byte, std::size_t matches)
+	{
+		std::string deflated;
+		uint32_t bits = 0;
+		int count = 0;
+		/// fixed codes are packed most significant bit first, into a stream filled least significant bit first
+		auto put = [&](uint32_t code, int length)
+		{
+			for (int bit = length - 1; bit >= 0; --bit)
+			{
+				bits |= ((code >> bit) & 1) << count;
+				if (++count == 8)
+				{
+					deflated += static_cast<char>(bits);
+					bits = 0;
+					count = 0;
+				}
+			}
+		};
+		/// a final block of fixed codes; the header fields are packed least significant bit first
+		put(1, 1);
+		put(1, 1);
+		put(0, 1);
+		put(0x30 + static_cast<unsigned char>(byte), 8);
+		for (std::size_t i = 0; i < matches; ++i)
+		{
+			/// length code 285 (258 bytes), then distance code 0 (1 byte back)
+			put(0xC5, 8);
+			put(0, 5);
+		}
+		/// end of block
+		put(0, 7);
+		if (count > 0)
+		{
+			deflated += static_cast<char>(bits);
+		}
+		return gzipMember(deflated, std::string(1 + 258 * matches, byte));
+	}
+}
+
 TEST(Utilities, errorString)
 {
 	ASSERT_NO_THROW(errorString(0));
@@ -14,4 +116,104 @@ TEST(Utilities, md5)
 	ASSERT_STREQ(known_md5.c_str(), md5("md5_me.ttf").c_str());
 
 	ASSERT_THROW(md5("I_DO_NOT_EXIST.ttf"), std::runtime_error);
-}
\ No newline at end of file
+}
+TEST(Utilities, replaceFile)
+{
+	const std::string file = "replace_me.txt", temp = "replace_me.txt.tmp";
+	{
+		std::ofstream(file.c_str()) << "old";
+		std::ofstream(temp.c_str()) << "new";
+	}
+	ASSERT_NO_THROW(replaceFile(temp, file));
+	ASSERT_FALSE(boost::filesystem::exists(temp));
+	std::string contents;
+	std::ifstream(file.c_str()) >> contents;
+	ASSERT_EQ("new", contents);
+
+	/// a temporary file that cannot be swapped in is cleaned up
+	std::ofstream(temp.c_str()) << "orphan";
+	ASSERT_THROW(replaceFile(temp, "I_DO_NOT_EXIST/replace_me.txt"), std::runtime_error);
+	ASSERT_FALSE(boost::filesystem::exists(temp));
+	boost::filesystem::remove(file);
+}
+
+namespace
+{
+	/// fetches a gzipped body, checking it is staged decoded and counted at its size on the wire
+	void fetchGzipped(const std::string& body, const std::string& encoded)
+	{
+		FaultServer server;
+		server.serve("/font.ttf", encoded);
+		Faults gzip;
+		gzip.headers = "Content-Encoding: gzip\r\n";
+		server.always(gzip);
+		const std::string staging = "fetch_gzip.ttf.part";
+		setCompressedDownloads(true);
+		DownloadTotals before = downloadTotals();
+		std::string digest;
+		ASSERT_NO_THROW(digest = fetch(staging, server.url("/font.ttf"), HashAlgorithm::MD5));
+		DownloadTotals after = downloadTotals();
+		std::ifstream in(staging.c_str(), std::ios::binary);
+		std::string staged((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+		in.close();
+		ASSERT_TRUE(staged == body);
+		ASSERT_EQ(md5(staging), digest);
+		ASSERT_EQ(1u, after.downloads - before.downloads);
+		ASSERT_EQ(body.size(), after.decodedBytes - before.decodedBytes);
+		ASSERT_EQ(encoded.size(), after.wireBytes - before.wireBytes);
+		boost::filesystem::remove(staging);
+	}
+}
+
+TEST(Utilities, fetchGzip)
+{
+	fetchGzipped(std::string(1 + 258 * 1000, 'A'), gzipRun('A', 1000));
+}
+
+TEST(Utilities, fetchGzipLargerThanDecoded)
+{
+	/// stored blocks take more on the wire than decoded, which the totals count as they are
+	std::string body(200000, 'x');
+	fetchGzipped(body, gzipStored(body));
+}
+
+TEST(Utilities, fetchRangeCountsOnce)
+{
+	FaultServer server;
+	server.serve("/font.ttf", std::string(4096, 'r'));
+	DownloadTotals before = downloadTotals();
+	std::size_t received = 0;
+	auto sink = [&received](const unsigned char*, std::size_t size) { received += size; };
+	ASSERT_TRUE(fetchRange(server.url("/font.ttf"), 0, 1024, sink));
+	ASSERT_TRUE(fetchRange(server.url("/font.ttf"), 1024, 3072, sink));
+	ASSERT_EQ(4096u, received);
+	ASSERT_EQ(0u, downloadTotals().downloads - before.downloads);
+	/// the font the ranges were assembled into is counted once
+	countDownload();
+	DownloadTotals after = downloadTotals();
+	ASSERT_EQ(1u, after.downloads - before.downloads);
+	ASSERT_EQ(4096u, after.decodedBytes - before.decodedBytes);
+	ASSERT_EQ(4096u, after.wireBytes - before.wireBytes);
+}
+
+TEST(Utilities, fetchBandwidthLimit)
+{
+	/// the server sends as fast as it can; bandwidth_limit shapes the download on this side
+	FaultServer server;
+	std::string body(160 * 1024, 'b');
+	server.serve("/font.ttf", body);
+	Config::Settings settings;
+	settings.bandwidth_limit = 64;
+	settings.bandwidth_burst = 32;
+	configureDownloadBandwidth(settings);
+	const std::string staging = "fetch_limited.ttf.part";
+	auto start = std::chrono::steady_clock::now();
+	ASSERT_NO_THROW(fetch(staging, server.url("/font.ttf"), HashAlgorithm::MD5));
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	configureDownloadBandwidth(Config::Settings());
+	boost::filesystem::remove(staging);
+	/// all but the burst waits on the limit
+	auto expected = static_cast<long long>((body.size() - settings.bandwidth_burst * 1024) * 1000 / (settings.bandwidth_limit * 1024));
+	ASSERT_GE(elapsed, expected * 8 / 10);
+	ASSERT_LT(elapsed, expected * 2 + 1000);
+}